@@ -0,0 +1,168 @@
+; K-1002 4-bit DPCM Playback Example
+; Plays DPCM data at 1MHz / PCM_CYCLES Hz with 1MHz system clock
+;
+; (C) 2025 Eduardo Casino
+;
+; Each byte holds two samples as 4-bit codes, high nibble first, so a clip
+; takes half the memory it takes with pcmplay. A code selects a delta from
+; a fixed table that is added to the previous sample. The table is expanded
+; at start up into one table per nibble, indexed by the whole byte, so
+; decoding is a single indexed ADC per sample.
+;
+; Assemble with -D PCM_CYCLES=n to select the sample period in CPU cycles.
+; The makefile builds the player for the same rates as pcmplay.
+;
+; The sample data is read from wav/dpcm_<PCM_CYCLES>.inc, which pcmconv -d
+; generates already resampled to the exact rate and padded to whole pages.
+;
+
+            .include "delay.inc"
+
+            .ifndef PCM_CYCLES
+PCM_CYCLES  = 125
+            .endif
+
+            .if PCM_CYCLES < 43 .or PCM_CYCLES = 44
+            .error  "PCM_CYCLES must be 43 or 45 and above"
+            .endif
+
+DAC         = $1700                 ; DAC output port
+DACDIR      = $1701                 ; DAC direction register
+KIMMON      = $1C22                 ; Entry point to KIM keyboard monitor
+
+            .include .sprintf("wav/dpcm_%d.inc", PCM_CYCLES)
+
+            .assert <PCM_TABLE = 0, error, "PCM data must be page aligned"
+            .assert <TABLE_SIZE = 0, error, "PCM data must be a whole number of pages"
+
+            .zeropage
+
+; Zero page temporary variables
+;
+PCMPTR:     .res    2               ; Pointer to current page of samples
+PAGES:      .res    1               ; Page counter
+SAMPLE:     .res    1               ; Last sample output
+BYTE:       .res    1               ; Current DPCM byte
+
+            .segment "TABLES"
+
+; Decoding tables, page aligned so that indexing never crosses a page
+;
+DHI:        .res    256             ; Delta for the high nibble of each byte
+DLO:        .res    256             ; Delta for the low nibble of each byte
+
+            .data
+
+PCMTBL:     .word   PCM_TABLE       ; Pointer to DPCM data
+TBLSIZ:     .word   TABLE_SIZE      ; Size of data in bytes
+
+; Delta for each code. Must match DPCM_DELTAS in pcmconv
+;
+DELTAS:     .byte   <-34, <-21, <-13, <-8, <-5, <-3, <-2, <-1
+            .byte   0, 1, 2, 3, 5, 8, 13, 21
+
+            .code
+
+            ; Initialize DAC port as output
+            ;
+            lda     #$FF
+            sta     DACDIR
+
+            cld
+
+            ; Expand the delta table
+            ;
+            ldx     #0
+tbl_loop:   txa
+            lsr
+            lsr
+            lsr
+            lsr
+            tay
+            lda     DELTAS,Y
+            sta     DHI,X
+            txa
+            and     #$0F
+            tay
+            lda     DELTAS,Y
+            sta     DLO,X
+            inx
+            bne     tbl_loop
+
+            ; The encoder starts from mid scale
+            ;
+            lda     #$80
+            sta     SAMPLE
+
+            ; Load table pointer into zero page. The low byte is always
+            ; zero, the byte index within the page is kept in Y
+            ;
+            lda     PCMTBL
+            sta     PCMPTR
+            lda     PCMTBL+1
+            sta     PCMPTR+1
+
+            ; Load table size in pages into counter
+            ;
+            lda     TBLSIZ+1
+            sta     PAGES
+
+            ; Check if table is empty
+            ;
+            beq     pcm_done        ; Exit if zero
+
+            ldy     #0
+
+;---------------------------------------------------------------------------------
+; Main playback loop - 2 * PCM_CYCLES cycles per iteration, one per sample
+;
+; NOTE: All paths take exactly PCM_CYCLES cycles between DAC writes. As the
+;       data and decoding tables are page aligned, no indexed access ever
+;       crosses a page and their timing is fixed. The encoder never lets the
+;       sample leave 0-255, so the carry is always clear after ADC
+;---------------------------------------------------------------------------------
+pcm_loop:
+            ; Decode and output the high nibble (20 cycles)
+            ;
+            lda     (PCMPTR),Y      ; 5 cycles - Read byte from table
+            tax                     ; 2 cycles
+            lda     SAMPLE          ; 3 cycles
+            clc                     ; 2 cycles
+            adc     DHI,X           ; 4 cycles - Add high nibble delta
+            sta     DAC             ; 4 cycles - Output to DAC
+
+            ; Decode and output the low nibble: 3 + delay + 13 = PCM_CYCLES
+            ;
+            stx     BYTE            ; 3 cycles - DELAY destroys X
+            DELAY   PCM_CYCLES - 16
+            ldx     BYTE            ; 3 cycles
+            clc                     ; 2 cycles
+            adc     DLO,X           ; 4 cycles - Add low nibble delta
+            sta     DAC             ; 4 cycles - Output to DAC
+            sta     SAMPLE          ; 3 cycles
+
+            ; Advance to next byte (4 cycles)
+            ;
+            iny                     ; 2 cycles
+            beq     pcm_page        ; 2 cycles (not taken)
+                                    ; 3 cycles (taken at end of page)
+
+            ; Path A (same page): 3 + 4 + delay + 3 + 20 = PCM_CYCLES
+            ;
+            DELAY   PCM_CYCLES - 30
+            jmp     pcm_loop        ; 3 cycles - Continue loop
+
+            ; Path B (next page): 3 + 5 + 12 + delay + 3 + 20 = PCM_CYCLES
+            ;
+pcm_page:
+            inc     PCMPTR+1        ; 5 cycles
+            dec     PAGES           ; 5 cycles
+            beq     pcm_done        ; 2 cycles (not taken)
+                                    ; 3 cycles (taken when done)
+            DELAY   PCM_CYCLES - 43
+            jmp     pcm_loop        ; 3 cycles - Continue loop
+
+pcm_done:
+            jmp     KIMMON
+
+            .end
@@ -0,0 +1,438 @@
+
+;        COPYRIGHT 1977 BY MICRO TECHNOLOGY UNLIMITED, BOX 4596,
+;        MANCHESTER, NEW HAMPSHIRE 03108
+;        PROGRAM WRITTEN BY HAL CHAMBERLIN
+
+;        WAVEFORM BANK VARIANT
+;        (C) 2025 EDUARDO CASINO
+
+;        FOURIER SERIES EVALUATION PROGRAM FOR COMPUTING A WHOLE BANK OF
+;        WAVEFORM TABLES FROM HARMONIC SPECIFICATIONS WHEN THE NOTRAN
+;        INTERPRETER IS STARTED.
+
+;        LOAD THE SPECIFICATIONS PACKED BY WAVEGEN -S TOGETHER WITH THE
+;        INTERPRETER AND THE SCORE AND RUN THE PROGRAM AT 2000 INSTEAD OF
+;        THE INTERPRETER.  EACH SPECIFICATION IS EVALUATED INTO ITS PAGE,
+;        STARTING AT THE PAGE IN WAVPG (2003), AND THEN THE INTERPRETER IS
+;        STARTED AT MUSIC.  A SPECIFICATION IS MUCH SMALLER THAN ITS TABLE
+;        SO THE BANK LOADS MANY TIMES FASTER THROUGH THE SERIAL PORT.
+
+;        EACH PACKED SPECIFICATION IS:
+
+;        NHARM    THE HIGHEST HARMONIC, AS IN KIMFS.  X'80 INSTEAD MEANS
+;                 THAT THE WHOLE TABLE FOLLOWS, AND X'FF ENDS THE BANK.
+;        PKAMP    THE PEAK AMPLITUDE OF THE NORMALIZED WAVEFORM, AS IN
+;                 KIMFS.
+;        SHIFT    THE BITS DROPPED FROM EACH HARMONIC SO THAT THEIR SUM
+;                 FITS IN 16 BITS.
+;        FSRAM    THE AMPLITUDE AND PHASE PAIRS OF THE DC COMPONENT AND
+;                 EACH HARMONIC UP TO NHARM, AS IN KIMFS.
+;        FIXES    A COUNT AND THAT MANY INDEX AND VALUE PAIRS OF SAMPLES
+;                 TO REPLACE IN THE TABLE.
+
+;        THE TABLES OF WAVEGEN ARE EVALUATED IN FLOATING POINT.  THIS
+;        PROGRAM USES A 15 BIT COSINE AND A ROUNDED DIVISION FOR EVERY
+;        SAMPLE, SO IT DIFFERS IN VERY FEW SAMPLES, AND WAVEGEN ADDS
+;        THOSE AS FIXES.  THE TABLES ARE THE SAME AS IN THE WAVEGEN
+;        OUTPUT, BYTE BY BYTE.
+
+;        AS IN KIMFSF THE CYCLE IS EVALUATED ONE HARMONIC AT A TIME.  A
+;        TABLE OF AMPLITUDE TIMES COSINE IS BUILT FOR THE 65 ANGLES OF
+;        QUADRANT 1 AND ITS ENTRIES ARE ADDED OR SUBTRACTED FOR THE
+;        OTHER QUADRANTS.  THE HIGH BYTES OF THE ACCUMULATOR ARE KEPT IN
+;        THE PAGE OF THE TABLE BEING EVALUATED, SO THE SCRATCH AREA AFTER
+;        THE BANK IS ONLY 386 BYTES.
+
+;        THE TWO POINTERS IN PAGE 0 ARE SAVED AND RESTORED, SO THE
+;        INTERPRETER FINDS ITS PAGE 0 AS IT WAS LOADED.
+
+         .IFNDEF WAVTBA
+WAVTBA   =      $3000        ; ADDRESS OF WAVEFORM TABLE AREA
+         .ENDIF
+
+         .ASSERT <WAVTBA = 0, error, "WAVTBA must be page aligned"
+
+MUSIC    =      $0200        ; ENTRY POINT OF THE NOTRAN INTERPRETER
+SPCEND   =      $FF          ; NHARM OF THE END OF THE BANK
+
+         .IMPORT __WAVE_RUN__ ; THE PACKED SPECIFICATIONS
+
+         .zeropage
+
+WAVEAD:  .RES   2            ; ADDRESS OF WAVEFORM TABLE TO FILL, ALSO
+                             ; THE HIGH BYTES OF THE ACCUMULATOR
+SPECAD:  .RES   2            ; ADDRESS OF NEXT PACKED SPECIFICATION
+
+         .code
+
+         JMP    BANK
+
+WAVPG:   .BYTE  >WAVTBA      ; PAGE OF THE FIRST WAVEFORM TABLE
+
+;        STORAGE
+
+SAVE:    .RES   4            ; PAGE 0 BYTES OF THE INTERPRETER
+PROD:    .RES   3            ; PRODUCT/DIVIDEND, LOW BYTE FIRST
+MPCD:    .RES   2            ; MULTIPLICAND
+AMPL:    .RES   1            ; AMPLITUDE OF CURRENT HARMONIC
+ANGLE:   .RES   1            ; ANGLE OF CURRENT HARMONIC AT CURRENT POINT
+HRMCNT:  .RES   1            ; HARMONIC COUNTER
+COUNT:   .RES   1            ; BYTE OR FIX COUNTER
+MAX:     .RES   2            ; MAXIMUM WAVEFORM AMPLITUDE
+MIN:     .RES   2            ; MINIMUM WAVEFORM AMPLITUDE
+SPAN:    .RES   2            ; MAX-MIN
+HALF:    .RES   2            ; SPAN/2, TO ROUND
+
+;        SPECTRUM PARAMETERS, COPIED FROM THE PACKED SPECIFICATION
+
+NHARM:   .RES   1            ; HIGHEST HARMONIC TO GENERATE
+PKAMP:   .RES   1            ; DESIRED PEAK AMPLITUDE OF WAVEFORM
+SHIFT:   .RES   1            ; BITS DROPPED FROM EACH HARMONIC
+FSRAM:   .RES   34           ; AMPLITUDE AND PHASE PAIRS
+
+;        MAIN LOOP, ONE SPECIFICATION AT A TIME
+
+BANK:    CLD
+         LDX    #3           ; KEEP THE PAGE 0 BYTES OF THE INTERPRETER
+BANK1:   LDA    WAVEAD,X
+         STA    SAVE,X
+         DEX
+         BPL    BANK1
+         LDA    #<__WAVE_RUN__ ; POINT TO THE FIRST SPECIFICATION
+         STA    SPECAD
+         LDA    #>__WAVE_RUN__
+         STA    SPECAD+1
+         LDA    #0           ; AND TO THE FIRST TABLE
+         STA    WAVEAD
+         LDA    WAVPG
+         STA    WAVEAD+1
+
+NEXT:    LDY    #0           ; GET NHARM
+         LDA    (SPECAD),Y
+         BPL    NEXT2        ; JUMP IF A SPECIFICATION
+         CMP    #SPCEND
+         BEQ    DONE         ; GO START THE INTERPRETER IF THE END
+         LDA    #1           ; COPY A WHOLE TABLE
+         JSR    ADVANC
+NEXT1:   LDA    (SPECAD),Y
+         STA    (WAVEAD),Y
+         INY
+         BNE    NEXT1
+         INC    SPECAD+1
+         JMP    NXTPG
+
+NEXT2:   ASL    A            ; COPY NHARM, PKAMP, SHIFT AND THE NHARM+1
+         CLC                 ; PAIRS
+         ADC    #5
+         STA    COUNT
+NEXT3:   LDA    (SPECAD),Y
+         STA    NHARM,Y
+         INY
+         CPY    COUNT
+         BNE    NEXT3
+         TYA
+         JSR    ADVANC
+         JSR    FSEVAL       ; EVALUATE THE WHOLE CYCLE
+         JSR    SCALE        ; AND NORMALIZE IT INTO THE TABLE
+
+         LDY    #0           ; GET THE FIX COUNT
+         LDA    (SPECAD),Y
+         STA    COUNT
+         LDA    #1
+         JSR    ADVANC
+FIX1:    LDA    COUNT        ; REPLACE THE SAMPLES
+         BEQ    NXTPG
+         LDY    #1           ; VALUE IN X
+         LDA    (SPECAD),Y
+         TAX
+         DEY                 ; INDEX IN Y
+         LDA    (SPECAD),Y
+         TAY
+         TXA
+         STA    (WAVEAD),Y
+         LDA    #2
+         JSR    ADVANC
+         DEC    COUNT
+         JMP    FIX1
+
+NXTPG:   INC    WAVEAD+1     ; NEXT TABLE
+         JMP    NEXT
+
+DONE:    LDX    #3           ; GIVE THE INTERPRETER ITS PAGE 0 BACK
+DONE1:   LDA    SAVE,X
+         STA    WAVEAD,X
+         DEX
+         BPL    DONE1
+         JMP    MUSIC        ; AND START IT
+
+;        ADD A TO THE SPECIFICATION POINTER
+
+ADVANC:  CLC
+         ADC    SPECAD
+         STA    SPECAD
+         BCC    ADV1
+         INC    SPECAD+1
+ADV1:    RTS
+
+;        THIS SUBROUTINE EVALUATES THE WHOLE CYCLE OF THE WAVEFORM
+;        SPECIFIED BY THE SPECTRUM AT FSRAM.
+;        NHARM SPECIFIES THE HIGHEST HARMONIC TO BE INCLUDED
+;        THE COMPUTED POINTS ARE RETURNED IN THE TABLE PAGE (HIGH) AND
+;        ACCLO (LOW) AS 16 BIT TWOS COMPLEMENT NUMBERS, INDEXED BY POINT
+;        NUMBER
+;        DESTROYS A, X AND Y
+
+FSEVAL:  LDA    #0           ; CLEAR THE ACCUMULATOR AREA
+         TAY
+FSEV1:   STA    ACCLO,Y
+         STA    (WAVEAD),Y
+         INY
+         BNE    FSEV1
+         STA    HRMCNT       ; ZERO HARMONIC COUNTER
+FSEV2:   LDA    HRMCNT       ; GET CURRENT HARMONIC NUMBER AND DOUBLE IT
+         ASL    A
+         TAX                 ; USE AS AN INDEX TO THE SPECTRUM TABLE
+         LDA    FSRAM,X      ; GET AMPLITUDE
+         BEQ    FSEV7        ; SKIP HARMONIC IF ZERO, IT ADDS NOTHING
+         STA    AMPL
+         LDA    FSRAM+1,X    ; GET PHASE, WHICH IS THE ANGLE AT POINT 0
+         STA    ANGLE
+         JSR    HRMTAB       ; BUILD THE TABLE FOR THIS AMPLITUDE
+         LDY    #0           ; POINT NUMBER IN Y
+FSEV3:   LDA    ANGLE        ; ANGLE IN QUADRANT 1 OR 3 IS THE INDEX
+         AND    #$3F
+         TAX
+         BIT    ANGLE
+         BVC    FSEV4
+         EOR    #$3F         ; IN QUADRANT 2 OR 4 IT IS 64 MINUS IT
+         TAX
+         INX
+FSEV4:   LDA    ANGLE        ; SUBTRACT IN QUADRANTS 2 AND 3, WHERE
+         ASL    A            ; BITS 7 AND 6 DIFFER
+         EOR    ANGLE
+         BMI    FSEV5
+         CLC                 ; ADD TABLE ENTRY TO THE ACCUMULATED POINT
+         LDA    ACCLO,Y
+         ADC    HTLO,X
+         STA    ACCLO,Y
+         LDA    (WAVEAD),Y
+         ADC    HTHI,X
+         JMP    FSEV6
+FSEV5:   SEC                 ; SUBTRACT TABLE ENTRY FROM THE ACCUMULATED
+         LDA    ACCLO,Y      ; POINT
+         SBC    HTLO,X
+         STA    ACCLO,Y
+         LDA    (WAVEAD),Y
+         SBC    HTHI,X
+FSEV6:   STA    (WAVEAD),Y
+         LDA    ANGLE        ; STEP THE ANGLE BY THE HARMONIC NUMBER
+         CLC
+         ADC    HRMCNT
+         STA    ANGLE
+         INY                 ; NEXT POINT
+         BNE    FSEV3
+FSEV7:   LDA    HRMCNT       ; TEST IF CURRENT HARMONIC IS LAST ONE TO
+         CMP    NHARM        ; INCLUDE
+         BEQ    FSEV8        ; GO RETURN IF SO
+         INC    HRMCNT       ; INCREMENT TO NEXT HARMONIC
+         BNE    FSEV2        ; LOOP FOR ANOTHER HARMONIC (ALWAYS)
+FSEV8:   RTS                 ; RETURN
+
+;        THIS SUBROUTINE BUILDS THE HARMONIC TABLE, HTHI (HIGH) AND HTLO
+;        (LOW), WITH AMPL TIMES THE COSINE OF EACH ANGLE OF QUADRANT 1,
+;        SHIFTED RIGHT SHIFT TIMES
+;        DESTROYS A, X AND Y
+
+HRMTAB:  LDY    #64          ; START AT THE END OF THE COSINE TABLE
+HRMT1:   LDA    COSLO,Y      ; MULTIPLY COSINE BY AMPLITUDE
+         STA    MPCD
+         LDA    COSHI,Y
+         STA    MPCD+1
+         LDA    AMPL
+         JSR    MPY16
+         LDA    SHIFT        ; DROP THE LOW BITS, A WHOLE BYTE FIRST IF
+         CMP    #8           ; 8 OR MORE
+         BCC    HRMT2
+         SBC    #8
+         LDX    PROD+1
+         STX    PROD
+         LDX    PROD+2
+         STX    PROD+1
+         LDX    #0
+         STX    PROD+2
+HRMT2:   TAX
+         BEQ    HRMT4
+HRMT3:   LSR    PROD+2
+         ROR    PROD+1
+         ROR    PROD
+         DEX
+         BNE    HRMT3
+HRMT4:   LDA    PROD         ; STORE THE ENTRY
+         STA    HTLO,Y
+         LDA    PROD+1
+         STA    HTHI,Y
+         DEY                 ; NEXT COSINE TABLE ENTRY
+         BPL    HRMT1
+         RTS                 ; RETURN
+
+;        SCALE THE WAVEFORM POINTS AND PUT THEM IN THE WAVEFORM TABLE
+;        FIRST FIND THE MOST POSITIVE AND THE MOST NEGATIVE POINTS, THEN
+;        SET EACH POINT TO (POINT-MIN)*PKAMP/(MAX-MIN), ROUNDED.
+;        DESTROYS A, X AND Y
+
+SCALE:   LDA    #$00         ; SET MAX TO 8000 AND MIN TO 7FFF
+         STA    MAX
+         LDA    #$80
+         STA    MAX+1
+         LDA    #$FF
+         STA    MIN
+         LDA    #$7F
+         STA    MIN+1
+         LDY    #0           ; ZERO THE POINT NUMBER
+SCALE1:  LDA    ACCLO,Y      ; COMPARE WITH MAX
+         CMP    MAX
+         LDA    (WAVEAD),Y
+         SBC    MAX+1
+         BVC    SCALE2
+         EOR    #$80
+SCALE2:  BMI    SCALE3       ; JUMP IF LESS THAN MAX
+         LDA    ACCLO,Y      ; UPDATE MAX IF EQUAL OR GREATER
+         STA    MAX
+         LDA    (WAVEAD),Y
+         STA    MAX+1
+SCALE3:  LDA    ACCLO,Y      ; COMPARE WITH MIN
+         CMP    MIN
+         LDA    (WAVEAD),Y
+         SBC    MIN+1
+         BVC    SCALE4
+         EOR    #$80
+SCALE4:  BPL    SCALE5       ; JUMP IF EQUAL OR GREATER THAN MIN
+         LDA    ACCLO,Y      ; UPDATE MIN IF LESS
+         STA    MIN
+         LDA    (WAVEAD),Y
+         STA    MIN+1
+SCALE5:  INY                 ; INCREMENT POINT NUMBER
+         BNE    SCALE1       ; GO FOR NEXT POINT IF NOT DONE
+
+         SEC                 ; COMPUTE THE SPAN AND HALF OF IT
+         LDA    MAX
+         SBC    MIN
+         STA    SPAN
+         LDA    MAX+1
+         SBC    MIN+1
+         STA    SPAN+1
+         LSR    A
+         STA    HALF+1
+         LDA    SPAN
+         ROR    A
+         STA    HALF
+
+SCALE6:  SEC                 ; SUBTRACT MIN FROM THE POINT AND PLACE IT
+         LDA    ACCLO,Y      ; IN THE MULTIPLICAND
+         SBC    MIN
+         STA    MPCD
+         LDA    (WAVEAD),Y
+         SBC    MIN+1
+         STA    MPCD+1
+         LDA    PKAMP        ; MULTIPLY BY THE PEAK AMPLITUDE
+         JSR    MPY16
+         CLC                 ; ADD HALF THE SPAN TO ROUND
+         LDA    PROD
+         ADC    HALF
+         STA    PROD
+         LDA    PROD+1
+         ADC    HALF+1
+         STA    PROD+1
+         LDA    PROD+2
+         ADC    #0
+         STA    PROD+2
+
+;        DIVIDE BY THE SPAN.  THE QUOTIENT IS AT MOST PKAMP, SO THE HIGH
+;        16 BITS OF THE DIVIDEND ARE ALREADY LESS THAN THE SPAN AND ONLY
+;        THE LOW 8 BITS OF THE QUOTIENT ARE COMPUTED, INTO PROD.  THE
+;        REMAINDER IN PROD+1 AND PROD+2 CAN TAKE 17 BITS, CARRY INCLUDED.
+
+         LDX    #8           ; SET 8 DIVIDE CYCLE COUNT
+SCALE7:  ASL    PROD         ; SHIFT DIVIDEND LEFT 1
+         ROL    PROD+1
+         ROL    PROD+2
+         BCS    SCALE8       ; SUBTRACT IF OVER 16 BITS
+         LDA    PROD+1       ; OR IF NOT LESS THAN THE SPAN
+         CMP    SPAN
+         LDA    PROD+2
+         SBC    SPAN+1
+         BCC    SCALE9
+SCALE8:  LDA    PROD+1       ; SUBTRACT THE SPAN, CARRY IS SET
+         SBC    SPAN
+         STA    PROD+1
+         LDA    PROD+2
+         SBC    SPAN+1
+         STA    PROD+2
+         INC    PROD         ; BRINGING IN A QUOTIENT BIT
+SCALE9:  DEX                 ; DECREMENT AND CHECK CYCLE COUNT
+         BNE    SCALE7
+         LDA    PROD         ; PUT THE QUOTIENT INTO THE WAVEFORM TABLE
+         STA    (WAVEAD),Y
+         INY                 ; INCREMENT POINT NUMBER
+         BNE    SCALE6       ; GO FOR ANOTHER POINT IF NOT FINISHED
+         RTS                 ; RETURN
+
+;        16 X 8 UNSIGNED MULTIPLY SUBROUTINE
+;        ENTER WITH UNSIGNED MULTIPLIER IN A
+;        ENTER WITH UNSIGNED MULTIPLICAND IN MPCD (LOW) AND MPCD+1
+;        RETURN WITH 24 BIT UNSIGNED PRODUCT IN PROD (LOW) THROUGH
+;        PROD+2 (HIGH)
+;        DESTROYS A AND X, PRESERVES Y
+
+MPY16:   LSR    A            ; FIRST MULTIPLIER BIT TO CARRY
+         STA    PROD
+         LDA    #0           ; CLEAR HIGH PRODUCT
+         STA    PROD+1
+         STA    PROD+2
+         LDX    #8           ; SET 8 MULTIPLY CYCLE COUNT
+MPY1:    BCC    MPY2         ; SKIP MULTIPLICAND ADD IF MULTIPLIER BIT
+                             ; IS ZERO
+         CLC                 ; ADD MULTIPLICAND TO HIGH PRODUCT
+         LDA    PROD+1
+         ADC    MPCD
+         STA    PROD+1
+         LDA    PROD+2
+         ADC    MPCD+1
+         STA    PROD+2
+MPY2:    ROR    PROD+2       ; SHIFT PRODUCT RIGHT 1, PUTTING NEXT
+         ROR    PROD+1       ; MULTIPLIER BIT IN CARRY
+         ROR    PROD
+         DEX                 ; DECREMENT AND CHECK CYCLE COUNT
+         BNE    MPY1
+         RTS                 ; RETURN
+
+;        65 POINT COSINE TABLE, QUADRANT 1, 15 BITS
+
+COSLO:   .BYTE  $FF,$F5,$D8,$A6,$61,$09,$9C,$1D
+         .BYTE  $89,$E3,$29,$5C,$7C,$89,$84,$6B
+         .BYTE  $41,$04,$B5,$54,$E2,$5E,$C9,$23
+         .BYTE  $6D,$A6,$CF,$E8,$F1,$EB,$D7,$B3
+         .BYTE  $82,$42,$F5,$9B,$33,$BF,$3F,$B4
+         .BYTE  $1C,$7A,$CE,$17,$56,$8C,$BA,$DF
+         .BYTE  $FB,$11,$1F,$26,$28,$23,$1A,$0B
+         .BYTE  $F9,$E2,$C8,$AB,$8C,$6A,$48,$24
+         .BYTE  $00
+COSHI:   .BYTE  $7F,$7F,$7F,$7F,$7F,$7F,$7E,$7E
+         .BYTE  $7D,$7C,$7C,$7B,$7A,$79,$78,$77
+         .BYTE  $76,$75,$73,$72,$70,$6F,$6D,$6C
+         .BYTE  $6A,$68,$66,$64,$62,$60,$5E,$5C
+         .BYTE  $5A,$58,$55,$53,$51,$4E,$4C,$49
+         .BYTE  $47,$44,$41,$3F,$3C,$39,$36,$33
+         .BYTE  $30,$2E,$2B,$28,$25,$22,$1F,$1C
+         .BYTE  $18,$15,$12,$0F,$0C,$09,$06,$03
+         .BYTE  $00
+
+;        SCRATCH AREA AFTER THE BANK
+
+         .segment "SCRATCH"
+
+ACCLO:   .RES   256          ; WHOLE CYCLE ACCUMULATOR, LOW BYTES
+HTLO:    .RES   65           ; HARMONIC TABLE, LOW BYTES
+HTHI:    .RES   65           ; HARMONIC TABLE, HIGH BYTES
+
+         .END
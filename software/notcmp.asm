@@ -208,6 +208,13 @@
 ;        ERROR LOCATION.  BE ON THE LOOKOUT FOR ANYTHING WHEN THE ERROR
 ;        CODE IS 1, 6, 8, OR 9.
 
+;        ASSEMBLED WITH -D FASTSYM, THE SYMBOL TABLE IS INSTEAD A 512
+;        BYTE TABLE OF THE VALUES OF ALL THE IDENTIFIERS FROM 0 TO 255,
+;        INDEXED BY THE IDENTIFIER ITSELF.  AN IDENTIFIER IS LOOKED UP
+;        WITHOUT A SEARCH, ALL 255 MAY BE USED AND ER-04 NEVER HAPPENS.
+;        THE TABLE TAKES THE TOP 2 PAGES OF THE 4K EXPANSION, SO THE
+;        OBJECT CODE AREA IS 512 BYTES SMALLER.
+
          .zeropage           ; KEEP ALL CONSTANTS AND DATA IN PAGE 0
 
 KIMMON   =      $1C22        ; ENTRY POINT TO KIM MONITOR
@@ -223,6 +230,13 @@ KIMDLY   =      $1ED4        ; KIM TTY DELAY ONE BIT TIME, KEEPS X
 
 INBFA:   .WORD  $300         ; INPUT BUFFER ADDRESS, 73 BYTES USED
 OUBFA:   .WORD  $300+73      ; OUTPUT BUFFER ADDRESS, 74 BYTES USED
+.ifdef FASTSYM
+SYMTA:   .WORD  $2E00        ; SYMBOL TABLE ADDRESS, 512 BYTES, MUST BE
+                             ; ON A PAGE BOUNDARY
+CODEA:   .WORD  CMPEND       ; OBJECT CODE AREA ADDRESS
+CODELN:  .WORD  $2DFF-CMPEND ; MAXIMUM NUMBER OF MUSIC OBJECT CODE BYTES
+                             ; ALLOWED
+.else
 SYMTA:   .WORD  $300+73+74   ; SYMBOL TABLE ADDRESS
 CODEA:   .WORD  CMPEND       ; OBJECT CODE AREA ADDRESS
 CODELN:  .WORD  $2FFF-CMPEND ; MAXIMUM NUMBER OF MUSIC OBJECT CODE BYTES
@@ -230,6 +244,7 @@ CODELN:  .WORD  $2FFF-CMPEND ; MAXIMUM NUMBER OF MUSIC OBJECT CODE BYTES
 SYMTLN:  .BYTE  (100-1)/3    ; MAXIMUM NUMBER OF SYMBOLS ALLOWED, 3
                              ; BYTES OF MEMORY USED FOR EACH SYMBOL
                              ; PLUS 1 FOR AN END MARK
+.endif
 
 ;        THESE ADDRESSES MAY BE ALTERED BY THE USER TO USE ALTERNATE I/O
 ;        ROUTINES IF A TELETYPE IS NOT AVAILABLE
@@ -422,8 +437,12 @@ NOTRAN:  CLD                 ; INSURE BINARY ARITHMETIC
          STA    SUBSKP+1
          STA    EVTBLD       ; TURN EVENT BEING BUILT FLAG OFF
          STA    ENDFLG       ; TURN END FLAG OFF
+.ifdef FASTSYM
+         JSR    SYMCLR       ; CLEAR THE SYMBOL TABLE, LEAVES A AND Y 0
+.else
          TAY                 ; CLEAR THE SYMBOL TABLE
          STA    (SYMTA),Y
+.endif
          STA    VPPNT        ; INITIALIZE VOICE PROCESSING POINTER
          TAX
 NOTR1:   LDA    #0
@@ -1276,6 +1295,79 @@ KWTAB:   .BYTE  'N','V','C'  ; DEFINE NUMBER OF VOICES
          .WORD  ESBP
          .BYTE  0            ; END OF TABLE MARKER
 
+.ifdef FASTSYM
+
+;        SYMSR  SYMBOL TABLE LOOKUP, DIRECT INDEXED TABLE
+;               ENTER WITH SYMBOL TO LOOK UP IN A RANGE OF 1-255.
+;               EXIT WITH SYMTPT POINTING TO LOW BYTE OF SYMBOL VALUE
+;               AND C=1 IF SYMBOL IS DEFINED, C=0 IF NOT.  A HIGH BYTE
+;               OF 0 MARKS AN UNDEFINED SYMBOL, AS THE OBJECT CODE IS
+;               NEVER IN PAGE 0.  NO REGISTERS AFFECTED.
+
+SYMSR:   PHA                 ; SAVE A
+         JSR    SYMIX        ; POINT SYMTPT TO THE ENTRY OF THE SYMBOL
+         TYA                 ; SAVE Y
+         PHA
+         LDY    #1           ; GET HIGH BYTE OF SYMBOL VALUE
+         LDA    (SYMTPT),Y
+         CMP    #1           ; SET CARRY IF NOT ZERO, SYMBOL DEFINED
+         PLA                 ; RESTORE REGISTERS
+         TAY
+         PLA
+         RTS                 ; RETURN
+
+;        SYMAD  SYMBOL TABLE ADD ROUTINE, DIRECT INDEXED TABLE
+;               ENTER WITH SYMBOL TO ADD IN A, VALUE OF SYMBOL IN CODEPT
+;               RETURN WITH C=1, THE TABLE CANNOT OVERFLOW.  NO
+;               REGISTERS AFFECTED.
+
+SYMAD:   PHA                 ; SAVE A
+         JSR    SYMIX        ; POINT SYMTPT TO THE ENTRY OF THE SYMBOL
+         TYA                 ; SAVE Y
+         PHA
+         INC    SYMTCT       ; INCREMENT SYMBOL COUNT
+         LDY    #0           ; STORE LOW VALUE IN THE TABLE
+         LDA    CODEPT
+         STA    (SYMTPT),Y
+         INY                 ; STORE HIGH VALUE IN THE TABLE
+         LDA    CODEPT+1
+         STA    (SYMTPT),Y
+         PLA                 ; RESTORE REGISTERS
+         TAY
+         PLA
+         SEC                 ; SET CARRY TO INDICATE SUCCESSFUL ADD
+         RTS                 ; RETURN
+
+;        SYMIX  SYMBOL TABLE INDEX
+;               ENTER WITH SYMBOL IN A.  EXIT WITH SYMTPT POINTING TO ITS
+;               ENTRY, AT (SYMTA) PLUS TWICE THE SYMBOL.  A IS LOST.
+
+SYMIX:   ASL    A            ; TWO BYTES PER ENTRY, CARRY IS THE 9TH BIT
+         STA    SYMTPT       ; LOW BYTE, (SYMTA) IS ON A PAGE BOUNDARY
+         LDA    SYMTA+1      ; HIGH BYTE, NEXT PAGE IF SYMBOL >= 128
+         ADC    #0
+         STA    SYMTPT+1
+         RTS                 ; RETURN
+
+;        SYMCLR CLEAR THE SYMBOL TABLE
+;               EXIT WITH A AND Y ZERO.  X IS LOST.
+
+SYMCLR:  LDA    SYMTA+1      ; POINT SYMTPT TO THE FIRST PAGE
+         STA    SYMTPT+1
+         LDA    #0
+         STA    SYMTPT
+         TAY
+         LDX    #2           ; TWO PAGES TO CLEAR
+SYMCL1:  STA    (SYMTPT),Y   ; CLEAR A BYTE
+         INY
+         BNE    SYMCL1       ; LOOP UNTIL END OF PAGE
+         INC    SYMTPT+1     ; MOVE TO NEXT PAGE
+         DEX
+         BNE    SYMCL1       ; LOOP UNTIL BOTH PAGES CLEARED
+         RTS                 ; RETURN
+
+.else
+
 ;        SYMSR  SYMBOL TABLE SEARCH
 ;               ENTER WITH SYMBOL TO SEARCH FOR IN A RANGE OF 1-255.
 ;               EXIT WITH SYMTPT POINTING TO LOW BYTE OF SYMBOL VALUE
@@ -1358,6 +1450,8 @@ SYMAD2:  INC    SYMTCT       ; INCREMENT SYMBOL COUNT
          SEC                 ; SET CARRY TO INDICATE SUCCESSFUL ADD
          BCS    SYMAD1       ; GO RESTORE REGISTERS AND RETURN
 
+.endif
+
 ;        NNB    NEXT NON-BLANK SEARCH
 ;               ENTER WITH INBFPT POINTING TO FIRST BYTE TO BE SEARCHED.
 ;               EXIT WITH INBFPT POINTING TO FIRST NON-BLANK CHARACTER
@@ -0,0 +1,605 @@
+
+;        COPYRIGHT 1977 BY MICRO TECHNOLOGY UNLIMITED, BOX 4596,
+;        MANCHESTER, NEW HAMPSHIRE 03108
+;        PROGRAM WRITTEN BY HAL CHAMBERLIN
+
+;        8 VOICE, HALF SAMPLE RATE VARIANT
+;        (C) 2025 EDUARDO CASINO
+
+;        THIS PROGRAM INTERPRETS NOTRAN OBJECT CODE GENERATED BY THE
+;        NOTRAN COMPILER.
+;        8 NON-DYNAMIC VOICES ARE SUPPORTED.
+;        AN 8-BIT UNSIGNED DIGITAL-TO-ANALOG CONVERTER IS USED FOR THE
+;        AUDIO OUTPUT,
+;        OUTPUT SAMPLE RATE IS 4.386 KHZ WITH A 1.0 MHZ 6502 PROCESSOR
+
+;        THE OBJECT CODE FORMAT AND THE RULES FOR INTERPRETING IT ARE
+;        THE SAME AS FOR THE 4 VOICE INTERPRETER (SEE NOTINT.ASM) WITH
+;        THE FOLLOWING DIFFERENCES:
+
+;          - THE SET NUMBER OF VOICES COMMAND (50) ACCEPTS 1 TO 8.
+;          - THE ACTIVATE (90) AND DEACTIVATE (80) VOICE COMMANDS ACCEPT
+;            VOICE NUMBERS 0 TO 7.
+;          - THE SOUND GENERATE LOOP TAKES 228 STATES INSTEAD OF 114 SO
+;            THE SAMPLE RATE IS HALVED.  THE NOTE FREQUENCY TABLE HAS BEEN
+;            RECOMPUTED FOR THE LOWER RATE SO PITCHES ARE UNCHANGED, BUT
+;            THE TEMPO VALUE STILL COUNTS SAMPLES.  A SONG WRITTEN FOR THE
+;            4 VOICE INTERPRETER NEEDS HALF THE TEMPO VALUE TO PLAY AT
+;            THE SAME SPEED.
+
+;        WITH 8 ENABLED VOICES THE LARGEST SAMPLE OF EACH WAVEFORM TABLE
+;        SHOULD NOT EXCEED 255/8 = 31 TO AVOID OVERFLOW WHEN THE VOICES
+;        ARE COMBINED (SEE DWAVES8.YAML).
+
+         .zeropage           ; ORG AT PAGE 0 LOCATION 0
+
+DAC      =      $1700        ; OUTPUT PORT ADDRESS WITH DAC
+DACDIR   =      $1701        ; DATA DRIECTION REGISTER FOR DAC PORT
+KIMMON   =      $1C22        ; ENTRY POINT TO KIM KEYBOARD MONITOR
+ISTKPT   =      $FF          ; INITIAL VALUE OF STACK POINTER
+
+                             ; FORMAT OF TABLE AREA FOR VOICE X
+VXPTF    =      0            ; VOICE WAVE POINTER, FRACTIONAL PART
+VXPTI    =      1            ; INTEGER PART
+VXPTW    =      2            ; WAVE TABLE PAGE NUMBER
+VXNOT    =      3            ; DISPLACEMENT IN NOTE FREQUENCY TABLE
+VXIN     =      4            ; WAVE TABLE POINTER INCREMENT (FREQUENCY
+                             ; PARAMETER, DOUBLE PRECISION)
+VXDUR    =      6            ; NOTE DURATION
+
+;        ADDRESSES OF OBJECT CODE AREA AND WAVEFORM TABLE AREA
+
+SONGA:   .WORD  0            ; ADDRESS OF OBJECT CODE AREA
+WAVTBA:  .WORD  0            ; ADDRESS OF WAVEFORM TABLE AREA
+
+;        STORAGE REQUIRED BY THE INTERPRETER
+
+CODEPT:  .WORD  0            ; OBJECT CODE POINTER
+TEMPO:   .BYTE  0            ; TEMPO CONTROL VALUE
+DUR:     .BYTE  0            ; EVENT DURATION
+DURC:    .BYTE  0            ; EVENT DURATION COUNTER
+V1TBA:   .RES   8            ; 8 BYTES FOR VOICE 1 TABLE AREA + 1 SPARE
+V2TBA:   .RES   8            ; 8 BYTES FOR VOICE 2 TABLE AREA + 1 SPARE
+V3TBA:   .RES   8            ; 8 BYTES FOR VOICE 3 TABLE AREA + 1 SPARE
+V4TBA:   .RES   8            ; 8 BYTES FOR VOICE 4 TABLE AREA + 1 SPARE
+V5TBA:   .RES   8            ; 8 BYTES FOR VOICE 5 TABLE AREA + 1 SPARE
+V6TBA:   .RES   8            ; 8 BYTES FOR VOICE 6 TABLE AREA + 1 SPARE
+V7TBA:   .RES   8            ; 8 BYTES FOR VOICE 7 TABLE AREA + 1 SPARE
+V8TBA:   .RES   8            ; 8 BYTES FOR VOICE 8 TABLE AREA + 1 SPARE
+XSAVE:   .BYTE  0            ; AREA FOR QUICK SAVE OF X
+YSAVE:   .BYTE  0            ; AREA FOR QUICK SAVE OF Y
+CMSAVE:  .BYTE  0            ; AREA FOR SAVING COMMAND BYTE
+NVCNT:   .BYTE  0            ; VOICE COUNTER FOR SETNV
+CTLM:    .BYTE  $0F          ; MASK FOR TESTING DURATION FIELD
+NULSMP:  .WORD  FRQTAB       ; ADDRESS OF NULL SAMPLE FOR USE IN
+                             ; EFFECTIVELY REDUCING NUMBER OF VOICES
+                             ; ADDED UP
+
+         ; NOTE DURATION TABLE
+
+DURTAB:  .BYTE  192          ; 1 WHOLE NOTE
+         .BYTE  144          ; 2 DOTTED HALF NOTE
+         .BYTE  96           ; 3 HALF NOTE
+         .BYTE  72           ; 4 DOTTED QUARTER NOTE
+         .BYTE  64           ; 5 HALF NOTE TRIPLET
+         .BYTE  48           ; 6 QUARTER NOTE
+         .BYTE  36           ; 7 DOTTED EIGHTH NOTE
+         .BYTE  32           ; 8 QUARTER NOTE TRIPLET
+         .BYTE  24           ; 9 EIGHTH NOTE
+         .BYTE  18           ; A DOTTED SIXTEENTH NOTE
+         .BYTE  16           ; B EIGHTH NOTE TRIPLET
+         .BYTE  12           ; C SIXTEENTH NOTE
+         .BYTE  9            ; D DOTTED 1/32 NOTE
+         .BYTE  8            ; E SIXTEENTH NOTE TRIPLET
+         .BYTE  6            ; F 1/32 NOTE
+
+;        NOTE FREQUENCY TABLE FOR 4.386 KHZ SAMPLE RATE
+;        RANGE FROM C1 (32.7 HZ) TO C6 (1046.5 HZ)
+;                               ID  NOTE  FREQ.   INCR.
+FRQTAB:  .BYTE  0,0          ;  00  SILENCE
+         .BYTE  1,233        ;  02  C1    32.703  1.9088
+         .BYTE  2,6          ;  04  C1#   34.648  2.0223
+         .BYTE  2,37         ;  06  D1    36.708  2.1426
+         .BYTE  2,69         ;  08  D1#   38.891  2.2700
+         .BYTE  2,104        ;  0A  E1    41.203  2.4050
+         .BYTE  2,140        ;  0C  F1    43.654  2.5480
+         .BYTE  2,179        ;  0E  F1#   46.249  2.6995
+         .BYTE  2,220        ;  10  G1    48.999  2.8600
+         .BYTE  3,8          ;  12  G1#   51.913  3.0301
+         .BYTE  3,54         ;  14  A1    55      3.2102
+         .BYTE  3,103        ;  16  A1#   58.27   3.4011
+         .BYTE  3,154        ;  18  B1    61.735  3.6034
+         .BYTE  3,209        ;  1A  C2    65.406  3.8176
+         .BYTE  4,11         ;  1C  C2#   69.296  4.0446
+         .BYTE  4,73         ;  1E  D2    73.416  4.2852
+         .BYTE  4,138        ;  20  D2#   77.782  4.5400
+         .BYTE  4,207        ;  22  E2    82.407  4.8099
+         .BYTE  5,25         ;  24  F2    87.307  5.0959
+         .BYTE  5,102        ;  26  F2#   92.499  5.3990
+         .BYTE  5,184        ;  28  G2    97.999  5.7200
+         .BYTE  6,15         ;  2A  G2#   103.83  6.0601
+         .BYTE  6,108        ;  2C  A2    110     6.4205
+         .BYTE  6,205        ;  2E  A2#   116.54  6.8023
+         .BYTE  7,53         ;  30  B2    123.47  7.2067
+         .BYTE  7,163        ;  32  C3    130.81  7.6353
+         .BYTE  8,23         ;  34  C3#   138.59  8.0893
+         .BYTE  8,146        ;  36  D3    146.83  8.5703
+         .BYTE  9,20         ;  38  D3#   155.56  9.0799
+         .BYTE  9,159        ;  3A  E3    164.81  9.6199
+         .BYTE  10,49        ;  3C  F3    174.61  10.1919
+         .BYTE  10,204       ;  3E  F3#   185     10.7979
+         .BYTE  11,113       ;  40  G3    196     11.4400
+         .BYTE  12,31        ;  42  G3#   207.65  12.1203
+         .BYTE  12,215       ;  44  A3    220     12.8410
+         .BYTE  13,155       ;  46  A3#   233.08  13.6045
+         .BYTE  14,106       ;  48  B3    246.94  14.4135
+         .BYTE  15,69        ;  4A  C4    261.63  15.2706
+         .BYTE  16,46        ;  4C  C4#   277.18  16.1786
+         .BYTE  17,36        ;  4E  D4    293.66  17.1406
+         .BYTE  18,41        ;  50  D4#   311.13  18.1599
+         .BYTE  19,61        ;  52  E4    329.63  19.2397
+         .BYTE  20,98        ;  54  F4    349.23  20.3838
+         .BYTE  21,153       ;  56  F4#   369.99  21.5958
+         .BYTE  22,225       ;  58  G4    392     22.8800
+         .BYTE  24,62        ;  5A  G4#   415.3   24.2405
+         .BYTE  25,175       ;  5C  A4    440     25.6819
+         .BYTE  27,54        ;  5E  A4#   466.16  27.2091
+         .BYTE  28,212       ;  60  B4    493.88  28.8270
+         .BYTE  30,139       ;  62  C5    523.25  30.5411
+         .BYTE  32,91        ;  64  C5#   554.37  32.3572
+         .BYTE  34,72        ;  66  D5    587.33  34.2813
+         .BYTE  36,82        ;  68  D5#   622.25  36.3197
+         .BYTE  38,123       ;  6A  E5    659.26  38.4794
+         .BYTE  40,196       ;  6C  F5    698.46  40.7675
+         .BYTE  43,49        ;  6E  F5#   739.99  43.1917
+         .BYTE  45,195       ;  70  G5    783.99  45.7600
+         .BYTE  48,123       ;  72  G5#   830.61  48.4810
+         .BYTE  51,93        ;  74  A5    880     51.3638
+         .BYTE  54,107       ;  76  A5#   932.33  54.4181
+         .BYTE  57,167       ;  78  B5    987.77  57.6540
+         .BYTE  61,21        ;  7A  C6    1046.5  61.0823
+
+;        INDIRECT JUMP POINTER FOR INTERPRETING PURE CONTROL COMMANDS.
+;        THE JUMP TABLE ITSELF IS IN PAGE 1, AS PAGE 0 FROM EF UP
+;        BELONGS TO THE KIM MONITOR
+
+JADDR:   .WORD  0            ; INDIRECT JUMP POINTER
+
+;        INITIALIZATION ROUTINE
+;        INITIALIZE THE MUSIC HARDWARE, SET UP THE OBJECT CODE POINTER,
+;        AND DEACTIVATE ALL 8 VOICES
+
+         .code               ; START INTERPRETER AT 200
+
+MUSIC:   LDA    #$FF         ; SET DAC PORT DATA DIRECTION REGISTER TO
+         STA    DACDIR       ; OUTPUT
+         CLD                 ; INSURE BINARY ARITHMETIC
+         LDX    #ISTKPT      ; INITIALIZE STACK POINTER
+         TXS
+         LDA    #0           ; ZERO THE PREVIOUS DURATION
+         STA    DUR
+         LDA    SONGA        ; INITIALIZE OBJECT CODE POINTER TO
+         STA    CODEPT       ; BEGINNING OF ORJECT CODE
+         LDA    SONGA+1
+         STA    CODEPT+1
+
+         LDX    #0           ; INITIALIZE ALL 8 VOICES
+DEACT:   LDA    #0
+         STA    V1TBA+VXIN,X ; ZERO THE WAVE TABLE INCREMENT FOR SILENCE
+         STA    V1TBA+VXIN+1,X
+         LDA    #$FF         ; SET THE VOICE DURATION TO FF TO
+         STA    V1TBA+VXDUR,X; DEACTIVATE
+         LDA    WAVTBA+1     ; INITIALLY ASSIGN WAVEFORM 1 TO ALL VOICES
+         STA    V1TBA+VXPTW,X
+         TXA                 ; BUMP INDEX UP TO NEXT VOICE
+         CLC
+         ADC    #8
+         TAX
+         CMP    #64          ; TEST IF DONE
+         BNE    DEACT        ; LOOP UNTIL 8 VOICES DONE
+         LDA    #8           ; SET NUMBER OF VOICES TO 8
+         JSR    SETNV
+         JMP    PCC          ; START INTERPRETING
+
+;        PLAY THE NOTES SET UP BY THE CODE SEGMENT INTERPRETER
+;        FIRST MERGE THE Y INDEX INTO THE CODE POINTER SO THAT IT POINTS
+;        TO THE NEXT CODE SEGMENT AFTER THE NOTES ARE PLAYED.
+;        NEXT SCAN THE DURATION FIELDS OF THE 8 VOICES TO FIND THE
+;        SHORTEST.  FINALLY, PLAY THE NOTES FOR THE SHORTEST DURATION AND
+;        GO BACK TO THE CODE SEGMENT INTERPRETER WHEN DONE.  THE SHORTEST
+;        DURATION IS SUBTRACTED FROM EACH VOICE WHEN THE NEXT CODE
+;        SEGMENT IS INTERPRETED.
+
+;        THIS CODE IS PLACED AHEAD OF THE INTERPRETER SO THAT THE SOUND
+;        GENERATE LOOP DOES NOT CROSS A PAGE BOUNDARY, WHICH WOULD ADD A
+;        STATE TO EVERY TAKEN BRANCH.
+
+PLAY:    TYA                 ; UPDATE THE CODE POINTER IN MEMORY BY
+         CLC                 ; ADDING THE Y INDEX TO IT
+         ADC    CODEPT
+         STA    CODEPT
+         BCC    PLAY1        ; INCREMENT UPPER BYTE IF CARRY FROM LOW
+         INC    CODEPT+1     ; BYTE
+
+;        SCAN THE DURATION FIELDS OF ALL OF THE VOICES TO FIND THE
+;        SHORTEST
+
+PLAY1:   LDA    #$FF         ; INITIALIZE SHORTEST DURATION
+         STA    DUR
+         LDX    #56          ; START WITH VOICE 8
+PLAY2:   LDA    V1TBA+VXDUR,X; TEST VOICE DURATION
+         CMP    DUR
+         BCS    PLAY3        ; SKIP IF NOT LESS THAN CURRENT MIN
+         STA    DUR
+PLAY3:   TXA                 ; BUMP THE POINTER DOWN TO THE PREVIOUS
+         SEC                 ; VOICE
+         SBC    #8
+         TAX
+         BPL    PLAY2        ; LOOP UNTIL VOICE 1 DONE
+         LDA    DUR          ; SHORTEST DURATION = PLAY DURATION
+         STA    DURC         ; SET DURATION COUNTER FOR SOUND GENERATE
+
+;        8 VOICE SOUND GENERATE ROUTINE
+;        ENTER WITH VARIOUS TABLE POINTERS ALREADY SET UP
+;        LOOPS TEMPO*DUR TIMES
+;        TOTAL LOOP TIME = 228 STATES = 4386 HZ
+
+SOUND:   LDY    #0           ; SET Y TO ZERO FOR STRAIGHT INDIRECT
+         LDX    TEMPO        ; SET X TO TEMPO COUNT
+                             ; COMPUTE AND OUTPUT A COMPOSITE SAMPLE
+SOUND1:  CLC                 ; CLEAR CARRY
+         LDA    (V1TBA+VXPTI),Y ; ADD UP 8 VOICE SAMPLES USING
+ADV2:    ADC    (V2TBA+VXPTI),Y ; INDIRECT ADDRESSING THROUGH VOICE
+ADV3:    ADC    (V3TBA+VXPTI),Y ; POINTERS INTO WAVEFORM TABLES
+ADV4:    ADC    (V4TBA+VXPTI),Y ; STRAIGHT INDIRECT WHEN Y INDEX = 0
+ADV5:    ADC    (V5TBA+VXPTI),Y
+ADV6:    ADC    (V6TBA+VXPTI),Y
+ADV7:    ADC    (V7TBA+VXPTI),Y
+ADV8:    ADC    (V8TBA+VXPTI),Y
+         STA    DAC             ; SEND SUM TO DIGITAL-TO-ANALOG CONVERTER
+         LDA    V1TBA+VXPTF  ; ADD INCREMENTS TO POINTERS FOR
+         ADC    V1TBA+VXIN+1 ; THE 8 VOICES
+         STA    V1TBA+VXPTF  ; FIRST FRACTIONAL PART
+         LDA    V1TBA+VXPTI
+         ADC    V1TBA+VXIN
+         STA    V1TBA+VXPTI  ; THEN INTEGER PART
+         LDA    V2TBA+VXPTF  ; DO THE SAME FOR VOICE 2
+         ADC    V2TBA+VXIN+1
+         STA    V2TBA+VXPTF
+         LDA    V2TBA+VXPTI
+         ADC    V2TBA+VXIN
+         STA    V2TBA+VXPTI
+         LDA    V3TBA+VXPTF  ; VOICE 3
+         ADC    V3TBA+VXIN+1
+         STA    V3TBA+VXPTF
+         LDA    V3TBA+VXPTI
+         ADC    V3TBA+VXIN
+         STA    V3TBA+VXPTI
+         LDA    V4TBA+VXPTF  ; VOICE 4
+         ADC    V4TBA+VXIN+1
+         STA    V4TBA+VXPTF
+         LDA    V4TBA+VXPTI
+         ADC    V4TBA+VXIN
+         STA    V4TBA+VXPTI
+         LDA    V5TBA+VXPTF  ; VOICE 5
+         ADC    V5TBA+VXIN+1
+         STA    V5TBA+VXPTF
+         LDA    V5TBA+VXPTI
+         ADC    V5TBA+VXIN
+         STA    V5TBA+VXPTI
+         LDA    V6TBA+VXPTF  ; VOICE 6
+         ADC    V6TBA+VXIN+1
+         STA    V6TBA+VXPTF
+         LDA    V6TBA+VXPTI
+         ADC    V6TBA+VXIN
+         STA    V6TBA+VXPTI
+         LDA    V7TBA+VXPTF  ; VOICE 7
+         ADC    V7TBA+VXIN+1
+         STA    V7TBA+VXPTF
+         LDA    V7TBA+VXPTI
+         ADC    V7TBA+VXIN
+         STA    V7TBA+VXPTI
+         LDA    V8TBA+VXPTF  ; VOICE 8
+         ADC    V8TBA+VXIN+1
+         STA    V8TBA+VXPTF
+         LDA    V8TBA+VXPTI
+         ADC    V8TBA+VXIN
+         STA    V8TBA+VXPTI
+         DEX                 ; DECREMENT & CHECK TEMPO COUNT
+         BNE    TIMWAS       ; BRANCH TO TIME WASTE IF NOT RUN OUT
+         DEC    DURC         ; DECREMENT & CHECK DURATION COUNTER
+         BEQ    JPCC         ; JUMP OUT IF END OF NOTE
+         LDX    TEMPO        ; RESTORE TEMPO COUNT
+         BNE    TMWS4        ; 3 WASTE 24 STATES AND CONTINUE PLAYING
+TIMWAS:  BNE    TMWS1        ; 3 WASTE 33 STATES
+TMWS1:   BNE    TMWS2        ; 3
+TMWS2:   BNE    TMWS3        ; 3
+TMWS3:   BNE    TMWS4        ; 3
+TMWS4:   BNE    TMWS5        ; 3
+TMWS5:   BNE    TMWS6        ; 3
+TMWS6:   BNE    TMWS7        ; 3
+TMWS7:   BNE    TMWS8        ; 3
+TMWS8:   BNE    TMWS9        ; 3
+TMWS9:   BNE    TMWS10       ; 3
+TMWS10:  JMP    SOUND1       ; 3 CONTINUE PLAYING (TOO FAR FOR A BRANCH)
+
+JPCC:    JMP    PCC          ; GO BACK TO INTERPRETER
+
+         .assert >SOUND1 = >TMWS10, error, "Sound generate loop crosses a page"
+
+;        INTERPRET CODE SEGMENTS UNTIL ALL ACTIVE, UNEXPIRED VOICES HAVE
+;        BEEN SATISFIED AND THEN GO TO THE SOUND GENERATION ROUTINE
+
+;        INITIALLY A "PURE CONTROL COMMAND" IS EXPECTED
+
+PCC:     LDY    #0           ; INITIALIZE INDEX Y TO POINT TO FIRST BYTE
+                             ; OF CODE SEGMENT
+PCC1:    LDA    (CODEPT),Y   ; GET FIRST BYTE OF CODE SEGMENT
+         BIT    CTLM         ; TEST IF LOW HEX DIGIT IS ZERO
+         BEQ    PCC2
+         JMP    NOTE         ; JUMP IF NOT, IT IS A SHORT NOTE COMMAND
+PCC2:    LSR A               ; PERFORM A VECTOR JUMP ON THE HIGH HEX
+         LSR A               ; DIGIT
+         LSR A
+         TAX
+         LDA    JTAB,X
+         STA    JADDR
+         LDA    JTAB+1,X
+         STA    JADDR+1
+         JMP    (JADDR)
+
+;        PROCESS TEMPO CHANGE COMMAND
+
+PCC10:   INY                 ; GET NEXT BYTE FROM CODE STRING
+         LDA    (CODEPT),Y
+         STA    TEMPO        ; UPDATE THE TEMPO
+         INY
+         JMP    PCC1         ; GO FOR NEXT COMMAND
+
+;        PROCESS MUSICAL SUBROUTINE CALL
+
+PCC20:   LDA    CODEPT       ; SAVE CURRENT VALUE OF OBJECT CODE POINTER
+         PHA                 ; ON THE STACK
+         LDA    CODEPT+1
+         PHA                 ; AND PROCESS THE NEXT 2 BYTES AS AN
+         TYA                 ; UNCONDITIONAL JUMP
+         PHA
+
+;        PROCESS AN UNCONDITIONAL JUMP
+
+PCC40:   INY                 ; GET NEXT TWO BYTES FROM THE CODE STRING
+         LDA    (CODEPT),Y
+         CLC                 ; AND ADD THEM TO THE CODE STRING ORIGIN
+         ADC    SONGA        ; FOR RELATIVE ADDRESSING WITHIN OBJECT
+         TAX                 ; CODE
+         INY
+         LDA    (CODEPT),Y
+         ADC    SONGA+1
+         STA    CODEPT+1     ; STORE THEM IN THE CODE STRING POINTER
+         STX    CODEPT
+         LDY    #0           ; ZERO THE INDEX FACTOR
+         JMP    PCC1         ; GO FOR NEXT COMMAND
+
+;        PROCESS A RETURN FROM MUSICAL SUBROUTINE
+
+PCC30:   PLA                 ; POP THE SAVED CODE POINTER FROM THE STACK
+         TAY
+         PLA
+         STA    CODEPT+1
+         PLA
+         STA    CODEPT
+         INY                 ; INCREMENT THE SAVED INDEX FACTOR BY 3
+         INY
+         INY
+         JMP    PCC1         ; AND GO FOR THE NEXT COMMAND
+
+;        NOTE COMMANDS ARE EXPECTED HERE.  SCAN THROUGH THE VOICES IN
+;        SEQUENCE SKIPPING ANY INACTIVE ONES.  IF VXDUR IS ZERO, FETCH A
+;        COMMAND FROM THE CODE STRING WHICH IS EXPECTED TO BE A NOTE
+;        COMMAND AND INTERPRET IT ASSIGNING THE RESULTS TO THE CURRENT
+;        VOICE.  WHEN ALL VOICES HAVE BEEN PROCESSED, GO PLAY THE NOTES.
+
+NOTE:    LDX   #0           ; INITIALIZE CURRENT VOICE POINTER
+NOTE1:   LDA   V1TBA+VXDUR,X; GET DURATION BYTE OF CURRENT VOICE
+         BEQ   NOTE2        ; JUMP IF NEWLY ACTIVATED
+         CMP   #$FF
+         BEQ   NOTE9        ; SKIP THIS VOICE IF INACTIVE
+         SEC                ; SUBTRACT PREVIOUS DURATION
+         SBC   DUR
+         STA   V1TBA+VXDUR,X; STORE RESULT BACK
+         BNE   NOTE9        ; SKIP THIS VOICE IF UNEXPIRED
+NOTE2:   LDA   (CODEPT),Y   ; GET A COMMAND BYTE
+         STA   CMSAVE       ; SAVE THE COMMAND BYTE
+         AND   #$0F         ; ISOLATE THE DURATION FIELD AND
+         BEQ   LNOTE        ; JUMP OUT IF NOT A SHORT NOTE COMMAND
+         STY   YSAVE        ; SAVE Y
+         TAY                ; GET DURATION VALUE CORRESPONDING TO
+         LDA   DURTAB-1,Y   ; CONTENTS OF DURATION FIELD AND
+         STA   V1TBA+VXDUR,X; PUT INTO DURATION BYTE OF CURRENT VOICE
+         LDA   CMSAVE       ; GET THE COMMAND BYTE BACK
+         AND   #$F0         ; ISOLATE THE PITCH DISPLACEMENT
+         CLC                ; CONVERT TWO'S COMPLEMENT TO EXCESS 8
+         ADC   #$80
+         BEQ   NOTE3        ; SKIP AHEAD IF -8 = REST
+         LSR A              ; RIGHT JUSTIFY THE PITCH DISPLACEMENT
+         LSR A              ; TIMES TWO
+         LSR A
+         ADC   V1TBA+VXNOT,X; ADD RESULT TO CURRENT PITCH BYTE
+         CLC
+         ADC   #<(-16)      ; SUBTRACT OUT THE EXCESS 8 OFFSET
+         STA   V1TBA+VXNOT,X; UPDATE THE CURRENT PITCH BYTE
+NOTE3:   TAY                ; LOOKUP IN THE FREQUENCY TABLE FOR
+         LDA   FRQTAB,Y     ; CORRESPONDING FREQUENCY PARAMETER
+         STA   V1TBA+VXIN,X ; AND PUT IT IN THE WAVE TABLE POINTER
+         LDA   FRQTAB+1,Y   ; INCREMENT FIELD OF THE CURRENT VOICE
+         STA   V1TBA+VXIN+1,X
+         LDY   YSAVE        ; RESTORE SAVED Y
+         INY                ; INCREMENT Y TO POINT TO THE NEXT CODE
+                            ; STRING ELEMENT
+NOTE9:   CPX   #56          ; TEST IF ALL VOICES HAVE BEEN SCANNED
+         BNE   NOTE10       ; CONTINUE IF NOT
+         JMP   PLAY         ; GO PLAY THE NOTES IF SO
+NOTE10:  TXA                ; BUMP THE POINTER TO THE NEXT VOICE
+         CLC
+         ADC   #8
+         TAX
+         JMP   NOTE1        ; GO PROCESS THE NEXT VOICE
+
+;        PROCESS LONG NOTE COMMANDS
+
+LNOTE:   LDA   CMSAVE       ; GET FIRST BYTE OF CODE SEGMENT BACK
+         AND   #$F0         ; ISOLATE PITCH FIELD
+         CMP   #$60         ; TEST IF LONG NOTE WITH ABSOLUTE PITCH
+         BEQ   PCC60        ; GO PROCESS IT IF SO
+         CMP   #$70         ; TEST IF LONG NOTE WITH RELATIVE PITCH
+         BEQ   PCC70        ; GO PROCESS IT IF SO
+         JMP   PCC          ; GO PROCESS PURE CONTROL COMMAND
+
+;        PROCESS ABSOLUTE PITCH BYTE
+
+PCC60:   INY                 ; GET PITCH FROM NEXT BYTE
+         LDA    (CODEPT),Y
+         STA    V1TBA+VXNOT,X; PUT IT IN THE FREQUENCY TABLE
+         JMP    LNOTE3       ; DISPLACEMENT BYTE OF THE CURRENT VOICE
+
+;        PROCESS RELATIVE PITCH BYTE
+
+PCC70:   INY                 ; GET PITCH FROM NEXT BYTE
+         LDA    (CODEPT),Y
+         CLC                 ; ADD TO THE FREQUENCY TABLE DISPLACEMENT
+         ADC    V1TBA+VXNOT,X; BYTE OF THE CURRENT VOICE
+         STA    V1TBA+VXNOT,X; UPDATE THE FREQUENCY TABLE DISPLACEMENT
+
+;        GET CORRESPONDING FREQUENCY PARAMETER FROM THE NOTE FREQUENCY
+;        TABLE.
+
+LNOTE3:  STY    YSAVE        ; SAVE INDEX Y TEMPORARILY
+         TAY                 ; LOOKUP IN FREQUENCY TABLE THE DOUBLE
+         LDA    FRQTAB,Y     ; PRECISION FREQUENCY PARAMETER AND MOVE
+         STA    V1TBA+VXIN,X ; IT TO VXIN
+         LDA    FRQTAB+1,Y
+         STA    V1TBA+VXIN+1,X
+         LDY    YSAVE        ; RESTORE INDEX Y
+
+;        PROCESS WAVEFORM FIELD
+
+         INY                 ; GET WAVEFORM TABLE NUMBER FROM NEXT BYTE
+         LDA    (CODEPT),Y
+         LSR A               ; POSITION IT CORRECTLY
+         LSR A
+         LSR A
+         LSR A
+         CLC
+         ADC    WAVTBA+1     ; ADD TO PAGE NUMBER OF WAVEFORM ZERO
+         STA    V1TBA+VXPTW,X; STORE IN WAVEFORM TABLE PAGE NUMBER
+                             ; BYTE OF THE CURRENT VOICE
+
+;        PROCESS DURATION FIELD
+
+         LDA    (CODEPT),Y   ; GET THE SECOND BYTE BACK
+         AND    #$0F         ; ISOLATE THE DURATION DIGIT
+         STY    YSAVE        ; SAVE Y AGAIN
+         TAY
+         LDA    DURTAB-1,Y   ; GET THE CORRESPONDING DURATION BYTE
+         STA    V1TBA+VXDUR,X; STORE IT IN THE DURATION BYTE OF THE
+                             ; SPECIFIED VOICE
+         LDY    YSAVE        ; RESTORE Y
+         INY                 ; UPDATE CODE POINTER
+         JMP    NOTE9        ; GO UPDATE VOICE POINTER
+
+;        THE LESS FREQUENTLY USED CONTROL COMMANDS DO NOT FIT IN PAGES 2
+;        AND 3 ALONG WITH THE 8 VOICE SOUND GENERATE ROUTINE, SO THEY ARE
+;        PUT AT THE BOTTOM OF PAGE 1, WITH THEIR JUMP TABLE.  THEY ARE
+;        LIMITED TO 128 BYTES SO AT LEAST AS MUCH IS LEFT FOR THE STACK,
+;        ENOUGH FOR MUSICAL SUBROUTINES NESTED 42 DEEP.
+
+         .segment "PAGE1"    ; PUT THEM AT 100
+
+;        PROCESS A SET NUMBER OF VOICES COMMAND
+
+PCC50:   INY                 ; GET SPECIFIED NUMBER OF VOICES
+         LDA    (CODEPT),Y   ; FROM NEXT CODE BYTE
+         JSR    SETNV        ; DO INSTRUCTION MODIFICATION IN SOUND
+                             ; GENERATE ROUTINE TO SET THE NUMBER OF
+         INY                 ; VOICES
+         JMP    PCC1         ; GO FOR NEXT COMMAND
+
+;        PROCESS A DEACTIVATE VOICE COMMAND
+
+PCC80:   INY                 ; GET SPECIFIED VOICE NUMBER TIMES 8
+         LDA    (CODEPT),Y
+         AND    #$07         ; RESTRICT RANGE TO 0 - 7
+         ASL A
+         ASL A
+         ASL A
+         TAX                 ; PUT IT INTO X
+         LDA    #$FF         ; SET THE DURATION BYTE IN THE SPECIFIED
+         STA    V1TBA+VXDUR,X; VOICE TO FF TO DEACTIVATE IT
+         LDA    #0           ; ZERO THE WAVE TABLE INCREMENT FOR SILENCE
+         STA    V1TBA+VXIN,X
+         STA    V1TBA+VXIN+1,X
+         INY                 ; INCREMENT THE CODE STRING POINTER
+         JMP    PCC1         ; GO FOR NEXT COMMAND
+
+;        PROCESS AN ACTIVATE VOICE COMMAND
+
+PCC90:   INY                 ; COMPUTE SPECIFIED VOICE NUMBER TIMES 8
+         LDA    (CODEPT),Y
+         AND    #$07
+         ASL A
+         ASL A
+         ASL A
+         TAX                 ; PUT IT INTO INDEX X
+         LDA    #0           ; SET THE DURATION BYTE IN THE SPECIFIED
+         STA    V1TBA+VXDUR,X; VOICE TO 0 TO ACTIVATE IT
+         INY                 ; INCREMENT THE CODE STRING POINTER
+         JMP    PCC1         ; GO FOR NEXT COMMAND
+
+;        SET NUMBER OF VOICES SUBROUTINE
+;        THIS ROUTINE MODIFIES INSTRUCTIONS IN THE SOUND GENERATE
+;        ROUTINE TO CONTROL THE NUMBER OF VOICES INCLUDED IN THE SAMPLE
+;        CALCULATION, ENTER WITH NUMBER OF VOICES TO INCLUDE IN A,
+;        RANGE IS 1 TO 8.  0 IS INTERPRETED AS 1.  USES INDEX X
+
+SETNV:   STA    NVCNT        ; SAVE NUMBER OF VOICES TO INCLUDE
+         LDX    #0           ; X = OFFSET OF OPERAND FROM ADV2+1
+         LDA    #V2TBA+VXPTI ; A = POINTER FOR VOICE 2
+SETNV1:  DEC    NVCNT        ; COUNT THE VOICE, SKIP TO ELIMINATE THE
+         BEQ    SETNV2       ; REST IF NO MORE TO INCLUDE
+         BMI    SETNV2
+         STA    ADV2+1,X     ; INCLUDE THIS VOICE
+         CLC                 ; BUMP POINTER TO THE NEXT VOICE TABLE AREA
+         ADC    #8
+         INX                 ; AND OFFSET TO THE NEXT ADC INSTRUCTION
+         INX
+         CPX    #14          ; TEST IF ALL 7 INSTRUCTIONS DONE
+         BNE    SETNV1
+         RTS
+SETNV2:  LDA    #NULSMP      ; ELIMINATE THE REMAINING VOICES
+SETNV3:  STA    ADV2+1,X
+         INX
+         INX
+         CPX    #14
+         BNE    SETNV3
+         RTS
+
+;        JUMP TABLE FOR INTERPRETING PURE CONTROL COMMANDS
+
+JTAB:    .WORD  KIMMON       ; 00 RETURN TO KIM MONITOR
+         .WORD  PCC10        ; 10 TEMPO SET
+         .WORD  PCC20        ; 20 MUSICAL SUBROUTINE CALL
+         .WORD  PCC30        ; 30 RETURN FROM MUSICAL SUBROUTINE
+         .WORD  PCC40        ; 40 UNCONDITIONAL JUMP
+         .WORD  PCC50        ; 50 SET NUMBER OF VOICES
+         .WORD  NOTE         ; 60 LONG NOTE WITH ABSOLUTE PITCH
+         .WORD  NOTE         ; 70 LONG NOTE WITH RELATIVE PITCH
+         .WORD  PCC80        ; 80 DEACTIVATE VOICE
+         .WORD  PCC90        ; 90 ACTIVATE VOICE
+         .WORD  KIMMON       ; A0 UNDEFINED
+         .WORD  KIMMON       ; B0 UNDEFINED
+         .WORD  KIMMON       ; C0 UNDEFINED
+         .WORD  KIMMON       ; D0 UNDEFINED
+         .WORD  KIMMON       ; E0 UNDEFINED
+         .WORD  KIMMON       ; F0 UNDEFINED
+
+         .END
@@ -0,0 +1,203 @@
+; K-1002 Interrupt Driven PCM Playback Example
+; Plays PCM data at 1MHz / PCM_CYCLES Hz with 1MHz system clock, output by
+; the interval timer interrupt
+;
+; (C) 2025 Eduardo Casino
+;
+; pcmplay spends most of every sample period in a busy wait. Here the
+; interval timer of the 6530-003 interrupts every PCM_CYCLES cycles and the
+; handler outputs the next sample of a one page ring buffer, so that the
+; foreground only has to keep the ring filled and is free the rest of the
+; time. In this example it just copies the samples into the ring; decoding,
+; streaming or mixing would take the place of the copy.
+;
+; The timer is one shot: it interrupts when its count gets to zero and then
+; goes on counting down, at one per cycle in the divide by 1 mode. The
+; handler reads the count, which tells how long ago the timer ran out, and
+; writes the next interval from it, so that the next time out comes exactly
+; PCM_CYCLES cycles after the last one, whatever the delay in answering the
+; interrupt. The rate is then exact by construction, and only the moment
+; of each sample moves, by the cycles left of the foreground instruction
+; being run when the interrupt comes. The difference between the value
+; written to the timer and the count read from it is measured at start up,
+; so it need not be known beforehand.
+;
+; The timer interrupt comes out on PB7 of the 6530-003, which must be wired
+; to the IRQ line of the expansion connector. The IRQ vector at $17FE is
+; set while playing and restored at the end.
+;
+; Assemble with -D PCM_CYCLES=n to select the sample period in CPU cycles.
+; The makefile builds the player for the same rates as pcmplay except 16000
+; Hz, as the handler and the copy take 88 cycles per sample between them.
+; The sample data is the same as for pcmplay, read from wav/pcm_<n>.inc.
+;
+
+            .ifndef PCM_CYCLES
+PCM_CYCLES  = 125
+            .endif
+
+IRQ_CYCLES  = 60                    ; Interrupt handler, with the interrupt
+                                    ; and the jump through IRQVEC
+FILL_CYCLES = 28                    ; Copy of a sample into the ring
+
+            .if PCM_CYCLES < IRQ_CYCLES + FILL_CYCLES + 1 .or PCM_CYCLES > 255
+            .error  "PCM_CYCLES must be between 89 and 255"
+            .endif
+
+DAC         = $1700                 ; DAC output port
+DACDIR      = $1701                 ; DAC direction register
+PBDIR       = $1703                 ; Port B direction register, for PB7
+TIMER       = $1704                 ; Write: divide by 1, no interrupt
+TIMERI      = $170C                 ; Write: divide by 1, interrupt
+TIMRD       = $1706                 ; Read: count, no interrupt
+TIMRDI      = $170E                 ; Read: count, interrupt
+IRQVEC      = $17FE                 ; IRQ vector of the KIM-1 monitor
+KIMMON      = $1C22                 ; Entry point to KIM keyboard monitor
+
+RELOAD      = 9                     ; Cycles from the read of the count to
+                                    ; the write of the interval in irq
+
+            .include .sprintf("wav/pcm_%d.inc", PCM_CYCLES)
+
+            .assert <PCM_TABLE = 0, error, "PCM data must be page aligned"
+            .assert <TABLE_SIZE = 0, error, "PCM data must be a whole number of pages"
+
+            .zeropage
+
+; Zero page temporary variables
+;
+PCMPTR:     .res    2               ; Pointer to current page of samples
+PAGES:      .res    1               ; Page counter
+HEAD:       .res    1               ; Next free place of the ring
+TAIL:       .res    1               ; Next sample to output
+ADJUST:     .res    1               ; Added to the count to get the interval
+XSAVE:      .res    1               ; X of the interrupted code
+OLDVEC:     .res    2               ; IRQ vector of the monitor
+
+            .segment "RING"
+
+RING:       .res    256             ; Page aligned, so indexes wrap by themselves
+
+            .data
+
+PCMTBL:     .word   PCM_TABLE       ; Pointer to PCM sample table
+TBLSIZ:     .word   TABLE_SIZE      ; Size of table in bytes
+
+            .code
+
+            ; Initialize DAC port as output and PB7 as input, which leaves
+            ; it to the timer interrupt
+            ;
+            lda     #$FF
+            sta     DACDIR
+            lda     PBDIR
+            and     #$7F
+            sta     PBDIR
+
+            cld
+
+            ; Load table pointer and size in pages, as pcmplay
+            ;
+            lda     PCMTBL
+            sta     PCMPTR
+            lda     PCMTBL+1
+            sta     PCMPTR+1
+            lda     TBLSIZ+1
+            sta     PAGES
+            bne     not_empty
+            jmp     KIMMON          ; Nothing to play
+
+            ; Measure the count right after a write, 4 cycles later, and
+            ; work out ADJUST = PCM_CYCLES - RELOAD minus the cycles that
+            ; the count is behind the value written. See irq
+            ;
+not_empty:  lda     #$FF
+            sta     TIMER
+            lda     TIMRD           ; $FF - 4 if the count is not behind
+            eor     #$FF
+            clc
+            adc     #<(PCM_CYCLES - RELOAD - 4)
+            sta     ADJUST
+
+            ; Take the IRQ vector
+            ;
+            lda     IRQVEC
+            sta     OLDVEC
+            lda     IRQVEC+1
+            sta     OLDVEC+1
+            lda     #<irq
+            sta     IRQVEC
+            lda     #>irq
+            sta     IRQVEC+1
+
+            ; Empty ring, with the first sample output a whole period after
+            ; the timer is started. By then the foreground is well ahead.
+            ;
+            ldy     #0
+            sty     HEAD
+            sty     TAIL
+            lda     #PCM_CYCLES
+            sta     TIMERI
+            cli
+
+;---------------------------------------------------------------------------------
+; Foreground - FILL_CYCLES cycles per sample if the ring is not full
+;
+; The ring is full with 255 samples, when HEAD + 1 = TAIL. The handler
+; does not check for an empty ring, so the foreground must keep ahead of it,
+; as it does here, taking less than PCM_CYCLES - IRQ_CYCLES per sample.
+;---------------------------------------------------------------------------------
+fill:       lda     (PCMPTR),Y      ; 5 cycles
+            ldx     HEAD            ; 3 cycles
+            sta     RING,X          ; 5 cycles
+            inx                     ; 2 cycles
+wait:       cpx     TAIL            ; 3 cycles
+            beq     wait            ; 2 cycles (not taken)
+                                    ; 3 cycles (taken while full)
+            stx     HEAD            ; 3 cycles
+            iny                     ; 2 cycles
+            bne     fill            ; 3 cycles
+            inc     PCMPTR+1
+            dec     PAGES
+            bne     fill
+
+            ; Wait for the ring to empty and stop the timer interrupt
+            ;
+drain:      lda     TAIL
+            cmp     HEAD
+            bne     drain
+            sei
+            sta     TIMER           ; Clears the interrupt too
+            lda     OLDVEC
+            sta     IRQVEC
+            lda     OLDVEC+1
+            sta     IRQVEC+1
+            cli
+            jmp     KIMMON
+
+;---------------------------------------------------------------------------------
+; Timer interrupt handler - IRQ_CYCLES cycles, with the 7 of the interrupt
+; and the 5 of the JMP ($17FE) of the monitor ROM that leads here
+;
+; The sample is output at the same point of every call. The count has
+; gone on from zero, so it is minus the cycles since the time out, and the
+; next time out must come PCM_CYCLES - RELOAD cycles minus those after the
+; write of the interval: the count plus PCM_CYCLES - RELOAD, less the cycles
+; that the count is behind the value written. Start up leaves that sum in
+; ADJUST.
+;---------------------------------------------------------------------------------
+irq:        pha                     ; 3 cycles
+            stx     XSAVE           ; 3 cycles
+            ldx     TAIL            ; 3 cycles
+            lda     RING,X          ; 4 cycles
+            sta     DAC             ; 4 cycles - Output the sample
+            inc     TAIL            ; 5 cycles
+            lda     TIMRDI          ; 4 cycles - Count, read on the last one
+            clc                     ; 2 cycles
+            adc     ADJUST          ; 3 cycles
+            sta     TIMERI          ; 4 cycles - Interval, written on the last one
+            ldx     XSAVE           ; 3 cycles
+            pla                     ; 4 cycles
+            rti                     ; 6 cycles
+
+            .end
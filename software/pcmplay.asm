@@ -1,21 +1,45 @@
 ; K-1002 PCM Playback Example
-; Plays PCM data at 8000 Hz with 1MHz system clock
+; Plays PCM data at 1MHz / PCM_CYCLES Hz with 1MHz system clock
 ;
 ; (C) 2025 Eduardo Casino
 ;
+; Assemble with -D PCM_CYCLES=n to select the sample period in CPU cycles.
+; The makefile builds the player for several rates:
+;
+;   PCM_CYCLES = 181    5525 Hz (5512)
+;   PCM_CYCLES = 125    8000 Hz
+;   PCM_CYCLES =  91   10989 Hz (11025)
+;   PCM_CYCLES =  63   15873 Hz (16000)
+;
+; The sample data is read from wav/pcm_<PCM_CYCLES>.inc, which pcmconv
+; generates already resampled to the exact rate and padded to whole pages.
+;
+
+            .include "delay.inc"
+
+            .ifndef PCM_CYCLES
+PCM_CYCLES  = 125
+            .endif
+
+            .if PCM_CYCLES < 29 .or PCM_CYCLES = 30
+            .error  "PCM_CYCLES must be 29 or 31 and above"
+            .endif
 
 DAC         = $1700                 ; DAC output port
 DACDIR      = $1701                 ; DAC direction register
 KIMMON      = $1C22                 ; Entry point to KIM keyboard monitor
 
-            .include "wav/pcmdata.inc"
+            .include .sprintf("wav/pcm_%d.inc", PCM_CYCLES)
+
+            .assert <PCM_TABLE = 0, error, "PCM data must be page aligned"
+            .assert <TABLE_SIZE = 0, error, "PCM data must be a whole number of pages"
 
             .zeropage
 
 ; Zero page temporary variables
 ;
-PCMPTR:     .res    2               ; Current sample pointer
-COUNTER:    .res    2               ; Sample counter
+PCMPTR:     .res    2               ; Pointer to current page of samples
+PAGES:      .res    1               ; Page counter
 
             .data
 
@@ -31,90 +55,56 @@ TBLSIZ:     .word   TABLE_SIZE      ; Size of table in bytes
 
             cld
 
-            ; Load table pointer into zero page
+            ; Load table pointer into zero page. The low byte is always
+            ; zero, the sample index within the page is kept in Y
             ;
             lda     PCMTBL
             sta     PCMPTR
             lda     PCMTBL+1
             sta     PCMPTR+1
-        
-            ; Load table size into counter
+
+            ; Load table size in pages into counter
             ;
-            lda     TBLSIZ
-            sta     COUNTER
             lda     TBLSIZ+1
-            sta     COUNTER+1
-        
+            sta     PAGES
+
             ; Check if table is empty
             ;
-            ora     COUNTER         ; OR high and low bytes
             beq     pcm_done        ; Exit if zero
 
+            ldy     #0
+
 ;---------------------------------------------------------------------------------
-; Main playback loop - 125 cycles per iteration, or 8000 Hz with 1MHz system clock
+; Main playback loop - PCM_CYCLES cycles per iteration
 ;
-; NOTE: This code ensures that each loop iteration takes exactly 125 cycles
+; NOTE: Both paths take exactly PCM_CYCLES cycles. As the table is page
+;       aligned, (PCMPTR),Y never crosses a page and always takes 5 cycles
 ;---------------------------------------------------------------------------------
 pcm_loop:
-            ; Load and output sample (11 cycles)
+            ; Load and output sample (9 cycles)
             ;
-            ldy     #0              ; 2 cycles
             lda     (PCMPTR),Y      ; 5 cycles - Read sample from table
             sta     DAC             ; 4 cycles - Output to DAC
-        
-            ; Increment pointer with cycle balancing:
-            ;
-            ; Path A (no carry):    5 + 3 + 2 + 2 + 3 = 15 cycles
-            ; Path B (carry):       5 + 2 + 5 + 3 = 15 cycles
+
+            ; Advance to next sample (4 cycles)
             ;
-            inc     PCMPTR          ; 5 cycles
-            bne     inc_no_carry    ; 3 cycles (branch taken)
-                                    ; 2 cycles (not taken)
-            
-            inc     PCMPTR+1        ; 5 cycles
-            jmp     dec_counter     ; 3 cycles
-inc_no_carry:
-            nop                     ; 2 cycles
-            nop                     ; 2 cycles
-            bit     PCMPTR          ; 3 cycles (just for matching 15 cycles, does nothing meaningful)
+            iny                     ; 2 cycles
+            beq     pcm_page        ; 2 cycles (not taken)
+                                    ; 3 cycles (taken at end of page)
 
-            ; Now, decrement counter with cycle balancing as well:
+            ; Path A (same page): 9 + 4 + delay + 3 = PCM_CYCLES
             ;
-            ; Path A (no borrow):   3 + 3 + 2 + 2 + 3 + 5 = 18 cycles
-            ; Path B (borrow):      3 + 2 + 5 + 3 + 5 = 18 cycles
-dec_counter:
-            lda     COUNTER         ; 3 cycles
-            bne     dec_no_borrow   ; 3 cycles (branch taken)
-                                    ; 2 cycles (not taken)
-            dec     COUNTER+1       ; 5 cycles
-            jmp     dec_cnt_low     ; 3 cycles
-dec_no_borrow:
-            nop                     ; 2 cycles
-            nop                     ; 2 cycles
-            bit     COUNTER         ; 3 cycles (just for matching 15 cycles, does nothing meaningful)
-dec_cnt_low:
-            dec     COUNTER         ; 5 cycles
-        
-            ; Check if done (8 cycles)
+            DELAY   PCM_CYCLES - 16
+            jmp     pcm_loop        ; 3 cycles - Continue loop
+
+            ; Path B (next page): 9 + 5 + 12 + delay + 3 = PCM_CYCLES
             ;
-            lda     COUNTER         ; 3 cycles
-            ora     COUNTER+1       ; 3 cycles
+pcm_page:
+            inc     PCMPTR+1        ; 5 cycles
+            dec     PAGES           ; 5 cycles
             beq     pcm_done        ; 2 cycles (not taken)
                                     ; 3 cycles (taken when done)
-        
-            ; Timing delay loop to reach 125 cycles total
-            ; Current: 11 (load) + 15 (inc) + 18 (dec) + 8 (check) = 52 cycles
-            ; Need: 125 - 52 = 73 cycles
-            ; Loop: NOP=2 + LDX=2 + (BIT=3 + DEX=2 + BNE=3)*N + BNE=2 + JMP=3
-            ; For N=8: 2 + 2 + 8*8 + 2 + 3 = 73 cycles
-            ;
-            nop                     ; 2 cycles
-            ldx     #8              ; 2 cycles
-pcm_delay:
-            bit     COUNTER         ; 3 cycles
-            dex                     ; 2 cycles
-            bne     pcm_delay       ; 3 cycles (branch taken)  8 * (3 + 2 + 3) = 64 cycles
-                                    ; 2 cycles (branch not taken)        
+            DELAY   PCM_CYCLES - 29
             jmp     pcm_loop        ; 3 cycles - Continue loop
 
 pcm_done:
@@ -0,0 +1,166 @@
+; K-1002 LZ Decompressor
+; Unpacks a memory image packed by pappack to its own addresses and starts
+; it
+;
+; (C) 2025 Eduardo Casino
+;
+; pappack joins the PAP files of a program into a single memory image and
+; packs every run of consecutive bytes of it with a byte aligned LZ code,
+; which takes a single table free loop per token to decode. The packed
+; stream is a list of tokens, each one a control byte and its operands:
+;
+;   Control    Operands    Meaning
+;   $00        8 bytes     End: see below
+;   $01-$7F    1-127       That many literal bytes follow
+;   $80        2 bytes     The next run of the image starts at that address
+;   $81-$BF    1 byte      Copy (C & $3F) + 1 bytes from 1-256 bytes back
+;   $C0-$FF    2 bytes     Copy (C & $3F) + 3 bytes from 1-65535 bytes back
+;
+; Distances are stored negated, so that adding them to the destination
+; gives the source of the copy. A copy may overlap the bytes it writes,
+; which repeats them.
+;
+; This code only uses branches, so it runs wherever it is loaded. pappack
+; places it in a free area of the image, with the packed stream right
+; after it and a PAP record that points SRC to the stream. Run it at the
+; address pappack reports. The six bytes of page 0 it uses, from $E0 to
+; $E5, are set at the end to their values in the image, which come in the
+; end token with the entry point of the program, minus one. The entry
+; point is pushed on the stack and reached with an RTS, which takes two
+; bytes of the stack.
+;
+; The work area is fixed, as pappack sets the stream pointer and takes
+; its bytes out of the image. Keep it in sync with UNLZ_ZP in pappack.c.
+;
+
+SRC         = $E0                   ; Next byte of the packed stream
+DST         = $E2                   ; Next byte of the image
+MSRC        = $E4                   ; Source of a copy
+
+            .code
+
+unlz:       cld
+            ldy     #0
+
+            ; One token per iteration, with Y = 0
+            ;
+next:       lda     (SRC),Y         ; Control byte
+            inc     SRC
+            bne     no_carry
+            inc     SRC+1
+no_carry:   tax
+            beq     finish          ; $00, end of the stream
+            bmi     not_literal
+
+            ; Literal bytes, X of them
+            ;
+lit_loop:   lda     (SRC),Y
+            sta     (DST),Y
+            iny
+            dex
+            bne     lit_loop
+            tya                     ; Skip them in the stream
+            clc
+            adc     SRC
+            sta     SRC
+            bcc     advance
+            inc     SRC+1
+            bcs     advance         ; Always
+
+not_literal:
+            cpx     #$80
+            beq     block           ; New run
+            and     #$3F
+            cpx     #$C0
+            bcs     long
+
+            ; Short copy: length in X, one byte of distance
+            ;
+            tax
+            inx
+            clc
+            lda     (SRC),Y
+            adc     DST
+            sta     MSRC
+            lda     DST+1
+            adc     #$FF
+            sta     MSRC+1
+            inc     SRC
+            bne     copy
+            inc     SRC+1
+            bne     copy            ; Always, the stream does not wrap
+
+            ; Long copy: length in X, two bytes of distance
+            ;
+long:       adc     #2              ; Carry is set, so 3 is added
+            tax
+            clc
+            lda     (SRC),Y
+            adc     DST
+            sta     MSRC
+            iny
+            lda     (SRC),Y
+            adc     DST+1
+            sta     MSRC+1
+            lda     #2
+            clc
+            adc     SRC
+            sta     SRC
+            bcc     copy_y
+            inc     SRC+1
+copy_y:     ldy     #0
+
+copy:       lda     (MSRC),Y
+            sta     (DST),Y
+            iny
+            dex
+            bne     copy
+
+            ; Move the destination past the Y bytes just written
+            ;
+advance:    tya
+            clc
+            adc     DST
+            sta     DST
+            bcc     adv_done
+            inc     DST+1
+adv_done:   ldy     #0
+            beq     next            ; Always
+
+            ; New run: its address is the new destination
+            ;
+block:      lda     (SRC),Y
+            sta     DST
+            iny
+            lda     (SRC),Y
+            sta     DST+1
+            lda     #2
+            clc
+            adc     SRC
+            sta     SRC
+            bcc     adv_done
+            inc     SRC+1
+            bcs     adv_done        ; Always
+
+            ; End: push the entry point, put the image bytes of the work
+            ; area in place, the pointer to them the last, and start it
+            ;
+finish:     ldy     #7
+            lda     (SRC),Y         ; Entry point - 1, high byte
+            pha
+            dey
+            lda     (SRC),Y
+            pha
+            dey
+rest_loop:  lda     (SRC),Y         ; $E5 down to $E2
+            sta     SRC,Y
+            dey
+            cpy     #2
+            bcs     rest_loop
+            lda     (SRC),Y         ; $E1
+            tax
+            dey
+            lda     (SRC),Y         ; $E0
+            sta     SRC
+            stx     SRC+1
+            rts
@@ -0,0 +1,284 @@
+/*
+ * k1002 - K-1002 score build and render front end
+ *
+ * Runs the NOTRAN compiler, the waveform table generator and the NOTRAN
+ * interpreter in a single process. The bytecode and the tables are handed
+ * from one to the next in memory, so a score and its waveform
+ * specifications become a WAV file in one pass, with no intermediate
+ * files.
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include "compiler.h"
+#include "wavetab.h"
+#include "synth.h"
+
+/* ============================================================================
+ * Type Definitions
+ * ============================================================================ */
+
+typedef struct {
+    const char *score_file;
+    const char *waves_file;
+    const char *output_file;
+    const char *listing_file;
+    int sample_rate;
+    uint32_t max_jumps;
+    int voices;
+} render_args_t;
+
+typedef struct {
+    const char *name;
+    int (*run)(int argc, char *argv[]);
+    const char *help;
+} command_t;
+
+/* ============================================================================
+ * Pipeline Stages
+ * ============================================================================ */
+
+static int compile_score(const render_args_t *args, notcmp_result_t *result) {
+    FILE *input = fopen(args->score_file, "r");
+    if (!input) {
+        fprintf(stderr, "Error: Cannot open score '%s'\n", args->score_file);
+        return -1;
+    }
+
+    FILE *listing = NULL;
+    if (args->listing_file) {
+        listing = fopen(args->listing_file, "w");
+        if (!listing) {
+            fprintf(stderr, "Error: Cannot create listing '%s'\n", args->listing_file);
+            fclose(input);
+            return -1;
+        }
+    }
+
+    /* The interpreter takes jump addresses as offsets into the code */
+    const notcmp_options_t opts = {
+        .num_voices = args->voices,
+        .base_address = 0,
+        .listing_file = listing
+    };
+    const int status = notcmp_compile(input, &opts, result);
+
+    fclose(input);
+    if (listing) {
+        fclose(listing);
+    }
+
+    if (status != 0) {
+        fprintf(stderr, "Error: Compilation of '%s' failed\n", args->score_file);
+        return -1;
+    }
+
+    printf("Compiled '%s': %d lines, %zu bytes\n", args->score_file,
+           result->lines, result->code_size);
+    return 0;
+}
+
+static uint8_t *generate_tables(const render_args_t *args, int *num_tables) {
+    waveform_list_t list;
+    wavetab_init_list(&list);
+
+    if (!wavetab_parse_yaml(args->waves_file, &list)) {
+        wavetab_free_list(&list);
+        return NULL;
+    }
+
+    uint8_t *tables = wavetab_generate_all(&list, num_tables);
+    wavetab_free_list(&list);
+
+    if (tables && *num_tables == 0) {
+        fprintf(stderr, "Error: No valid waveforms in '%s'\n", args->waves_file);
+        free(tables);
+        return NULL;
+    }
+
+    if (tables) {
+        printf("Generated %d wavetable%s from '%s'\n", *num_tables,
+               (*num_tables == 1) ? "" : "s", args->waves_file);
+    }
+    return tables;
+}
+
+static int render(const render_args_t *args) {
+    notcmp_result_t score;
+    if (compile_score(args, &score) != 0) {
+        return -1;
+    }
+
+    int num_tables;
+    uint8_t *table_data = generate_tables(args, &num_tables);
+    if (!table_data) {
+        notcmp_free(&score);
+        return -1;
+    }
+
+    int result = -1;
+    uint8_t **tables = synth_table_pointers(table_data, num_tables);
+    interpreter_state_t *state = calloc(1, sizeof(interpreter_state_t));
+
+    if (tables && state &&
+        synth_init(state, score.code, score.code_size, tables, num_tables,
+                   args->max_jumps, args->voices) == 0) {
+        wav_context_t *wav = wav_open(args->output_file, args->sample_rate);
+        if (wav) {
+            result = synth_run_notran(state, wav_sink, wav);
+            wav_close(wav);
+        }
+    }
+
+    free(state);
+    free(tables);
+    free(table_data);
+    notcmp_free(&score);
+    return result;
+}
+
+/* ============================================================================
+ * Commands
+ * ============================================================================ */
+
+static void print_render_usage(const char *program_name) {
+    printf("Usage: %s render [OPTIONS] -o <output.wav> <score.not> <waves.yaml>\n\n",
+           program_name);
+    printf("Compiles the score, generates the waveform tables and renders the\n");
+    printf("result with the NOTRAN interpreter, all in memory.\n\n");
+    printf("Options:\n");
+    printf("  -o, --output FILE   Output WAV file\n");
+    printf("  -l, --listing FILE  Write the compiler listing to FILE\n");
+    printf("  -r, --rate RATE     Sample rate in Hz (default: %d, or %d with 8 voices)\n",
+           SAMPLE_RATE_DEFAULT, SAMPLE_RATE_8V_DEFAULT);
+    printf("  -j, --jumps N       Maximum allowed jumps (default: unlimited)\n");
+    printf("  -v, --voices N      Compile and render for the 4 or 8 voice interpreter\n");
+    printf("                      (default: %d)\n", DEFAULT_VOICES);
+    printf("  -h, --help          Show this help\n");
+}
+
+static int cmd_render(int argc, char *argv[]) {
+    render_args_t args = {
+        .max_jumps = UINT32_MAX,
+        .voices = DEFAULT_VOICES
+    };
+
+    static struct option long_options[] = {
+        {"output",  required_argument, 0, 'o'},
+        {"listing", required_argument, 0, 'l'},
+        {"rate",    required_argument, 0, 'r'},
+        {"jumps",   required_argument, 0, 'j'},
+        {"voices",  required_argument, 0, 'v'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:l:r:j:v:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'o': args.output_file = optarg; break;
+            case 'l': args.listing_file = optarg; break;
+            case 'r':
+                args.sample_rate = atoi(optarg);
+                if (args.sample_rate < 1000 || args.sample_rate > 96000) {
+                    fprintf(stderr, "Error: Invalid sample rate\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'j':
+                args.max_jumps = strtoul(optarg, NULL, 10);
+                break;
+            case 'v':
+                args.voices = atoi(optarg);
+                if (args.voices != 4 && args.voices != 8) {
+                    fprintf(stderr, "Error: Number of voices must be 4 or 8\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'h':
+                print_render_usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                print_render_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind + 2 != argc || !args.output_file) {
+        print_render_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    args.score_file = argv[optind];
+    args.waves_file = argv[optind + 1];
+
+    if (args.sample_rate == 0) {
+        args.sample_rate = (args.voices == 8) ? SAMPLE_RATE_8V_DEFAULT
+                                              : SAMPLE_RATE_DEFAULT;
+    }
+
+    return (render(&args) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static const command_t COMMANDS[] = {
+    { "render", cmd_render, "Compile a score and render it to a WAV file" },
+};
+
+#define NUM_COMMANDS (sizeof(COMMANDS) / sizeof(COMMANDS[0]))
+
+static void print_usage(const char *program_name) {
+    printf("K-1002 score tools\n\n");
+    printf("Usage: %s <command> [OPTIONS] ...\n\n", program_name);
+    printf("Commands:\n");
+    for (size_t i = 0; i < NUM_COMMANDS; i++) {
+        printf("  %-10s %s\n", COMMANDS[i].name, COMMANDS[i].help);
+    }
+    printf("\nUse '%s <command> -h' for the options of each command.\n", program_name);
+}
+
+/* ============================================================================
+ * Main Entry Point
+ * ============================================================================ */
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < NUM_COMMANDS; i++) {
+        if (strcmp(argv[1], COMMANDS[i].name) == 0) {
+            /* Options are parsed from the command name on */
+            argv[1] = argv[0];
+            return COMMANDS[i].run(argc - 1, argv + 1);
+        }
+    }
+
+    if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+        print_usage(argv[0]);
+        return EXIT_SUCCESS;
+    }
+
+    fprintf(stderr, "Error: Unknown command '%s'\n\n", argv[1]);
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,1576 @@
+/*
+ * NOTRAN compiler library - Compiles NOTRAN scores to interpreter bytecode
+ *
+ * Based on the original 6502 assembly implementation by Hal Chamberlin
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include "compiler.h"
+
+/* ============================================================================
+ * Constants and Configuration
+ * ============================================================================ */
+
+#define MAX_LINE_LENGTH 256
+#define MAX_SYMBOLS 100
+#define MAX_CODE_SIZE 8192
+#define MAX_RELOCS (MAX_CODE_SIZE / 2)
+#define MAX_VOICES 8
+#define DEFAULT_VOICES 4
+
+#define INACTIVE_VOICE_DURATION 0xFF
+#define ACTIVE_VOICE_DURATION 0
+
+#define MIN_OCTAVE 1
+#define MAX_OCTAVE 6
+#define MIN_PITCH 1
+#define MAX_PITCH 61
+
+#define MIN_WAVEFORM 1
+#define MAX_WAVEFORM 16
+
+#define MIN_TEMPO 1
+#define MAX_TEMPO 255
+#define MIN_CLIP 1
+#define MAX_CLIP 255
+
+/* Opcodes */
+#define OP_END 0x00
+#define OP_TEMPO 0x10
+#define OP_JSR 0x20
+#define OP_RTS 0x30
+#define OP_JMP 0x40
+#define OP_SET_VOICES 0x50
+#define OP_LONG_NOTE 0x60
+#define OP_REST_MASK 0x80
+#define OP_VOICE_DEACTIVATE 0x80
+#define OP_VOICE_ACTIVATE 0x90
+#define OP_PCM 0xA0             /* Extension, only played by notint */
+
+/* Error codes */
+typedef enum {
+    ERR_NONE = 0,
+    ERR_ARG_OUT_OF_RANGE,
+    ERR_UNDEFINED_IDENTIFIER,
+    ERR_DUPLICATE_IDENTIFIER,
+    ERR_SYMBOL_TABLE_OVERFLOW,
+    ERR_CODE_OVERFLOW,
+    ERR_INCOMPREHENSIBLE_SPEC,
+    ERR_VOICE_MISMATCH,
+    ERR_PITCH_OUT_OF_RANGE,
+    ERR_ILLEGAL_DURATION,
+    ERR_EXEC_CTRL_IN_EVENT,
+    ERR_IDENTIFIER_IN_EVENT,
+    ERR_NESTED_SUB_ESB,
+    ERR_ESB_WITHOUT_SUB,
+    ERR_HANGING_SUB,
+    ERR_NO_VOICES_ACTIVE
+} error_code_t;
+
+/* ============================================================================
+ * Data Structures
+ * ============================================================================ */
+
+typedef struct {
+    uint8_t id;
+    uint16_t address;
+    bool external;          /* Referenced, to be resolved by the linker */
+} symbol_t;
+
+/* Code address stored in the object code, so that it can be moved when
+   reusing the code of a previous compile */
+#define RELOC_SUB 0xFF      /* SUB jump over its body, patched by ESB */
+
+typedef struct {
+    uint16_t offset;        /* Where the address is stored */
+    uint8_t symbol;         /* Symbol index, or RELOC_SUB */
+} reloc_t;
+
+typedef struct {
+    uint8_t voice;
+    uint8_t pitch;
+    uint8_t octave;
+    uint8_t duration_code;
+    uint8_t duration_time;
+} note_spec_t;
+
+typedef struct {
+    uint8_t waveform;      /* 0-15 (waveform 1 stored as 0) */
+    uint8_t duration;      /* Time units remaining */
+    uint8_t pitch;         /* Last absolute pitch */
+    uint8_t octave;        /* Current octave */
+    bool use_absolute;     /* Force absolute pitch encoding */
+} voice_state_t;
+
+typedef struct {
+    FILE *input_file;
+    FILE *listing_file;
+    
+    uint16_t base_address;
+    bool listing_enabled;
+    bool relocatable;
+    
+    char input_line[MAX_LINE_LENGTH];
+    const char *input_ptr;
+    int line_number;
+    
+    symbol_t symbols[MAX_SYMBOLS];
+    int symbol_count;
+    
+    uint8_t code[MAX_CODE_SIZE];
+    int code_line[MAX_CODE_SIZE];   /* Source line of each code byte */
+    size_t code_size;
+    size_t line_code_start;
+    
+    reloc_t relocs[MAX_RELOCS];
+    int reloc_count;
+    
+    bool event_building;
+    uint8_t voice_ptr;
+    voice_state_t voices[MAX_VOICES];
+    int num_voices;
+    
+    uint16_t sub_address;
+    bool end_flag;
+    bool error_flag;
+} compiler_t;
+
+/* Compiler state between lines, as kept by incremental sessions. The
+   symbols, code and relocations are only recorded by their count, as
+   lines just append to them. */
+typedef struct {
+    voice_state_t voices[MAX_VOICES];
+    uint16_t code_size;
+    uint16_t sub_address;
+    uint16_t reloc_count;
+    uint8_t symbol_count;
+    uint8_t voice_ptr;
+    bool event_building;
+    bool end_flag;
+} checkpoint_t;
+
+struct notcmp_session {
+    compiler_t c;
+    notcmp_result_t result;
+    bool failed;
+
+    char *text;
+    size_t text_length;
+    size_t text_capacity;
+    size_t *line_start;             /* line_count + 1 entries, the last one
+                                       is the end of the text */
+    int line_count;
+    int line_capacity;
+    size_t *new_start;              /* Start of the changed lines */
+    int new_capacity;
+
+    checkpoint_t *checkpoints;      /* [n] is the state after line n */
+    int checkpoint_capacity;
+    int compiled;                   /* Lines with a valid checkpoint */
+
+    /* Previous compile, as the changed lines overwrite it */
+    uint8_t prev_code[MAX_CODE_SIZE];
+    int prev_code_line[MAX_CODE_SIZE];
+    reloc_t prev_relocs[MAX_RELOCS];
+    symbol_t prev_symbols[MAX_SYMBOLS];
+};
+
+/* ============================================================================
+ * Forward Declarations
+ * ============================================================================ */
+
+static void init_compiler(compiler_t *c);
+static void process_file(compiler_t *c);
+static void process_line(compiler_t *c);
+static void parse_identifier(compiler_t *c);
+static bool parse_keyword(compiler_t *c);
+static void parse_note(compiler_t *c);
+static void process_note_event(compiler_t *c, const note_spec_t *note);
+static void skip_whitespace(compiler_t *c);
+static int parse_numeric_arg(compiler_t *c);
+static bool add_symbol(compiler_t *c, uint8_t id, uint16_t addr);
+static bool find_symbol(const compiler_t *c, uint8_t id, uint16_t *addr);
+static int symbol_index(const compiler_t *c, uint8_t id);
+static void add_reloc(compiler_t *c, size_t offset, uint8_t symbol);
+static int copy_module(const compiler_t *c, notcmp_result_t *result);
+static void emit_byte(compiler_t *c, uint8_t byte);
+static void emit_word(compiler_t *c, uint16_t word);
+static void report_error(compiler_t *c, error_code_t code);
+static const char* get_error_message(error_code_t code);
+static void write_listing_line(compiler_t *c);
+
+/* Keyword handlers */
+static void handle_nvc(compiler_t *c);
+static void handle_act(compiler_t *c);
+static void handle_dct(compiler_t *c);
+static void handle_voice_control(compiler_t *c, bool activate);
+static void handle_wav(compiler_t *c);
+static void handle_tpo(compiler_t *c);
+static void handle_pcm(compiler_t *c);
+static void handle_abs(compiler_t *c);
+static void handle_jmp(compiler_t *c);
+static void handle_jsr(compiler_t *c);
+static void handle_jump(compiler_t *c, uint8_t opcode);
+static void handle_rts(compiler_t *c);
+static void handle_sub(compiler_t *c);
+static void handle_esb(compiler_t *c);
+static void handle_end(compiler_t *c);
+static void check_event_conflict(compiler_t *c);
+
+/* Helper functions */
+static bool is_valid_voice(const compiler_t *c, int voice_num);
+static bool is_valid_waveform(int waveform);
+static bool is_valid_pitch(int pitch);
+static bool is_line_terminator(char ch);
+static void activate_voice(compiler_t *c, int voice_idx);
+static void deactivate_voice(compiler_t *c, int voice_idx);
+static bool any_voice_active(const compiler_t *c);
+static int find_next_voice_needing_note(const compiler_t *c, int start_idx);
+static void complete_event(compiler_t *c);
+static uint8_t calculate_min_voice_duration(const compiler_t *c);
+static void subtract_duration_from_voices(compiler_t *c, uint8_t duration);
+
+/* ============================================================================
+ * Initialization
+ * ============================================================================ */
+
+static void init_compiler(compiler_t *c) {
+    memset(c, 0, sizeof(compiler_t));
+    c->num_voices = DEFAULT_VOICES;
+    
+    for (int i = 0; i < MAX_VOICES; i++) {
+        c->voices[i].waveform = 0;
+        c->voices[i].duration = INACTIVE_VOICE_DURATION;
+        c->voices[i].use_absolute = true;
+        c->voices[i].pitch = 0;
+        c->voices[i].octave = 0;
+    }
+}
+
+/* ============================================================================
+ * Public Interface
+ * ============================================================================ */
+
+int notcmp_compile(FILE *input, const notcmp_options_t *opts, notcmp_result_t *result) {
+    memset(result, 0, sizeof(*result));
+
+    compiler_t *c = malloc(sizeof(compiler_t));
+    if (!c) {
+        fprintf(stderr, "Cannot allocate compiler state\n");
+        return -1;
+    }
+
+    init_compiler(c);
+    c->input_file = input;
+    c->listing_file = opts->listing_file;
+    c->listing_enabled = (opts->listing_file != NULL);
+    c->base_address = opts->base_address;
+    c->num_voices = opts->num_voices;
+    c->relocatable = opts->relocatable;
+
+    process_file(c);
+
+    int status = c->error_flag ? -1 : 0;
+
+    if (status == 0) {
+        result->code = malloc(c->code_size ? c->code_size : 1);
+        result->code_line = malloc((c->code_size ? c->code_size : 1) * sizeof(int));
+        if (!result->code || !result->code_line) {
+            fprintf(stderr, "Cannot allocate compiled code\n");
+            notcmp_free(result);
+            status = -1;
+        } else {
+            memcpy(result->code, c->code, c->code_size);
+            memcpy(result->code_line, c->code_line, c->code_size * sizeof(int));
+            result->code_size = c->code_size;
+        }
+    }
+    if (status == 0 && c->relocatable && copy_module(c, result) != 0) {
+        fprintf(stderr, "Cannot allocate module tables\n");
+        notcmp_free(result);
+        status = -1;
+    }
+    result->lines = c->line_number;
+    for (int i = 0; i < c->symbol_count; i++) {
+        if (c->symbols[i].external) {
+            result->externals++;
+        } else {
+            result->symbols++;
+        }
+    }
+
+    free(c);
+    return status;
+}
+
+void notcmp_free(notcmp_result_t *result) {
+    free(result->code);
+    free(result->code_line);
+    free(result->exports);
+    free(result->relocs);
+    result->code = NULL;
+    result->code_line = NULL;
+    result->code_size = 0;
+    result->exports = NULL;
+    result->relocs = NULL;
+    result->num_exports = 0;
+    result->num_relocs = 0;
+}
+
+/* Symbols and relocations of a relocatable module, by code offset */
+static int copy_module(const compiler_t *c, notcmp_result_t *result) {
+    result->exports = malloc((c->symbol_count ? c->symbol_count : 1) * sizeof(notcmp_symbol_t));
+    result->relocs = malloc((c->reloc_count ? c->reloc_count : 1) * sizeof(notcmp_reloc_t));
+    if (!result->exports || !result->relocs) {
+        return -1;
+    }
+
+    for (int i = 0; i < c->symbol_count; i++) {
+        const symbol_t *sym = &c->symbols[i];
+        if (!sym->external) {
+            notcmp_symbol_t *e = &result->exports[result->num_exports++];
+            e->id = sym->id;
+            e->offset = sym->address - c->base_address;
+        }
+    }
+
+    for (int i = 0; i < c->reloc_count; i++) {
+        const reloc_t *r = &c->relocs[i];
+        notcmp_reloc_t *out = &result->relocs[result->num_relocs++];
+        out->offset = r->offset;
+        out->symbol = (r->symbol != RELOC_SUB && c->symbols[r->symbol].external)
+                      ? c->symbols[r->symbol].id : 0;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * File Processing
+ * ============================================================================ */
+
+static void normalize_line(char *line) {
+    /* Remove trailing newlines/carriage returns */
+    size_t len = strlen(line);
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) {
+        line[--len] = '\0';
+    }
+    
+    /* Convert to uppercase */
+    for (char *p = line; *p; p++) {
+        *p = (char)toupper((unsigned char)*p);
+    }
+}
+
+static void process_file(compiler_t *c) {
+    while (fgets(c->input_line, sizeof(c->input_line), c->input_file)) {
+        c->line_number++;
+        normalize_line(c->input_line);
+        process_line(c);
+        
+        if (c->error_flag || c->end_flag) {
+            break;
+        }
+    }
+}
+
+static bool is_comment_line(const char *line) {
+    return *line == '*';
+}
+
+static bool is_empty_line(const char *line) {
+    return *line == '\0';
+}
+
+static void process_line(compiler_t *c) {
+    c->input_ptr = c->input_line;
+    c->line_code_start = c->code_size;
+    
+    if (is_comment_line(c->input_line)) {
+        write_listing_line(c);
+        return;
+    }
+    
+    /* Parse identifier if line starts with a digit */
+    if (isdigit((unsigned char)*c->input_ptr)) {
+        parse_identifier(c);
+    } else if (*c->input_ptr != ' ' && !is_empty_line(c->input_line)) {
+        report_error(c, ERR_INCOMPREHENSIBLE_SPEC);
+        write_listing_line(c);
+        return;
+    }
+    
+    /* Parse specifications (keywords and notes), up to the first error */
+    while (*c->input_ptr && !is_line_terminator(*c->input_ptr) && !c->error_flag) {
+        skip_whitespace(c);
+        if (!*c->input_ptr || is_line_terminator(*c->input_ptr)) {
+            break;
+        }
+        
+        if (!parse_keyword(c)) {
+            parse_note(c);
+        }
+        
+        skip_whitespace(c);
+        if (*c->input_ptr == ';') {
+            c->input_ptr++;
+        }
+    }
+    
+    write_listing_line(c);
+}
+
+/* ============================================================================
+ * Identifier Parsing
+ * ============================================================================ */
+
+static void parse_identifier(compiler_t *c) {
+    if (c->event_building) {
+        report_error(c, ERR_IDENTIFIER_IN_EVENT);
+        return;
+    }
+    
+    int id = parse_numeric_arg(c);
+    if (id == 0) {
+        report_error(c, ERR_INCOMPREHENSIBLE_SPEC);
+        return;
+    }
+    
+    uint16_t dummy;
+    if (find_symbol(c, (uint8_t)id, &dummy)) {
+        report_error(c, ERR_DUPLICATE_IDENTIFIER);
+        return;
+    }
+    
+    add_symbol(c, (uint8_t)id, c->base_address + c->code_size);
+}
+
+/* ============================================================================
+ * Listing Output
+ * ============================================================================ */
+
+static void write_listing_line(compiler_t *c) {
+    if (!c->listing_enabled) {
+        return;
+    }
+    
+    size_t bytes_generated = c->code_size - c->line_code_start;
+    
+    if (is_comment_line(c->input_line)) {
+        fprintf(c->listing_file, "%s\n", c->input_line);
+        return;
+    }
+    
+    if (is_empty_line(c->input_line)) {
+        fprintf(c->listing_file, "\n");
+        return;
+    }
+
+    /* Output: source line, then address and hex bytes */
+    fprintf(c->listing_file, "%s\n", c->input_line);
+    fprintf(c->listing_file, "%04X  ", 
+            (unsigned)(c->base_address + c->line_code_start));
+
+    for (size_t i = 0; i < bytes_generated; i++) {
+        fprintf(c->listing_file, "%02X ", c->code[c->line_code_start + i]);
+    }
+
+    fprintf(c->listing_file, "\n");
+}
+
+/* ============================================================================
+ * Utility Functions
+ * ============================================================================ */
+
+static void skip_whitespace(compiler_t *c) {
+    while (*c->input_ptr == ' ' || *c->input_ptr == '\t') {
+        c->input_ptr++;
+    }
+}
+
+static bool is_line_terminator(char ch) {
+    return ch == '\r' || ch == '\n';
+}
+
+static bool is_valid_voice(const compiler_t *c, int voice_num) {
+    return voice_num >= 1 && voice_num <= c->num_voices;
+}
+
+static bool is_valid_waveform(int waveform) {
+    return waveform >= MIN_WAVEFORM && waveform <= MAX_WAVEFORM;
+}
+
+static bool is_valid_pitch(int pitch) {
+    return pitch >= MIN_PITCH && pitch <= MAX_PITCH;
+}
+
+static int parse_numeric_arg(compiler_t *c) {
+    skip_whitespace(c);
+    
+    if (!isdigit((unsigned char)*c->input_ptr)) {
+        report_error(c, ERR_INCOMPREHENSIBLE_SPEC);
+        return 0;
+    }
+    
+    int val = 0;
+    bool overflow = false;
+    
+    while (isdigit((unsigned char)*c->input_ptr)) {
+        int digit = *c->input_ptr - '0';
+        int new_val = val * 10 + digit;
+        
+        if (new_val > 255) {
+            overflow = true;
+        }
+        val = new_val;
+        c->input_ptr++;
+    }
+    
+    if (overflow) {
+        report_error(c, ERR_ARG_OUT_OF_RANGE);
+        return 0;
+    }
+    
+    return val;
+}
+
+/* ============================================================================
+ * Symbol Table Management
+ * ============================================================================ */
+
+static bool add_symbol(compiler_t *c, uint8_t id, uint16_t addr) {
+    if (c->symbol_count >= MAX_SYMBOLS) {
+        report_error(c, ERR_SYMBOL_TABLE_OVERFLOW);
+        return false;
+    }
+    
+    c->symbols[c->symbol_count].id = id;
+    c->symbols[c->symbol_count].address = addr;
+    c->symbols[c->symbol_count].external = false;
+    c->symbol_count++;
+    return true;
+}
+
+static bool find_symbol(const compiler_t *c, uint8_t id, uint16_t *addr) {
+    int i = symbol_index(c, id);
+    if (i < 0) {
+        return false;
+    }
+    if (addr) {
+        *addr = c->symbols[i].address;
+    }
+    return true;
+}
+
+static int symbol_index(const compiler_t *c, uint8_t id) {
+    for (int i = 0; i < c->symbol_count; i++) {
+        if (c->symbols[i].id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void add_reloc(compiler_t *c, size_t offset, uint8_t symbol) {
+    if (c->reloc_count < MAX_RELOCS) {
+        c->relocs[c->reloc_count].offset = (uint16_t)offset;
+        c->relocs[c->reloc_count].symbol = symbol;
+        c->reloc_count++;
+    }
+}
+
+/* ============================================================================
+ * Code Emission
+ * ============================================================================ */
+
+static void emit_byte(compiler_t *c, uint8_t byte) {
+    if (c->code_size >= MAX_CODE_SIZE) {
+        report_error(c, ERR_CODE_OVERFLOW);
+        return;
+    }
+    c->code_line[c->code_size] = c->line_number;
+    c->code[c->code_size++] = byte;
+}
+
+static void emit_word(compiler_t *c, uint16_t word) {
+    emit_byte(c, word & 0xFF);
+    emit_byte(c, (word >> 8) & 0xFF);
+}
+
+/* ============================================================================
+ * Error Handling
+ * ============================================================================ */
+
+static void report_error(compiler_t *c, error_code_t code) {
+    fprintf(stderr, "Error %d on line %d: %s\n", 
+            code, c->line_number, get_error_message(code));
+    c->error_flag = true;
+}
+
+static const char* get_error_message(error_code_t code) {
+    static const char *messages[] = {
+        [ERR_NONE] = "No error",
+        [ERR_ARG_OUT_OF_RANGE] = "Argument out of range",
+        [ERR_UNDEFINED_IDENTIFIER] = "Undefined identifier",
+        [ERR_DUPLICATE_IDENTIFIER] = "Identifier already used",
+        [ERR_SYMBOL_TABLE_OVERFLOW] = "Symbol table overflow",
+        [ERR_CODE_OVERFLOW] = "Object code overflow",
+        [ERR_INCOMPREHENSIBLE_SPEC] = "Incomprehensible specification",
+        [ERR_VOICE_MISMATCH] = "Voice number mismatch",
+        [ERR_PITCH_OUT_OF_RANGE] = "Note pitch out of range",
+        [ERR_ILLEGAL_DURATION] = "Illegal duration",
+        [ERR_EXEC_CTRL_IN_EVENT] = "Executable control in event",
+        [ERR_IDENTIFIER_IN_EVENT] = "Identifier in event",
+        [ERR_NESTED_SUB_ESB] = "Nested SUB-ESB",
+        [ERR_ESB_WITHOUT_SUB] = "ESB without SUB",
+        [ERR_HANGING_SUB] = "Hanging SUB",
+        [ERR_NO_VOICES_ACTIVE] = "No voices active"
+    };
+    
+    if (code >= 0 && code < sizeof(messages)/sizeof(messages[0]) && messages[code]) {
+        return messages[code];
+    }
+    return "Unknown error";
+}
+
+/* ============================================================================
+ * Note Parsing
+ * ============================================================================ */
+
+static uint8_t parse_note_pitch(compiler_t *c) {
+    static const uint8_t pitch_table[] = {
+        9,10,11, 11,12,1, 12,1,2, 2,3,4, 4,5,6, 5,6,7, 7,8,9
+    };
+    
+    char note_letter = *c->input_ptr;
+    if (note_letter < 'A' || note_letter > 'G') {
+        report_error(c, ERR_INCOMPREHENSIBLE_SPEC);
+        return 0;
+    }
+    
+    int note_value = (note_letter - 'A' + 1) * 3;
+    c->input_ptr++;
+    
+    /* Handle accidentals */
+    if (*c->input_ptr == '#') {
+        note_value++;
+        c->input_ptr++;
+    } else if (*c->input_ptr == '@') {
+        note_value--;
+        c->input_ptr++;
+    }
+    
+    return pitch_table[note_value - 2];
+}
+
+static bool parse_duration(compiler_t *c, uint8_t *duration_code, uint8_t *duration_time) {
+    static const char *duration_letters = "WHQEST";
+    static const uint8_t code_table[] = {
+        0,1,0, 2,3,5, 4,6,8, 7,9,11, 10,12,14, 13,15,0
+    };
+    static const uint8_t time_table[] = {
+        192,144,96, 72,64,48, 36,32,24, 18,16,12, 9,8,6
+    };
+    
+    const char *dur_pos = strchr(duration_letters, *c->input_ptr);
+    if (!dur_pos) {
+        report_error(c, ERR_ILLEGAL_DURATION);
+        return false;
+    }
+    
+    int dur_idx = (int)(dur_pos - duration_letters) * 3 + 1;
+    c->input_ptr++;
+    
+    /* Handle dotted notes and triplets */
+    if (*c->input_ptr == '.') {
+        dur_idx--;
+        c->input_ptr++;
+    } else if (*c->input_ptr == '3') {
+        dur_idx++;
+        c->input_ptr++;
+    }
+    
+    uint8_t code = code_table[dur_idx];
+    if (code == 0) {
+        report_error(c, ERR_ILLEGAL_DURATION);
+        return false;
+    }
+    
+    *duration_code = code;
+    *duration_time = time_table[code - 1];
+    return true;
+}
+
+static void parse_note(compiler_t *c) {
+    note_spec_t note = {0};
+    
+    /* Optional voice digit */
+    if (*c->input_ptr >= '1' && *c->input_ptr <= '0' + c->num_voices) {
+        note.voice = *c->input_ptr - '0';
+        c->input_ptr++;
+    }
+    
+    /* Parse rest or note */
+    if (*c->input_ptr == 'R') {
+        c->input_ptr++;
+        note.pitch = 0;  /* Rest */
+    } else {
+        note.pitch = parse_note_pitch(c);
+        if (note.pitch == 0) {
+            return;  /* Error already reported */
+        }
+        
+        /* Optional octave */
+        if (*c->input_ptr >= '1' && *c->input_ptr <= '6') {
+            note.octave = *c->input_ptr - '0';
+            c->input_ptr++;
+        }
+    }
+    
+    /* Parse duration */
+    if (!parse_duration(c, &note.duration_code, &note.duration_time)) {
+        return;  /* Error already reported */
+    }
+    
+    /* Validate proper termination */
+    if (*c->input_ptr != ' ' && *c->input_ptr != ';' && 
+        *c->input_ptr != '\0' && !is_line_terminator(*c->input_ptr)) {
+        report_error(c, ERR_INCOMPREHENSIBLE_SPEC);
+        return;
+    }
+    
+    process_note_event(c, &note);
+}
+
+/* ============================================================================
+ * Voice State Management
+ * ============================================================================ */
+
+static void activate_voice(compiler_t *c, int voice_idx) {
+    c->voices[voice_idx].duration = ACTIVE_VOICE_DURATION;
+}
+
+static void deactivate_voice(compiler_t *c, int voice_idx) {
+    c->voices[voice_idx].duration = INACTIVE_VOICE_DURATION;
+}
+
+static bool any_voice_active(const compiler_t *c) {
+    for (int i = 0; i < c->num_voices; i++) {
+        if (c->voices[i].duration != INACTIVE_VOICE_DURATION) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int find_next_voice_needing_note(const compiler_t *c, int start_idx) {
+    for (int i = start_idx; i < c->num_voices; i++) {
+        if (c->voices[i].duration == 0) {
+            return i;
+        }
+    }
+    return c->num_voices;  /* Not found */
+}
+
+static uint8_t calculate_min_voice_duration(const compiler_t *c) {
+    uint8_t min_duration = INACTIVE_VOICE_DURATION;
+    
+    for (int i = 0; i < c->num_voices; i++) {
+        if (c->voices[i].duration != INACTIVE_VOICE_DURATION && 
+            c->voices[i].duration < min_duration) {
+            min_duration = c->voices[i].duration;
+        }
+    }
+    
+    return min_duration;
+}
+
+static void subtract_duration_from_voices(compiler_t *c, uint8_t duration) {
+    for (int i = 0; i < c->num_voices; i++) {
+        if (c->voices[i].duration != INACTIVE_VOICE_DURATION) {
+            c->voices[i].duration -= duration;
+        }
+    }
+}
+
+static void complete_event(compiler_t *c) {
+    uint8_t min_duration = calculate_min_voice_duration(c);
+    subtract_duration_from_voices(c, min_duration);
+    c->event_building = false;
+}
+
+/* ============================================================================
+ * Note Event Processing
+ * ============================================================================ */
+
+static void emit_rest(compiler_t *c, uint8_t duration_code) {
+    emit_byte(c, OP_REST_MASK | duration_code);
+}
+
+static void emit_short_note(compiler_t *c, int pitch_diff, uint8_t duration_code) {
+    emit_byte(c, ((pitch_diff & 0x0F) << 4) | duration_code);
+}
+
+static void emit_long_note(compiler_t *c, int pitch, uint8_t waveform, uint8_t duration_code) {
+    emit_byte(c, OP_LONG_NOTE);
+    emit_byte(c, pitch * 2);
+    emit_byte(c, (waveform << 4) | duration_code);
+}
+
+static bool should_use_short_encoding(const compiler_t *c, int voice_idx, int new_pitch) {
+    if (c->voices[voice_idx].use_absolute || c->voices[voice_idx].pitch == 0) {
+        return false;
+    }
+    
+    int diff = new_pitch - c->voices[voice_idx].pitch;
+    return diff >= -7 && diff <= 7;
+}
+
+static void process_note_event(compiler_t *c, const note_spec_t *note) {
+    /* Start new event if needed */
+    if (!c->event_building) {
+        c->voice_ptr = 0;
+        c->event_building = true;
+        
+        if (!any_voice_active(c)) {
+            report_error(c, ERR_NO_VOICES_ACTIVE);
+            return;
+        }
+    }
+    
+    /* Find the next voice that needs a note */
+    int voice_idx = find_next_voice_needing_note(c, c->voice_ptr);
+    
+    if (voice_idx >= c->num_voices) {
+        report_error(c, ERR_NO_VOICES_ACTIVE);
+        return;
+    }
+    
+    /* Check voice number match if specified */
+    if (note->voice != 0 && voice_idx != note->voice - 1) {
+        report_error(c, ERR_VOICE_MISMATCH);
+    }
+    
+    /* Process rest */
+    if (note->pitch == 0) {
+        emit_rest(c, note->duration_code);
+    } else {
+        /* Process note */
+        uint8_t octave = note->octave;
+        if (octave == 0) {
+            octave = c->voices[voice_idx].octave;
+            if (octave == 0) {
+                report_error(c, ERR_PITCH_OUT_OF_RANGE);
+                octave = 4;
+            }
+        }
+        c->voices[voice_idx].octave = octave;
+        
+        int absolute_pitch = octave * 12 + note->pitch - 12;
+        if (!is_valid_pitch(absolute_pitch)) {
+            report_error(c, ERR_PITCH_OUT_OF_RANGE);
+            absolute_pitch = MAX_PITCH;
+        }
+        
+        /* Choose short or long encoding */
+        if (should_use_short_encoding(c, voice_idx, absolute_pitch)) {
+            int pitch_diff = absolute_pitch - c->voices[voice_idx].pitch;
+            emit_short_note(c, pitch_diff, note->duration_code);
+        } else {
+            emit_long_note(c, absolute_pitch, c->voices[voice_idx].waveform, note->duration_code);
+        }
+        
+        c->voices[voice_idx].pitch = absolute_pitch;
+    }
+
+    /* Update voice state */
+    c->voices[voice_idx].duration = note->duration_time;
+    c->voices[voice_idx].use_absolute = false;
+
+    /* Check if event is complete */
+    int next_voice = voice_idx + 1;
+    bool event_complete = (find_next_voice_needing_note(c, next_voice) >= c->num_voices);
+    
+    if (event_complete) {
+        complete_event(c);
+    } else {
+        c->voice_ptr = next_voice;
+    }
+}
+
+/* ============================================================================
+ * Keyword Parsing and Handlers
+ * ============================================================================ */
+
+typedef struct {
+    const char *keyword;
+    void (*handler)(compiler_t *);
+} keyword_handler_t;
+
+static const keyword_handler_t keyword_table[] = {
+    {"NVC", handle_nvc},
+    {"ACT", handle_act},
+    {"DCT", handle_dct},
+    {"WAV", handle_wav},
+    {"TPO", handle_tpo},
+    {"PCM", handle_pcm},
+    {"ABS", handle_abs},
+    {"JMP", handle_jmp},
+    {"JSR", handle_jsr},
+    {"RTS", handle_rts},
+    {"SUB", handle_sub},
+    {"ESB", handle_esb},
+    {"END", handle_end},
+    {NULL, NULL}
+};
+
+static bool parse_keyword(compiler_t *c) {
+    skip_whitespace(c);
+    
+    if (!c->input_ptr[0] || !c->input_ptr[1] || !c->input_ptr[2]) {
+        return false;
+    }
+    
+    char keyword[4] = {c->input_ptr[0], c->input_ptr[1], c->input_ptr[2], '\0'};
+    
+    for (const keyword_handler_t *kw = keyword_table; kw->keyword != NULL; kw++) {
+        if (strcmp(keyword, kw->keyword) == 0) {
+            c->input_ptr += 3;
+            kw->handler(c);
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+static void check_event_conflict(compiler_t *c) {
+    if (c->event_building) {
+        report_error(c, ERR_EXEC_CTRL_IN_EVENT);
+        c->event_building = false;
+    }
+}
+
+static void handle_nvc(compiler_t *c) {
+    int num_voices = parse_numeric_arg(c);
+    
+    if (!is_valid_voice(c, num_voices)) {
+        report_error(c, ERR_ARG_OUT_OF_RANGE);
+        return;
+    }
+    
+    check_event_conflict(c);
+    emit_byte(c, OP_SET_VOICES);
+    emit_byte(c, num_voices);
+}
+
+static void handle_act(compiler_t *c) {
+    handle_voice_control(c, true);
+}
+
+static void handle_dct(compiler_t *c) {
+    handle_voice_control(c, false);
+}
+
+static void handle_voice_control(compiler_t *c, bool activate) {
+    uint8_t opcode = activate ? OP_VOICE_ACTIVATE : OP_VOICE_DEACTIVATE;
+    
+    do {
+        skip_whitespace(c);
+        int voice_num = parse_numeric_arg(c);
+        int voice_idx = voice_num - 1;
+        
+        if (!is_valid_voice(c, voice_num)) {
+            report_error(c, ERR_ARG_OUT_OF_RANGE);
+            skip_whitespace(c);
+            if (*c->input_ptr == ',') {
+                c->input_ptr++;
+            }
+            continue;
+        }
+        
+        check_event_conflict(c);
+        emit_byte(c, opcode);
+        emit_byte(c, voice_idx);
+        
+        if (activate) {
+            activate_voice(c, voice_idx);
+        } else {
+            deactivate_voice(c, voice_idx);
+        }
+        
+        skip_whitespace(c);
+    } while (*c->input_ptr == ',' && ++c->input_ptr);
+}
+
+static void handle_wav(compiler_t *c) {
+    skip_whitespace(c);
+    int waveform = parse_numeric_arg(c);
+    
+    if (!is_valid_waveform(waveform)) {
+        report_error(c, ERR_ARG_OUT_OF_RANGE);
+        return;
+    }
+    
+    skip_whitespace(c);
+    if (*c->input_ptr != ',') {
+        report_error(c, ERR_INCOMPREHENSIBLE_SPEC);
+        return;
+    }
+    c->input_ptr++;
+    
+    skip_whitespace(c);
+    int voice_num = parse_numeric_arg(c);
+    int voice_idx = voice_num - 1;
+    
+    if (!is_valid_voice(c, voice_num)) {
+        report_error(c, ERR_ARG_OUT_OF_RANGE);
+        return;
+    }
+    
+    /* Validate proper termination */
+    skip_whitespace(c);
+    if (*c->input_ptr != ';' && *c->input_ptr != '\0' && 
+        !is_line_terminator(*c->input_ptr) && *c->input_ptr != ' ') {
+        report_error(c, ERR_INCOMPREHENSIBLE_SPEC);
+        while (*c->input_ptr && *c->input_ptr != ';' && !is_line_terminator(*c->input_ptr)) {
+            c->input_ptr++;
+        }
+        return;
+    }
+    
+    c->voices[voice_idx].use_absolute = true;
+    c->voices[voice_idx].waveform = waveform - 1;  /* Store as 0-15 */
+}
+
+static void handle_tpo(compiler_t *c) {
+    skip_whitespace(c);
+    int tempo = parse_numeric_arg(c);
+    
+    if (tempo < MIN_TEMPO || tempo > MAX_TEMPO) {
+        report_error(c, ERR_ARG_OUT_OF_RANGE);
+        return;
+    }
+    
+    check_event_conflict(c);
+    emit_byte(c, OP_TEMPO);
+    emit_byte(c, tempo);
+}
+
+static void handle_pcm(compiler_t *c) {
+    skip_whitespace(c);
+    int clip = parse_numeric_arg(c);
+    
+    if (clip < MIN_CLIP || clip > MAX_CLIP) {
+        report_error(c, ERR_ARG_OUT_OF_RANGE);
+        return;
+    }
+    
+    check_event_conflict(c);
+    emit_byte(c, OP_PCM);
+    emit_byte(c, clip - 1);     /* Stored as 0-254 */
+}
+
+static void handle_abs(compiler_t *c) {
+    for (int i = 0; i < c->num_voices; i++) {
+        c->voices[i].use_absolute = true;
+    }
+}
+
+static void handle_jmp(compiler_t *c) {
+    handle_jump(c, OP_JMP);
+}
+
+static void handle_jsr(compiler_t *c) {
+    handle_jump(c, OP_JSR);
+}
+
+static void handle_jump(compiler_t *c, uint8_t opcode) {
+    skip_whitespace(c);
+    int target_id = parse_numeric_arg(c);
+    
+    if (target_id < 1 || target_id > 255) {
+        report_error(c, ERR_ARG_OUT_OF_RANGE);
+        return;
+    }
+    
+    int symbol = symbol_index(c, (uint8_t)target_id);
+    if (symbol < 0 && c->relocatable) {
+        /* Left to the linker. Defining it later is an error, as it would
+           not be the one the linker finds */
+        if (add_symbol(c, (uint8_t)target_id, 0)) {
+            symbol = c->symbol_count - 1;
+            c->symbols[symbol].external = true;
+        }
+    }
+    if (symbol < 0) {
+        if (!c->error_flag) {
+            report_error(c, ERR_UNDEFINED_IDENTIFIER);
+        }
+        check_event_conflict(c);
+        return;
+    }
+    
+    check_event_conflict(c);
+    emit_byte(c, opcode);
+    add_reloc(c, c->code_size, (uint8_t)symbol);
+    emit_word(c, c->symbols[symbol].external ? 0 : c->symbols[symbol].address - c->base_address);
+}
+
+static void handle_rts(compiler_t *c) {
+    check_event_conflict(c);
+    emit_byte(c, OP_RTS);
+}
+
+static void handle_sub(compiler_t *c) {
+    if (c->sub_address != 0) {
+        report_error(c, ERR_NESTED_SUB_ESB);
+        check_event_conflict(c);
+        return;
+    }
+    
+    check_event_conflict(c);
+    emit_byte(c, OP_JMP);
+    c->sub_address = c->code_size;
+    emit_word(c, 0x0000);  /* Placeholder */
+}
+
+static void handle_esb(compiler_t *c) {
+    if (c->sub_address == 0) {
+        report_error(c, ERR_ESB_WITHOUT_SUB);
+        check_event_conflict(c);
+        return;
+    }
+    
+    check_event_conflict(c);
+    
+    /* Patch the jump address to point here */
+    uint16_t current_addr = c->code_size + c->base_address;
+    uint16_t relative_addr = current_addr - c->base_address;
+    
+    c->code[c->sub_address] = relative_addr & 0xFF;
+    c->code[c->sub_address + 1] = (relative_addr >> 8) & 0xFF;
+    add_reloc(c, c->sub_address, RELOC_SUB);
+    
+    c->sub_address = 0;
+}
+
+static void handle_end(compiler_t *c) {
+    emit_byte(c, OP_END);
+    c->end_flag = true;
+    
+    if (c->sub_address != 0) {
+        report_error(c, ERR_HANGING_SUB);
+    }
+}
+
+/* ============================================================================
+ * Incremental Compilation
+ * ============================================================================ */
+
+static void save_checkpoint(const compiler_t *c, checkpoint_t *cp) {
+    memset(cp, 0, sizeof(*cp));
+    memcpy(cp->voices, c->voices, sizeof(cp->voices));
+    cp->code_size = (uint16_t)c->code_size;
+    cp->sub_address = c->sub_address;
+    cp->reloc_count = (uint16_t)c->reloc_count;
+    cp->symbol_count = (uint8_t)c->symbol_count;
+    cp->voice_ptr = c->voice_ptr;
+    cp->event_building = c->event_building;
+    cp->end_flag = c->end_flag;
+}
+
+static void restore_checkpoint(compiler_t *c, const checkpoint_t *cp, int line) {
+    memcpy(c->voices, cp->voices, sizeof(cp->voices));
+    c->code_size = cp->code_size;
+    c->sub_address = cp->sub_address;
+    c->reloc_count = cp->reloc_count;
+    c->symbol_count = cp->symbol_count;
+    c->voice_ptr = cp->voice_ptr;
+    c->event_building = cp->event_building;
+    c->end_flag = cp->end_flag;
+    c->error_flag = false;
+    c->line_number = line;
+
+    /* Undo the patch of a later ESB */
+    if (c->sub_address != 0) {
+        c->code[c->sub_address] = 0;
+        c->code[c->sub_address + 1] = 0;
+    }
+}
+
+static bool reserve_checkpoints(notcmp_session_t *s, int count) {
+    if (count <= s->checkpoint_capacity) {
+        return true;
+    }
+    int capacity = count + 1024;
+    checkpoint_t *cps = realloc(s->checkpoints, capacity * sizeof(checkpoint_t));
+    if (!cps) {
+        return false;
+    }
+    s->checkpoints = cps;
+    s->checkpoint_capacity = capacity;
+    return true;
+}
+
+static bool grow_array(size_t **array, int *capacity, int count) {
+    if (count <= *capacity) {
+        return true;
+    }
+    int new_capacity = count + count / 2 + 1024;
+    size_t *grown = realloc(*array, new_capacity * sizeof(size_t));
+    if (!grown) {
+        return false;
+    }
+    *array = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+/* End of the line starting at pos, split the same way process_file()
+   reads them */
+static size_t line_end(const char *text, size_t pos, size_t length) {
+    size_t max = length - pos;
+    if (max > MAX_LINE_LENGTH - 1) {
+        max = MAX_LINE_LENGTH - 1;
+    }
+    const char *nl = memchr(text + pos, '\n', max);
+    return nl ? (size_t)(nl - text) + 1 : pos + max;
+}
+
+static size_t common_prefix(const char *a, const char *b, size_t n) {
+    size_t i = 0;
+    while (i + 256 <= n && memcmp(a + i, b + i, 256) == 0) {
+        i += 256;
+    }
+    while (i < n && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+static size_t common_suffix(const char *a, size_t na, const char *b, size_t nb, size_t n) {
+    size_t i = 0;
+    while (i + 256 <= n && memcmp(a + na - i - 256, b + nb - i - 256, 256) == 0) {
+        i += 256;
+    }
+    while (i < n && a[na - i - 1] == b[nb - i - 1]) {
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Split the new source in lines, reusing the line table of the previous
+ * one for the unchanged text at the start and at the end. Returns the
+ * number of unchanged lines at the start and at the end.
+ */
+static bool update_lines(notcmp_session_t *s, const char *source, size_t length,
+                         int *prefix, int *suffix) {
+    const size_t old_length = s->text_length;
+    const int old_count = s->line_count;
+    const size_t shortest = (old_length < length) ? old_length : length;
+    const size_t same_start = common_prefix(s->text, source, shortest);
+    const size_t same_end = common_suffix(s->text, old_length, source, length,
+                                          shortest - same_start);
+
+    /* Lines entirely in the unchanged start, and whose end is not only
+       due to the end of the text */
+    int first = 0;
+    while (first < old_count && s->line_start[first + 1] <= same_start) {
+        first++;
+    }
+    if (first > 0 && s->line_start[first] == old_length &&
+        s->text[old_length - 1] != '\n' &&
+        old_length - s->line_start[first - 1] < MAX_LINE_LENGTH - 1) {
+        first--;
+    }
+
+    /* Split the changed text until a line starts where one did before */
+    const long shift = (long)length - (long)old_length;
+    size_t pos = s->line_start[first];
+    int changed = 0;
+    int tail = old_count;
+    int old_line = first;
+
+    while (pos < length) {
+        if (pos >= length - same_end) {
+            const size_t old_pos = pos - shift;
+            while (old_line < old_count && s->line_start[old_line] < old_pos) {
+                old_line++;
+            }
+            if (old_line < old_count && s->line_start[old_line] == old_pos) {
+                tail = old_line;
+                break;
+            }
+        }
+        if (!grow_array(&s->new_start, &s->new_capacity, changed + 1)) {
+            return false;
+        }
+        s->new_start[changed++] = pos;
+        pos = line_end(source, pos, length);
+    }
+
+    const int count = first + changed + (old_count - tail);
+    if (!grow_array(&s->line_start, &s->line_capacity, count + 1)) {
+        return false;
+    }
+
+    memmove(&s->line_start[first + changed], &s->line_start[tail],
+            (old_count - tail + 1) * sizeof(size_t));
+    for (int i = first + changed; i <= count; i++) {
+        s->line_start[i] += shift;
+    }
+    memcpy(&s->line_start[first], s->new_start, changed * sizeof(size_t));
+    s->line_start[count] = length;
+    s->line_count = count;
+
+    *prefix = first;
+    *suffix = old_count - tail;
+    return true;
+}
+
+static void compile_source_line(notcmp_session_t *s, int line) {
+    compiler_t *c = &s->c;
+    const size_t start = s->line_start[line - 1];
+    const size_t length = s->line_start[line] - start;
+
+    memcpy(c->input_line, s->text + start, length);
+    c->input_line[length] = '\0';
+    c->line_number = line;
+    normalize_line(c->input_line);
+    process_line(c);
+}
+
+/* Whether the tail of the previous compile, from the line of old, produces
+   the same code after now, except for the place it is moved to */
+static bool states_converge(const notcmp_session_t *s, const checkpoint_t *now,
+                            const checkpoint_t *old, const checkpoint_t *last,
+                            int first_symbol) {
+    if (now->symbol_count != old->symbol_count ||
+        now->sub_address != 0 || old->sub_address != 0 ||
+        now->voice_ptr != old->voice_ptr ||
+        now->event_building != old->event_building ||
+        now->end_flag != old->end_flag ||
+        memcmp(now->voices, old->voices, sizeof(now->voices)) != 0) {
+        return false;
+    }
+
+    /* The tail refers to symbols by their index */
+    for (int i = first_symbol; i < now->symbol_count; i++) {
+        if (s->c.symbols[i].id != s->prev_symbols[i].id) {
+            return false;
+        }
+    }
+
+    return last->code_size - old->code_size + now->code_size <= MAX_CODE_SIZE &&
+           last->reloc_count - old->reloc_count + now->reloc_count <= MAX_RELOCS;
+}
+
+/* Move the tail of the previous compile, from old line old_line on, after
+   the current code and adjust its addresses and checkpoints */
+static void reuse_tail(notcmp_session_t *s, const checkpoint_t *old,
+                       const checkpoint_t *last, int old_line, int line_delta) {
+    compiler_t *c = &s->c;
+    const int delta = (int)c->code_size - old->code_size;
+    const int reloc_delta = c->reloc_count - old->reloc_count;
+    const int tail = last->code_size - old->code_size;
+
+    memcpy(&c->code[c->code_size], &s->prev_code[old->code_size], tail);
+    for (int i = 0; i < tail; i++) {
+        c->code_line[c->code_size + i] = s->prev_code_line[old->code_size + i] + line_delta;
+    }
+
+    for (int i = old->symbol_count; i < last->symbol_count; i++) {
+        c->symbols[i].id = s->prev_symbols[i].id;
+        c->symbols[i].address = s->prev_symbols[i].address + delta;
+    }
+
+    for (int i = old->reloc_count; i < last->reloc_count; i++) {
+        reloc_t *r = &c->relocs[i + reloc_delta];
+        *r = s->prev_relocs[i];
+        r->offset += delta;
+
+        uint16_t addr;
+        if (r->symbol == RELOC_SUB) {
+            addr = (c->code[r->offset] | (c->code[r->offset + 1] << 8)) + delta;
+        } else {
+            addr = c->symbols[r->symbol].address - c->base_address;
+        }
+        c->code[r->offset] = addr & 0xFF;
+        c->code[r->offset + 1] = (addr >> 8) & 0xFF;
+    }
+
+    if (delta != 0 || reloc_delta != 0) {
+        for (int n = old_line + 1; n <= s->compiled; n++) {
+            checkpoint_t *cp = &s->checkpoints[n + line_delta];
+            cp->code_size += delta;
+            cp->reloc_count += reloc_delta;
+            if (cp->sub_address != 0) {
+                cp->sub_address += delta;
+            }
+        }
+    }
+}
+
+notcmp_session_t *notcmp_session_new(const notcmp_options_t *opts) {
+    notcmp_session_t *s = calloc(1, sizeof(notcmp_session_t));
+    if (!s) {
+        fprintf(stderr, "Cannot allocate compiler session\n");
+        return NULL;
+    }
+
+    if (!reserve_checkpoints(s, 1) || !grow_array(&s->line_start, &s->line_capacity, 1)) {
+        fprintf(stderr, "Cannot allocate compiler session\n");
+        notcmp_session_free(s);
+        return NULL;
+    }
+    s->line_start[0] = 0;
+
+    init_compiler(&s->c);
+    s->c.base_address = opts->base_address;
+    s->c.num_voices = opts->num_voices;
+    save_checkpoint(&s->c, &s->checkpoints[0]);
+
+    return s;
+}
+
+int notcmp_session_update(notcmp_session_t *s, const char *source, size_t length,
+                          notcmp_update_t *info) {
+    compiler_t *c = &s->c;
+
+    if (length > s->text_capacity) {
+        char *text = realloc(s->text, length);
+        if (!text) {
+            fprintf(stderr, "Cannot allocate compiler session\n");
+            return -1;
+        }
+        s->text = text;
+        s->text_capacity = length;
+    }
+
+    const int old_count = s->line_count;
+    int prefix, suffix;
+    if (!update_lines(s, source, length, &prefix, &suffix)) {
+        fprintf(stderr, "Cannot allocate compiler session\n");
+        return -1;
+    }
+    memcpy(s->text, source, length);
+    s->text_length = length;
+
+    const int new_count = s->line_count;
+    if (!reserve_checkpoints(s, new_count + 1)) {
+        /* Start over on the next update */
+        fprintf(stderr, "Cannot allocate compiler session\n");
+        s->line_count = 0;
+        s->line_start[0] = 0;
+        s->text_length = 0;
+        s->compiled = 0;
+        return -1;
+    }
+
+    /* Keep the previous code, it is overwritten from the first changed line */
+    const int restart = (prefix < s->compiled) ? prefix : s->compiled;
+    const checkpoint_t *from = &s->checkpoints[restart];
+    const checkpoint_t last = s->checkpoints[s->compiled];
+
+    memcpy(&s->prev_code[from->code_size], &c->code[from->code_size],
+           last.code_size - from->code_size);
+    memcpy(&s->prev_code_line[from->code_size], &c->code_line[from->code_size],
+           (last.code_size - from->code_size) * sizeof(int));
+    memcpy(&s->prev_relocs[from->reloc_count], &c->relocs[from->reloc_count],
+           (last.reloc_count - from->reloc_count) * sizeof(reloc_t));
+    memcpy(s->prev_symbols, c->symbols, last.symbol_count * sizeof(symbol_t));
+
+    /* Move the checkpoints of the unchanged tail to its new line numbers */
+    const int line_delta = new_count - old_count;
+    const int tail_first = old_count - suffix + 1;
+    const int tail_last = s->compiled;
+    if (line_delta != 0 && tail_first <= tail_last) {
+        memmove(&s->checkpoints[tail_first + line_delta], &s->checkpoints[tail_first],
+                (tail_last - tail_first + 1) * sizeof(checkpoint_t));
+    }
+
+    const int first_symbol = from->symbol_count;
+    restore_checkpoint(c, from, restart);
+
+    notcmp_update_t stats = { .first_line = restart + 1 };
+    int line = restart;
+
+    while (!c->end_flag && line < new_count) {
+        compile_source_line(s, ++line);
+        stats.lines_compiled++;
+        if (c->error_flag) {
+            break;
+        }
+
+        checkpoint_t now;
+        save_checkpoint(c, &now);
+
+        const int old_line = line - line_delta;
+        if (stats.reused || old_line < tail_first || old_line > tail_last) {
+            s->checkpoints[line] = now;
+            continue;
+        }
+
+        /* Unchanged line, its checkpoint is still the previous one */
+        const checkpoint_t old = s->checkpoints[line];
+        s->checkpoints[line] = now;
+
+        if (states_converge(s, &now, &old, &last, first_symbol)) {
+            reuse_tail(s, &old, &last, old_line, line_delta);
+            line = tail_last + line_delta;
+            restore_checkpoint(c, &s->checkpoints[line], line);
+            stats.reused = true;
+        }
+    }
+
+    s->failed = c->error_flag;
+    s->compiled = s->failed ? line - 1 : line;
+
+    s->result.code = c->code;
+    s->result.code_line = c->code_line;
+    s->result.code_size = c->code_size;
+    s->result.lines = c->line_number;
+    s->result.symbols = c->symbol_count;
+
+    if (info) {
+        *info = stats;
+    }
+    return s->failed ? -1 : 0;
+}
+
+const notcmp_result_t *notcmp_session_result(const notcmp_session_t *s) {
+    return &s->result;
+}
+
+void notcmp_session_free(notcmp_session_t *s) {
+    if (!s) {
+        return;
+    }
+    free(s->text);
+    free(s->line_start);
+    free(s->new_start);
+    free(s->checkpoints);
+    free(s);
+}
@@ -0,0 +1,128 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+/*
+ * NOTRAN compiler library
+ *
+ *  Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct {
+    int num_voices;         /* 4 or 8 */
+    uint16_t base_address;  /* Address the code is loaded at */
+    FILE *listing_file;     /* Listing output, or NULL for none */
+    bool relocatable;       /* Compile a module for the linker (see below) */
+} notcmp_options_t;
+
+/*
+ * Relocatable modules
+ *
+ * A module keeps its identifiers and the places where the code holds a
+ * JMP or JSR address, so that the linker can load it anywhere and join
+ * it with others. A JMP or JSR to an identifier not defined before is
+ * then an external reference, to be resolved against the exports of the
+ * library the module is linked with, instead of an error. Every
+ * identifier of a module is exported.
+ */
+typedef struct {
+    uint8_t id;
+    uint16_t offset;        /* Code offset of the identifier */
+} notcmp_symbol_t;
+
+typedef struct {
+    uint16_t offset;        /* Code offset of the address word */
+    uint8_t symbol;         /* 0 if the word is a code offset of the module
+                               itself, or the external identifier */
+} notcmp_reloc_t;
+
+typedef struct {
+    uint8_t *code;          /* NOTRAN bytecode */
+    int *code_line;         /* Source line of each code byte */
+    size_t code_size;
+    int lines;              /* Source lines read */
+    int symbols;            /* Identifiers defined */
+    notcmp_symbol_t *exports;   /* Relocatable modules only, else NULL */
+    int num_exports;
+    notcmp_reloc_t *relocs;
+    int num_relocs;
+    int externals;          /* External identifiers referenced */
+} notcmp_result_t;
+
+/**
+ * Compile a NOTRAN score. Errors are reported on stderr as they are
+ * found, with their source line.
+ *
+ * @param input Score source
+ * @param opts Compiler options
+ * @param result Compiled code, to be released with notcmp_free()
+ * @return 0 on success, -1 if there were errors
+ */
+int notcmp_compile(FILE *input, const notcmp_options_t *opts, notcmp_result_t *result);
+
+void notcmp_free(notcmp_result_t *result);
+
+/*
+ * Incremental compilation
+ *
+ * A session keeps the compiler state after every source line. When the
+ * source is updated, compilation restarts from the first changed line and
+ * stops as soon as the state matches again the one of the previous compile
+ * at the same point of the unchanged tail. The code of the tail is then
+ * moved into place and its addresses adjusted, instead of being compiled
+ * again.
+ */
+typedef struct notcmp_session notcmp_session_t;
+
+typedef struct {
+    int first_line;         /* First line compiled again */
+    int lines_compiled;     /* Lines run through the compiler */
+    bool reused;            /* The tail of the previous compile was reused */
+} notcmp_update_t;
+
+/**
+ * Create an incremental compilation session. The listing file and the
+ * relocatable flag of the options are ignored.
+ *
+ * @return The session, to be released with notcmp_session_free(), or NULL
+ */
+notcmp_session_t *notcmp_session_new(const notcmp_options_t *opts);
+
+/**
+ * Compile a new version of the score, reusing as much of the previous
+ * compile as possible. The result is the same as notcmp_compile() for
+ * the same source.
+ *
+ * @param source Complete score source
+ * @param length Source length in bytes
+ * @param info What was compiled, or NULL
+ * @return 0 on success, -1 if there were errors
+ */
+int notcmp_session_update(notcmp_session_t *s, const char *source, size_t length,
+                          notcmp_update_t *info);
+
+/**
+ * Result of the last update. The code belongs to the session and is valid
+ * until the next update; do not pass it to notcmp_free().
+ */
+const notcmp_result_t *notcmp_session_result(const notcmp_session_t *s);
+
+void notcmp_session_free(notcmp_session_t *s);
+
+#endif /* COMPILER_H */
@@ -0,0 +1,1421 @@
+/*
+ * NOTRAN to kim4v song table back end
+ *
+ * kim4v.asm plays songs made of 5 byte events: a duration followed by the
+ * note ID of each of its 4 voices. NOTRAN gives each voice its own note
+ * durations, so the bytecode is run through the same voice scheduling as
+ * the NOTRAN interpreter and every time slice becomes one event. JSR/RTS
+ * become refrain calls and returns and JMP a segment link. A subroutine
+ * called at several tempos is lowered once for each of them.
+ *
+ * The result is then made as small as possible for the basic 1K KIM-1:
+ * identical consecutive events are merged, repeated runs of events are
+ * moved to refrains and the table is split across the free memory areas,
+ * linked with segment links.
+ *
+ *  Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include "kim4v.h"
+
+/* NOTRAN bytecode, as emitted by notcmp.c */
+#define OP_END 0x00
+#define OP_TEMPO 0x10
+#define OP_JSR 0x20
+#define OP_RTS 0x30
+#define OP_JMP 0x40
+#define OP_SET_VOICES 0x50
+#define OP_LONG_NOTE 0x60
+#define OP_LONG_NOTE_REL 0x70
+#define OP_VOICE_DEACTIVATE 0x80
+#define OP_VOICE_ACTIVATE 0x90
+#define OP_PCM 0xA0
+#define OP_MASK 0xF0
+#define DURATION_MASK 0x0F
+#define PITCH_REST (-8)
+
+#define INACTIVE_VOICE_DURATION 0xFF
+#define DEFAULT_TEMPO 32
+
+/* kim4v.asm song table */
+#define NUM_VOICES 4
+#define K4_END 0
+#define K4_LINK 1
+#define K4_CALL 2
+#define K4_RETURN 3
+#define EVENT_SIZE 5
+#define JUMP_SIZE 3
+#define MIN_DURATION 4          /* 0-3 are control codes */
+#define MAX_DURATION 255
+
+/* kim4v.asm zero page: V1PT-V4PT, V1IN-V4IN, SONGA and TEMPO */
+#define HEADER_ADDRESS 0x0000
+#define HEADER_SIZE 0x17
+#define HEADER_SONGA 0x14
+#define HEADER_TEMPO 0x16
+
+/* FRQTAB goes from C2 (ID 2) to C6 (ID 0x62). NOTRAN note offsets are
+   twice the pitch, with C1 as pitch 1 */
+#define NOTE_ID_BASE 24
+#define MIN_NOTE_ID 0x02
+#define MAX_NOTE_ID 0x62
+#define OCTAVE_IDS 24
+
+#define MEMORY_SIZE 0x10000
+
+/* Pitch check: calls followed, and code bytes run for each one in the code */
+#define MAX_CALL_DEPTH 16
+#define PITCH_CHECK_STEPS 4
+
+/* Do not make refrains longer than this, it only bounds the search */
+#define MAX_REFRAIN_EVENTS 64
+
+/* Tempo values below this give too many long events to be worth it */
+#define MIN_EXACT_TEMPO 16
+
+static const uint8_t DURATION_TABLE[16] = {
+    0, 192, 144, 96, 72, 64, 48, 36, 32, 24, 18, 16, 12, 9, 8, 6
+};
+
+/* Free memory of a 1K KIM-1 with kim4v.asm loaded: page 2 up to the
+   waveform table, zero page after FRQTAB up to the monitor variables,
+   page 1 between P1END and the stack and the 6530 RAM up to the monitor
+   variables. */
+static const kim4v_region_t DEFAULT_REGIONS[] = {
+    { 0x0200, 0x02FF },
+    { 0x0082, 0x00EE },
+    { 0x01CD, 0x01DF },
+    { 0x1780, 0x17E6 }
+};
+
+#define DEFAULT_WAVE_PAGE 0x03
+
+/* ============================================================================
+ * Data Structures
+ * ============================================================================ */
+
+typedef enum {
+    ITEM_EVENT,
+    ITEM_CALL,
+    ITEM_JUMP,
+    ITEM_RETURN,
+    ITEM_END,
+    ITEM_LABEL
+} item_kind_t;
+
+typedef struct {
+    item_kind_t kind;
+    uint32_t samples;               /* Events: length in samples */
+    uint8_t duration;               /* Events: duration byte */
+    uint8_t notes[NUM_VOICES];      /* Events: note IDs */
+    int label;                      /* Target of calls and jumps, or label */
+    uint8_t tempo;                  /* NOTRAN tempo, 0 before the first TPO */
+    int line;                       /* Source line, for messages */
+    uint16_t address;               /* Set by the layout */
+} item_t;
+
+typedef struct {
+    item_t *items;
+    int count;
+    int capacity;
+} item_list_t;
+
+typedef struct {
+    uint8_t duration;               /* Remaining time units */
+    int note_offset;                /* Twice the NOTRAN pitch */
+    bool sounding;                  /* False for rests */
+    uint8_t waveform;
+    bool waveform_set;
+    bool waveform_warned;
+    bool range_warned;
+} voice_t;
+
+typedef struct {
+    size_t pc;
+    int label;
+    int line;
+} target_t;
+
+/* State where the code order reaches a jump or call target, to lower a
+   subroutine again at another tempo */
+typedef struct {
+    size_t pc;
+    uint8_t tempo;
+    voice_t voices[NUM_VOICES];
+    int num_active_voices;
+} entry_t;
+
+/* Subroutine lowered again at the tempo of a call */
+typedef struct {
+    size_t pc;
+    uint8_t tempo;
+    int label;
+} copy_t;
+
+/* Voice and pitch given to the note at each code position */
+typedef struct {
+    int8_t voice;                   /* -1 if no note starts here */
+    int note_offset;
+} note_t;
+
+typedef struct {
+    const uint8_t *code;
+    size_t size;
+    const int *lines;
+    const kim4v_options_t *opts;
+
+    item_list_t list;
+    item_list_t refrains;
+    int *pc_item;                   /* Item reached at each sync point, or -1 */
+    note_t *notes;                  /* Notes in code order */
+    bool *is_target;                /* Code positions jumped to or called */
+    target_t *targets;
+    int num_targets;
+    int num_labels;
+    entry_t *entries;
+    int num_entries;
+    copy_t *copies;
+    int num_copies;
+    bool copying;                   /* Lowering a copy of a subroutine */
+
+    voice_t voices[NUM_VOICES];
+    int num_active_voices;
+    uint8_t tempo;
+    uint8_t first_tempo;
+
+    int errors;
+} lower_t;
+
+/* ============================================================================
+ * Messages
+ * ============================================================================ */
+
+static int line_at(const lower_t *l, size_t pc) {
+    return (pc < l->size) ? l->lines[pc] : (l->size ? l->lines[l->size - 1] : 0);
+}
+
+static void report(lower_t *l, bool error, int line, const char *fmt, ...) {
+    va_list ap;
+
+    if (line > 0) {
+        fprintf(stderr, "kim4v: %s on line %d: ", error ? "Error" : "Warning", line);
+    } else {
+        fprintf(stderr, "kim4v: %s: ", error ? "Error" : "Warning");
+    }
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+
+    if (error) {
+        ++l->errors;
+    }
+}
+
+/* ============================================================================
+ * Options
+ * ============================================================================ */
+
+void kim4v_default_options(kim4v_options_t *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->num_regions = sizeof(DEFAULT_REGIONS) / sizeof(DEFAULT_REGIONS[0]);
+    memcpy(opts->regions, DEFAULT_REGIONS, sizeof(DEFAULT_REGIONS));
+    opts->wave_page = DEFAULT_WAVE_PAGE;
+}
+
+bool kim4v_parse_regions(const char *spec, kim4v_options_t *opts) {
+    int count = 0;
+
+    while (*spec) {
+        char *end;
+        const unsigned long start = strtoul(spec, &end, 0);
+        if (end == spec || *end != '-' || count >= KIM4V_MAX_REGIONS) {
+            return false;
+        }
+        spec = end + 1;
+
+        const unsigned long last = strtoul(spec, &end, 0);
+        if (end == spec || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        spec = (*end == ',') ? end + 1 : end;
+
+        /* Must hold at least an event and a segment link, and stay clear of
+           the zero page variables of kim4v.asm */
+        if (last >= MEMORY_SIZE || last < start + EVENT_SIZE + JUMP_SIZE - 1 ||
+            start < HEADER_ADDRESS + HEADER_SIZE) {
+            return false;
+        }
+        for (int i = 0; i < count; i++) {
+            if (start <= opts->regions[i].end && last >= opts->regions[i].start) {
+                return false;
+            }
+        }
+
+        opts->regions[count].start = (uint16_t)start;
+        opts->regions[count].end = (uint16_t)last;
+        ++count;
+    }
+
+    opts->num_regions = count;
+    return count > 0;
+}
+
+/* ============================================================================
+ * Item Lists
+ * ============================================================================ */
+
+static item_t *append_item(lower_t *l, item_list_t *list, item_kind_t kind, int line) {
+    if (list->count == list->capacity) {
+        const int capacity = list->capacity ? 2 * list->capacity : 64;
+        item_t *items = realloc(list->items, capacity * sizeof(item_t));
+        if (!items) {
+            report(l, true, 0, "Out of memory");
+            return NULL;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    item_t *item = &list->items[list->count++];
+    memset(item, 0, sizeof(*item));
+    item->kind = kind;
+    item->line = line;
+    return item;
+}
+
+static bool same_event(const item_t *a, const item_t *b) {
+    return a->kind == ITEM_EVENT && b->kind == ITEM_EVENT &&
+           a->duration == b->duration &&
+           memcmp(a->notes, b->notes, sizeof(a->notes)) == 0;
+}
+
+static int item_size(const item_t *item) {
+    switch (item->kind) {
+        case ITEM_EVENT:  return EVENT_SIZE;
+        case ITEM_CALL:
+        case ITEM_JUMP:   return JUMP_SIZE;
+        case ITEM_RETURN:
+        case ITEM_END:    return 1;
+        default:          return 0;
+    }
+}
+
+static bool falls_through(const item_t *item) {
+    return item->kind != ITEM_JUMP && item->kind != ITEM_RETURN &&
+           item->kind != ITEM_END;
+}
+
+/* ============================================================================
+ * Lowering
+ * ============================================================================ */
+
+static bool voices_in_sync(const lower_t *l) {
+    for (int i = 0; i < NUM_VOICES; i++) {
+        const uint8_t duration = l->voices[i].duration;
+        if (duration != INACTIVE_VOICE_DURATION && duration != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void add_target(lower_t *l, size_t pc, int line, item_t *item) {
+    /* Reuse the label of an earlier jump to the same place */
+    for (int i = 0; i < l->num_targets; i++) {
+        if (l->targets[i].pc == pc) {
+            item->label = l->targets[i].label;
+            return;
+        }
+    }
+
+    target_t *targets = realloc(l->targets, (l->num_targets + 1) * sizeof(target_t));
+    if (!targets) {
+        report(l, true, 0, "Out of memory");
+        return;
+    }
+    l->targets = targets;
+    l->targets[l->num_targets++] = (target_t){ pc, l->num_labels, line };
+    item->label = l->num_labels++;
+}
+
+/* Tempo of the notes that start now, the default one until it is set */
+static uint8_t current_tempo(const lower_t *l) {
+    return l->tempo ? l->tempo : DEFAULT_TEMPO;
+}
+
+/* Size of the note or control command at pc */
+static size_t command_size(const lower_t *l, size_t pc) {
+    const uint8_t op = l->code[pc];
+
+    if ((op & DURATION_MASK) != 0) {
+        return 1;
+    }
+    switch (op & OP_MASK) {
+        case OP_END:
+        case OP_RTS:
+            return 1;
+        case OP_JSR:
+        case OP_JMP:
+        case OP_LONG_NOTE:
+        case OP_LONG_NOTE_REL:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
+/* Marks the positions that are the target of a JSR or JMP */
+static void find_targets(lower_t *l) {
+    for (size_t pc = 0; pc < l->size; pc += command_size(l, pc)) {
+        const uint8_t op = l->code[pc];
+        if ((op & DURATION_MASK) == 0 && (op == OP_JSR || op == OP_JMP) &&
+            pc + 2 < l->size) {
+            const size_t target = l->code[pc + 1] | (l->code[pc + 2] << 8);
+            if (target <= l->size) {
+                l->is_target[target] = true;
+            }
+        }
+    }
+}
+
+/*
+ * Tempo left by the subroutine at pc when called at the given one,
+ * following its code in order up to the RTS.
+ */
+static uint8_t exit_tempo(const lower_t *l, size_t pc, uint8_t tempo, int depth) {
+    for (; pc < l->size; pc += command_size(l, pc)) {
+        const uint8_t op = l->code[pc];
+        if ((op & DURATION_MASK) != 0) {
+            continue;
+        }
+        const size_t target = (pc + 2 < l->size)
+                              ? (size_t)(l->code[pc + 1] | (l->code[pc + 2] << 8)) : l->size;
+
+        switch (op & OP_MASK) {
+            case OP_TEMPO:
+                if (pc + 1 < l->size && l->code[pc + 1] != 0) {
+                    tempo = l->code[pc + 1];
+                }
+                break;
+            case OP_JSR:
+                if (depth < MAX_CALL_DEPTH) {
+                    tempo = exit_tempo(l, target, tempo, depth + 1);
+                }
+                break;
+            case OP_END:
+            case OP_RTS:
+            case OP_JMP:
+                return tempo;
+            default:
+                break;
+        }
+    }
+    return tempo;
+}
+
+static void add_entry(lower_t *l, size_t pc) {
+    entry_t *entries = realloc(l->entries, (l->num_entries + 1) * sizeof(entry_t));
+    if (!entries) {
+        report(l, true, 0, "Out of memory");
+        return;
+    }
+    l->entries = entries;
+
+    entry_t *entry = &l->entries[l->num_entries++];
+    entry->pc = pc;
+    entry->tempo = current_tempo(l);
+    memcpy(entry->voices, l->voices, sizeof(l->voices));
+    entry->num_active_voices = l->num_active_voices;
+}
+
+/*
+ * Processes one control command. Returns the position of the next one,
+ * or the end of the code after END.
+ */
+static size_t lower_control(lower_t *l, size_t pc) {
+    const uint8_t op = l->code[pc] & OP_MASK;
+    const int line = line_at(l, pc);
+    const uint8_t arg = (pc + 1 < l->size) ? l->code[pc + 1] : 0;
+    const size_t target = (pc + 2 < l->size) ? (arg | (l->code[pc + 2] << 8)) : 0;
+    item_t *item;
+
+    switch (op) {
+        case OP_END:
+            append_item(l, &l->list, ITEM_END, line);
+            return l->size;
+
+        case OP_TEMPO:
+            if (l->first_tempo == 0) {
+                l->first_tempo = arg;
+            }
+            l->tempo = arg;
+            return pc + 2;
+
+        case OP_JSR:
+        case OP_JMP:
+            if (!voices_in_sync(l)) {
+                report(l, true, line, "%s while notes are still held",
+                       (op == OP_JSR) ? "JSR" : "JMP");
+            }
+            if (op == OP_JMP && l->copying) {
+                report(l, true, line, "JMP in a subroutine called at several tempos");
+            }
+            item = append_item(l, &l->list, (op == OP_JSR) ? ITEM_CALL : ITEM_JUMP, line);
+            if (item) {
+                add_target(l, target, line, item);
+                item->tempo = current_tempo(l);
+            }
+            if (item && op == OP_JSR) {
+                /* Go on with the tempo that the subroutine leaves */
+                const uint8_t tempo = exit_tempo(l, target, item->tempo, 0);
+                if (tempo != item->tempo) {
+                    if (l->first_tempo == 0) {
+                        l->first_tempo = tempo;
+                    }
+                    l->tempo = tempo;
+                }
+            }
+            return pc + 3;
+
+        case OP_RTS:
+            if (!voices_in_sync(l)) {
+                report(l, true, line, "RTS while notes are still held");
+            }
+            append_item(l, &l->list, ITEM_RETURN, line);
+            return pc + 1;
+
+        case OP_SET_VOICES:
+            l->num_active_voices = arg;
+            return pc + 2;
+
+        case OP_VOICE_DEACTIVATE:
+        case OP_VOICE_ACTIVATE: {
+            voice_t *voice = &l->voices[arg & (NUM_VOICES - 1)];
+            voice->duration = (op == OP_VOICE_ACTIVATE) ? 0 : INACTIVE_VOICE_DURATION;
+            voice->sounding = false;
+            return pc + 2;
+        }
+
+        case OP_PCM:
+            report(l, false, line, "PCM clip %d is not played by kim4v", arg + 1);
+            return pc + 2;
+
+        default:
+            report(l, true, line, "Undefined control command 0x%02X", l->code[pc]);
+            return l->size;
+    }
+}
+
+static void set_waveform(lower_t *l, int voice_idx, uint8_t waveform, int line) {
+    voice_t *voice = &l->voices[voice_idx];
+
+    if (!voice->waveform_set) {
+        voice->waveform = waveform;
+        voice->waveform_set = true;
+    } else if (voice->waveform != waveform && !voice->waveform_warned) {
+        report(l, false, line, "Voice %d changes to waveform %d, kim4v keeps "
+               "waveform %d for the whole song", voice_idx + 1, waveform + 1,
+               voice->waveform + 1);
+        voice->waveform_warned = true;
+    }
+}
+
+/*
+ * Gives a new note to every active voice whose note has run out, in voice
+ * order, as the NOTRAN interpreter does. Returns the position after the
+ * notes.
+ */
+static size_t assign_notes(lower_t *l, size_t pc) {
+    for (int i = 0; i < NUM_VOICES && pc < l->size; i++) {
+        voice_t *voice = &l->voices[i];
+
+        if (voice->duration != 0) {
+            continue;
+        }
+
+        const uint8_t op = l->code[pc];
+        const int line = line_at(l, pc);
+        uint8_t duration_code = op & DURATION_MASK;
+
+        if (duration_code != 0) {
+            const int pitch_nibble = (op & 0x80) ? (op >> 4) - 16 : (op >> 4);
+            if (pitch_nibble == PITCH_REST) {
+                voice->sounding = false;
+            } else {
+                voice->note_offset += pitch_nibble * 2;
+                voice->sounding = true;
+                if (!l->copying) {
+                    l->notes[pc] = (note_t){ (int8_t)i, voice->note_offset };
+                }
+                set_waveform(l, i, voice->waveform_set ? voice->waveform : 0, line);
+            }
+            pc += 1;
+        } else if ((op & OP_MASK) == OP_LONG_NOTE || (op & OP_MASK) == OP_LONG_NOTE_REL) {
+            const uint8_t pitch = (pc + 1 < l->size) ? l->code[pc + 1] : 0;
+            const uint8_t wd = (pc + 2 < l->size) ? l->code[pc + 2] : 0;
+
+            voice->note_offset = ((op & OP_MASK) == OP_LONG_NOTE)
+                                 ? pitch : voice->note_offset + (int8_t)pitch;
+            voice->sounding = true;
+            if (!l->copying) {
+                l->notes[pc] = (note_t){ (int8_t)i, voice->note_offset };
+            }
+            set_waveform(l, i, wd >> 4, line);
+            duration_code = wd & DURATION_MASK;
+            pc += 3;
+        } else {
+            break;
+        }
+
+        voice->duration = DURATION_TABLE[duration_code];
+
+        if (voice->sounding) {
+            const int id = voice->note_offset - NOTE_ID_BASE;
+            if ((id < MIN_NOTE_ID || id > MAX_NOTE_ID) && !voice->range_warned) {
+                report(l, false, line, "Voice %d plays notes out of the C2-C6 "
+                       "range of kim4v, moved by octaves into range", i + 1);
+                voice->range_warned = true;
+            }
+        }
+    }
+    return pc;
+}
+
+static void add_event(lower_t *l, uint8_t duration, int line) {
+    item_t *event = append_item(l, &l->list, ITEM_EVENT, line);
+    if (!event) {
+        return;
+    }
+
+    event->tempo = l->tempo;
+    event->samples = (uint32_t)current_tempo(l) * duration;
+
+    for (int i = 0; i < NUM_VOICES; i++) {
+        const voice_t *voice = &l->voices[i];
+        if (i < l->num_active_voices && voice->duration != INACTIVE_VOICE_DURATION &&
+            voice->sounding) {
+            int id = voice->note_offset - NOTE_ID_BASE;
+            while (id < MIN_NOTE_ID) {
+                id += OCTAVE_IDS;
+            }
+            while (id > MAX_NOTE_ID) {
+                id -= OCTAVE_IDS;
+            }
+            event->notes[i] = (uint8_t)id;
+        }
+    }
+}
+
+/*
+ * Walks the bytecode in order from pc, turning every time slice into an
+ * event. The positions where all the voices are in step are recorded, as
+ * only those can be the target of a jump in kim4v. A copy of a subroutine
+ * ends at its RTS.
+ */
+static void lower_code(lower_t *l, size_t pc) {
+    while (l->errors == 0) {
+        while (pc < l->size) {
+            if (voices_in_sync(l) && !l->copying) {
+                l->pc_item[pc] = l->list.count;
+                if (l->is_target[pc]) {
+                    add_entry(l, pc);
+                }
+            }
+            const uint8_t op = l->code[pc];
+            if ((op & DURATION_MASK) != 0 || (op & OP_MASK) == OP_LONG_NOTE ||
+                (op & OP_MASK) == OP_LONG_NOTE_REL) {
+                break;
+            }
+            pc = lower_control(l, pc);
+            if (l->copying && l->list.items[l->list.count - 1].kind == ITEM_RETURN) {
+                return;
+            }
+        }
+
+        if (pc >= l->size) {
+            if (l->list.count == 0 || l->list.items[l->list.count - 1].kind != ITEM_END) {
+                append_item(l, &l->list, ITEM_END, line_at(l, pc));
+            }
+            return;
+        }
+
+        const size_t start = pc;
+        pc = assign_notes(l, pc);
+
+        uint8_t shortest = INACTIVE_VOICE_DURATION;
+        for (int i = 0; i < NUM_VOICES; i++) {
+            const uint8_t duration = l->voices[i].duration;
+            if (duration != INACTIVE_VOICE_DURATION && duration != 0 && duration < shortest) {
+                shortest = duration;
+            }
+        }
+
+        if (shortest == INACTIVE_VOICE_DURATION) {
+            if (pc == start) {
+                report(l, true, line_at(l, pc), "No voices active");
+                return;
+            }
+            continue;
+        }
+
+        add_event(l, shortest, line_at(l, start));
+
+        for (int i = 0; i < NUM_VOICES; i++) {
+            if (l->voices[i].duration != INACTIVE_VOICE_DURATION) {
+                l->voices[i].duration -= shortest;
+            }
+        }
+    }
+}
+
+/*
+ * Inserts a label item at the place each jump target was reached.
+ */
+static void place_labels(lower_t *l) {
+    item_list_t out = {0};
+
+    for (int i = 0; i < l->num_targets; i++) {
+        const target_t *t = &l->targets[i];
+        if (t->pc > l->size || l->pc_item[t->pc] < 0) {
+            report(l, true, t->line, "Jump target is not at a point where all "
+                   "voices start a note together");
+        }
+    }
+    if (l->errors) {
+        return;
+    }
+
+    for (int pos = 0; pos <= l->list.count; pos++) {
+        for (int i = 0; i < l->num_targets; i++) {
+            if (l->pc_item[l->targets[i].pc] == pos) {
+                item_t *label = append_item(l, &out, ITEM_LABEL, l->targets[i].line);
+                if (label) {
+                    label->label = l->targets[i].label;
+                }
+            }
+        }
+        if (pos < l->list.count) {
+            item_t *item = append_item(l, &out, ITEM_EVENT, 0);
+            if (item) {
+                *item = l->list.items[pos];
+            }
+        }
+    }
+
+    free(l->list.items);
+    l->list = out;
+}
+
+/*
+ * The song table holds the pitches of a single pass over the code, in code
+ * order. Relative pitches depend on the note played before, so they can
+ * differ when the code is reached through JSR or JMP, as in a loop that
+ * transposes itself. Follows the NOTRAN control flow for a while to find
+ * those notes and warns about each voice that plays one.
+ */
+static void check_pitches(lower_t *l) {
+    int pitch[NUM_VOICES] = {0};
+    bool warned[NUM_VOICES] = {false};
+    size_t stack[MAX_CALL_DEPTH];
+    int depth = 0;
+    size_t pc = 0;
+
+    for (size_t steps = 0; steps < PITCH_CHECK_STEPS * (l->size + 1) && pc < l->size; steps++) {
+        const uint8_t op = l->code[pc];
+        const size_t target = (pc + 2 < l->size)
+                              ? (size_t)(l->code[pc + 1] | (l->code[pc + 2] << 8)) : l->size;
+
+        if ((op & DURATION_MASK) != 0) {
+            const int pitch_nibble = (op & 0x80) ? (op >> 4) - 16 : (op >> 4);
+            if (pitch_nibble != PITCH_REST && l->notes[pc].voice >= 0) {
+                pitch[l->notes[pc].voice] += pitch_nibble * 2;
+            }
+        } else if ((op & OP_MASK) == OP_LONG_NOTE || (op & OP_MASK) == OP_LONG_NOTE_REL) {
+            const int8_t arg = (pc + 1 < l->size) ? (int8_t)l->code[pc + 1] : 0;
+            if (l->notes[pc].voice >= 0) {
+                pitch[l->notes[pc].voice] = ((op & OP_MASK) == OP_LONG_NOTE)
+                                            ? (uint8_t)arg : pitch[l->notes[pc].voice] + arg;
+            }
+        }
+
+        const note_t *note = &l->notes[pc];
+        if (note->voice >= 0 && pitch[note->voice] != note->note_offset) {
+            if (!warned[note->voice]) {
+                report(l, false, line_at(l, pc), "Voice %d plays relative pitches that "
+                       "depend on how this point is reached, kim4v repeats the pitches "
+                       "of the code order", note->voice + 1);
+                warned[note->voice] = true;
+            }
+            pitch[note->voice] = note->note_offset;
+        }
+
+        if ((op & DURATION_MASK) != 0) {
+            pc += 1;
+            continue;
+        }
+
+        switch (op & OP_MASK) {
+            case OP_LONG_NOTE:
+            case OP_LONG_NOTE_REL:
+                pc += 3;
+                break;
+            case OP_JSR:
+                if (depth == MAX_CALL_DEPTH) {
+                    return;
+                }
+                stack[depth++] = pc + 3;
+                pc = target;
+                break;
+            case OP_RTS:
+                if (depth == 0) {
+                    return;
+                }
+                pc = stack[--depth];
+                break;
+            case OP_JMP:
+                pc = target;
+                break;
+            case OP_TEMPO:
+            case OP_SET_VOICES:
+            case OP_VOICE_DEACTIVATE:
+            case OP_VOICE_ACTIVATE:
+            case OP_PCM:
+                pc += 2;
+                break;
+            default:
+                return;
+        }
+    }
+}
+
+static const entry_t *find_entry(const lower_t *l, int label) {
+    for (int i = 0; i < l->num_targets; i++) {
+        if (l->targets[i].label != label) {
+            continue;
+        }
+        for (int j = 0; j < l->num_entries; j++) {
+            if (l->entries[j].pc == l->targets[i].pc) {
+                return &l->entries[j];
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Lowers the subroutine at the entry again at tempo, after the song */
+static int lower_copy(lower_t *l, const entry_t *entry, uint8_t tempo, int line) {
+    copy_t *copies = realloc(l->copies, (l->num_copies + 1) * sizeof(copy_t));
+    if (!copies) {
+        report(l, true, 0, "Out of memory");
+        return 0;
+    }
+    l->copies = copies;
+
+    const int label = l->num_labels++;
+    l->copies[l->num_copies++] = (copy_t){ entry->pc, tempo, label };
+
+    item_t *mark = append_item(l, &l->list, ITEM_LABEL, line);
+    if (mark) {
+        mark->label = label;
+    }
+
+    /* The warnings already given are not repeated */
+    for (int v = 0; v < NUM_VOICES; v++) {
+        l->voices[v].duration = entry->voices[v].duration;
+        l->voices[v].note_offset = entry->voices[v].note_offset;
+        l->voices[v].sounding = entry->voices[v].sounding;
+    }
+    l->num_active_voices = entry->num_active_voices;
+    l->tempo = tempo;
+
+    l->copying = true;
+    lower_code(l, entry->pc);
+    l->copying = false;
+    return label;
+}
+
+/*
+ * Subroutines are lowered in code order, at the tempo found there, but
+ * NOTRAN plays them at the tempo of each call. Calls made at another tempo
+ * go to a copy lowered at theirs, which goes after the end of the song and
+ * may make more copies for the calls in it. A jump keeps the tempo of the
+ * code order, so only a warning can be given for it.
+ */
+static void lower_copies(lower_t *l) {
+    for (int i = 0; i < l->list.count && !l->errors; i++) {
+        const item_t *item = &l->list.items[i];
+        if (item->kind != ITEM_CALL && item->kind != ITEM_JUMP) {
+            continue;
+        }
+
+        const entry_t *entry = find_entry(l, item->label);
+        if (!entry || entry->tempo == item->tempo) {
+            continue;
+        }
+        if (item->kind == ITEM_JUMP) {
+            report(l, false, item->line, "JMP at tempo %u to code lowered at tempo %u, "
+                   "kim4v keeps the tempo of the code order", item->tempo, entry->tempo);
+            continue;
+        }
+
+        int label = -1;
+        for (int c = 0; c < l->num_copies; c++) {
+            if (l->copies[c].pc == entry->pc && l->copies[c].tempo == item->tempo) {
+                label = l->copies[c].label;
+            }
+        }
+        if (label < 0) {
+            label = lower_copy(l, entry, item->tempo, item->line);
+        }
+        l->list.items[i].label = label;
+    }
+}
+
+/* Warns about the first note left that is played before any TPO */
+static void check_tempo_set(lower_t *l) {
+    for (int i = 0; i < l->list.count; i++) {
+        const item_t *item = &l->list.items[i];
+        if (item->kind == ITEM_EVENT && item->tempo == 0) {
+            report(l, false, item->line, "Tempo not set, using default of %d", DEFAULT_TEMPO);
+            return;
+        }
+    }
+}
+
+static bool label_used(const lower_t *l, int label) {
+    for (int i = 0; i < l->list.count; i++) {
+        const item_t *item = &l->list.items[i];
+        if ((item->kind == ITEM_CALL || item->kind == ITEM_JUMP) && item->label == label) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Removes the subroutines that are only reached through copies now: the
+ * items from a label that nothing refers to and that cannot be fallen
+ * into, up to the first one that does not fall through.
+ */
+static void drop_unused(lower_t *l) {
+    bool dropped = true;
+
+    while (dropped) {
+        dropped = false;
+
+        for (int i = 0; i < l->list.count && !dropped; i++) {
+            const item_t *items = l->list.items;
+            if (items[i].kind != ITEM_LABEL || label_used(l, items[i].label)) {
+                continue;
+            }
+
+            int before = i - 1;
+            while (before >= 0 && items[before].kind == ITEM_LABEL) {
+                --before;
+            }
+            if (before < 0 || falls_through(&items[before])) {
+                continue;
+            }
+
+            int end = i + 1;
+            bool reached = false;
+            for (; end < l->list.count && falls_through(&items[end - 1]); end++) {
+                if (items[end].kind == ITEM_LABEL && label_used(l, items[end].label)) {
+                    reached = true;
+                    break;
+                }
+            }
+            if (reached || falls_through(&items[end - 1])) {
+                continue;
+            }
+
+            memmove(&l->list.items[i], &l->list.items[end],
+                    (l->list.count - end) * sizeof(item_t));
+            l->list.count -= end - i;
+            dropped = true;
+        }
+    }
+}
+
+/* ============================================================================
+ * Timing
+ * ============================================================================ */
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b) {
+        const uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static void merge_events(lower_t *l) {
+    int out = 0;
+
+    for (int i = 0; i < l->list.count; i++) {
+        item_t *item = &l->list.items[i];
+        item_t *prev = out ? &l->list.items[out - 1] : NULL;
+
+        if (prev && prev->kind == ITEM_EVENT && item->kind == ITEM_EVENT &&
+            memcmp(prev->notes, item->notes, sizeof(item->notes)) == 0) {
+            prev->samples += item->samples;
+        } else {
+            l->list.items[out++] = *item;
+        }
+    }
+    l->list.count = out;
+}
+
+/*
+ * kim4v has a single TEMPO for the whole song, so each event length in
+ * samples must become a duration byte times TEMPO. An exact TEMPO that
+ * divides every length is used when there is one that is not too small,
+ * otherwise the first NOTRAN tempo is kept and durations are rounded.
+ */
+static uint8_t choose_tempo(lower_t *l) {
+    uint32_t common = 0, shortest = UINT32_MAX;
+
+    for (int i = 0; i < l->list.count; i++) {
+        const item_t *item = &l->list.items[i];
+        if (item->kind == ITEM_EVENT) {
+            common = gcd(item->samples, common);
+            if (item->samples < shortest) {
+                shortest = item->samples;
+            }
+        }
+    }
+    if (common == 0) {
+        return l->first_tempo ? l->first_tempo : DEFAULT_TEMPO;
+    }
+
+    uint32_t limit = shortest / MIN_DURATION;
+    if (limit > MAX_DURATION) {
+        limit = MAX_DURATION;
+    }
+    if (limit == 0) {
+        limit = 1;
+    }
+
+    for (uint32_t tempo = limit; tempo >= MIN_EXACT_TEMPO; tempo--) {
+        if (common % tempo == 0) {
+            return (uint8_t)tempo;
+        }
+    }
+
+    const uint8_t tempo = (l->first_tempo < limit) ? l->first_tempo : (uint8_t)limit;
+    report(l, false, 0, "Tempo changes cannot be followed exactly, durations are "
+           "rounded to multiples of %u samples", tempo);
+    return tempo;
+}
+
+/*
+ * Converts event lengths to duration bytes, splitting events longer than
+ * the largest duration into several identical ones.
+ */
+static void set_durations(lower_t *l, uint8_t tempo) {
+    item_list_t out = {0};
+
+    for (int i = 0; i < l->list.count && !l->errors; i++) {
+        const item_t *item = &l->list.items[i];
+
+        if (item->kind != ITEM_EVENT) {
+            item_t *copy = append_item(l, &out, item->kind, item->line);
+            if (copy) {
+                *copy = *item;
+            }
+            continue;
+        }
+
+        uint32_t units = (item->samples + tempo / 2) / tempo;
+        if (units < MIN_DURATION) {
+            report(l, false, item->line, "Note too short for kim4v, lengthened "
+                   "to %d units", MIN_DURATION);
+            units = MIN_DURATION;
+        }
+
+        const uint32_t parts = (units + MAX_DURATION - 1) / MAX_DURATION;
+        for (uint32_t p = 0; p < parts; p++) {
+            item_t *event = append_item(l, &out, ITEM_EVENT, item->line);
+            if (event) {
+                *event = *item;
+                event->duration = (uint8_t)(units / parts + (p < units % parts));
+            }
+        }
+    }
+
+    free(l->list.items);
+    l->list = out;
+}
+
+/* ============================================================================
+ * Size Optimization
+ * ============================================================================ */
+
+/*
+ * Finds the run of events that saves most space when moved to a refrain
+ * and replaces every copy with a call. Each copy of L events costs 5 * L
+ * bytes in line and 3 as a call, and the refrain itself 5 * L + 1.
+ * Returns false when no run is worth it.
+ */
+static bool extract_refrain(lower_t *l) {
+    const int n = l->list.count;
+    const item_t *items = l->list.items;
+
+    /* match[i * (n + 1) + j]: number of equal events starting at i and j */
+    uint8_t *match = calloc((size_t)(n + 1) * (n + 1), 1);
+    int *copies = malloc(n * sizeof(int));
+    if (!match || !copies) {
+        free(match);
+        free(copies);
+        return false;
+    }
+
+    for (int i = n - 1; i >= 0; i--) {
+        for (int j = n - 1; j > i; j--) {
+            if (same_event(&items[i], &items[j])) {
+                const int next = match[(i + 1) * (n + 1) + j + 1];
+                match[i * (n + 1) + j] = (next < MAX_REFRAIN_EVENTS) ? next + 1 : next;
+            }
+        }
+    }
+
+    int best_savings = 0, best_start = 0, best_length = 0;
+
+    for (int i = 0; i < n; i++) {
+        const uint8_t *row = &match[i * (n + 1)];
+        int longest = 0;
+        for (int j = i + 1; j < n; j++) {
+            if (row[j] > longest) {
+                longest = row[j];
+            }
+        }
+
+        for (int length = 2; length <= longest; length++) {
+            int count = 1;
+            for (int j = i + length; j < n; j++) {
+                if (row[j] >= length) {
+                    ++count;
+                    j += length - 1;
+                }
+            }
+            const int savings = EVENT_SIZE * length * count - JUMP_SIZE * count
+                                - EVENT_SIZE * length - 1;
+            if (savings > best_savings) {
+                best_savings = savings;
+                best_start = i;
+                best_length = length;
+            }
+        }
+    }
+
+    if (best_savings == 0) {
+        free(match);
+        free(copies);
+        return false;
+    }
+
+    /* Collect the copies, then build the refrain and the new item list */
+    const uint8_t *row = &match[best_start * (n + 1)];
+    int num_copies = 0;
+    copies[num_copies++] = best_start;
+    for (int j = best_start + best_length; j < n; j++) {
+        if (row[j] >= best_length) {
+            copies[num_copies++] = j;
+            j += best_length - 1;
+        }
+    }
+
+    const int label = l->num_labels++;
+    item_t *mark = append_item(l, &l->refrains, ITEM_LABEL, items[best_start].line);
+    if (mark) {
+        mark->label = label;
+    }
+    for (int k = 0; k < best_length; k++) {
+        item_t *event = append_item(l, &l->refrains, ITEM_EVENT, 0);
+        if (event) {
+            *event = items[best_start + k];
+        }
+    }
+    append_item(l, &l->refrains, ITEM_RETURN, 0);
+
+    item_list_t out = {0};
+    int next_copy = 0;
+    for (int i = 0; i < n; i++) {
+        if (next_copy < num_copies && copies[next_copy] == i) {
+            item_t *call = append_item(l, &out, ITEM_CALL, items[i].line);
+            if (call) {
+                call->label = label;
+            }
+            i += best_length - 1;
+            ++next_copy;
+        } else {
+            item_t *copy = append_item(l, &out, ITEM_EVENT, 0);
+            if (copy) {
+                *copy = items[i];
+            }
+        }
+    }
+
+    free(l->list.items);
+    l->list = out;
+    free(match);
+    free(copies);
+    return true;
+}
+
+/* ============================================================================
+ * Layout
+ * ============================================================================ */
+
+static void put_byte(kim4v_song_t *song, uint16_t *addr, uint8_t value) {
+    song->memory[(*addr)++] = value;
+}
+
+static void put_jump(kim4v_song_t *song, uint16_t *addr, uint8_t code, uint16_t target) {
+    put_byte(song, addr, code);
+    put_byte(song, addr, target & 0xFF);
+    put_byte(song, addr, target >> 8);
+}
+
+/*
+ * Lays out the main items and then the refrains across the regions, in
+ * order, moving to the next region with a segment link when the next item
+ * would not leave room for one.
+ */
+static int layout(lower_t *l, item_t *items, int count, kim4v_song_t *song,
+                  uint16_t *region_used) {
+    const kim4v_options_t *opts = l->opts;
+    int region = 0;
+    uint16_t addr = opts->regions[0].start;
+    bool fallthrough = false;
+
+    for (int i = 0; i < count; i++) {
+        item_t *item = &items[i];
+        const int size = item_size(item);
+        const int needed = size + (falls_through(item) ? JUMP_SIZE : 0);
+
+        while (addr + needed > opts->regions[region].end + 1) {
+            region_used[region] = addr;
+            if (region + 1 >= opts->num_regions) {
+                return -1;
+            }
+            ++region;
+            if (fallthrough) {
+                uint16_t link = region_used[region - 1];
+                put_jump(song, &link, K4_LINK, opts->regions[region].start);
+                region_used[region - 1] = link;
+            }
+            addr = opts->regions[region].start;
+        }
+
+        item->address = addr;
+        addr += size;
+        if (item->kind != ITEM_LABEL) {
+            fallthrough = falls_through(item);
+        }
+    }
+
+    region_used[region] = addr;
+    for (int r = region + 1; r < opts->num_regions; r++) {
+        region_used[r] = opts->regions[r].start;
+    }
+    return 0;
+}
+
+static uint16_t label_address(const item_t *items, int count, int label) {
+    for (int i = 0; i < count; i++) {
+        if (items[i].kind == ITEM_LABEL && items[i].label == label) {
+            return items[i].address;
+        }
+    }
+    return 0;
+}
+
+static void emit_items(const item_t *items, int count, kim4v_song_t *song) {
+    for (int i = 0; i < count; i++) {
+        const item_t *item = &items[i];
+        uint16_t addr = item->address;
+
+        switch (item->kind) {
+            case ITEM_EVENT:
+                put_byte(song, &addr, item->duration);
+                for (int v = 0; v < NUM_VOICES; v++) {
+                    put_byte(song, &addr, item->notes[v]);
+                }
+                ++song->events;
+                break;
+            case ITEM_CALL:
+            case ITEM_JUMP:
+                put_jump(song, &addr, (item->kind == ITEM_CALL) ? K4_CALL : K4_LINK,
+                         label_address(items, count, item->label));
+                break;
+            case ITEM_RETURN:
+                put_byte(song, &addr, K4_RETURN);
+                break;
+            case ITEM_END:
+                put_byte(song, &addr, K4_END);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static void emit_header(const lower_t *l, kim4v_song_t *song) {
+    uint8_t *header = song->memory + HEADER_ADDRESS;
+    const uint16_t start = l->opts->regions[0].start;
+
+    memset(header, 0, HEADER_SIZE);
+    for (int v = 0; v < NUM_VOICES; v++) {
+        header[3 * v + 2] = l->opts->wave_page + l->voices[v].waveform;
+    }
+    header[HEADER_SONGA] = start & 0xFF;
+    header[HEADER_SONGA + 1] = start >> 8;
+    header[HEADER_TEMPO] = song->tempo;
+
+    song->segments[song->num_segments++] = (objfile_segment_t){
+        header, HEADER_SIZE, HEADER_ADDRESS
+    };
+}
+
+/* ============================================================================
+ * Public Interface
+ * ============================================================================ */
+
+int kim4v_lower(const uint8_t *code, size_t size, const int *lines,
+                const kim4v_options_t *opts, kim4v_song_t *song) {
+    lower_t l = {
+        .code = code,
+        .size = size,
+        .lines = lines,
+        .opts = opts,
+        .num_active_voices = NUM_VOICES
+    };
+
+    memset(song, 0, sizeof(*song));
+    for (int i = 0; i < NUM_VOICES; i++) {
+        l.voices[i].duration = INACTIVE_VOICE_DURATION;
+    }
+
+    l.pc_item = malloc((size + 1) * sizeof(int));
+    l.notes = malloc((size + 1) * sizeof(note_t));
+    l.is_target = calloc(size + 1, sizeof(bool));
+    song->memory = calloc(MEMORY_SIZE, 1);
+    if (!l.pc_item || !l.notes || !l.is_target || !song->memory) {
+        report(&l, true, 0, "Out of memory");
+    }
+    for (size_t i = 0; l.pc_item && l.notes && i <= size; i++) {
+        l.pc_item[i] = -1;
+        l.notes[i].voice = -1;
+    }
+
+    if (!l.errors) {
+        find_targets(&l);
+        lower_code(&l, 0);
+    }
+    if (!l.errors) {
+        place_labels(&l);
+    }
+    if (!l.errors) {
+        check_pitches(&l);
+        lower_copies(&l);
+        drop_unused(&l);
+        check_tempo_set(&l);
+    }
+    if (!l.errors) {
+        merge_events(&l);
+        song->tempo = choose_tempo(&l);
+        set_durations(&l, song->tempo);
+    }
+    while (!l.errors && extract_refrain(&l)) {
+        ++song->refrains;
+    }
+
+    if (!l.errors) {
+        /* Refrains go after the end of the song */
+        const int total = l.list.count + l.refrains.count;
+        item_t *all = malloc((total ? total : 1) * sizeof(item_t));
+        uint16_t used[KIM4V_MAX_REGIONS];
+
+        if (!all) {
+            report(&l, true, 0, "Out of memory");
+        } else {
+            memcpy(all, l.list.items, l.list.count * sizeof(item_t));
+            memcpy(all + l.list.count, l.refrains.items, l.refrains.count * sizeof(item_t));
+
+            if (layout(&l, all, total, song, used) != 0) {
+                size_t bytes = 0;
+                for (int i = 0; i < total; i++) {
+                    bytes += item_size(&all[i]);
+                }
+                report(&l, true, 0, "Song does not fit in the available memory "
+                       "(%zu bytes plus segment links)", bytes);
+            } else {
+                emit_items(all, total, song);
+                emit_header(&l, song);
+                for (int r = 0; r < opts->num_regions; r++) {
+                    const size_t bytes = used[r] - opts->regions[r].start;
+                    if (bytes) {
+                        song->segments[song->num_segments++] = (objfile_segment_t){
+                            song->memory + opts->regions[r].start, bytes,
+                            opts->regions[r].start
+                        };
+                        song->size += bytes;
+                    }
+                }
+            }
+            free(all);
+        }
+    }
+
+    free(l.pc_item);
+    free(l.notes);
+    free(l.is_target);
+    free(l.targets);
+    free(l.entries);
+    free(l.copies);
+    free(l.list.items);
+    free(l.refrains.items);
+
+    if (l.errors) {
+        kim4v_free(song);
+        return -1;
+    }
+    return 0;
+}
+
+int kim4v_write(const kim4v_song_t *song, output_format_t format, FILE *file) {
+    if (format == OUT_BIN) {
+        fprintf(stderr, "kim4v: Error: Song tables need pap or ihex output\n");
+        return -1;
+    }
+    return objfile_write_segments(format, file, song->segments, song->num_segments);
+}
+
+void kim4v_free(kim4v_song_t *song) {
+    free(song->memory);
+    song->memory = NULL;
+    song->num_segments = 0;
+}
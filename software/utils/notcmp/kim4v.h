@@ -0,0 +1,89 @@
+#ifndef KIM4V_H
+#define KIM4V_H
+/*
+ * NOTRAN to kim4v song table back end
+ *
+ *  Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "objfile.h"
+
+#define KIM4V_MAX_REGIONS 8
+
+typedef struct {
+    uint16_t start;         /* First free address */
+    uint16_t end;           /* Last free address, inclusive */
+} kim4v_region_t;
+
+typedef struct {
+    kim4v_region_t regions[KIM4V_MAX_REGIONS];
+    int num_regions;
+    uint8_t wave_page;      /* Page of the table for waveform 1 */
+} kim4v_options_t;
+
+typedef struct {
+    uint8_t *memory;        /* 64K image holding all the segments */
+    objfile_segment_t segments[KIM4V_MAX_REGIONS + 1];
+    int num_segments;
+    int events;             /* Events in the song table */
+    int refrains;           /* Refrains created to save space */
+    size_t size;            /* Song table size, without the header */
+    uint8_t tempo;          /* Value for TEMPO */
+} kim4v_song_t;
+
+/**
+ * Set the defaults: the free memory of a basic 1K KIM-1 running kim4v.asm
+ * and its single waveform table at page 3.
+ */
+void kim4v_default_options(kim4v_options_t *opts);
+
+/**
+ * Parse a comma separated list of start-end address ranges, in the order
+ * they are to be filled, into opts.
+ *
+ * @return true on success, false if the list is malformed
+ */
+bool kim4v_parse_regions(const char *spec, kim4v_options_t *opts);
+
+/**
+ * Lower NOTRAN bytecode to a kim4v song table laid out in the regions.
+ * Anything that kim4v cannot express is reported on stderr, using lines
+ * to map each code byte to its source line.
+ *
+ * @param code NOTRAN bytecode, with addresses relative to its start
+ * @param size Size of the bytecode
+ * @param lines Source line of each byte of code
+ * @param opts Memory layout
+ * @param song Result, to be released with kim4v_free()
+ * @return 0 on success, -1 on error
+ */
+int kim4v_lower(const uint8_t *code, size_t size, const int *lines,
+                const kim4v_options_t *opts, kim4v_song_t *song);
+
+/**
+ * Write the song, including the zero page header that sets SONGA, TEMPO
+ * and the waveform pages, in a hex format.
+ *
+ * @return 0 on success, -1 on error
+ */
+int kim4v_write(const kim4v_song_t *song, output_format_t format, FILE *file);
+
+void kim4v_free(kim4v_song_t *song);
+
+#endif /* KIM4V_H */
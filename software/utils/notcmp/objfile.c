@@ -1,5 +1,6 @@
 /*
- * Support functions for outputting different object file formats
+ * Support functions for outputting different object file formats, and
+ * for reading PAP files back
  * 
  *  Copyright (C) 2025 Eduardo Casino
  *
@@ -22,6 +23,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
 #include "objfile.h"
 
 /* Format-specific constants */
@@ -38,6 +40,9 @@
 #define INTEL_RECORD_SUFFIX  "%02X\n"
 #define INTEL_EOF_RECORD     ":00000001FF\n"
 
+/* Longest PAP record: ;LLAAAA, 255 data bytes, checksum and line end */
+#define PAP_MAX_LINE         (7 + 255 * 2 + 4 + 2)
+
 /*
  * Calculate checksum for a line of data.
  * For both formats, checksum includes: byte_count + address_high + address_low + data_bytes
@@ -141,17 +146,16 @@ static int write_binary_format(FILE *file, const uint8_t *data, size_t size)
 }
 
 /*
- * Write data in hex format (PAP or Intel HEX).
- * Breaks data into lines and writes records with checksums.
+ * Write the data records for one block of data in hex format (PAP or
+ * Intel HEX), adding the number of records written to line_count.
  */
-static int write_hex_format(FILE *file, const uint8_t *data, size_t size, 
-                            uint16_t base_addr, bool is_pap)
+static int write_hex_records(FILE *file, const uint8_t *data, size_t size, 
+                             uint16_t base_addr, bool is_pap, uint16_t *line_count)
 {
     const uint8_t bytes_per_line = is_pap ? PAP_BYTES_PER_LINE : INTEL_BYTES_PER_LINE;
     uint8_t line_buffer[MAX_BYTES_PER_LINE];
     size_t bytes_remaining = size;
     uint16_t current_addr = base_addr;
-    uint16_t line_count = 0;
     
     while (bytes_remaining > 0) {
         /* Determine bytes for this line */
@@ -179,7 +183,23 @@ static int write_hex_format(FILE *file, const uint8_t *data, size_t size,
         data += bytes_this_line;
         bytes_remaining -= bytes_this_line;
         current_addr += bytes_this_line;
-        ++line_count;
+        ++*line_count;
+    }
+    
+    return 0;
+}
+
+/*
+ * Write data in hex format (PAP or Intel HEX).
+ * Breaks data into lines and writes records with checksums.
+ */
+static int write_hex_format(FILE *file, const uint8_t *data, size_t size, 
+                            uint16_t base_addr, bool is_pap)
+{
+    uint16_t line_count = 0;
+    
+    if (write_hex_records(file, data, size, base_addr, is_pap, &line_count) < 0) {
+        return -1;
     }
     
     /* Write format-specific trailer */
@@ -210,4 +230,120 @@ int objfile_write(output_format_t format, FILE *file, uint8_t *data,
         default:
             return -1;
     }
-}
\ No newline at end of file
+}
+
+int objfile_write_segments(output_format_t format, FILE *file,
+                           const objfile_segment_t *segments, int count)
+{
+    if (!file || !segments || count < 0) {
+        return -1;
+    }
+    
+    if (format == OUT_BIN) {
+        if (count != 1) {
+            return -1;
+        }
+        return write_binary_format(file, segments[0].data, segments[0].size);
+    }
+    
+    if (format != OUT_PAP && format != OUT_IHEX) {
+        return -1;
+    }
+    
+    const bool is_pap = (format == OUT_PAP);
+    uint16_t line_count = 0;
+    
+    for (int i = 0; i < count; ++i) {
+        if (write_hex_records(file, segments[i].data, segments[i].size,
+                              segments[i].address, is_pap, &line_count) < 0) {
+            return -1;
+        }
+    }
+    
+    return is_pap ? write_pap_trailer(file, line_count) : write_intel_eof(file);
+}
+
+/*
+ * Parse digits hex digits, returning -1 if any is not one.
+ */
+static int parse_hex(const char *text, int digits)
+{
+    int value = 0;
+    
+    for (int i = 0; i < digits; ++i) {
+        const char c = text[i];
+        int nibble;
+        
+        if (c >= '0' && c <= '9') {
+            nibble = c - '0';
+        } else if (c >= 'A' && c <= 'F') {
+            nibble = c - 'A' + 10;
+        } else if (c >= 'a' && c <= 'f') {
+            nibble = c - 'a' + 10;
+        } else {
+            return -1;
+        }
+        value = (value << 4) | nibble;
+    }
+    return value;
+}
+
+long objfile_read_pap(FILE *file, const char *filename,
+                      objfile_record_fn record, void *context)
+{
+    char line[PAP_MAX_LINE + 1];
+    int number = 0;
+    long loaded = 0;
+    
+    while (fgets(line, sizeof(line), file)) {
+        ++number;
+        line[strcspn(line, "\r\n")] = '\0';
+        
+        /* Anything else is not part of the data */
+        if (line[0] != ';') {
+            continue;
+        }
+        
+        const int length = parse_hex(line + 1, 2);
+        if (length == 0) {
+            return loaded;
+        }
+        
+        const int addr = parse_hex(line + 3, 4);
+        if (length < 0 || addr < 0 || strlen(line) != 7 + (size_t)length * 2 + 4) {
+            fprintf(stderr, "Error: Malformed record on line %d of '%s'\n",
+                    number, filename);
+            return -1;
+        }
+        
+        uint8_t data[255];
+        for (int i = 0; i < length; ++i) {
+            const int value = parse_hex(line + 7 + 2 * i, 2);
+            if (value < 0) {
+                fprintf(stderr, "Error: Malformed record on line %d of '%s'\n",
+                        number, filename);
+                return -1;
+            }
+            data[i] = (uint8_t)value;
+        }
+        
+        if (parse_hex(line + 7 + 2 * length, 4) !=
+            calculate_checksum((uint16_t)addr, data, (uint8_t)length)) {
+            fprintf(stderr, "Error: Bad checksum on line %d of '%s'\n",
+                    number, filename);
+            return -1;
+        }
+        
+        if (record(context, (uint16_t)addr, data, length) != 0) {
+            return -1;
+        }
+        loaded += length;
+    }
+    
+    if (ferror(file)) {
+        fprintf(stderr, "Error: Cannot read '%s': %s\n", filename, strerror(errno));
+    } else {
+        fprintf(stderr, "Error: No trailer record in '%s'\n", filename);
+    }
+    return -1;
+}
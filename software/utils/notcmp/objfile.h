@@ -1,7 +1,8 @@
 #ifndef OBJFILE_H
 #define OBJFILE_H
 /*
- * Support functions for outputting different object file formats
+ * Support functions for outputting different object file formats, and
+ * for reading PAP files back
  * 
  *  Copyright (C) 2025 Eduardo Casino
  *
@@ -42,4 +43,50 @@ typedef enum {
 int objfile_write(output_format_t format, FILE *file, uint8_t *data, 
                   size_t size, uint16_t base_addr);
 
+typedef struct {
+    const uint8_t *data;    /* Segment contents */
+    size_t size;            /* Number of bytes */
+    uint16_t address;       /* Load address */
+} objfile_segment_t;
+
+/**
+ * Write several segments, each at its own address, to a single file.
+ * Hex formats get a single trailer at the end. Binary format only
+ * supports a single segment, as it cannot hold addresses.
+ *
+ * @param format Output format (binary, PAP, or Intel HEX)
+ * @param file Output file handle (must be writable)
+ * @param segments Segments to write
+ * @param count Number of segments
+ * @return 0 on success, -1 on error
+ */
+int objfile_write_segments(output_format_t format, FILE *file,
+                           const objfile_segment_t *segments, int count);
+
+/**
+ * Called with the data of every record read from a PAP file.
+ *
+ * @param context Passed through from objfile_read_pap()
+ * @param address Load address of the data
+ * @param data Data bytes of the record
+ * @param size Number of bytes, 1 to 255
+ * @return 0 to go on, -1 to stop the read with an error
+ */
+typedef int (*objfile_record_fn)(void *context, uint16_t address,
+                                 const uint8_t *data, size_t size);
+
+/**
+ * Read the data records of a PAP file up to its trailer, checking their
+ * format and checksums. Lines that do not start with ';' are skipped.
+ * Errors are reported on stderr, with the line number.
+ *
+ * @param file Input file handle
+ * @param filename Name of the file, for messages
+ * @param record Called with the data of each record, in file order
+ * @param context Passed to record
+ * @return Number of data bytes read, or -1 on error
+ */
+long objfile_read_pap(FILE *file, const char *filename,
+                      objfile_record_fn record, void *context);
+
 #endif /* OBJFILE_H */
\ No newline at end of file
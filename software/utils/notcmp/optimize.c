@@ -0,0 +1,564 @@
+/*
+ * NOTRAN whole program optimizer
+ *
+ *  Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "optimize.h"
+
+/* ============================================================================
+ * Constants and Data Structures
+ * ============================================================================ */
+
+#define CONTROL_MASK    0x0F    /* Clear in control commands and long notes */
+#define OPCODE_MASK     0xF0
+
+#define OP_END          0x00
+#define OP_TEMPO        0x10
+#define OP_JSR          0x20
+#define OP_RTS          0x30
+#define OP_JMP          0x40
+#define OP_SET_VOICES   0x50
+#define OP_LONG_NOTE    0x60
+#define OP_LONG_NOTE_REL 0x70
+#define OP_DEACTIVATE   0x80
+#define OP_ACTIVATE     0x90
+#define OP_PCM          0xA0
+
+#define CALL_SIZE       3       /* JSR and its address */
+#define INLINE_SPEED_MAX 16     /* Largest body inlined at OPTIMIZE_SPEED */
+#define MAX_PASSES      16
+#define MAX_PROGRAM     0xFFFF
+
+/*
+ * A command. Jumps and calls point to the id of their target, so that
+ * commands can be added and removed without fixing the addresses until
+ * the code is written again.
+ */
+typedef struct {
+    uint8_t bytes[3];
+    uint8_t length;
+    int line;
+    uint16_t origin;        /* Offset of the command, or of the one it was
+                               copied from, in the code as compiled */
+    int id;
+    int target;             /* Id of the target of JMP and JSR, else -1 */
+    bool reachable;
+} command_t;
+
+typedef struct {
+    command_t *commands;
+    int count;
+    int *position;          /* Of each id, -1 if removed */
+    int next_id;
+    int id_capacity;
+    FILE *report;
+    uint16_t base;
+    notcmp_optimize_t stats;
+} program_t;
+
+/* ============================================================================
+ * Decoding
+ * ============================================================================ */
+
+static uint8_t opcode(const command_t *cmd) {
+    return (cmd->bytes[0] & CONTROL_MASK) == 0 ? (cmd->bytes[0] & OPCODE_MASK) : 0xFF;
+}
+
+static bool is_jump(const command_t *cmd) {
+    return opcode(cmd) == OP_JMP;
+}
+
+static bool is_call(const command_t *cmd) {
+    return opcode(cmd) == OP_JSR;
+}
+
+/* True if the next command is never run after this one */
+static bool ends_flow(const command_t *cmd) {
+    const uint8_t op = opcode(cmd);
+    return op == OP_JMP || op == OP_RTS || op == OP_END;
+}
+
+static size_t command_length(uint8_t byte) {
+    if ((byte & CONTROL_MASK) != 0) {
+        return 1;               /* Short note */
+    }
+
+    switch (byte & OPCODE_MASK) {
+        case OP_TEMPO:
+        case OP_SET_VOICES:
+        case OP_DEACTIVATE:
+        case OP_ACTIVATE:
+        case OP_PCM:
+            return 2;
+        case OP_JSR:
+        case OP_JMP:
+        case OP_LONG_NOTE:
+        case OP_LONG_NOTE_REL:
+            return 3;
+        default:
+            return 1;
+    }
+}
+
+static int new_id(program_t *p) {
+    if (p->next_id >= p->id_capacity) {
+        const int capacity = p->id_capacity ? p->id_capacity * 2 : 256;
+        int *bigger = realloc(p->position, capacity * sizeof(int));
+        if (!bigger) {
+            return -1;
+        }
+        p->position = bigger;
+        p->id_capacity = capacity;
+    }
+    p->position[p->next_id] = -1;
+    return p->next_id++;
+}
+
+static void update_positions(program_t *p) {
+    for (int i = 0; i < p->next_id; i++) {
+        p->position[i] = -1;
+    }
+    for (int i = 0; i < p->count; i++) {
+        p->position[p->commands[i].id] = i;
+    }
+}
+
+static command_t *target_of(const program_t *p, const command_t *cmd) {
+    return &p->commands[p->position[cmd->target]];
+}
+
+/*
+ * Split the code into commands and link the jumps and calls to their
+ * targets, which must be the start of a command
+ */
+static int decode(program_t *p, const notcmp_result_t *result) {
+    p->commands = malloc((result->code_size ? result->code_size : 1) * sizeof(command_t));
+    int *at_offset = malloc((result->code_size + 1) * sizeof(int));
+    if (!p->commands || !at_offset) {
+        free(at_offset);
+        fprintf(stderr, "Cannot allocate optimizer state\n");
+        return -1;
+    }
+
+    for (size_t i = 0; i <= result->code_size; i++) {
+        at_offset[i] = -1;
+    }
+
+    size_t offset = 0;
+    while (offset < result->code_size) {
+        command_t *cmd = &p->commands[p->count];
+        const size_t length = command_length(result->code[offset]);
+        if (offset + length > result->code_size) {
+            fprintf(stderr, "Not optimized: truncated command at 0x%04zX\n", offset);
+            free(at_offset);
+            return -1;
+        }
+
+        memcpy(cmd->bytes, &result->code[offset], length);
+        cmd->length = (uint8_t)length;
+        cmd->line = result->code_line[offset];
+        cmd->origin = (uint16_t)offset;
+        cmd->target = -1;
+        cmd->reachable = false;
+        cmd->id = new_id(p);
+        if (cmd->id < 0) {
+            free(at_offset);
+            fprintf(stderr, "Cannot allocate optimizer state\n");
+            return -1;
+        }
+        at_offset[offset] = p->count++;
+        offset += length;
+    }
+
+    for (int i = 0; i < p->count; i++) {
+        command_t *cmd = &p->commands[i];
+        if (is_jump(cmd) || is_call(cmd)) {
+            const uint16_t address = cmd->bytes[1] | (cmd->bytes[2] << 8);
+            if (address >= result->code_size || at_offset[address] < 0) {
+                fprintf(stderr, "Not optimized: %s at 0x%04X to 0x%04X is not to a command\n",
+                        is_jump(cmd) ? "JMP" : "JSR", cmd->origin, address);
+                free(at_offset);
+                return -1;
+            }
+            cmd->target = p->commands[at_offset[address]].id;
+        }
+    }
+
+    free(at_offset);
+    update_positions(p);
+    return 0;
+}
+
+/* ============================================================================
+ * Passes
+ * ============================================================================ */
+
+/* Remove the commands that no path from the start reaches */
+static bool remove_unreachable(program_t *p) {
+    int *pending = malloc((p->count + 1) * sizeof(int));
+    if (!pending) {
+        return false;
+    }
+
+    for (int i = 0; i < p->count; i++) {
+        p->commands[i].reachable = false;
+    }
+
+    int top = 0;
+    if (p->count > 0) {
+        pending[top++] = 0;
+    }
+    while (top > 0) {
+        int i = pending[--top];
+        while (i < p->count && !p->commands[i].reachable) {
+            command_t *cmd = &p->commands[i];
+            cmd->reachable = true;
+            if (is_jump(cmd) || is_call(cmd)) {
+                const int target = p->position[cmd->target];
+                if (!p->commands[target].reachable) {
+                    pending[top++] = target;
+                }
+            }
+            if (ends_flow(cmd)) {
+                break;
+            }
+            i++;
+        }
+    }
+    free(pending);
+
+    bool changed = false;
+    int out = 0;
+    for (int i = 0; i < p->count; i++) {
+        if (p->commands[i].reachable) {
+            p->commands[out++] = p->commands[i];
+            continue;
+        }
+
+        int bytes = 0, j = i;
+        while (j < p->count && !p->commands[j].reachable) {
+            bytes += p->commands[j++].length;
+        }
+        if (p->report) {
+            fprintf(p->report, "  Removed unreachable code at 0x%04X (%d bytes, line %d)\n",
+                    (uint16_t)(p->base + p->commands[i].origin), bytes, p->commands[i].line);
+        }
+        p->stats.unreachable += bytes;
+        changed = true;
+        i = j - 1;
+    }
+    p->count = out;
+    update_positions(p);
+    return changed;
+}
+
+/*
+ * Send jumps and calls to a jump to the end of the chain, turn jumps to
+ * RTS or END into the command itself and remove jumps to the next command
+ */
+static bool thread_jumps(program_t *p) {
+    bool changed = false;
+    int out = 0;
+    int *removed = malloc(p->next_id * sizeof(int));    /* Target of each
+                                                           removed jump */
+    if (!removed) {
+        return false;
+    }
+    for (int i = 0; i < p->next_id; i++) {
+        removed[i] = -1;
+    }
+
+    for (int i = 0; i < p->count; i++) {
+        command_t cmd = p->commands[i];
+
+        if (is_jump(&cmd) || is_call(&cmd)) {
+            const command_t *target = target_of(p, &cmd);
+            for (int n = 0; is_jump(target) && n < p->count; n++) {
+                cmd.target = target->target;
+                target = target_of(p, target);
+            }
+            if (is_jump(target)) {
+                /* Endless loop of jumps, left for the jump limit to end */
+                cmd.target = p->commands[i].target;
+                target = target_of(p, &cmd);
+            }
+            if (cmd.target != p->commands[i].target) {
+                if (p->report) {
+                    fprintf(p->report, "  Threaded %s at 0x%04X to 0x%04X\n",
+                            is_jump(&cmd) ? "JMP" : "JSR",
+                            (uint16_t)(p->base + cmd.origin), (uint16_t)(p->base + target->origin));
+                }
+                p->stats.threaded++;
+                changed = true;
+            }
+
+            const uint8_t op = opcode(target);
+            if (is_jump(&cmd) && (op == OP_RTS || op == OP_END)) {
+                if (p->report) {
+                    fprintf(p->report, "  Replaced JMP at 0x%04X by %s\n",
+                            (uint16_t)(p->base + cmd.origin), op == OP_RTS ? "RTS" : "END");
+                }
+                cmd.bytes[0] = target->bytes[0];
+                cmd.length = 1;
+                cmd.target = -1;
+                p->stats.threaded++;
+                changed = true;
+            } else if (is_jump(&cmd) && !is_jump(target) && p->position[cmd.target] == i + 1) {
+                if (p->report) {
+                    fprintf(p->report, "  Removed JMP to the next command at 0x%04X\n",
+                            (uint16_t)(p->base + cmd.origin));
+                }
+                p->stats.removed_jumps++;
+                removed[cmd.id] = cmd.target;
+                changed = true;
+                continue;
+            }
+        }
+        p->commands[out++] = cmd;
+    }
+
+    /* Anything still sent to a removed jump goes to the next command, as
+       the jump did */
+    for (int i = 0; i < out; i++) {
+        command_t *cmd = &p->commands[i];
+        if (cmd->target >= 0 && removed[cmd->target] >= 0) {
+            cmd->target = removed[cmd->target];
+        }
+    }
+    free(removed);
+
+    p->count = out;
+    update_positions(p);
+    return changed;
+}
+
+typedef struct {
+    int calls;              /* Calls to the refrain */
+    int end;                /* Position of its RTS, -1 if not inlinable */
+    int bytes;              /* Size of the body, without the RTS */
+    bool inline_it;
+} refrain_t;
+
+/* Find the RTS that ends the straight body at entry, or -1 */
+static int body_end(const program_t *p, int entry, int *bytes) {
+    *bytes = 0;
+    for (int i = entry; i < p->count; i++) {
+        const command_t *cmd = &p->commands[i];
+        const uint8_t op = opcode(cmd);
+        if (op == OP_RTS) {
+            return i;
+        }
+        if (op == OP_JMP || op == OP_JSR || op == OP_END) {
+            return -1;
+        }
+        *bytes += cmd->length;
+    }
+    return -1;
+}
+
+/*
+ * True if the body and RTS of the refrain at entry go once all its calls
+ * are inlined: nothing else jumps into them and the command before does
+ * not run into them
+ */
+static bool body_goes(const program_t *p, int entry, int end) {
+    if (entry == 0 || !ends_flow(&p->commands[entry - 1])) {
+        return false;
+    }
+
+    for (int i = 0; i < p->count; i++) {
+        const command_t *cmd = &p->commands[i];
+        if (cmd->target < 0) {
+            continue;
+        }
+        const int target = p->position[cmd->target];
+        if (target >= entry && target <= end && !(is_call(cmd) && target == entry)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Replace calls by the body of the refrain where it pays */
+static int inline_calls(program_t *p, int level, bool *changed) {
+    refrain_t *refrains = calloc(p->count ? p->count : 1, sizeof(refrain_t));
+    if (!refrains) {
+        return -1;
+    }
+
+    int new_count = p->count;
+    for (int i = 0; i < p->count; i++) {
+        if (is_call(&p->commands[i])) {
+            refrains[p->position[p->commands[i].target]].calls++;
+        }
+    }
+
+    for (int entry = 0; entry < p->count; entry++) {
+        refrain_t *r = &refrains[entry];
+        if (r->calls == 0 || (r->end = body_end(p, entry, &r->bytes)) <= entry) {
+            continue;
+        }
+
+        const int saved = body_goes(p, entry, r->end) ? r->bytes + 1 : 0;
+        const int growth = r->calls * (r->bytes - CALL_SIZE) - saved;
+        r->inline_it = growth <= 0 || (level >= OPTIMIZE_SPEED && r->bytes <= INLINE_SPEED_MAX);
+        if (r->inline_it) {
+            new_count += r->calls * (r->end - entry - 1);
+        }
+    }
+
+    command_t *commands = malloc((new_count ? new_count : 1) * sizeof(command_t));
+    if (!commands) {
+        free(refrains);
+        return -1;
+    }
+
+    int out = 0;
+    for (int i = 0; i < p->count; i++) {
+        const command_t *cmd = &p->commands[i];
+        const int entry = is_call(cmd) ? p->position[cmd->target] : -1;
+        if (entry < 0 || !refrains[entry].inline_it) {
+            commands[out++] = *cmd;
+            continue;
+        }
+
+        for (int j = entry; j < refrains[entry].end; j++) {
+            /* The first command takes the place of the call */
+            command_t copy = p->commands[j];
+            copy.id = (j == entry) ? cmd->id : new_id(p);
+            if (copy.id < 0) {
+                free(commands);
+                free(refrains);
+                return -1;
+            }
+            commands[out++] = copy;
+        }
+        p->stats.inlined++;
+        *changed = true;
+    }
+
+    if (p->report) {
+        for (int entry = 0; entry < p->count; entry++) {
+            if (refrains[entry].inline_it) {
+                fprintf(p->report, "  Inlined refrain at 0x%04X (%d bytes, line %d) into %d call%s\n",
+                        (uint16_t)(p->base + p->commands[entry].origin), refrains[entry].bytes,
+                        p->commands[entry].line, refrains[entry].calls,
+                        refrains[entry].calls == 1 ? "" : "s");
+            }
+        }
+    }
+
+    free(p->commands);
+    free(refrains);
+    p->commands = commands;
+    p->count = out;
+    update_positions(p);
+    return 0;
+}
+
+/* ============================================================================
+ * Public Interface
+ * ============================================================================ */
+
+static int encode(const program_t *p, notcmp_result_t *result) {
+    size_t size = 0;
+    uint16_t *offset = malloc((p->count ? p->count : 1) * sizeof(uint16_t));
+    if (!offset) {
+        return -1;
+    }
+    for (int i = 0; i < p->count; i++) {
+        offset[i] = (uint16_t)size;
+        size += p->commands[i].length;
+    }
+    if (size > MAX_PROGRAM) {
+        fprintf(stderr, "Not optimized: code would be %zu bytes\n", size);
+        free(offset);
+        return -1;
+    }
+
+    uint8_t *code = malloc(size ? size : 1);
+    int *code_line = malloc((size ? size : 1) * sizeof(int));
+    if (!code || !code_line) {
+        free(code);
+        free(code_line);
+        free(offset);
+        return -1;
+    }
+
+    for (int i = 0; i < p->count; i++) {
+        const command_t *cmd = &p->commands[i];
+        memcpy(&code[offset[i]], cmd->bytes, cmd->length);
+        for (int j = 0; j < cmd->length; j++) {
+            code_line[offset[i] + j] = cmd->line;
+        }
+        if (cmd->target >= 0) {
+            const uint16_t address = offset[p->position[cmd->target]];
+            code[offset[i] + 1] = address & 0xFF;
+            code[offset[i] + 2] = address >> 8;
+        }
+    }
+    free(offset);
+
+    free(result->code);
+    free(result->code_line);
+    result->code = code;
+    result->code_line = code_line;
+    result->code_size = size;
+    return 0;
+}
+
+int notcmp_optimize(notcmp_result_t *result, int level, uint16_t base_address,
+                    FILE *report, notcmp_optimize_t *stats) {
+    program_t p = { .report = report, .base = base_address };
+    p.stats.old_size = result->code_size;
+
+    int status = decode(&p, result);
+    if (status == 0 && report) {
+        fprintf(report, "Optimization:\n");
+    }
+
+    for (int pass = 0; status == 0 && pass < MAX_PASSES; pass++) {
+        bool changed = remove_unreachable(&p);
+        changed |= thread_jumps(&p);
+        if (inline_calls(&p, level, &changed) != 0) {
+            fprintf(stderr, "Cannot allocate optimizer state\n");
+            status = -1;
+        } else if (!changed) {
+            break;
+        }
+    }
+
+    if (status == 0) {
+        status = encode(&p, result);
+    }
+    if (status == 0 && report) {
+        fprintf(report, "  Code size: %zu bytes, was %zu\n", result->code_size, p.stats.old_size);
+    }
+    if (stats) {
+        *stats = p.stats;
+    }
+
+    free(p.commands);
+    free(p.position);
+    return status;
+}
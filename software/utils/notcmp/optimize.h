@@ -0,0 +1,57 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+/*
+ * NOTRAN whole program optimizer
+ *
+ *  Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include "compiler.h"
+
+#define OPTIMIZE_SIZE   1   /* Only changes that do not make the code bigger */
+#define OPTIMIZE_SPEED  2   /* Also inline small refrains at every call */
+
+typedef struct {
+    size_t old_size;
+    int unreachable;        /* Bytes of unreachable code removed */
+    int inlined;            /* Calls replaced by the refrain body */
+    int threaded;           /* Jumps and calls sent straight to their end */
+    int removed_jumps;      /* Jumps to the next command removed */
+} notcmp_optimize_t;
+
+/**
+ * Optimize the code of a whole program, starting at its first byte. The
+ * program flows through calls and jumps only, so the code that can run
+ * is known exactly: the rest is removed, jumps to jumps go straight to
+ * the end of the chain, and refrains are inlined at their calls where
+ * that does not make the code bigger, or, at OPTIMIZE_SPEED, where they
+ * are small. Every change is written to report, if not NULL, with the
+ * addresses of the code as compiled.
+ *
+ * The notes played are the same, but fewer jumps may be made to play
+ * them, which matters if the jumps are limited (notint -j).
+ *
+ * @param level OPTIMIZE_SIZE or OPTIMIZE_SPEED
+ * @param base_address Address the code is loaded at, for the report
+ * @param stats What was done, or NULL
+ * @return 0 on success, -1 on error, with the code left as it was
+ */
+int notcmp_optimize(notcmp_result_t *result, int level, uint16_t base_address,
+                    FILE *report, notcmp_optimize_t *stats);
+
+#endif /* OPTIMIZE_H */
@@ -0,0 +1,144 @@
+/*
+ * NOTRAN relocatable object files, written by notcmp for the linker
+ *
+ *  Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "relobj.h"
+
+#define RELOBJ_MAGIC        "NREL"
+#define RELOBJ_VERSION      1
+#define RELOBJ_HEADER_SIZE  12
+#define EXPORT_SIZE         3
+#define RELOC_SIZE          3
+
+static inline void put_le16(uint8_t *p, uint16_t value) {
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+static inline uint16_t get_le16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+int relobj_write(FILE *file, const notcmp_result_t *c, int num_voices) {
+    uint8_t header[RELOBJ_HEADER_SIZE];
+    memcpy(header, RELOBJ_MAGIC, 4);
+    header[4] = RELOBJ_VERSION;
+    header[5] = (uint8_t)num_voices;
+    put_le16(header + 6, (uint16_t)c->code_size);
+    put_le16(header + 8, (uint16_t)c->num_exports);
+    put_le16(header + 10, (uint16_t)c->num_relocs);
+
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+        fwrite(c->code, 1, c->code_size, file) != c->code_size) {
+        return -1;
+    }
+
+    for (int i = 0; i < c->num_exports; i++) {
+        uint8_t entry[EXPORT_SIZE];
+        entry[0] = c->exports[i].id;
+        put_le16(entry + 1, c->exports[i].offset);
+        if (fwrite(entry, 1, sizeof(entry), file) != sizeof(entry)) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < c->num_relocs; i++) {
+        uint8_t entry[RELOC_SIZE];
+        put_le16(entry, c->relocs[i].offset);
+        entry[2] = c->relocs[i].symbol;
+        if (fwrite(entry, 1, sizeof(entry), file) != sizeof(entry)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int relobj_read(const char *filename, relobj_t *obj) {
+    memset(obj, 0, sizeof(*obj));
+
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open module '%s'\n", filename);
+        return -1;
+    }
+
+    uint8_t header[RELOBJ_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, RELOBJ_MAGIC, 4) != 0 || header[4] != RELOBJ_VERSION) {
+        fprintf(stderr, "Error: '%s' is not a NOTRAN relocatable module\n", filename);
+        fclose(file);
+        return -1;
+    }
+
+    obj->num_voices = header[5];
+    obj->code_size = get_le16(header + 6);
+    obj->num_exports = get_le16(header + 8);
+    obj->num_relocs = get_le16(header + 10);
+
+    obj->code = malloc(obj->code_size ? obj->code_size : 1);
+    obj->exports = malloc((obj->num_exports ? obj->num_exports : 1) * sizeof(notcmp_symbol_t));
+    obj->relocs = malloc((obj->num_relocs ? obj->num_relocs : 1) * sizeof(notcmp_reloc_t));
+    if (!obj->code || !obj->exports || !obj->relocs) {
+        fprintf(stderr, "Error: Cannot allocate module '%s'\n", filename);
+        fclose(file);
+        relobj_free(obj);
+        return -1;
+    }
+
+    bool ok = fread(obj->code, 1, obj->code_size, file) == obj->code_size;
+
+    for (int i = 0; ok && i < obj->num_exports; i++) {
+        uint8_t entry[EXPORT_SIZE];
+        ok = fread(entry, 1, sizeof(entry), file) == sizeof(entry);
+        obj->exports[i].id = entry[0];
+        obj->exports[i].offset = get_le16(entry + 1);
+        ok = ok && obj->exports[i].offset <= obj->code_size;
+    }
+
+    for (int i = 0; ok && i < obj->num_relocs; i++) {
+        uint8_t entry[RELOC_SIZE];
+        ok = fread(entry, 1, sizeof(entry), file) == sizeof(entry);
+        obj->relocs[i].offset = get_le16(entry);
+        obj->relocs[i].symbol = entry[2];
+        ok = ok && obj->relocs[i].offset + 2u <= obj->code_size;
+    }
+
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Error: Module '%s' is truncated or damaged\n", filename);
+        relobj_free(obj);
+        return -1;
+    }
+    return 0;
+}
+
+void relobj_free(relobj_t *obj) {
+    free(obj->code);
+    free(obj->exports);
+    free(obj->relocs);
+    obj->code = NULL;
+    obj->exports = NULL;
+    obj->relocs = NULL;
+}
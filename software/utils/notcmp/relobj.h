@@ -0,0 +1,63 @@
+#ifndef RELOBJ_H
+#define RELOBJ_H
+/*
+ * NOTRAN relocatable object files, written by notcmp for the linker
+ *
+ *  Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "compiler.h"
+
+/*
+ * File layout, little endian:
+ *
+ *   "NREL", version (1 byte), voices (1 byte), code size (2 bytes),
+ *   exports (2 bytes), relocations (2 bytes)
+ *   Code
+ *   Exports: identifier (1 byte) and code offset (2 bytes) each
+ *   Relocations: code offset (2 bytes) and symbol (1 byte) each
+ */
+typedef struct {
+    int num_voices;
+    uint8_t *code;
+    size_t code_size;
+    notcmp_symbol_t *exports;
+    int num_exports;
+    notcmp_reloc_t *relocs;
+    int num_relocs;
+} relobj_t;
+
+/**
+ * Write the module of a relocatable compile.
+ *
+ * @return 0 on success, -1 on error
+ */
+int relobj_write(FILE *file, const notcmp_result_t *c, int num_voices);
+
+/**
+ * Read a module. Errors are reported on stderr.
+ *
+ * @param obj Module read, to be released with relobj_free()
+ * @return 0 on success, -1 on error
+ */
+int relobj_read(const char *filename, relobj_t *obj);
+
+void relobj_free(relobj_t *obj);
+
+#endif /* RELOBJ_H */
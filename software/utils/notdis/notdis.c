@@ -0,0 +1,473 @@
+/*
+ * notdis - NOTRAN object code disassembler
+ *
+ * Decodes NOTRAN bytecode with the same command semantics as the
+ * interpreter and lists every command with its address, the sample time
+ * of its first execution, the length of the notes and the running byte
+ * count. Times come from a silent run of the interpreter library, which
+ * can also report how often each command ran, the 6502 cycles notint.asm
+ * is predicted to spend interpreting it and the samples played after it.
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include "synth.h"
+
+/* ============================================================================
+ * Constants
+ * ============================================================================ */
+
+#define DEFAULT_JUMPS       16
+#define NUM_WAVETABLES      16      /* Waveform field of the long notes */
+
+#define PITCH_MASK          0xF0
+#define DURATION_MASK       0x0F
+
+#define CMD_END             0x00
+#define CMD_TEMPO           0x10
+#define CMD_CALL            0x20
+#define CMD_RETURN          0x30
+#define CMD_JUMP            0x40
+#define CMD_SETVOICES       0x50
+#define CMD_LONGNOTE_ABS    0x60
+#define CMD_LONGNOTE_REL    0x70
+#define CMD_DEACTIVATE      0x80
+#define CMD_ACTIVATE        0x90
+#define CMD_PCM             0xA0
+
+#define PITCH_REST          (-8)
+
+#define MAX_INSTRUCTION     40
+
+/* ============================================================================
+ * Type Definitions
+ * ============================================================================ */
+
+typedef struct {
+    const char *input_file;
+    const char *output_file;
+    uint16_t base_address;
+    uint32_t max_jumps;
+    int voices;
+    bool profile;
+} config_t;
+
+/* ============================================================================
+ * Global Data
+ * ============================================================================ */
+
+/* Duration codes 1 to 15, as written in the score */
+static const char *DURATION_NAMES[16] = {
+    "?", "W", "H.", "H", "Q.", "H3", "Q", "E.",
+    "Q3", "E", "S.", "E3", "S", "T.", "S3", "T"
+};
+
+static const char *NOTE_NAMES[12] = {
+    "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"
+};
+
+/* ============================================================================
+ * Decoding
+ * ============================================================================ */
+
+/*
+ * Length in bytes of the command at the start of code, clipped to the
+ * bytes left
+ */
+static size_t command_length(const uint8_t *code, size_t left) {
+    size_t length = 1;
+
+    if ((code[0] & DURATION_MASK) == 0) {
+        switch (code[0] & PITCH_MASK) {
+            case CMD_TEMPO:
+            case CMD_SETVOICES:
+            case CMD_DEACTIVATE:
+            case CMD_ACTIVATE:
+            case CMD_PCM:
+                length = 2;
+                break;
+            case CMD_CALL:
+            case CMD_JUMP:
+            case CMD_LONGNOTE_ABS:
+            case CMD_LONGNOTE_REL:
+                length = 3;
+                break;
+        }
+    }
+
+    return (length > left) ? left : length;
+}
+
+static inline uint16_t code_address(const uint8_t *code) {
+    return (uint16_t)code[1] | ((uint16_t)code[2] << 8);
+}
+
+static void pitch_name(char *buffer, size_t size, uint8_t pitch_byte) {
+    const int pitch = pitch_byte / 2;
+
+    if (pitch == 0) {
+        snprintf(buffer, size, "SILENCE");
+    } else {
+        snprintf(buffer, size, "%s%d", NOTE_NAMES[(pitch - 1) % 12],
+                 (pitch - 1) / 12 + 1);
+    }
+}
+
+/*
+ * Text of the command at code. Call and jump targets are offsets into the
+ * code, and are shown as addresses from base.
+ */
+static void decode_command(char *buffer, size_t size, const uint8_t *code,
+                           size_t length, uint16_t base) {
+    const uint8_t command = code[0];
+    const uint8_t duration_code = command & DURATION_MASK;
+
+    if (duration_code != 0) {
+        const int pitch = (int8_t)(command & PITCH_MASK) >> 4;
+        if (pitch == PITCH_REST) {
+            snprintf(buffer, size, "REST    %s", DURATION_NAMES[duration_code]);
+        } else {
+            snprintf(buffer, size, "NOTE    %+d %s", pitch,
+                     DURATION_NAMES[duration_code]);
+        }
+        return;
+    }
+
+    const uint8_t type = command & PITCH_MASK;
+    const bool complete = length == command_length(code, SIZE_MAX);
+
+    if (!complete) {
+        snprintf(buffer, size, ".BYTE   $%02X", command);
+        return;
+    }
+
+    switch (type) {
+        case CMD_END:
+            snprintf(buffer, size, "END");
+            break;
+        case CMD_TEMPO:
+            snprintf(buffer, size, "TEMPO   %d", code[1]);
+            break;
+        case CMD_CALL:
+            snprintf(buffer, size, "CALL    $%04X",
+                     (uint16_t)(base + code_address(code)));
+            break;
+        case CMD_RETURN:
+            snprintf(buffer, size, "RETURN");
+            break;
+        case CMD_JUMP:
+            snprintf(buffer, size, "JUMP    $%04X",
+                     (uint16_t)(base + code_address(code)));
+            break;
+        case CMD_SETVOICES:
+            snprintf(buffer, size, "VOICES  %d", code[1]);
+            break;
+        case CMD_DEACTIVATE:
+            snprintf(buffer, size, "DCT     %d", code[1] + 1);
+            break;
+        case CMD_ACTIVATE:
+            snprintf(buffer, size, "ACT     %d", code[1] + 1);
+            break;
+        case CMD_PCM:
+            snprintf(buffer, size, "PCM     %d", code[1] + 1);
+            break;
+        case CMD_LONGNOTE_ABS:
+        case CMD_LONGNOTE_REL: {
+            char pitch[16];
+            if (type == CMD_LONGNOTE_ABS) {
+                pitch_name(pitch, sizeof(pitch), code[1]);
+            } else {
+                snprintf(pitch, sizeof(pitch), "%+d", (int8_t)code[1] / 2);
+            }
+            const uint8_t wd = code[2];
+            snprintf(buffer, size, "%s   %s %s WAVE %d",
+                     (type == CMD_LONGNOTE_ABS) ? "LNOTE" : "LNREL",
+                     pitch, DURATION_NAMES[wd & DURATION_MASK], (wd >> 4) + 1);
+            break;
+        }
+        default:
+            snprintf(buffer, size, ".BYTE   $%02X", command);
+            break;
+    }
+}
+
+/* ============================================================================
+ * Profiling Run
+ * ============================================================================ */
+
+static int discard_sink(void *ctx, const uint8_t *buffer, size_t count) {
+    (void)ctx;
+    (void)buffer;
+    (void)count;
+    return 0;
+}
+
+/*
+ * Run the code silently through the interpreter to fill in the profile.
+ * The waveforms do not change the timing, so the tables are blank. If the
+ * run stops at an error, the commands after it are listed as not reached.
+ */
+static synth_profile_t *profile_code(const config_t *config, uint8_t *code,
+                                     size_t size) {
+    uint8_t *table_data = calloc(NUM_WAVETABLES, WAVETABLE_SIZE);
+    uint8_t **tables = table_data ? synth_table_pointers(table_data, NUM_WAVETABLES)
+                                  : NULL;
+    interpreter_state_t *state = calloc(1, sizeof(interpreter_state_t));
+    synth_profile_t *profile = NULL;
+
+    if (tables && state &&
+        synth_init(state, code, size, tables, NUM_WAVETABLES,
+                   config->max_jumps, config->voices) == 0) {
+        profile = synth_profile_attach(state);
+        if (profile && synth_run_notran(state, discard_sink, NULL) != 0) {
+            fprintf(stderr, "Warning: Timing stops at the error above\n");
+        }
+    }
+
+    free(state);
+    free(tables);
+    free(table_data);
+    return profile;
+}
+
+/* ============================================================================
+ * Listing
+ * ============================================================================ */
+
+static void write_header(FILE *out, bool profile) {
+    fprintf(out, "ADDR  CODE      BYTES       TIME   LENGTH  V  ");
+    if (profile) {
+        fprintf(out, " EXEC     CYCLES    SAMPLES  ");
+    }
+    fprintf(out, "COMMAND\n");
+}
+
+static void write_listing(FILE *out, const config_t *config, const uint8_t *code,
+                          size_t size, const synth_profile_t *profile) {
+    uint64_t total_cycles = 0;
+    uint64_t total_samples = 0;
+    size_t commands = 0;
+    size_t reached = 0;
+
+    write_header(out, config->profile);
+
+    for (size_t pos = 0; pos < size; ) {
+        const size_t length = command_length(&code[pos], size - pos);
+        const synth_profile_t *entry = &profile[pos];
+
+        char bytes[12] = "";
+        for (size_t i = 0; i < length; i++) {
+            snprintf(bytes + i * 3, sizeof(bytes) - i * 3, "%02X ", code[pos + i]);
+        }
+
+        char time[24] = "-";
+        char note_length[16] = "";
+        char voice[8] = "";
+        if (entry->executions > 0) {
+            snprintf(time, sizeof(time), "%llu", (unsigned long long)entry->first_time);
+            reached++;
+        }
+        if (entry->voice >= 0) {
+            snprintf(note_length, sizeof(note_length), "%u", entry->first_length);
+            snprintf(voice, sizeof(voice), "%d", entry->voice + 1);
+        }
+
+        char instruction[MAX_INSTRUCTION];
+        decode_command(instruction, sizeof(instruction), &code[pos], length,
+                       config->base_address);
+
+        fprintf(out, "%04X  %-9s %5zu  %9s  %7s  %1s  ",
+                (unsigned)((config->base_address + pos) & 0xFFFF), bytes,
+                pos + length, time, note_length, voice);
+        if (config->profile) {
+            fprintf(out, "%5u %10llu %10llu  ", entry->executions,
+                    (unsigned long long)entry->cycles,
+                    (unsigned long long)entry->samples);
+        }
+        fprintf(out, "%s\n", instruction);
+
+        total_cycles += entry->cycles;
+        total_samples += entry->samples;
+        commands++;
+        pos += length;
+    }
+
+    fprintf(out, "\n%zu bytes, %zu commands, %zu reached\n", size, commands, reached);
+
+    if (config->profile) {
+        const uint64_t sound_cycles = total_samples *
+            ((config->voices == 8) ? SOUND_CYCLES_8V : SOUND_CYCLES);
+        const uint64_t all_cycles = sound_cycles + total_cycles;
+        fprintf(out, "%llu samples, %llu interpreter cycles",
+                (unsigned long long)total_samples, (unsigned long long)total_cycles);
+        if (all_cycles > 0) {
+            fprintf(out, " (%.2f%% of the playing time)",
+                    100.0 * (double)total_cycles / (double)all_cycles);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+/* ============================================================================
+ * File Handling
+ * ============================================================================ */
+
+static uint8_t *load_code(const char *filename, size_t *size) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot open '%s': %s\n", filename, strerror(errno));
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    const long file_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if (file_size <= 0) {
+        fprintf(stderr, "Error: '%s' is empty\n", filename);
+        fclose(fp);
+        return NULL;
+    }
+
+    uint8_t *code = malloc(file_size);
+    if (!code || fread(code, 1, file_size, fp) != (size_t)file_size) {
+        fprintf(stderr, "Error: Cannot read '%s'\n", filename);
+        free(code);
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+    *size = file_size;
+    return code;
+}
+
+/* ============================================================================
+ * Command Line Interface
+ * ============================================================================ */
+
+static void print_usage(const char *program_name) {
+    printf("NOTRAN Disassembler - Lists NOTRAN bytecode with its timing\n\n");
+    printf("Usage: %s [OPTIONS] <bytecode.bin>\n\n", program_name);
+    printf("Options:\n");
+    printf("  -o, --output FILE   Write the listing to FILE (default: stdout)\n");
+    printf("  -a, --address ADDR  Address the code is loaded at (default: 0)\n");
+    printf("  -j, --jumps N       Maximum jumps followed when timing (default: %d)\n",
+           DEFAULT_JUMPS);
+    printf("  -v, --voices N      Time for the 4 or 8 voice interpreter (default: %d)\n",
+           DEFAULT_VOICES);
+    printf("  -p, --profile       Also show executions, predicted 6502 cycles and\n");
+    printf("                      samples played for every command\n");
+    printf("  -h, --help          Show this help\n");
+}
+
+static int parse_arguments(int argc, char *argv[], config_t *config) {
+    *config = (config_t){
+        .max_jumps = DEFAULT_JUMPS,
+        .voices = DEFAULT_VOICES
+    };
+
+    static struct option long_options[] = {
+        {"output",  required_argument, 0, 'o'},
+        {"address", required_argument, 0, 'a'},
+        {"jumps",   required_argument, 0, 'j'},
+        {"voices",  required_argument, 0, 'v'},
+        {"profile", no_argument,       0, 'p'},
+        {"help",    no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:a:j:v:ph", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'o': config->output_file = optarg; break;
+            case 'a': config->base_address = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 'j': config->max_jumps = strtoul(optarg, NULL, 10); break;
+            case 'v':
+                config->voices = atoi(optarg);
+                if (config->voices != 4 && config->voices != 8) {
+                    fprintf(stderr, "Error: Number of voices must be 4 or 8\n");
+                    return -1;
+                }
+                break;
+            case 'p': config->profile = true; break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(argv[0]);
+                return -1;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        print_usage(argv[0]);
+        return -1;
+    }
+
+    config->input_file = argv[optind];
+    return 0;
+}
+
+/* ============================================================================
+ * Main Entry Point
+ * ============================================================================ */
+
+int main(int argc, char *argv[]) {
+    config_t config;
+    if (parse_arguments(argc, argv, &config) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    size_t size;
+    uint8_t *code = load_code(config.input_file, &size);
+    if (!code) {
+        return EXIT_FAILURE;
+    }
+
+    synth_profile_t *profile = profile_code(&config, code, size);
+    if (!profile) {
+        free(code);
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = stdout;
+    if (config.output_file) {
+        out = fopen(config.output_file, "w");
+        if (!out) {
+            fprintf(stderr, "Error: Cannot create '%s'\n", config.output_file);
+            free(profile);
+            free(code);
+            return EXIT_FAILURE;
+        }
+    }
+
+    write_listing(out, &config, code, size, profile);
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    free(profile);
+    free(code);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1089 @@
+/*
+ * notfarm - Distributed NOTRAN renderer
+ *
+ * Renders a long NOTRAN score on several worker processes and joins their
+ * output into one WAV file, with exactly the same samples as a serial
+ * notint render. A silent run of the interpreter first finds the length
+ * of the score and saves the interpreter state at every chunk boundary;
+ * the voices are only advanced, with no samples made, so it takes a small
+ * part of the render time. Each chunk is then rendered from its state by
+ * a worker and the chunks are written in order as they come back.
+ *
+ * Workers are processes reached over a stream socket. Local ones are
+ * forked by the coordinator; remote ones are started with -l on other
+ * hosts and given to the coordinator with -w. A worker that fails has its
+ * chunk rendered again by another one.
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <signal.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "synth.h"
+
+/* ============================================================================
+ * Constants and Configuration
+ * ============================================================================ */
+
+#define MAX_WORKERS             64
+#define MAX_CLIPS               255
+#define CHUNK_SECONDS_DEFAULT   30.0
+
+/*
+ * Protocol. Every message is a type byte and a 32 bit little endian
+ * payload size, followed by the payload.
+ *
+ *   LOAD   voices, clip count, 2 reserved, code size, wavetables size and
+ *          the size of each clip (32 bits each), then the code, the
+ *          wavetables and the clips
+ *   CHUNK  chunk number (32 bits), first sample (64 bits) and length in
+ *          samples (32 bits), then the saved interpreter state to render
+ *          it from
+ *   PCM    chunk number (32 bits), then its samples
+ *   ERROR  the message of the worker
+ *
+ * LOAD and CHUNK go to the worker, PCM and ERROR come back.
+ */
+#define MSG_LOAD                'L'
+#define MSG_CHUNK               'C'
+#define MSG_PCM                 'P'
+#define MSG_ERROR               'E'
+#define MSG_HEADER_SIZE         5
+#define MSG_MAX_SIZE            (256u * 1024 * 1024)
+#define LOAD_HEADER_SIZE        12
+#define CHUNK_HEADER_SIZE       16
+
+typedef struct {
+    const char *code_file;
+    const char *wavetable_file;
+    const char *output_file;
+    const char *clip_files[MAX_CLIPS];
+    int num_clips;
+    const char *hosts[MAX_WORKERS];
+    int num_hosts;
+    int local_workers;          /* -1 for one per processor */
+    double chunk_seconds;
+    uint32_t max_jumps;
+    int voices;
+    int sample_rate;
+    const char *listen_port;    /* Run as a remote worker */
+} config_t;
+
+/* A score and everything needed to render it, as a worker gets it */
+typedef struct {
+    int voices;
+    uint8_t *code;
+    size_t code_size;
+    uint8_t *tables;
+    int num_tables;
+    uint8_t **table_pointers;
+    uint8_t *clip_data[MAX_CLIPS];
+    synth_clip_t clips[MAX_CLIPS];
+    int num_clips;
+} song_t;
+
+typedef struct {
+    int fd;                     /* -1 once it has failed */
+    pid_t pid;                  /* Local worker, or 0 */
+    const char *name;
+    long chunk;                 /* Being rendered, or -1 */
+} worker_t;
+
+/* Takes the samples of one chunk out of a render that starts before it */
+typedef struct {
+    interpreter_state_t *state;
+    uint64_t skip;
+    uint8_t *buffer;
+    uint32_t length;
+    uint32_t filled;
+} chunk_sink_t;
+
+/* ============================================================================
+ * Helper Functions
+ * ============================================================================ */
+
+static inline void put_le32(uint8_t *p, uint32_t value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = value >> 24;
+}
+
+static inline uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+static uint8_t *load_file(const char *filename, size_t *size) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot open '%s': %s\n", filename, strerror(errno));
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    const long file_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if (file_size <= 0) {
+        fprintf(stderr, "Error: '%s' is empty\n", filename);
+        fclose(fp);
+        return NULL;
+    }
+
+    uint8_t *data = malloc(file_size);
+    if (!data || fread(data, 1, file_size, fp) != (size_t)file_size) {
+        fprintf(stderr, "Error: Cannot read '%s'\n", filename);
+        free(data);
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+    *size = file_size;
+    return data;
+}
+
+/* ============================================================================
+ * Songs
+ * ============================================================================ */
+
+static void free_song(song_t *song) {
+    free(song->code);
+    free(song->tables);
+    free(song->table_pointers);
+    for (int i = 0; i < song->num_clips; i++) {
+        free(song->clip_data[i]);
+    }
+    memset(song, 0, sizeof(*song));
+}
+
+/* Make the table pointers and the clip bank once the data is in place */
+static int prepare_song(song_t *song) {
+    song->table_pointers = synth_table_pointers(song->tables, song->num_tables);
+    if (!song->table_pointers) {
+        return -1;
+    }
+    for (int i = 0; i < song->num_clips; i++) {
+        song->clips[i].data = song->clip_data[i];
+    }
+    return 0;
+}
+
+static int load_song(const config_t *config, song_t *song) {
+    memset(song, 0, sizeof(*song));
+    song->voices = config->voices;
+
+    song->code = load_file(config->code_file, &song->code_size);
+    if (!song->code) {
+        return -1;
+    }
+
+    size_t tables_size;
+    song->tables = load_file(config->wavetable_file, &tables_size);
+    if (!song->tables) {
+        free_song(song);
+        return -1;
+    }
+    if (tables_size % WAVETABLE_SIZE != 0) {
+        fprintf(stderr, "Warning: File size not multiple of %d bytes\n",
+                WAVETABLE_SIZE);
+    }
+    song->num_tables = tables_size / WAVETABLE_SIZE;
+    if (song->num_tables == 0) {
+        fprintf(stderr, "Error: File too small for wavetable\n");
+        free_song(song);
+        return -1;
+    }
+
+    for (int i = 0; i < config->num_clips; i++) {
+        song->clip_data[i] = load_file(config->clip_files[i], &song->clips[i].size);
+        if (!song->clip_data[i]) {
+            free_song(song);
+            return -1;
+        }
+        song->num_clips++;
+    }
+
+    return prepare_song(song);
+}
+
+static int init_state(interpreter_state_t *state, const song_t *song,
+                      uint32_t max_jumps) {
+    if (synth_init(state, song->code, song->code_size, song->table_pointers,
+                   song->num_tables, max_jumps, song->voices) != 0) {
+        return -1;
+    }
+    synth_set_clips(state, song->clips, song->num_clips);
+    return 0;
+}
+
+/* ============================================================================
+ * Messages
+ * ============================================================================ */
+
+static int write_full(int fd, const void *data, size_t size) {
+    const uint8_t *p = data;
+    while (size > 0) {
+        const ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/* Returns 1 at the end of the stream before any data, as a closed peer */
+static int read_full(int fd, void *data, size_t size) {
+    uint8_t *p = data;
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t n = read(fd, p + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return (n == 0 && done == 0) ? 1 : -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+static int send_message(int fd, uint8_t type, const void *head, size_t head_size,
+                        const void *data, size_t size) {
+    uint8_t header[MSG_HEADER_SIZE];
+    header[0] = type;
+    put_le32(header + 1, head_size + size);
+
+    if (write_full(fd, header, sizeof(header)) != 0 ||
+        write_full(fd, head, head_size) != 0 ||
+        write_full(fd, data, size) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Read one message into a new buffer, released by the caller.
+ *
+ * @return 0 on success, 1 if the peer has closed, -1 on error
+ */
+static int read_message(int fd, uint8_t *type, uint8_t **payload, uint32_t *size) {
+    uint8_t header[MSG_HEADER_SIZE];
+    const int result = read_full(fd, header, sizeof(header));
+    if (result != 0) {
+        return result;
+    }
+
+    *type = header[0];
+    *size = get_le32(header + 1);
+    if (*size > MSG_MAX_SIZE) {
+        fprintf(stderr, "Error: Message of %u bytes is too large\n", *size);
+        return -1;
+    }
+
+    *payload = malloc(*size ? *size : 1);
+    if (!*payload) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return -1;
+    }
+    if (read_full(fd, *payload, *size) != 0) {
+        free(*payload);
+        return -1;
+    }
+    return 0;
+}
+
+static int send_load(int fd, const song_t *song) {
+    const size_t tables_size = (size_t)song->num_tables * WAVETABLE_SIZE;
+    const size_t head_size = LOAD_HEADER_SIZE + 4 * song->num_clips;
+    size_t size = head_size + song->code_size + tables_size;
+    for (int i = 0; i < song->num_clips; i++) {
+        size += song->clips[i].size;
+    }
+    if (size > MSG_MAX_SIZE) {
+        fprintf(stderr, "Error: Score too large to send\n");
+        return -1;
+    }
+
+    uint8_t *payload = malloc(size);
+    if (!payload) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return -1;
+    }
+
+    payload[0] = song->voices;
+    payload[1] = song->num_clips;
+    payload[2] = payload[3] = 0;
+    put_le32(payload + 4, song->code_size);
+    put_le32(payload + 8, tables_size);
+
+    uint8_t *p = payload + LOAD_HEADER_SIZE;
+    for (int i = 0; i < song->num_clips; i++, p += 4) {
+        put_le32(p, song->clips[i].size);
+    }
+    memcpy(p, song->code, song->code_size);
+    p += song->code_size;
+    memcpy(p, song->tables, tables_size);
+    p += tables_size;
+    for (int i = 0; i < song->num_clips; i++) {
+        memcpy(p, song->clips[i].data, song->clips[i].size);
+        p += song->clips[i].size;
+    }
+
+    const int result = send_message(fd, MSG_LOAD, payload, size, NULL, 0);
+    free(payload);
+    return result;
+}
+
+/* Take a song out of a LOAD payload, with copies of its parts */
+static int parse_load(const uint8_t *payload, uint32_t size, song_t *song) {
+    memset(song, 0, sizeof(*song));
+
+    if (size < LOAD_HEADER_SIZE || size < LOAD_HEADER_SIZE + 4u * payload[1]) {
+        fprintf(stderr, "Error: Malformed score message\n");
+        return -1;
+    }
+
+    const int num_clips = payload[1];
+    const size_t code_size = get_le32(payload + 4);
+    const size_t tables_size = get_le32(payload + 8);
+    const uint8_t *p = payload + LOAD_HEADER_SIZE + 4 * num_clips;
+
+    size_t total = (p - payload) + code_size + tables_size;
+    for (int i = 0; i < num_clips; i++) {
+        total += get_le32(payload + LOAD_HEADER_SIZE + 4 * i);
+    }
+    if ((payload[0] != 4 && payload[0] != 8) || total != size || code_size == 0 ||
+        tables_size < WAVETABLE_SIZE || tables_size % WAVETABLE_SIZE != 0) {
+        fprintf(stderr, "Error: Malformed score message\n");
+        return -1;
+    }
+
+    song->voices = payload[0];
+    song->code_size = code_size;
+    song->num_tables = tables_size / WAVETABLE_SIZE;
+    song->code = malloc(code_size);
+    song->tables = malloc(tables_size);
+    if (!song->code || !song->tables) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free_song(song);
+        return -1;
+    }
+    memcpy(song->code, p, code_size);
+    p += code_size;
+    memcpy(song->tables, p, tables_size);
+    p += tables_size;
+
+    for (int i = 0; i < num_clips; i++) {
+        const size_t clip_size = get_le32(payload + LOAD_HEADER_SIZE + 4 * i);
+        song->clip_data[i] = malloc(clip_size ? clip_size : 1);
+        if (!song->clip_data[i]) {
+            fprintf(stderr, "Error: Out of memory\n");
+            free_song(song);
+            return -1;
+        }
+        memcpy(song->clip_data[i], p, clip_size);
+        song->clips[i].size = clip_size;
+        song->num_clips++;
+        p += clip_size;
+    }
+
+    if (prepare_song(song) != 0) {
+        free_song(song);
+        return -1;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Worker
+ * ============================================================================ */
+
+static int chunk_sink(void *ctx, const uint8_t *buffer, size_t count) {
+    chunk_sink_t *chunk = ctx;
+
+    if (chunk->skip >= count) {
+        chunk->skip -= count;
+        return 0;
+    }
+    buffer += chunk->skip;
+    count -= chunk->skip;
+    chunk->skip = 0;
+
+    const uint32_t room = chunk->length - chunk->filled;
+    const size_t n = (count < room) ? count : room;
+    memcpy(chunk->buffer + chunk->filled, buffer, n);
+    chunk->filled += n;
+
+    /* Stop the render as soon as the chunk is complete */
+    if (chunk->filled == chunk->length) {
+        chunk->state->running = false;
+    }
+    return 0;
+}
+
+static int render_chunk(int fd, const song_t *song, const uint8_t *payload,
+                        uint32_t size) {
+    if (size < CHUNK_HEADER_SIZE) {
+        fprintf(stderr, "Error: Malformed chunk message\n");
+        return -1;
+    }
+
+    const uint32_t number = get_le32(payload);
+    const uint64_t start = get_le32(payload + 4) | ((uint64_t)get_le32(payload + 8) << 32);
+    const uint32_t length = get_le32(payload + 12);
+
+    uint8_t head[4];
+    put_le32(head, number);
+
+    static interpreter_state_t state;
+    if (init_state(&state, song, 0) != 0 ||
+        synth_state_restore(&state, payload + CHUNK_HEADER_SIZE,
+                            size - CHUNK_HEADER_SIZE) != 0 ||
+        state.sample_time > start) {
+        const char *message = "Bad interpreter state for the chunk";
+        return send_message(fd, MSG_ERROR, message, strlen(message), NULL, 0);
+    }
+
+    chunk_sink_t chunk = {
+        .state = &state,
+        .skip = start - state.sample_time,
+        .buffer = malloc(length ? length : 1),
+        .length = length
+    };
+    if (!chunk.buffer) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return -1;
+    }
+
+    int result;
+    if (length > 0 && synth_run_notran(&state, chunk_sink, &chunk) != 0) {
+        const char *message = "Render failed";
+        result = send_message(fd, MSG_ERROR, message, strlen(message), NULL, 0);
+    } else if (chunk.filled != length) {
+        const char *message = "The score ended before the chunk";
+        result = send_message(fd, MSG_ERROR, message, strlen(message), NULL, 0);
+    } else {
+        result = send_message(fd, MSG_PCM, head, sizeof(head), chunk.buffer, length);
+    }
+
+    free(chunk.buffer);
+    return result;
+}
+
+/*
+ * Render the chunks asked for on fd until the coordinator closes it.
+ * The interpreter reports go nowhere; the coordinator gives its own.
+ */
+static int serve(int fd) {
+    song_t song = {0};
+    bool loaded = false;
+    int result = 0;
+
+    if (!freopen("/dev/null", "w", stdout)) {
+        return -1;
+    }
+
+    while (result == 0) {
+        uint8_t type;
+        uint8_t *payload;
+        uint32_t size;
+
+        const int status = read_message(fd, &type, &payload, &size);
+        if (status != 0) {
+            result = (status > 0) ? 0 : -1;
+            break;
+        }
+
+        if (type == MSG_LOAD) {
+            if (loaded) {
+                free_song(&song);
+            }
+            loaded = parse_load(payload, size, &song) == 0;
+            result = loaded ? 0 : -1;
+        } else if (type == MSG_CHUNK && loaded) {
+            result = render_chunk(fd, &song, payload, size);
+        } else {
+            fprintf(stderr, "Error: Unexpected message '%c'\n", type);
+            result = -1;
+        }
+        free(payload);
+    }
+
+    if (loaded) {
+        free_song(&song);
+    }
+    close(fd);
+    return result;
+}
+
+/* Remote worker: serve every connection in its own process */
+static int listen_for_coordinators(const char *port) {
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = AI_PASSIVE
+    };
+    struct addrinfo *info;
+
+    const int err = getaddrinfo(NULL, port, &hints, &info);
+    if (err != 0) {
+        fprintf(stderr, "Error: Port '%s': %s\n", port, gai_strerror(err));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo *ai = info; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        const int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || listen(fd, 8) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(info);
+
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot listen on port %s: %s\n", port, strerror(errno));
+        return -1;
+    }
+
+    signal(SIGCHLD, SIG_IGN);
+    printf("Worker listening on port %s\n", port);
+    fflush(stdout);
+
+    for (;;) {
+        const int conn = accept(fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Error: accept: %s\n", strerror(errno));
+            close(fd);
+            return -1;
+        }
+
+        const pid_t pid = fork();
+        if (pid == 0) {
+            close(fd);
+            _exit(serve(conn) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        if (pid < 0) {
+            fprintf(stderr, "Error: fork: %s\n", strerror(errno));
+        }
+        close(conn);
+    }
+}
+
+/* ============================================================================
+ * Coordinator
+ * ============================================================================ */
+
+static int start_local_worker(worker_t *workers, int count, worker_t *worker) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        fprintf(stderr, "Error: socketpair: %s\n", strerror(errno));
+        return -1;
+    }
+
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error: fork: %s\n", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        for (int i = 0; i < count; i++) {
+            if (workers[i].fd >= 0) {
+                close(workers[i].fd);
+            }
+        }
+        _exit(serve(fds[1]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+    *worker = (worker_t){ .fd = fds[0], .pid = pid, .name = "local", .chunk = -1 };
+    return 0;
+}
+
+static int connect_worker(const char *host_port, worker_t *worker) {
+    char host[256];
+    const char *colon = strrchr(host_port, ':');
+    if (!colon || colon == host_port || (size_t)(colon - host_port) >= sizeof(host)) {
+        fprintf(stderr, "Error: Worker '%s' is not HOST:PORT\n", host_port);
+        return -1;
+    }
+    memcpy(host, host_port, colon - host_port);
+    host[colon - host_port] = '\0';
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *info;
+    const int err = getaddrinfo(host, colon + 1, &hints, &info);
+    if (err != 0) {
+        fprintf(stderr, "Error: Worker '%s': %s\n", host_port, gai_strerror(err));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo *ai = info; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(info);
+
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot connect to worker '%s'\n", host_port);
+        return -1;
+    }
+
+    *worker = (worker_t){ .fd = fd, .pid = 0, .name = host_port, .chunk = -1 };
+    return 0;
+}
+
+static void drop_worker(worker_t *worker) {
+    if (worker->fd >= 0) {
+        fprintf(stderr, "Warning: Worker %s (%s) failed\n",
+                worker->name, worker->pid ? "process" : "remote");
+        close(worker->fd);
+        worker->fd = -1;
+    }
+}
+
+/*
+ * Silent run of the whole score, saving the interpreter state at every
+ * chunk boundary
+ */
+static synth_index_t *index_song(const config_t *config, const song_t *song,
+                                 uint32_t interval, uint64_t *length) {
+    static interpreter_state_t state;
+    if (init_state(&state, song, config->max_jumps) != 0) {
+        return NULL;
+    }
+
+    synth_index_t *index = synth_index_attach(&state, interval);
+    if (!index) {
+        return NULL;
+    }
+
+    state.silent = true;
+    if (synth_run_notran(&state, NULL, NULL) != 0 ||
+        synth_index_finish(index, &state) != 0) {
+        synth_index_free(index);
+        return NULL;
+    }
+
+    *length = state.sample_time;
+    return index;
+}
+
+static int send_chunk(worker_t *worker, const synth_index_t *index, size_t chunk,
+                      uint32_t interval, uint64_t length) {
+    const uint64_t start = (uint64_t)chunk * interval;
+    const uint32_t size = (length - start < interval) ? length - start : interval;
+    const uint8_t *record;
+    const size_t record_size = synth_index_record(index, chunk, &record);
+
+    uint8_t head[CHUNK_HEADER_SIZE];
+    put_le32(head, chunk);
+    put_le32(head + 4, start & 0xFFFFFFFF);
+    put_le32(head + 8, start >> 32);
+    put_le32(head + 12, size);
+
+    if (send_message(worker->fd, MSG_CHUNK, head, sizeof(head), record, record_size) != 0) {
+        return -1;
+    }
+    worker->chunk = chunk;
+    return 0;
+}
+
+/*
+ * Hand out the chunks to the idle workers, one each, and write the
+ * results in order. Chunks of failed workers go back to the queue.
+ */
+static int distribute(worker_t *workers, int num_workers, const synth_index_t *index,
+                      uint32_t interval, uint64_t length, wav_context_t *wav) {
+    const size_t count = synth_index_count(index);
+    uint8_t **results = calloc(count, sizeof(uint8_t *));
+    size_t *queue = malloc(count * sizeof(size_t));
+    if (!results || !queue) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(results);
+        free(queue);
+        return -1;
+    }
+
+    /* Chunks are taken from the end of the queue, so it is kept reversed */
+    size_t queued = count;
+    for (size_t i = 0; i < count; i++) {
+        queue[i] = count - 1 - i;
+    }
+
+    size_t written = 0;
+    int result = 0;
+
+    while (result == 0 && written < count) {
+        struct pollfd fds[MAX_WORKERS];
+        int polled[MAX_WORKERS];
+        int num_polled = 0;
+
+        for (int i = 0; i < num_workers; i++) {
+            worker_t *worker = &workers[i];
+
+            if (worker->fd >= 0 && worker->chunk < 0 && queued > 0) {
+                if (send_chunk(worker, index, queue[queued - 1], interval, length) == 0) {
+                    queued--;
+                } else {
+                    drop_worker(worker);
+                }
+            }
+            if (worker->fd >= 0 && worker->chunk >= 0) {
+                fds[num_polled] = (struct pollfd){ .fd = worker->fd, .events = POLLIN };
+                polled[num_polled++] = i;
+            }
+        }
+
+        if (num_polled == 0) {
+            fprintf(stderr, "Error: No workers left\n");
+            result = -1;
+            break;
+        }
+
+        if (poll(fds, num_polled, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Error: poll: %s\n", strerror(errno));
+            result = -1;
+            break;
+        }
+
+        for (int n = 0; n < num_polled && result == 0; n++) {
+            if (!(fds[n].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+
+            worker_t *worker = &workers[polled[n]];
+            const size_t chunk = worker->chunk;
+            const uint64_t start = (uint64_t)chunk * interval;
+            const uint32_t expected = (length - start < interval) ? length - start
+                                                                  : interval;
+            uint8_t type;
+            uint8_t *payload;
+            uint32_t size;
+
+            if (read_message(worker->fd, &type, &payload, &size) != 0) {
+                drop_worker(worker);
+                queue[queued++] = chunk;
+                continue;
+            }
+
+            if (type == MSG_ERROR) {
+                fprintf(stderr, "Error: Worker %s, chunk %zu: %.*s\n",
+                        worker->name, chunk, (int)size, (const char *)payload);
+                result = -1;
+            } else if (type != MSG_PCM || size != 4 + expected ||
+                       get_le32(payload) != chunk) {
+                free(payload);
+                drop_worker(worker);
+                queue[queued++] = chunk;
+                continue;
+            } else {
+                /* The chunk number is overwritten by the samples kept */
+                memmove(payload, payload + 4, expected);
+                results[chunk] = payload;
+                payload = NULL;
+                worker->chunk = -1;
+            }
+            free(payload);
+        }
+
+        while (result == 0 && written < count && results[written]) {
+            const uint64_t start = (uint64_t)written * interval;
+            const uint32_t size = (length - start < interval) ? length - start
+                                                              : interval;
+            if (wav_write(wav, results[written], size) != 0) {
+                result = -1;
+            }
+            free(results[written]);
+            results[written++] = NULL;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        free(results[i]);
+    }
+    free(results);
+    free(queue);
+    return result;
+}
+
+static int coordinate(const config_t *config) {
+    song_t song;
+    if (load_song(config, &song) != 0) {
+        return -1;
+    }
+
+    const uint32_t interval = (uint32_t)(config->chunk_seconds * config->sample_rate + 0.5);
+    uint64_t length;
+
+    synth_index_t *index = index_song(config, &song, interval ? interval : 1, &length);
+    if (!index) {
+        free_song(&song);
+        return -1;
+    }
+
+    const size_t count = synth_index_count(index);
+    printf("Score length %.2f seconds, %zu chunk%s of %.2f seconds\n",
+           (double)length / config->sample_rate, count, (count == 1) ? "" : "s",
+           (double)interval / config->sample_rate);
+
+    static worker_t workers[MAX_WORKERS];
+    int num_workers = 0;
+    int result = 0;
+
+    for (int i = 0; i < config->num_hosts; i++) {
+        if (connect_worker(config->hosts[i], &workers[num_workers]) == 0) {
+            num_workers++;
+        }
+    }
+    for (int i = 0; i < config->local_workers && num_workers < MAX_WORKERS; i++) {
+        if (start_local_worker(workers, num_workers, &workers[num_workers]) == 0) {
+            num_workers++;
+        }
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        if (send_load(workers[i].fd, &song) != 0) {
+            drop_worker(&workers[i]);
+        }
+    }
+
+    wav_context_t *wav = wav_open(config->output_file, config->sample_rate);
+    if (!wav) {
+        result = -1;
+    } else {
+        if (count > 0) {
+            printf("Rendering on %d worker%s...\n", num_workers,
+                   (num_workers == 1) ? "" : "s");
+            fflush(stdout);
+            result = distribute(workers, num_workers, index, interval ? interval : 1,
+                                length, wav);
+        }
+        wav_close(wav);
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        if (workers[i].fd >= 0) {
+            close(workers[i].fd);
+        }
+        if (workers[i].pid > 0) {
+            waitpid(workers[i].pid, NULL, 0);
+        }
+    }
+
+    synth_index_free(index);
+    free_song(&song);
+    return result;
+}
+
+/* ============================================================================
+ * Command Line Interface
+ * ============================================================================ */
+
+static void print_usage(const char *program_name) {
+    printf("NOTRAN Render Farm - Renders a score on several worker processes\n\n");
+    printf("Usage: %s [OPTIONS] -o <output.wav> <bytecode.bin> <wavetables.bin>\n",
+           program_name);
+    printf("       %s -l PORT\n\n", program_name);
+    printf("Options:\n");
+    printf("  -o, --output FILE   Output WAV file, the same as notint writes\n");
+    printf("  -c, --chunk SEC     Seconds of output per chunk (default: %.0f)\n",
+           CHUNK_SECONDS_DEFAULT);
+    printf("  -n, --local N       Local worker processes (default: one per processor,\n");
+    printf("                      or none with -w)\n");
+    printf("  -w, --worker H:P    Use the worker started with -l on host H, port P.\n");
+    printf("                      Repeat for several\n");
+    printf("  -l, --listen PORT   Run as a worker for coordinators on other hosts\n");
+    printf("  -k, --clip FILE     Add a PCM clip for the PCM command, as in notint\n");
+    printf("  -r, --rate RATE     Sample rate in Hz (default: %d)\n",
+           SAMPLE_RATE_DEFAULT);
+    printf("  -j, --jumps N       Maximum allowed jumps (default: unlimited)\n");
+    printf("  -v, --voices N      Emulate the 4 or 8 voice interpreter (default: %d)\n",
+           DEFAULT_VOICES);
+    printf("  -h, --help          Show this help\n\n");
+}
+
+static int parse_arguments(int argc, char *argv[], config_t *config) {
+    *config = (config_t){
+        .local_workers = -1,
+        .chunk_seconds = CHUNK_SECONDS_DEFAULT,
+        .max_jumps = UINT32_MAX,
+        .voices = DEFAULT_VOICES
+    };
+
+    static struct option long_options[] = {
+        {"output", required_argument, 0, 'o'},
+        {"chunk",  required_argument, 0, 'c'},
+        {"local",  required_argument, 0, 'n'},
+        {"worker", required_argument, 0, 'w'},
+        {"listen", required_argument, 0, 'l'},
+        {"clip",   required_argument, 0, 'k'},
+        {"rate",   required_argument, 0, 'r'},
+        {"jumps",  required_argument, 0, 'j'},
+        {"voices", required_argument, 0, 'v'},
+        {"help",   no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:c:n:w:l:k:r:j:v:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'o': config->output_file = optarg; break;
+            case 'c':
+                config->chunk_seconds = atof(optarg);
+                if (config->chunk_seconds <= 0.0) {
+                    fprintf(stderr, "Error: Chunk length must be positive\n");
+                    return -1;
+                }
+                break;
+            case 'n':
+                config->local_workers = atoi(optarg);
+                if (config->local_workers < 0 || config->local_workers > MAX_WORKERS) {
+                    fprintf(stderr, "Error: Local workers must be 0 to %d\n", MAX_WORKERS);
+                    return -1;
+                }
+                break;
+            case 'w':
+                if (config->num_hosts == MAX_WORKERS) {
+                    fprintf(stderr, "Error: Too many workers (max %d)\n", MAX_WORKERS);
+                    return -1;
+                }
+                config->hosts[config->num_hosts++] = optarg;
+                break;
+            case 'l': config->listen_port = optarg; break;
+            case 'k':
+                if (config->num_clips == MAX_CLIPS) {
+                    fprintf(stderr, "Error: Too many clips (max %d)\n", MAX_CLIPS);
+                    return -1;
+                }
+                config->clip_files[config->num_clips++] = optarg;
+                break;
+            case 'r': config->sample_rate = atoi(optarg); break;
+            case 'j': config->max_jumps = strtoul(optarg, NULL, 10); break;
+            case 'v':
+                config->voices = atoi(optarg);
+                if (config->voices != 4 && config->voices != 8) {
+                    fprintf(stderr, "Error: Number of voices must be 4 or 8\n");
+                    return -1;
+                }
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(argv[0]);
+                return -1;
+        }
+    }
+
+    if (config->listen_port) {
+        if (optind != argc) {
+            fprintf(stderr, "Error: A worker takes no files\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (optind + 2 != argc || !config->output_file) {
+        fprintf(stderr, "Error: Expected -o, the bytecode and the wavetables\n");
+        print_usage(argv[0]);
+        return -1;
+    }
+    config->code_file = argv[optind];
+    config->wavetable_file = argv[optind + 1];
+
+    if (config->local_workers < 0) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        config->local_workers = config->num_hosts ? 0
+                              : (cpus < 1) ? 1
+                              : (cpus > MAX_WORKERS) ? MAX_WORKERS : (int)cpus;
+    }
+    if (config->local_workers + config->num_hosts == 0) {
+        fprintf(stderr, "Error: No workers\n");
+        return -1;
+    }
+    if (config->local_workers + config->num_hosts > MAX_WORKERS) {
+        fprintf(stderr, "Error: Too many workers (max %d)\n", MAX_WORKERS);
+        return -1;
+    }
+
+    if (config->sample_rate == 0) {
+        config->sample_rate = (config->voices == 8) ? SAMPLE_RATE_8V_DEFAULT
+                                                    : SAMPLE_RATE_DEFAULT;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Main Entry Point
+ * ============================================================================ */
+
+int main(int argc, char *argv[]) {
+    static config_t config;
+    if (parse_arguments(argc, argv, &config) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    /* A worker that goes away is handled where its socket fails */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (config.listen_port) {
+        return (listen_for_coordinators(config.listen_port) == 0) ? EXIT_SUCCESS
+                                                                  : EXIT_FAILURE;
+    }
+    return (coordinate(&config) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,444 @@
+/*
+ * Output fan-out - Feeds the samples of one render to several WAV files,
+ *                  each with its own rate, sample size and filter
+ *
+ * The render writes each block of samples once into a queue shared by all
+ * the outputs. Every output has a worker thread that reads the blocks in
+ * order, without changing them, and converts them into its own file. A
+ * slot of the queue is reused only when all the workers are past it.
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "synth.h"
+#include "fanout.h"
+
+/* ============================================================================
+ * CONSTANTS
+ * ============================================================================ */
+
+#define PI                  3.14159265358979323846
+#define QUEUE_BLOCKS        32          /* Of BUFFER_FRAMES samples */
+#define OUTPUT_RATE_MIN     1000
+#define OUTPUT_RATE_MAX     96000
+#define CARD_SECTIONS       3
+
+/*
+ * The output filter of the card: three 2 pole lowpass sections with 470p
+ * capacitors, R34-R36, R20-R22 and R26-R28 in the schematic. Each section
+ * has f0 = 1 / (2 pi R C) and Q = Rq / R, together a 6 pole, 0.5 dB ripple
+ * Chebyshev lowpass with its corner at about 3.4 kHz.
+ */
+static const struct {
+    double r;
+    double rq;
+} CARD_FILTER[CARD_SECTIONS] = {
+    { 240e3, 180e3 },
+    { 130e3, 240e3 },
+    { 100e3, 680e3 }
+};
+
+#define CARD_FILTER_C       470e-12
+
+/* ============================================================================
+ * TYPE DEFINITIONS
+ * ============================================================================ */
+
+typedef struct {
+    double b0, b1, b2, a1, a2;
+    double z1, z2;
+} biquad_t;
+
+typedef struct {
+    fanout_t *fanout;
+    const fanout_spec_t *spec;
+    wav_context_t *wav;
+    pthread_t thread;
+    bool started;
+    int status;
+    size_t next;                /* Next block to read */
+    int in_rate;
+    int out_rate;
+    int phase;                  /* Resampler, in units of 1/in_rate */
+    biquad_t sections[CARD_SECTIONS];
+    int num_sections;
+    uint8_t *out;
+    size_t out_size;
+} output_t;
+
+struct fanout {
+    uint8_t blocks[QUEUE_BLOCKS][BUFFER_FRAMES];
+    size_t lengths[QUEUE_BLOCKS];
+    size_t written;             /* Blocks queued */
+    bool finished;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;      /* A block was queued, or the end */
+    pthread_cond_t drained;     /* A worker is done with a block */
+    output_t outputs[FANOUT_MAX_OUTPUTS];
+    int count;
+};
+
+/* ============================================================================
+ * Output Specifications
+ * ============================================================================ */
+
+static int parse_option(const char *option, size_t length, fanout_spec_t *spec) {
+    char text[32];
+    if (length >= sizeof(text)) {
+        fprintf(stderr, "Error: Invalid output option '%.*s'\n", (int)length, option);
+        return -1;
+    }
+    memcpy(text, option, length);
+    text[length] = '\0';
+
+    char *value = strchr(text, '=');
+    if (!value) {
+        fprintf(stderr, "Error: Invalid output option '%s'\n", text);
+        return -1;
+    }
+    *value++ = '\0';
+
+    if (strcmp(text, "rate") == 0) {
+        spec->rate = atoi(value);
+        if (spec->rate < OUTPUT_RATE_MIN || spec->rate > OUTPUT_RATE_MAX) {
+            fprintf(stderr, "Error: Invalid output rate '%s'\n", value);
+            return -1;
+        }
+    } else if (strcmp(text, "bits") == 0) {
+        spec->bits = atoi(value);
+        if (spec->bits != 8 && spec->bits != 16) {
+            fprintf(stderr, "Error: Output bits must be 8 or 16\n");
+            return -1;
+        }
+    } else if (strcmp(text, "filter") == 0) {
+        if (strcmp(value, "none") == 0) {
+            spec->filter = FANOUT_FILTER_NONE;
+        } else if (strcmp(value, "card") == 0) {
+            spec->filter = FANOUT_FILTER_CARD;
+        } else {
+            fprintf(stderr, "Error: Output filter must be none or card\n");
+            return -1;
+        }
+    } else {
+        fprintf(stderr, "Error: Unknown output option '%s'\n", text);
+        return -1;
+    }
+    return 0;
+}
+
+int fanout_parse_spec(const char *text, fanout_spec_t *spec) {
+    *spec = (fanout_spec_t){ .bits = BITS_PER_SAMPLE };
+
+    /* Options only if what follows the last colon looks like them, so that
+       file names with colons still work */
+    const char *colon = strrchr(text, ':');
+    if (colon && !strchr(colon, '=')) {
+        colon = NULL;
+    }
+
+    const size_t name_length = colon ? (size_t)(colon - text) : strlen(text);
+    if (name_length == 0) {
+        fprintf(stderr, "Error: Missing output file name in '%s'\n", text);
+        return -1;
+    }
+
+    spec->filename = malloc(name_length + 1);
+    if (!spec->filename) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return -1;
+    }
+    memcpy(spec->filename, text, name_length);
+    spec->filename[name_length] = '\0';
+
+    for (const char *option = colon; option; ) {
+        option++;
+        const char *end = strchr(option, ',');
+        const size_t length = end ? (size_t)(end - option) : strlen(option);
+        if (parse_option(option, length, spec) != 0) {
+            fanout_free_spec(spec);
+            return -1;
+        }
+        option = end;
+    }
+    return 0;
+}
+
+void fanout_free_spec(fanout_spec_t *spec) {
+    free(spec->filename);
+    spec->filename = NULL;
+}
+
+bool fanout_spec_is_plain(const fanout_spec_t *spec) {
+    return spec->rate == 0 && spec->bits == BITS_PER_SAMPLE &&
+           spec->filter == FANOUT_FILTER_NONE;
+}
+
+/* ============================================================================
+ * Conversion
+ * ============================================================================ */
+
+/* Lowpass section by the bilinear transform, with unity gain at DC */
+static void biquad_lowpass(biquad_t *bq, double f0, double q, int rate) {
+    const double w0 = 2.0 * PI * f0 / rate;
+    const double cosw = cos(w0);
+    const double alpha = sin(w0) / (2.0 * q);
+    const double a0 = 1.0 + alpha;
+
+    bq->b0 = (1.0 - cosw) / 2.0 / a0;
+    bq->b1 = (1.0 - cosw) / a0;
+    bq->b2 = bq->b0;
+    bq->a1 = -2.0 * cosw / a0;
+    bq->a2 = (1.0 - alpha) / a0;
+    bq->z1 = bq->z2 = 0.0;
+}
+
+static double biquad_run(biquad_t *bq, double x) {
+    const double y = bq->b0 * x + bq->z1;
+    bq->z1 = bq->b1 * x - bq->a1 * y + bq->z2;
+    bq->z2 = bq->b2 * x - bq->a2 * y;
+    return y;
+}
+
+static size_t put_sample(const output_t *out, uint8_t *dest, double value) {
+    if (out->spec->bits == 16) {
+        long s = lround(value * 32768.0);
+        s = (s < -32768) ? -32768 : (s > 32767) ? 32767 : s;
+        dest[0] = (uint8_t)(s & 0xFF);
+        dest[1] = (uint8_t)((s >> 8) & 0xFF);
+        return 2;
+    }
+    long s = lround(value * 128.0) + 128;
+    dest[0] = (uint8_t)((s < 0) ? 0 : (s > 255) ? 255 : s);
+    return 1;
+}
+
+/*
+ * Convert a block into the output buffer. The DAC holds each sample until
+ * the next one, so other rates repeat or drop samples as the hold would
+ * be sampled at the new rate; the card filter, when asked for, then works
+ * on the held signal as the real one does.
+ */
+static size_t convert_block(output_t *out, const uint8_t *samples, size_t count) {
+    size_t pos = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const double value = (samples[i] - 128) / 128.0;
+
+        out->phase += out->out_rate;
+        while (out->phase >= out->in_rate) {
+            out->phase -= out->in_rate;
+
+            double y = value;
+            for (int s = 0; s < out->num_sections; s++) {
+                y = biquad_run(&out->sections[s], y);
+            }
+            pos += put_sample(out, out->out + pos, y);
+        }
+    }
+    return pos;
+}
+
+/* ============================================================================
+ * Workers
+ * ============================================================================ */
+
+static void *output_worker(void *arg) {
+    output_t *out = arg;
+    fanout_t *f = out->fanout;
+
+    for (;;) {
+        pthread_mutex_lock(&f->lock);
+        while (out->next == f->written && !f->finished) {
+            pthread_cond_wait(&f->filled, &f->lock);
+        }
+        if (out->next == f->written) {
+            pthread_mutex_unlock(&f->lock);
+            break;
+        }
+        const size_t slot = out->next % QUEUE_BLOCKS;
+        const size_t count = f->lengths[slot];
+        pthread_mutex_unlock(&f->lock);
+
+        /* The slot is not rewritten until this worker moves past it.
+           After an error the blocks are still taken, not to stall the
+           render */
+        if (out->status == 0) {
+            const size_t bytes = convert_block(out, f->blocks[slot], count);
+            if (wav_write(out->wav, out->out, bytes) != 0) {
+                fprintf(stderr, "Error: Writing '%s' failed\n", out->spec->filename);
+                out->status = -1;
+            }
+        }
+
+        pthread_mutex_lock(&f->lock);
+        out->next++;
+        pthread_cond_signal(&f->drained);
+        pthread_mutex_unlock(&f->lock);
+    }
+    return NULL;
+}
+
+static size_t slowest_block(const fanout_t *f) {
+    size_t slowest = f->written;
+    for (int i = 0; i < f->count; i++) {
+        if (f->outputs[i].next < slowest) {
+            slowest = f->outputs[i].next;
+        }
+    }
+    return slowest;
+}
+
+static int open_output(fanout_t *f, output_t *out, const fanout_spec_t *spec,
+                       int sample_rate) {
+    out->fanout = f;
+    out->spec = spec;
+    out->in_rate = sample_rate;
+    out->out_rate = spec->rate ? spec->rate : sample_rate;
+
+    if (spec->filter == FANOUT_FILTER_CARD) {
+        for (int s = 0; s < CARD_SECTIONS; s++) {
+            const double f0 = 1.0 / (2.0 * PI * CARD_FILTER[s].r * CARD_FILTER_C);
+            if (2.0 * f0 >= out->out_rate) {
+                fprintf(stderr, "Error: The card filter of '%s' needs a rate above %.0f Hz\n",
+                        spec->filename, 2.0 * f0);
+                return -1;
+            }
+            biquad_lowpass(&out->sections[s], f0, CARD_FILTER[s].rq / CARD_FILTER[s].r,
+                           out->out_rate);
+        }
+        out->num_sections = CARD_SECTIONS;
+    }
+
+    /* Room for the most samples one block can turn into */
+    const size_t frames = (size_t)BUFFER_FRAMES * out->out_rate / out->in_rate + 1;
+    out->out_size = frames * (size_t)(spec->bits / 8);
+    out->out = malloc(out->out_size);
+    if (!out->out) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return -1;
+    }
+
+    out->wav = wav_open_format(spec->filename, out->out_rate, spec->bits);
+    return out->wav ? 0 : -1;
+}
+
+/* ============================================================================
+ * Fan-out
+ * ============================================================================ */
+
+fanout_t *fanout_open(const fanout_spec_t *specs, int count, int sample_rate) {
+    if (count < 1 || count > FANOUT_MAX_OUTPUTS) {
+        fprintf(stderr, "Error: Between 1 and %d outputs are allowed\n",
+                FANOUT_MAX_OUTPUTS);
+        return NULL;
+    }
+
+    fanout_t *f = calloc(1, sizeof(fanout_t));
+    if (!f) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return NULL;
+    }
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->filled, NULL);
+    pthread_cond_init(&f->drained, NULL);
+
+    for (int i = 0; i < count; i++) {
+        output_t *out = &f->outputs[i];
+        f->count++;
+        if (open_output(f, out, &specs[i], sample_rate) != 0) {
+            fanout_close(f);
+            return NULL;
+        }
+        if (pthread_create(&out->thread, NULL, output_worker, out) != 0) {
+            fprintf(stderr, "Error: Cannot start the worker of '%s'\n",
+                    specs[i].filename);
+            fanout_close(f);
+            return NULL;
+        }
+        out->started = true;
+    }
+    return f;
+}
+
+int fanout_sink(void *ctx, const uint8_t *buffer, size_t count) {
+    fanout_t *f = ctx;
+
+    while (count > 0) {
+        const size_t length = (count < BUFFER_FRAMES) ? count : BUFFER_FRAMES;
+
+        pthread_mutex_lock(&f->lock);
+        while (f->written - slowest_block(f) == QUEUE_BLOCKS) {
+            pthread_cond_wait(&f->drained, &f->lock);
+        }
+        pthread_mutex_unlock(&f->lock);
+
+        /* No worker reads the slot until it is published below */
+        const size_t slot = f->written % QUEUE_BLOCKS;
+        memcpy(f->blocks[slot], buffer, length);
+        f->lengths[slot] = length;
+
+        pthread_mutex_lock(&f->lock);
+        f->written++;
+        pthread_cond_broadcast(&f->filled);
+        pthread_mutex_unlock(&f->lock);
+
+        buffer += length;
+        count -= length;
+    }
+    return 0;
+}
+
+int fanout_close(fanout_t *f) {
+    if (!f) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&f->lock);
+    f->finished = true;
+    pthread_cond_broadcast(&f->filled);
+    pthread_mutex_unlock(&f->lock);
+
+    int result = 0;
+    for (int i = 0; i < f->count; i++) {
+        output_t *out = &f->outputs[i];
+        if (out->started) {
+            pthread_join(out->thread, NULL);
+        } else {
+            result = -1;
+        }
+        if (out->wav) {
+            printf("%s: ", out->spec->filename);
+            if (wav_close(out->wav) != 0) {
+                out->status = -1;
+            }
+        }
+        if (out->status != 0) {
+            result = -1;
+        }
+        free(out->out);
+    }
+
+    pthread_cond_destroy(&f->drained);
+    pthread_cond_destroy(&f->filled);
+    pthread_mutex_destroy(&f->lock);
+    free(f);
+    return result;
+}
@@ -0,0 +1,85 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+/*
+ * Output fan-out - Feeds the samples of one render to several WAV files,
+ *                  each with its own rate, sample size and filter
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FANOUT_MAX_OUTPUTS      8
+
+typedef enum {
+    FANOUT_FILTER_NONE = 0,
+    FANOUT_FILTER_CARD          /* The FILTER OUT of the card */
+} fanout_filter_t;
+
+/*
+ * An output specification, FILE[:OPTION,...] on the command line. The
+ * options are rate=N, bits=8 or 16 and filter=none or card. Without any,
+ * the output gets the samples of the interpreter unchanged.
+ */
+typedef struct {
+    char *filename;
+    int rate;                   /* 0 for the interpreter sample rate */
+    int bits;
+    fanout_filter_t filter;
+} fanout_spec_t;
+
+typedef struct fanout fanout_t;
+
+/**
+ * Parse an output specification. The filename is a copy, released by
+ * fanout_free_spec().
+ *
+ * @return 0 on success, -1 on error
+ */
+int fanout_parse_spec(const char *text, fanout_spec_t *spec);
+
+void fanout_free_spec(fanout_spec_t *spec);
+
+/**
+ * True if the output is written with the samples as they are rendered
+ */
+bool fanout_spec_is_plain(const fanout_spec_t *spec);
+
+/**
+ * Open the outputs and start a worker thread for each one. The samples
+ * passed to fanout_sink() are queued once and read by all the workers.
+ *
+ * @param sample_rate Rate of the rendered samples
+ * @return The fan-out, to be released with fanout_close(), or NULL on error
+ */
+fanout_t *fanout_open(const fanout_spec_t *specs, int count, int sample_rate);
+
+/**
+ * Sink for the synthesis library. Blocks while the slowest worker is a
+ * full queue behind.
+ */
+int fanout_sink(void *ctx, const uint8_t *buffer, size_t count);
+
+/**
+ * Let the workers finish the queue, close the files and free the fan-out.
+ *
+ * @return 0 on success, -1 if any output failed
+ */
+int fanout_close(fanout_t *f);
+
+#endif /* FANOUT_H */
@@ -28,127 +28,105 @@
 #include <getopt.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <alsa/asoundlib.h>
+#include "synth.h"
+#include "fanout.h"
 
 /* ============================================================================
  * CONSTANTS
  * ============================================================================ */
 
-#define SAMPLE_RATE_DEFAULT     8772
-#define CHANNELS                1
-#define BITS_PER_SAMPLE         8
-#define BUFFER_FRAMES           1024
-
-#define MAX_VOICES              4
-#define WAVETABLE_SIZE          256
-#define NUM_NOTES               62
-
-#define PITCH_MASK              0xF0
-#define DURATION_MASK           0x0F
-#define PITCH_SHIFT             4
-
-/* Control commands (duration field = 0) */
-#define CMD_END                 0x00
-#define CMD_TEMPO               0x10
-#define CMD_CALL                0x20
-#define CMD_RETURN              0x30
-#define CMD_JUMP                0x40
-#define CMD_SETVOICES           0x50
-#define CMD_LONGNOTE_ABS        0x60
-#define CMD_LONGNOTE_REL        0x70
-#define CMD_DEACTIVATE          0x80
-#define CMD_ACTIVATE            0x90
-
-#define PITCH_REST              (-8)
-#define VOICE_INACTIVE          0xFF
-#define STACK_SIZE              256
-
-#define SAMPLE_MIN              0
-#define SAMPLE_MAX              255
+#define LIVE_PERIOD_DEFAULT     16      /* Frames, 1.8 ms at 8772 Hz */
+#define LIVE_PERIODS            3       /* Periods in the ALSA buffer */
+#define LIVE_PERIOD_MAX         1024
+#define LIVE_TARGET_MS          10.0
+#define MIDI_RING_SIZE          4096    /* Power of two */
+#define MIDI_POLL_MS            100     /* To notice the end of playing */
+#define NS_PER_SEC              1000000000LL
+#define MAX_CLIPS               255
+#define INDEX_INTERVAL_DEFAULT  10.0    /* Seconds between seek index entries */
 
 /* ============================================================================
  * TYPE DEFINITIONS
  * ============================================================================ */
 
+typedef enum {
+    MODE_NOTRAN = 0,
+    MODE_KIM4V,
+    MODE_LIVE
+} render_mode_t;
+
 typedef struct {
-    uint8_t phase_frac;
-    uint8_t phase_int;
-    uint8_t wavetable_page;
-    uint8_t note_offset;
-    uint16_t freq_increment;
-    uint8_t duration;
-    uint8_t padding;
-} voice_t;
+    render_mode_t mode;
+    char **image_files;
+    int num_images;
+    char **bytecode_files;      /* NOTRAN programs, mixed if several */
+    int num_programs;
+    const char *wavetable_file;
+    fanout_spec_t outputs[FANOUT_MAX_OUTPUTS];
+    int num_outputs;
+    int sample_rate;
+    uint32_t max_jumps;
+    int voices;
+    const char *midi_input;
+    int period;
+    const char *clip_files[MAX_CLIPS];
+    int num_clips;
+    const char *index_file;
+    double index_interval;
+    double seek;                /* Seconds, negative for none */
+} config_t;
 
+/* Drops the samples before the seek position */
 typedef struct {
-    char riff_id[4];
-    uint32_t riff_size;
-    char wave_id[4];
-    char fmt_id[4];
-    uint32_t fmt_size;
-    uint16_t audio_format;
-    uint16_t num_channels;
-    uint32_t sample_rate;
-    uint32_t byte_rate;
-    uint16_t block_align;
-    uint16_t bits_per_sample;
-    char data_id[4];
-    uint32_t data_size;
-} wav_header_t;
+    synth_sink_t sink;
+    void *ctx;
+    uint64_t skip;
+} seek_sink_t;
 
+/*
+ * MIDI bytes on their way from the input thread to the audio loop, with
+ * their arrival time. One producer and one consumer, so no locks.
+ */
 typedef struct {
-    FILE *fp;
-    wav_header_t header;
-    size_t samples_written;
-    uint8_t *buffer;
-    size_t buffer_size;
-    size_t buffer_pos;
-} wav_context_t;
+    uint8_t byte;
+    int64_t time;
+} midi_byte_t;
 
 typedef struct {
-    voice_t voices[MAX_VOICES];
-    uint8_t *object_code;
-    size_t code_size;
-    size_t code_ptr;
-    uint8_t **wavetables;
-    int num_wavetables;
-    uint8_t tempo;
-    uint8_t duration;
-    uint8_t duration_counter;
-    uint16_t call_stack[STACK_SIZE];
-    int stack_ptr;
-    int num_active_voices;
-    bool running;
-    uint32_t max_jumps;
-} interpreter_state_t;
+    midi_byte_t items[MIDI_RING_SIZE];
+    atomic_size_t head;         /* Written by the input thread */
+    atomic_size_t tail;         /* Written by the audio loop */
+    atomic_bool done;           /* The input has ended */
+    atomic_bool stop;           /* Asks the input thread to end */
+    atomic_uint dropped;
+} midi_ring_t;
 
 typedef struct {
-    const char *bytecode_file;
-    const char *wavetable_file;
-    const char *output_file;
-    int sample_rate;
-    uint32_t max_jumps;
-} config_t;
+    int fd;                     /* File, FIFO or stdin, or -1 */
+    snd_rawmidi_t *rawmidi;     /* ALSA port, or NULL */
+    midi_ring_t *ring;
+} midi_input_t;
+
+typedef struct {
+    uint32_t count;
+    int64_t total;
+    int64_t min;
+    int64_t max;
+} latency_stats_t;
 
 /* ============================================================================
  * GLOBAL DATA
  * ============================================================================ */
 
-static const uint8_t DURATION_TABLE[16] = {
-    0, 192, 144, 96, 72, 64, 48, 36, 32, 24, 18, 16, 12, 9, 8, 6
-};
-
-static const uint16_t FREQUENCY_TABLE[NUM_NOTES] = {
-    0x0000, 0x00F4, 0x0103, 0x0112, 0x0123, 0x0134, 0x0146, 0x015A,
-    0x016E, 0x0184, 0x019B, 0x01B3, 0x01CD, 0x01E9, 0x0206, 0x0225,
-    0x0245, 0x0268, 0x028C, 0x02B3, 0x02DC, 0x0308, 0x0336, 0x0367,
-    0x039A, 0x03D1, 0x040B, 0x0449, 0x048A, 0x04CF, 0x0519, 0x0566,
-    0x05B8, 0x060F, 0x066C, 0x06CD, 0x0735, 0x07A3, 0x0817, 0x0892,
-    0x0915, 0x099F, 0x0A31, 0x0ACC, 0x0B71, 0x0C1F, 0x0CD7, 0x0D9B,
-    0x0E6A, 0x0F45, 0x102E, 0x1124, 0x1229, 0x133E, 0x1462, 0x1599,
-    0x16E2, 0x183E, 0x19AF, 0x1B36, 0x1CD4, 0x1E8B
-};
-
 static interpreter_state_t *g_state = NULL;
 static snd_pcm_t *g_pcm_handle = NULL;
 
@@ -158,19 +136,21 @@ static snd_pcm_t *g_pcm_handle = NULL;
 
 static void signal_handler(int signum);
 static void cleanup(interpreter_state_t *state, snd_pcm_t *pcm_handle);
-static wav_context_t *wav_open(const char *filename, int sample_rate);
-static int wav_write(wav_context_t *ctx, const uint8_t *buffer, size_t count);
-static int wav_close(wav_context_t *ctx);
 static void print_usage(const char *program_name);
 static uint8_t **load_wavetables(const char *filename, int *num_tables);
 static uint8_t *load_notran_bytecode(const char *filename, size_t *size);
-static int init_interpreter(interpreter_state_t *state, uint8_t *object_code,
-                            size_t code_size, uint8_t **wavetables,
-                            int num_wavetables, uint32_t max_jumps);
-static int init_audio(snd_pcm_t **pcm_handle, int sample_rate);
-static int interpret_loop(interpreter_state_t *state, snd_pcm_t *pcm_handle,
-                         wav_context_t *wav_ctx);
+static int map_clips(const config_t *config, synth_clip_t *clips);
+static void unmap_clips(synth_clip_t *clips, int count);
+static int init_audio(snd_pcm_t **pcm_handle, int sample_rate, int period);
+static int run_live(const config_t *config);
+static int alsa_sink(void *ctx, const uint8_t *buffer, size_t count);
+static int seek_sink(void *ctx, const uint8_t *buffer, size_t count);
 static void free_wavetables(uint8_t **tables);
+static void free_outputs(config_t *config);
+static int open_streams(const config_t *config, interpreter_state_t **streams,
+                        const synth_clip_t *clips);
+static void close_streams(interpreter_state_t **streams, int count);
+static int render(const config_t *config);
 
 /* ============================================================================
  * Command Line Interface
@@ -178,34 +158,112 @@ static void free_wavetables(uint8_t **tables);
 
 static void print_usage(const char *program_name) {
     printf("NOTRAN Interpreter - Music synthesis from NOTRAN bytecode\n\n");
-    printf("Usage: %s [OPTIONS] <bytecode.bin> <wavetables.bin>\n\n", 
+    printf("Usage: %s [OPTIONS] <bytecode.bin>... <wavetables.bin>\n", 
            program_name);
+    printf("       %s -m kim4v [OPTIONS] <image.pap>...\n", program_name);
+    printf("       %s -m live [OPTIONS] <wavetables.bin>\n\n", program_name);
+    printf("Several NOTRAN programs are played together, each with its own voices.\n\n");
     printf("Options:\n");
-    printf("  -o, --output FILE   Output WAV file\n");
+    printf("  -m, --mode MODE     notran (default), kim4v, which plays the song\n");
+    printf("                      tables of kim4v.asm from its PAP memory images,\n");
+    printf("                      or live, which plays the notes of a MIDI stream\n");
+    printf("  -i, --input SRC     MIDI input of the live mode: - for stdin (default),\n");
+    printf("                      a file or FIFO, or alsa:PORT for an ALSA rawmidi\n");
+    printf("                      port (alsa:virtual creates one)\n");
+    printf("  -p, --period N      Live mode audio period in frames (default: %d)\n",
+           LIVE_PERIOD_DEFAULT);
+    printf("  -k, --clip FILE     Add a PCM clip for the PCM command, 8 bit unsigned at\n");
+    printf("                      the interpreter sample rate (e.g. pcmconv -c 114\n");
+    printf("                      -f bin). The first one is clip 1\n");
+    printf("  -o, --output FILE[:OPTS]\n");
+    printf("                      Output WAV file. Repeat to write several files\n");
+    printf("                      from one render, each with the comma separated\n");
+    printf("                      options rate=N (the DAC output resampled), bits=8\n");
+    printf("                      or 16 and filter=card (the FILTER OUT of the card)\n");
     printf("  -r, --rate RATE     Sample rate in Hz (default: %d)\n", 
            SAMPLE_RATE_DEFAULT);
-    printf("  -j, --jumps N       Maximum allowed jumps (default: unlimited)\n");
+    printf("  -x, --index FILE    Write a seek index of the NOTRAN render, or read it\n");
+    printf("                      with -s to start there without rendering from the\n");
+    printf("                      beginning\n");
+    printf("  -t, --interval SEC  Seconds between seek index entries (default: %.0f)\n",
+           INDEX_INTERVAL_DEFAULT);
+    printf("  -s, --seek SEC      Start the output at SEC seconds\n");
+    printf("  -j, --jumps N       Maximum allowed jumps or kim4v segment links\n");
+    printf("                      (default: unlimited)\n");
+    printf("  -v, --voices N      Emulate the 4 or 8 voice interpreter (default: %d)\n",
+           DEFAULT_VOICES);
     printf("  -h, --help          Show this help\n\n");
 }
 
 static int parse_arguments(int argc, char *argv[], config_t *config) {
     *config = (config_t){
-        .sample_rate = SAMPLE_RATE_DEFAULT,
-        .max_jumps = UINT32_MAX
+        .sample_rate = 0,
+        .max_jumps = UINT32_MAX,
+        .voices = DEFAULT_VOICES,
+        .midi_input = "-",
+        .period = LIVE_PERIOD_DEFAULT,
+        .index_interval = INDEX_INTERVAL_DEFAULT,
+        .seek = -1.0
     };
     
     static struct option long_options[] = {
+        {"mode",   required_argument, 0, 'm'},
+        {"input",  required_argument, 0, 'i'},
+        {"period", required_argument, 0, 'p'},
+        {"clip",   required_argument, 0, 'k'},
         {"output", required_argument, 0, 'o'},
         {"rate",   required_argument, 0, 'r'},
+        {"index",  required_argument, 0, 'x'},
+        {"interval", required_argument, 0, 't'},
+        {"seek",   required_argument, 0, 's'},
         {"jumps",  required_argument, 0, 'j'},
+        {"voices", required_argument, 0, 'v'},
         {"help",   no_argument,       0, 'h'},
         {0, 0, 0, 0}
     };
     
     int opt;
-    while ((opt = getopt_long(argc, argv, "o:r:j:h", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "m:i:p:k:o:r:x:t:s:j:v:h", long_options, NULL)) != -1) {
         switch (opt) {
-            case 'o': config->output_file = optarg; break;
+            case 'm':
+                if (strcmp(optarg, "notran") == 0) {
+                    config->mode = MODE_NOTRAN;
+                } else if (strcmp(optarg, "kim4v") == 0) {
+                    config->mode = MODE_KIM4V;
+                } else if (strcmp(optarg, "live") == 0) {
+                    config->mode = MODE_LIVE;
+                } else {
+                    fprintf(stderr, "Error: Mode must be notran, kim4v or live\n");
+                    return -1;
+                }
+                break;
+            case 'i': config->midi_input = optarg; break;
+            case 'p':
+                config->period = atoi(optarg);
+                if (config->period < 1 || config->period > LIVE_PERIOD_MAX) {
+                    fprintf(stderr, "Error: Invalid period\n");
+                    return -1;
+                }
+                break;
+            case 'k':
+                if (config->num_clips == MAX_CLIPS) {
+                    fprintf(stderr, "Error: Too many clips, the maximum is %d\n",
+                            MAX_CLIPS);
+                    return -1;
+                }
+                config->clip_files[config->num_clips++] = optarg;
+                break;
+            case 'o':
+                if (config->num_outputs == FANOUT_MAX_OUTPUTS) {
+                    fprintf(stderr, "Error: Too many outputs, the maximum is %d\n",
+                            FANOUT_MAX_OUTPUTS);
+                    return -1;
+                }
+                if (fanout_parse_spec(optarg, &config->outputs[config->num_outputs]) != 0) {
+                    return -1;
+                }
+                config->num_outputs++;
+                break;
             case 'r':
                 config->sample_rate = atoi(optarg);
                 if (config->sample_rate < 1000 || config->sample_rate > 96000) {
@@ -213,9 +271,31 @@ static int parse_arguments(int argc, char *argv[], config_t *config) {
                     return -1;
                 }
                 break;
+            case 'x': config->index_file = optarg; break;
+            case 't':
+                config->index_interval = atof(optarg);
+                if (config->index_interval < 0.1) {
+                    fprintf(stderr, "Error: Invalid seek index interval\n");
+                    return -1;
+                }
+                break;
+            case 's':
+                config->seek = atof(optarg);
+                if (config->seek < 0.0) {
+                    fprintf(stderr, "Error: Invalid seek position\n");
+                    return -1;
+                }
+                break;
             case 'j':
                 config->max_jumps = strtoul(optarg, NULL, 10);
                 break;
+            case 'v':
+                config->voices = atoi(optarg);
+                if (config->voices != 4 && config->voices != 8) {
+                    fprintf(stderr, "Error: Number of voices must be 4 or 8\n");
+                    return -1;
+                }
+                break;
             case 'h':
                 print_usage(argv[0]);
                 exit(0);
@@ -224,14 +304,65 @@ static int parse_arguments(int argc, char *argv[], config_t *config) {
         }
     }
     
-    if (optind + 2 != argc) {
-        fprintf(stderr, "Error: Expected 2 arguments\n");
-        print_usage(argv[0]);
+    if (config->mode != MODE_NOTRAN && (config->index_file || config->seek >= 0.0)) {
+        fprintf(stderr, "Error: Seek index and seeking are only for NOTRAN code\n");
         return -1;
     }
     
-    config->bytecode_file = argv[optind];
-    config->wavetable_file = argv[optind + 1];
+    if (config->mode == MODE_KIM4V) {
+        if (optind >= argc) {
+            fprintf(stderr, "Error: Expected at least one PAP image\n");
+            print_usage(argv[0]);
+            return -1;
+        }
+        if (config->voices != KIM4V_VOICES) {
+            fprintf(stderr, "Error: kim4v songs always have %d voices\n",
+                    KIM4V_VOICES);
+            return -1;
+        }
+        config->image_files = &argv[optind];
+        config->num_images = argc - optind;
+        config->sample_rate = config->sample_rate ? config->sample_rate
+                                                  : SAMPLE_RATE_DEFAULT;
+        return 0;
+    }
+    
+    if (config->mode == MODE_LIVE) {
+        if (config->num_outputs > 1 ||
+            (config->num_outputs == 1 && !fanout_spec_is_plain(&config->outputs[0]))) {
+            fprintf(stderr, "Error: The live mode takes a single output, with no options\n");
+            return -1;
+        }
+        if (optind + 1 != argc) {
+            fprintf(stderr, "Error: Expected the wavetables\n");
+            print_usage(argv[0]);
+            return -1;
+        }
+        config->wavetable_file = argv[optind];
+    } else if (optind + 2 > argc) {
+        fprintf(stderr, "Error: Expected the bytecode and the wavetables\n");
+        print_usage(argv[0]);
+        return -1;
+    } else {
+        config->bytecode_files = &argv[optind];
+        config->num_programs = argc - optind - 1;
+        config->wavetable_file = argv[argc - 1];
+        
+        if (config->num_programs > SYNTH_MAX_STREAMS) {
+            fprintf(stderr, "Error: At most %d programs can be played together\n",
+                    SYNTH_MAX_STREAMS);
+            return -1;
+        }
+        if (config->num_programs > 1 && (config->index_file || config->seek >= 0.0)) {
+            fprintf(stderr, "Error: Seek index and seeking are for a single program\n");
+            return -1;
+        }
+    }
+
+    if (config->sample_rate == 0) {
+        config->sample_rate = (config->voices == 8) ? SAMPLE_RATE_8V_DEFAULT
+                                                    : SAMPLE_RATE_DEFAULT;
+    }
     
     return 0;
 }
@@ -241,46 +372,142 @@ static int parse_arguments(int argc, char *argv[], config_t *config) {
  * ============================================================================ */
 
 int main(int argc, char *argv[]) {
-    config_t config;
+    static config_t config;
     if (parse_arguments(argc, argv, &config) != 0) {
+        free_outputs(&config);
         return 1;
     }
     
-    int num_wavetables;
-    uint8_t **wavetables = load_wavetables(config.wavetable_file, &num_wavetables);
-    if (!wavetables) {
-        return 1;
+    if (config.mode == MODE_LIVE) {
+        const int status = run_live(&config);
+        free_outputs(&config);
+        return (status == 0) ? 0 : 1;
     }
     
+    const int status = render(&config);
+    free_outputs(&config);
+    return (status == 0) ? 0 : 1;
+}
+
+static int render(const config_t *config) {
+    int num_wavetables;
+    uint8_t **wavetables;
     size_t bytecode_size;
-    uint8_t *bytecode = load_notran_bytecode(config.bytecode_file, &bytecode_size);
-    if (!bytecode) {
-        free_wavetables(wavetables);
-        return 1;
+    uint8_t *bytecode;
+    
+    if (config->mode == MODE_KIM4V) {
+        /* The song and the waveforms are both read from the memory image,
+           with every page of memory available as a wavetable */
+        bytecode = synth_load_pap_images(config->image_files, config->num_images);
+        if (!bytecode) {
+            return -1;
+        }
+        wavetables = synth_table_pointers(bytecode, MEMORY_SIZE / WAVETABLE_SIZE);
+        if (!wavetables) {
+            free(bytecode);
+            return -1;
+        }
+        bytecode_size = MEMORY_SIZE;
+        num_wavetables = MEMORY_SIZE / WAVETABLE_SIZE;
+    } else {
+        wavetables = load_wavetables(config->wavetable_file, &num_wavetables);
+        if (!wavetables) {
+            return -1;
+        }
+        
+        bytecode = load_notran_bytecode(config->bytecode_files[0], &bytecode_size);
+        if (!bytecode) {
+            free_wavetables(wavetables);
+            return -1;
+        }
     }
     
     interpreter_state_t *state = calloc(1, sizeof(interpreter_state_t));
-    if (!state || init_interpreter(state, bytecode, bytecode_size, 
-                                   wavetables, num_wavetables, 
-                                   config.max_jumps) != 0) {
+    if (!state || synth_init(state, bytecode, bytecode_size, 
+                             wavetables, num_wavetables, 
+                             config->max_jumps, config->voices) != 0) {
         cleanup(state, NULL);
-        return 1;
+        return -1;
+    }
+    
+    static synth_clip_t clips[MAX_CLIPS];
+    if (map_clips(config, clips) != 0) {
+        cleanup(state, NULL);
+        return -1;
+    }
+    synth_set_clips(state, clips, config->num_clips);
+    
+    /* The other programs share the wavetables and the clips of the first */
+    interpreter_state_t *streams[SYNTH_MAX_STREAMS] = { state };
+    if (open_streams(config, streams, clips) != 0) {
+        unmap_clips(clips, config->num_clips);
+        cleanup(state, NULL);
+        return -1;
+    }
+    
+    /* With an index, a seek starts from its nearest entry; without, the
+       whole score is rendered up to the seek position */
+    synth_index_t *index = NULL;
+    uint64_t seek_sample = 0;
+    uint64_t position = 0;
+    
+    if (config->seek >= 0.0) {
+        seek_sample = (uint64_t)(config->seek * config->sample_rate + 0.5);
+        if (config->index_file) {
+            if (synth_index_seek(state, config->index_file, seek_sample, &position) != 0) {
+                close_streams(streams, config->num_programs);
+                unmap_clips(clips, config->num_clips);
+                cleanup(state, NULL);
+                return -1;
+            }
+            printf("Seek index entry at %.2f seconds, rendering %.2f seconds to %.2f\n",
+                   (double)position / config->sample_rate,
+                   (double)(seek_sample - position) / config->sample_rate,
+                   (double)seek_sample / config->sample_rate);
+        }
+    } else if (config->index_file) {
+        index = synth_index_attach(state, (uint32_t)(config->index_interval *
+                                                     config->sample_rate + 0.5));
+        if (!index) {
+            close_streams(streams, config->num_programs);
+            unmap_clips(clips, config->num_clips);
+            cleanup(state, NULL);
+            return -1;
+        }
     }
     
     snd_pcm_t *pcm_handle = NULL;
     wav_context_t *wav_ctx = NULL;
+    fanout_t *fanout = NULL;
     
-    if (config.output_file) {
-        wav_ctx = wav_open(config.output_file, config.sample_rate);
+    /* A single output as rendered is written directly, several or
+       converted ones through the fan-out */
+    if (config->num_outputs == 1 && fanout_spec_is_plain(&config->outputs[0])) {
+        wav_ctx = wav_open(config->outputs[0].filename, config->sample_rate);
         if (!wav_ctx) {
+            synth_index_free(index);
+            close_streams(streams, config->num_programs);
+            unmap_clips(clips, config->num_clips);
+            cleanup(state, NULL);
+            return -1;
+        }
+    } else if (config->num_outputs) {
+        fanout = fanout_open(config->outputs, config->num_outputs, config->sample_rate);
+        if (!fanout) {
+            synth_index_free(index);
+            close_streams(streams, config->num_programs);
+            unmap_clips(clips, config->num_clips);
             cleanup(state, NULL);
-            return 1;
+            return -1;
         }
     } else {
-        if (init_audio(&pcm_handle, config.sample_rate) != 0) {
+        if (init_audio(&pcm_handle, config->sample_rate, 0) != 0) {
             fprintf(stderr, "\nTip: Try WAV output: -o output.wav\n");
+            synth_index_free(index);
+            close_streams(streams, config->num_programs);
+            unmap_clips(clips, config->num_clips);
             cleanup(state, NULL);
-            return 1;
+            return -1;
         }
     }
     
@@ -289,603 +516,427 @@ int main(int argc, char *argv[]) {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
     
-    printf("Starting NOTRAN playback...\n");
-    const int result = interpret_loop(state, pcm_handle, wav_ctx);
+    synth_sink_t sink = alsa_sink;
+    void *sink_ctx = pcm_handle;
+    if (wav_ctx) {
+        sink = wav_sink;
+        sink_ctx = wav_ctx;
+    } else if (fanout) {
+        sink = fanout_sink;
+        sink_ctx = fanout;
+    }
+    
+    seek_sink_t seek = { sink, sink_ctx, seek_sample - position };
+    if (seek.skip) {
+        sink = seek_sink;
+        sink_ctx = &seek;
+    }
+    
+    int result;
+    if (config->mode == MODE_KIM4V) {
+        printf("Starting kim4v playback...\n");
+        result = synth_run_kim4v(state, sink, sink_ctx);
+    } else if (config->num_programs > 1) {
+        printf("Starting NOTRAN playback of %d programs...\n", config->num_programs);
+        result = synth_run_notran_mix(streams, config->num_programs, sink, sink_ctx);
+    } else {
+        printf("Starting NOTRAN playback...\n");
+        result = synth_run_notran(state, sink, sink_ctx);
+    }
     
     if (wav_ctx) {
         wav_close(wav_ctx);
     }
-    
-    cleanup(state, pcm_handle);
-    return (result == 0) ? 0 : 1;
-}
-
-/* ============================================================================
- * Utility Functions
- * ============================================================================ */
-
-static inline uint16_t get_frequency_increment(uint8_t note_offset) {
-    const int array_index = note_offset / 2;
-    
-    if (array_index >= NUM_NOTES || array_index < 0) {
-        return 0;
+    if (fanout && fanout_close(fanout) != 0) {
+        result = -1;
     }
     
-    return FREQUENCY_TABLE[array_index];
-}
-
-static inline int8_t sign_extend_4bit(uint8_t nibble) {
-    int8_t value = (int8_t)nibble;
-    return (value >= 8) ? (value | 0xF0) : value;
-}
-
-static inline uint8_t clamp_sample(uint16_t value) {
-    return (value > SAMPLE_MAX) ? SAMPLE_MAX : (uint8_t)value;
-}
-
-static inline bool is_control_command(uint8_t command) {
-    return (command & DURATION_MASK) == 0;
-}
-
-static inline bool is_long_note_command(uint8_t command) {
-    const uint8_t cmd_type = command & PITCH_MASK;
-    return (cmd_type == CMD_LONGNOTE_ABS || cmd_type == CMD_LONGNOTE_REL);
-}
-
-static inline bool is_voice_active(const voice_t *voice) {
-    return voice->duration != VOICE_INACTIVE;
-}
-
-static inline bool is_voice_expired(const voice_t *voice) {
-    return voice->duration == 0;
-}
-
-/* ============================================================================
- * Voice Management
- * ============================================================================ */
-
-static void init_voice(voice_t *voice, uint8_t wavetable_base) {
-    memset(voice, 0, sizeof(*voice));
-    voice->wavetable_page = wavetable_base;
-    voice->duration = VOICE_INACTIVE;
-}
-
-static void set_voice_silent(voice_t *voice) {
-    voice->freq_increment = 0;
-}
-
-static void activate_voice(voice_t *voice) {
-    voice->duration = 0;
-    set_voice_silent(voice);
-}
-
-static void deactivate_voice(voice_t *voice) {
-    voice->duration = VOICE_INACTIVE;
-    set_voice_silent(voice);
-}
-
-static void reset_phase_accumulator(voice_t *voice) {
-    voice->phase_frac = 0;
-    voice->phase_int = 0;
-}
-
-static void update_voice_frequency(voice_t *voice, uint8_t note_offset) {
-    voice->note_offset = note_offset;
-    voice->freq_increment = get_frequency_increment(note_offset);
-}
-
-static void assign_short_note(voice_t *voice, uint8_t pitch_field, 
-                              uint8_t duration_code) {
-    const uint8_t prev_note_offset = voice->note_offset;
-    voice->duration = DURATION_TABLE[duration_code];
-    
-    const int8_t pitch_nibble = sign_extend_4bit(pitch_field >> PITCH_SHIFT);
-    
-    if (pitch_nibble == PITCH_REST) {
-        set_voice_silent(voice);
-        return;
+    if (index) {
+        if (result == 0 &&
+            synth_index_write(index, state, config->index_file, config->sample_rate) != 0) {
+            result = -1;
+        }
+        synth_index_free(index);
     }
     
-    const int8_t byte_offset = pitch_nibble * 2;
-    voice->note_offset += byte_offset;
-    update_voice_frequency(voice, voice->note_offset);
-    
-    if (byte_offset == 0 && prev_note_offset == voice->note_offset) {
-        reset_phase_accumulator(voice);
-    }
-}
-
-static void assign_long_note_absolute(voice_t *voice, uint8_t pitch_byte,
-                                      uint8_t waveform, uint8_t duration_code) {
-    voice->note_offset = pitch_byte;
-    voice->wavetable_page = waveform;
-    voice->duration = DURATION_TABLE[duration_code];
-    update_voice_frequency(voice, pitch_byte);
-}
-
-static void assign_long_note_relative(voice_t *voice, int8_t pitch_displacement,
-                                      uint8_t waveform, uint8_t duration_code) {
-    voice->note_offset += pitch_displacement;
-    voice->wavetable_page = waveform;
-    voice->duration = DURATION_TABLE[duration_code];
-    update_voice_frequency(voice, voice->note_offset);
+    close_streams(streams, config->num_programs);
+    unmap_clips(clips, config->num_clips);
+    cleanup(state, pcm_handle);
+    return result;
 }
 
 /* ============================================================================
- * Interpreter State
+ * Audio Backend
  * ============================================================================ */
 
-static int init_interpreter(interpreter_state_t *state,
-                            uint8_t *object_code,
-                            size_t code_size,
-                            uint8_t **wavetables,
-                            int num_wavetables,
-                            uint32_t max_jumps) {
-    if (!state || !object_code || !wavetables) {
-        fprintf(stderr, "Error: NULL parameter in init_interpreter\n");
+/*
+ * Open the default device. With a period, the buffer is kept to a few
+ * periods for low latency; without, it is large enough to never run dry.
+ */
+static int init_audio(snd_pcm_t **pcm_handle, int sample_rate, int period) {
+    snd_pcm_hw_params_t *hw_params;
+    const char *device = "default";
+    
+    int err = snd_pcm_open(pcm_handle, device, SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0) {
+        fprintf(stderr, "Error: Cannot open audio device '%s': %s\n",
+                device, snd_strerror(err));
         return -1;
     }
     
-    if (code_size == 0 || num_wavetables == 0) {
-        fprintf(stderr, "Error: Invalid code_size or num_wavetables\n");
+    if (snd_pcm_hw_params_malloc(&hw_params) < 0) {
+        fprintf(stderr, "Error: Cannot allocate hardware parameter structure\n");
+        snd_pcm_close(*pcm_handle);
         return -1;
     }
     
-    memset(state, 0, sizeof(*state));
-    
-    state->object_code = object_code;
-    state->code_size = code_size;
-    state->wavetables = wavetables;
-    state->num_wavetables = num_wavetables;
-    state->num_active_voices = MAX_VOICES;
-    state->running = true;
-    state->max_jumps = max_jumps;
+    snd_pcm_hw_params_any(*pcm_handle, hw_params);
+    snd_pcm_hw_params_set_access(*pcm_handle, hw_params,
+                                  SND_PCM_ACCESS_RW_INTERLEAVED);
+    snd_pcm_hw_params_set_format(*pcm_handle, hw_params, SND_PCM_FORMAT_U8);
+    snd_pcm_hw_params_set_channels(*pcm_handle, hw_params, CHANNELS);
     
-    for (int i = 0; i < MAX_VOICES; i++) {
-        init_voice(&state->voices[i], 0);
-    }
+    unsigned int actual_rate = sample_rate;
+    snd_pcm_hw_params_set_rate_near(*pcm_handle, hw_params, &actual_rate, 0);
     
-    return 0;
-}
-
-static void set_num_voices(interpreter_state_t *state, int num_voices) {
-    if (num_voices < 1) {
-        num_voices = 1;
-    } else if (num_voices > MAX_VOICES) {
-        num_voices = MAX_VOICES;
-    }
-    state->num_active_voices = num_voices;
-}
-
-/* ============================================================================
- * Bytecode Reading
- * ============================================================================ */
-
-static inline uint8_t read_code_byte(interpreter_state_t *state) {
-    if (state->code_ptr >= state->code_size) {
-        return 0;
-    }
-    return state->object_code[state->code_ptr++];
-}
-
-static inline uint16_t read_code_address(interpreter_state_t *state) {
-    const uint8_t low = read_code_byte(state);
-    const uint8_t high = read_code_byte(state);
-    return (uint16_t)low | ((uint16_t)high << 8);
-}
-
-/* ============================================================================
- * Command Processing
- * ============================================================================ */
-
-static int handle_tempo_command(interpreter_state_t *state) {
-    const uint8_t new_tempo = read_code_byte(state);
-    if (new_tempo == 0) {
-        fprintf(stderr, "Error: Tempo cannot be zero at position %zu\n",
-                state->code_ptr - 2);
-        return -1;
-    }
-    state->tempo = new_tempo;
-    return 0;
-}
-
-static int handle_call_command(interpreter_state_t *state) {
-    if (state->stack_ptr >= STACK_SIZE) {
-        fprintf(stderr, "Error: Call stack overflow at position %zu\n",
-                state->code_ptr - 1);
-        return -1;
+    snd_pcm_uframes_t buffer_size = BUFFER_FRAMES * 4;
+    if (period > 0) {
+        snd_pcm_uframes_t period_size = period;
+        snd_pcm_hw_params_set_period_size_near(*pcm_handle, hw_params,
+                                               &period_size, NULL);
+        buffer_size = period_size * LIVE_PERIODS;
     }
+    snd_pcm_hw_params_set_buffer_size_near(*pcm_handle, hw_params, &buffer_size);
     
-    state->call_stack[state->stack_ptr++] = state->code_ptr + 2;
+    err = snd_pcm_hw_params(*pcm_handle, hw_params);
+    snd_pcm_hw_params_free(hw_params);
     
-    const uint16_t addr = read_code_address(state);
-    if (addr >= state->code_size) {
-        fprintf(stderr, "Error: Call to invalid address 0x%04X at position %zu\n",
-                addr, state->code_ptr - 3);
+    if (err < 0) {
+        fprintf(stderr, "Error: Cannot set hardware parameters: %s\n",
+                snd_strerror(err));
+        snd_pcm_close(*pcm_handle);
         return -1;
     }
     
-    state->code_ptr = addr;
-    return 0;
-}
-
-static int handle_return_command(interpreter_state_t *state) {
-    if (state->stack_ptr == 0) {
-        fprintf(stderr, "Error: Return with empty call stack at position %zu\n",
-                state->code_ptr - 1);
+    if (snd_pcm_prepare(*pcm_handle) < 0) {
+        fprintf(stderr, "Error: Cannot prepare audio interface\n");
+        snd_pcm_close(*pcm_handle);
         return -1;
     }
     
-    state->code_ptr = state->call_stack[--state->stack_ptr];
-    return 0;
-}
-
-static int handle_jump_command(interpreter_state_t *state) {
-    if (state->max_jumps == 0) {
-        fprintf(stderr, "Info: Maximum jump limit reached at position %zu\n",
-                state->code_ptr - 1);
-        return 1;
-    }
-    
-    --state->max_jumps;
-    
-    const uint16_t addr = read_code_address(state);
-    if (addr >= state->code_size) {
-        fprintf(stderr, "Error: Jump to invalid address 0x%04X at position %zu\n",
-                addr, state->code_ptr - 3);
-        return -1;
+    printf("Audio initialized: %s @ %d Hz", device, actual_rate);
+    if (period > 0) {
+        printf(", %lu frame buffer", (unsigned long)buffer_size);
     }
-    
-    state->code_ptr = addr;
+    printf("\n");
     return 0;
 }
 
-static int handle_setvoices_command(interpreter_state_t *state) {
-    const uint8_t num_voices = read_code_byte(state);
-    if (num_voices < 1 || num_voices > MAX_VOICES) {
-        fprintf(stderr, "Warning: Invalid voice count %d at position %zu\n",
-                num_voices, state->code_ptr - 2);
+static void close_audio(snd_pcm_t *pcm_handle) {
+    if (pcm_handle) {
+        snd_pcm_drain(pcm_handle);
+        snd_pcm_close(pcm_handle);
     }
-    set_num_voices(state, num_voices);
-    return 0;
 }
 
-static int handle_deactivate_command(interpreter_state_t *state) {
-    const uint8_t voice_num = read_code_byte(state) & 0x03;
-    deactivate_voice(&state->voices[voice_num]);
-    return 0;
-}
-
-static int handle_activate_command(interpreter_state_t *state) {
-    const uint8_t voice_num = read_code_byte(state) & 0x03;
-    activate_voice(&state->voices[voice_num]);
-    return 0;
-}
-
-static int process_control_command(interpreter_state_t *state, uint8_t command) {
-    const uint8_t cmd_type = command & PITCH_MASK;
-    
-    if (is_long_note_command(command)) {
-        fprintf(stderr, "Error: Long note command 0x%02X in control processing "
-                "at position %zu\n", command, state->code_ptr - 1);
-        return -1;
-    }
+static int alsa_sink(void *ctx, const uint8_t *buffer, size_t count) {
+    snd_pcm_t *pcm_handle = ctx;
+    snd_pcm_sframes_t frames = snd_pcm_writei(pcm_handle, buffer, count);
     
-    switch (cmd_type) {
-        case CMD_END:        return 1;
-        case CMD_TEMPO:      return handle_tempo_command(state);
-        case CMD_CALL:       return handle_call_command(state);
-        case CMD_RETURN:     return handle_return_command(state);
-        case CMD_JUMP:       return handle_jump_command(state);
-        case CMD_SETVOICES:  return handle_setvoices_command(state);
-        case CMD_DEACTIVATE: return handle_deactivate_command(state);
-        case CMD_ACTIVATE:   return handle_activate_command(state);
-        default:
-            fprintf(stderr, "Error: Undefined control command 0x%02X at position %zu\n",
-                    command, state->code_ptr - 1);
+    if (frames < 0) {
+        frames = snd_pcm_recover(pcm_handle, frames, 0);
+        if (frames < 0) {
+            fprintf(stderr, "Error: snd_pcm_writei failed: %s\n",
+                    snd_strerror(frames));
             return -1;
-    }
-}
-
-static void process_long_note(interpreter_state_t *state, voice_t *voice, 
-                              uint8_t command) {
-    const uint8_t cmd_type = command & PITCH_MASK;
-    const uint8_t pitch_byte = read_code_byte(state);
-    const uint8_t wd_byte = read_code_byte(state);
-    
-    uint8_t waveform = (wd_byte >> 4) & 0x0F;
-    uint8_t duration_code = wd_byte & 0x0F;
-    
-    if (duration_code == 0) {
-        fprintf(stderr, "Warning: Long note with duration code 0 at position %zu\n",
-                state->code_ptr - 3);
-        duration_code = 1;
-    }
-    
-    if (waveform >= state->num_wavetables) {
-        fprintf(stderr, "Warning: Invalid wavetable %d at position %zu\n",
-                waveform, state->code_ptr - 3);
-        waveform = state->num_wavetables - 1;
+        }
     }
     
-    if (cmd_type == CMD_LONGNOTE_ABS) {
-        assign_long_note_absolute(voice, pitch_byte, waveform, duration_code);
-    } else {
-        assign_long_note_relative(voice, (int8_t)pitch_byte, waveform, duration_code);
-    }
+    return 0;
 }
 
-static uint8_t find_shortest_duration(const interpreter_state_t *state) {
-    uint8_t shortest = VOICE_INACTIVE;
+static int seek_sink(void *ctx, const uint8_t *buffer, size_t count) {
+    seek_sink_t *seek = ctx;
     
-    for (int i = 0; i < MAX_VOICES; i++) {
-        const voice_t *voice = &state->voices[i];
-        
-        if (is_voice_active(voice) && !is_voice_expired(voice)) {
-            if (voice->duration < shortest) {
-                shortest = voice->duration;
-            }
-        }
+    if (seek->skip >= count) {
+        seek->skip -= count;
+        return 0;
     }
     
-    return shortest;
+    const size_t skip = seek->skip;
+    seek->skip = 0;
+    return seek->sink(seek->ctx, buffer + skip, count - skip);
 }
 
 /* ============================================================================
- * Synthesis Engine
+ * Live Instrument
  * ============================================================================ */
 
-static inline void advance_phase(voice_t *voice) {
-    uint16_t phase = ((uint16_t)voice->phase_int << 8) | voice->phase_frac;
-    phase += voice->freq_increment;
-    voice->phase_frac = phase & 0xFF;
-    voice->phase_int = (phase >> 8) & 0xFF;
+static int64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
 }
 
-static inline uint8_t generate_sample(interpreter_state_t *state) {
-    uint16_t sum = 0;
-    
-    for (int i = 0; i < state->num_active_voices; i++) {
-        voice_t *voice = &state->voices[i];
-        
-        if (voice->freq_increment == 0 || 
-            voice->wavetable_page >= state->num_wavetables) {
-            continue;
+static int open_midi_input(const char *source, midi_input_t *input) {
+    if (strncmp(source, "alsa:", 5) == 0) {
+        const char *port = source + 5;
+        const int err = snd_rawmidi_open(&input->rawmidi, NULL, port,
+                                         SND_RAWMIDI_NONBLOCK);
+        if (err < 0) {
+            fprintf(stderr, "Error: Cannot open MIDI port '%s': %s\n",
+                    port, snd_strerror(err));
+            return -1;
         }
-        
-        const uint8_t *wavetable = state->wavetables[voice->wavetable_page];
-        sum += wavetable[voice->phase_int];
-        advance_phase(voice);
-    }
-    
-    return clamp_sample(sum);
-}
-
-static int write_audio_buffer(snd_pcm_t *pcm_handle, wav_context_t *wav_ctx,
-                              const uint8_t *buffer, size_t count) {
-    if (wav_ctx) {
-        return wav_write(wav_ctx, buffer, count);
+        printf("MIDI input: ALSA port '%s'\n", port);
+        return 0;
     }
     
-    if (!pcm_handle) {
+    if (strcmp(source, "-") == 0) {
+        input->fd = STDIN_FILENO;
+        printf("MIDI input: stdin\n");
         return 0;
     }
     
-    snd_pcm_sframes_t frames = snd_pcm_writei(pcm_handle, buffer, count);
-    
-    if (frames < 0) {
-        frames = snd_pcm_recover(pcm_handle, frames, 0);
-        if (frames < 0) {
-            fprintf(stderr, "Error: snd_pcm_writei failed: %s\n",
-                    snd_strerror(frames));
-            return -1;
-        }
+    /* Opening a FIFO waits for the other end */
+    printf("MIDI input: '%s'\n", source);
+    fflush(stdout);
+    input->fd = open(source, O_RDONLY);
+    if (input->fd < 0) {
+        fprintf(stderr, "Error: Cannot open '%s': %s\n", source, strerror(errno));
+        return -1;
     }
-    
     return 0;
 }
 
-static int play_notes(interpreter_state_t *state, snd_pcm_t *pcm_handle,
-                     wav_context_t *wav_ctx, uint8_t *buffer, size_t buffer_size) {
-    const int total_samples = state->tempo * state->duration;
-    int samples_generated = 0;
-    size_t buffer_pos = 0;
-    
-    while (samples_generated < total_samples && state->running) {
-        buffer[buffer_pos++] = generate_sample(state);
-        samples_generated++;
-        
-        if (buffer_pos >= buffer_size) {
-            if (write_audio_buffer(pcm_handle, wav_ctx, buffer, buffer_pos) != 0) {
-                return -1;
-            }
-            buffer_pos = 0;
-        }
+static void close_midi_input(midi_input_t *input) {
+    if (input->rawmidi) {
+        snd_rawmidi_close(input->rawmidi);
+    } else if (input->fd > STDIN_FILENO) {
+        close(input->fd);
     }
+}
+
+/*
+ * Input thread. Stamps the bytes with their arrival time and queues them
+ * for the audio loop until the input ends or it is asked to stop.
+ */
+static void *midi_input_thread(void *arg) {
+    midi_input_t *input = arg;
+    midi_ring_t *ring = input->ring;
+    struct pollfd pfd = { .fd = input->fd, .events = POLLIN };
+    uint8_t buffer[256];
     
-    if (buffer_pos > 0) {
-        if (write_audio_buffer(pcm_handle, wav_ctx, buffer, buffer_pos) != 0) {
-            return -1;
-        }
+    if (input->rawmidi) {
+        snd_rawmidi_poll_descriptors(input->rawmidi, &pfd, 1);
     }
     
-    return 0;
-}
-
-/* ============================================================================
- * Interpreter Main Loop
- * ============================================================================ */
-
-static int process_pure_control_commands(interpreter_state_t *state) {
-    while (state->code_ptr < state->code_size) {
-        const uint8_t command = state->object_code[state->code_ptr];
-        
-        if (!is_control_command(command) || is_long_note_command(command)) {
+    while (!atomic_load(&ring->stop)) {
+        const int ready = poll(&pfd, 1, MIDI_POLL_MS);
+        if (ready < 0 && errno != EINTR) {
             break;
         }
-        
-        state->code_ptr++;
-        const int result = process_control_command(state, command);
-        if (result != 0) {
-            return result;
-        }
-    }
-    
-    return 0;
-}
-
-static int process_notes_for_voices(interpreter_state_t *state) {
-    int notes_assigned = 0;
-    
-    for (int voice_idx = 0; voice_idx < MAX_VOICES; voice_idx++) {
-        voice_t *voice = &state->voices[voice_idx];
-        
-        if (!is_voice_active(voice)) {
+        if (ready <= 0) {
             continue;
         }
         
-        if (voice->duration > 0 && state->duration > 0) {
-            if (voice->duration > state->duration) {
-                voice->duration -= state->duration;
+        ssize_t count;
+        if (input->rawmidi) {
+            count = snd_rawmidi_read(input->rawmidi, buffer, sizeof(buffer));
+            if (count == -EAGAIN) {
+                continue;
+            }
+        } else {
+            count = read(input->fd, buffer, sizeof(buffer));
+            if (count < 0 && (errno == EAGAIN || errno == EINTR)) {
                 continue;
             }
-            voice->duration = 0;
-        }
-        
-        if (!is_voice_expired(voice)) {
-            continue;
         }
-        
-        if (state->code_ptr >= state->code_size) {
+        if (count <= 0) {
             break;
         }
         
-        const uint8_t command = read_code_byte(state);
-        const uint8_t duration_code = command & DURATION_MASK;
+        const int64_t now = monotonic_ns();
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        const size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
         
-        if (duration_code == 0) {
-            if (is_long_note_command(command)) {
-                process_long_note(state, voice, command);
-                notes_assigned++;
-            } else {
-                state->code_ptr--;
-                return notes_assigned;
+        for (ssize_t i = 0; i < count; i++) {
+            if (head - tail >= MIDI_RING_SIZE) {
+                atomic_fetch_add(&ring->dropped, 1);
+                continue;
             }
-        } else {
-            const uint8_t pitch_field = command & PITCH_MASK;
-            assign_short_note(voice, pitch_field, duration_code);
-            notes_assigned++;
+            ring->items[head & (MIDI_RING_SIZE - 1)] = (midi_byte_t){ buffer[i], now };
+            head++;
         }
+        atomic_store_explicit(&ring->head, head, memory_order_release);
     }
     
-    return notes_assigned;
+    atomic_store(&ring->done, true);
+    return NULL;
 }
 
-static int interpret_loop(interpreter_state_t *state, snd_pcm_t *pcm_handle,
-                         wav_context_t *wav_ctx) {
-    uint8_t *audio_buffer = malloc(BUFFER_FRAMES);
-    if (!audio_buffer) {
-        fprintf(stderr, "Error: Failed to allocate audio buffer\n");
-        return -1;
+static void latency_add(latency_stats_t *stats, int64_t latency) {
+    if (stats->count == 0 || latency < stats->min) {
+        stats->min = latency;
     }
-    
-    if (state->tempo == 0) {
-        fprintf(stderr, "Warning: Tempo not set, using default of 32\n");
-        state->tempo = 32;
+    if (latency > stats->max) {
+        stats->max = latency;
+    }
+    stats->total += latency;
+    stats->count++;
+}
+
+/*
+ * Feed the queued MIDI bytes to the instrument, recording the latency of
+ * the note-ons: the time they waited for this period plus the audio
+ * already queued ahead of it
+ */
+static bool drain_midi(synth_live_t *live, midi_ring_t *ring, int64_t now,
+                       int64_t output_delay, latency_stats_t *stats) {
+    const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    
+    for (; tail != head; tail++) {
+        const midi_byte_t *item = &ring->items[tail & (MIDI_RING_SIZE - 1)];
+        if (synth_live_midi(live, item->byte)) {
+            latency_add(stats, now - item->time + output_delay);
+        }
     }
     
-    while (state->running && state->code_ptr < state->code_size) {
-        const int pcc_result = process_pure_control_commands(state);
-        if (pcc_result != 0) {
-            free(audio_buffer);
-            return (pcc_result > 0) ? 0 : -1;
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    return atomic_load(&ring->done) && tail == atomic_load(&ring->head);
+}
+
+/*
+ * Audio loop. Renders one period at a time, taking the MIDI bytes that
+ * arrived in the meantime before each. ALSA paces it by blocking while
+ * the buffer is full; a WAV file is written in real time instead.
+ */
+static int live_loop(synth_live_t *live, midi_ring_t *ring, snd_pcm_t *pcm,
+                     wav_context_t *wav, const config_t *config,
+                     latency_stats_t *stats) {
+    static uint8_t buffer[LIVE_PERIOD_MAX];
+    const int64_t period_ns = (int64_t)config->period * NS_PER_SEC / config->sample_rate;
+    int64_t deadline = monotonic_ns();
+    
+    while (live->state->running) {
+        int64_t output_delay = 0;
+        if (pcm) {
+            snd_pcm_sframes_t frames;
+            if (snd_pcm_delay(pcm, &frames) == 0 && frames > 0) {
+                output_delay = (int64_t)frames * NS_PER_SEC / config->sample_rate;
+            }
         }
         
-        if (state->code_ptr >= state->code_size) {
+        if (drain_midi(live, ring, monotonic_ns(), output_delay, stats)) {
             break;
         }
         
-        process_notes_for_voices(state);
-        
-        state->duration = find_shortest_duration(state);
-        
-        if (state->duration == VOICE_INACTIVE || state->duration == 0) {
-            continue;
-        }
+        synth_live_render(live, buffer, config->period);
         
-        if (play_notes(state, pcm_handle, wav_ctx, audio_buffer, BUFFER_FRAMES) != 0) {
-            free(audio_buffer);
-            return -1;
+        if (pcm) {
+            if (alsa_sink(pcm, buffer, config->period) != 0) {
+                return -1;
+            }
+        } else {
+            if (wav_write(wav, buffer, config->period) != 0) {
+                return -1;
+            }
+            deadline += period_ns;
+            const struct timespec ts = { deadline / NS_PER_SEC, deadline % NS_PER_SEC };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
         }
     }
     
-    if (pcm_handle) {
-        snd_pcm_drain(pcm_handle);
-    }
-    
-    puts("Interpretation complete");
-    free(audio_buffer);
     return 0;
 }
 
-/* ============================================================================
- * Audio Backend
- * ============================================================================ */
+static void report_live(const synth_live_t *live, const midi_ring_t *ring,
+                        const latency_stats_t *stats) {
+    if (stats->count == 0) {
+        printf("No notes played\n");
+    } else {
+        printf("%u notes, event to audio latency: min %.2f ms, avg %.2f ms, "
+               "max %.2f ms\n", stats->count, stats->min / 1e6,
+               stats->total / 1e6 / stats->count, stats->max / 1e6);
+        if (stats->max / 1e6 > LIVE_TARGET_MS) {
+            fprintf(stderr, "Warning: Latency above %.0f ms, try a smaller period\n",
+                    LIVE_TARGET_MS);
+        }
+    }
+    
+    if (live->stolen > 0) {
+        printf("%u note%s cut short for lack of voices\n", live->stolen,
+               (live->stolen == 1) ? "" : "s");
+    }
+    if (atomic_load(&ring->dropped) > 0) {
+        fprintf(stderr, "Warning: %u MIDI bytes lost, the input was too fast\n",
+                atomic_load(&ring->dropped));
+    }
+}
 
-static int init_audio(snd_pcm_t **pcm_handle, int sample_rate) {
-    snd_pcm_hw_params_t *hw_params;
-    const char *device = "default";
+static int run_live(const config_t *config) {
+    /* Everything the audio loop uses is set up here, so that it never
+       allocates */
+    static midi_ring_t ring;
+    midi_input_t input = { .fd = -1, .ring = &ring };
+    synth_live_t live;
+    latency_stats_t stats = {0};
+    int result = -1;
     
-    int err = snd_pcm_open(pcm_handle, device, SND_PCM_STREAM_PLAYBACK, 0);
-    if (err < 0) {
-        fprintf(stderr, "Error: Cannot open audio device '%s': %s\n",
-                device, snd_strerror(err));
+    int num_wavetables;
+    uint8_t **wavetables = load_wavetables(config->wavetable_file, &num_wavetables);
+    if (!wavetables) {
         return -1;
     }
     
-    if (snd_pcm_hw_params_malloc(&hw_params) < 0) {
-        fprintf(stderr, "Error: Cannot allocate hardware parameter structure\n");
-        snd_pcm_close(*pcm_handle);
+    interpreter_state_t *state = calloc(1, sizeof(interpreter_state_t));
+    if (!state || synth_live_init(&live, state, wavetables, num_wavetables,
+                                  config->voices) != 0) {
+        free(state);
+        free_wavetables(wavetables);
         return -1;
     }
     
-    snd_pcm_hw_params_any(*pcm_handle, hw_params);
-    snd_pcm_hw_params_set_access(*pcm_handle, hw_params,
-                                  SND_PCM_ACCESS_RW_INTERLEAVED);
-    snd_pcm_hw_params_set_format(*pcm_handle, hw_params, SND_PCM_FORMAT_U8);
-    snd_pcm_hw_params_set_channels(*pcm_handle, hw_params, CHANNELS);
-    
-    unsigned int actual_rate = sample_rate;
-    snd_pcm_hw_params_set_rate_near(*pcm_handle, hw_params, &actual_rate, 0);
-    
-    snd_pcm_uframes_t buffer_size = BUFFER_FRAMES * 4;
-    snd_pcm_hw_params_set_buffer_size_near(*pcm_handle, hw_params, &buffer_size);
-    
-    err = snd_pcm_hw_params(*pcm_handle, hw_params);
-    snd_pcm_hw_params_free(hw_params);
+    snd_pcm_t *pcm_handle = NULL;
+    wav_context_t *wav_ctx = NULL;
     
-    if (err < 0) {
-        fprintf(stderr, "Error: Cannot set hardware parameters: %s\n",
-                snd_strerror(err));
-        snd_pcm_close(*pcm_handle);
-        return -1;
+    if (config->num_outputs) {
+        wav_ctx = wav_open(config->outputs[0].filename, config->sample_rate);
+    } else if (init_audio(&pcm_handle, config->sample_rate, config->period) != 0) {
+        pcm_handle = NULL;
     }
     
-    if (snd_pcm_prepare(*pcm_handle) < 0) {
-        fprintf(stderr, "Error: Cannot prepare audio interface\n");
-        snd_pcm_close(*pcm_handle);
-        return -1;
+    if ((wav_ctx || pcm_handle) && open_midi_input(config->midi_input, &input) == 0) {
+        pthread_t thread;
+        
+        g_state = state;
+        signal(SIGINT, signal_handler);
+        signal(SIGTERM, signal_handler);
+        
+        if (pthread_create(&thread, NULL, midi_input_thread, &input) == 0) {
+            printf("Playing live, %d frame periods (%.2f ms)...\n", config->period,
+                   config->period * 1000.0 / config->sample_rate);
+            result = live_loop(&live, &ring, pcm_handle, wav_ctx, config, &stats);
+            
+            atomic_store(&ring.stop, true);
+            pthread_join(thread, NULL);
+            report_live(&live, &ring, &stats);
+        } else {
+            fprintf(stderr, "Error: Cannot start the MIDI input thread\n");
+        }
+        close_midi_input(&input);
     }
     
-    printf("Audio initialized: %s @ %d Hz\n", device, actual_rate);
-    return 0;
-}
-
-static void close_audio(snd_pcm_t *pcm_handle) {
+    if (wav_ctx) {
+        wav_close(wav_ctx);
+    }
     if (pcm_handle) {
-        snd_pcm_drain(pcm_handle);
-        snd_pcm_close(pcm_handle);
+        close_audio(pcm_handle);
     }
+    free_wavetables(wavetables);
+    free(state);
+    return result;
 }
 
 /* ============================================================================
@@ -954,17 +1005,12 @@ static uint8_t **load_wavetables(const char *filename, int *num_tables) {
         return NULL;
     }
     
-    uint8_t **tables = malloc(num * sizeof(uint8_t *));
+    uint8_t **tables = synth_table_pointers(file_data, num);
     if (!tables) {
-        fprintf(stderr, "Error: Cannot allocate wavetable array\n");
         free(file_data);
         return NULL;
     }
     
-    for (int i = 0; i < num; i++) {
-        tables[i] = file_data + (i * WAVETABLE_SIZE);
-    }
-    
     *num_tables = num;
     printf("Loaded %d wavetable%s (%zu bytes)\n", num, 
            (num == 1) ? "" : "s", file_size);
@@ -987,91 +1033,107 @@ static uint8_t *load_notran_bytecode(const char *filename, size_t *size) {
     return bytecode;
 }
 
-/* ============================================================================
- * WAV File Output
- * ============================================================================ */
-
-static wav_context_t *wav_open(const char *filename, int sample_rate) {
-    wav_context_t *ctx = calloc(1, sizeof(wav_context_t));
-    if (!ctx) {
-        return NULL;
-    }
-    
-    ctx->fp = fopen(filename, "wb");
-    if (!ctx->fp) {
-        fprintf(stderr, "Error: Cannot create WAV file '%s'\n", filename);
-        free(ctx);
-        return NULL;
+/*
+ * Load the programs after the first into streams[1] on, each in its own
+ * state with the wavetables and clips of streams[0]
+ */
+static int open_streams(const config_t *config, interpreter_state_t **streams,
+                        const synth_clip_t *clips) {
+    const interpreter_state_t *first = streams[0];
+    
+    for (int i = 1; i < config->num_programs; i++) {
+        size_t bytecode_size;
+        uint8_t *bytecode = load_notran_bytecode(config->bytecode_files[i],
+                                                 &bytecode_size);
+        if (!bytecode) {
+            close_streams(streams, i);
+            return -1;
+        }
+        
+        streams[i] = calloc(1, sizeof(interpreter_state_t));
+        if (!streams[i] ||
+            synth_init(streams[i], bytecode, bytecode_size, first->wavetables,
+                       first->num_wavetables, config->max_jumps,
+                       config->voices) != 0) {
+            free(bytecode);
+            close_streams(streams, i + 1);
+            return -1;
+        }
+        synth_set_clips(streams[i], clips, config->num_clips);
     }
     
-    ctx->buffer_size = BUFFER_FRAMES;
-    ctx->buffer = malloc(ctx->buffer_size);
-    if (!ctx->buffer) {
-        fclose(ctx->fp);
-        free(ctx);
-        return NULL;
+    return 0;
+}
+
+/*
+ * Free the states of streams[1] on. The first is released by cleanup(),
+ * with the shared wavetables.
+ */
+static void close_streams(interpreter_state_t **streams, int count) {
+    for (int i = 1; i < count; i++) {
+        if (streams[i]) {
+            free(streams[i]->object_code);
+            free(streams[i]);
+            streams[i] = NULL;
+        }
     }
-    
-    memcpy(ctx->header.riff_id, "RIFF", 4);
-    memcpy(ctx->header.wave_id, "WAVE", 4);
-    memcpy(ctx->header.fmt_id, "fmt ", 4);
-    ctx->header.fmt_size = 16;
-    ctx->header.audio_format = 1;
-    ctx->header.num_channels = CHANNELS;
-    ctx->header.sample_rate = sample_rate;
-    ctx->header.bits_per_sample = BITS_PER_SAMPLE;
-    ctx->header.byte_rate = sample_rate * CHANNELS * BITS_PER_SAMPLE / 8;
-    ctx->header.block_align = CHANNELS * BITS_PER_SAMPLE / 8;
-    memcpy(ctx->header.data_id, "data", 4);
-    
-    fwrite(&ctx->header, sizeof(wav_header_t), 1, ctx->fp);
-    printf("WAV file opened: '%s' @ %d Hz\n", filename, sample_rate);
-    
-    return ctx;
 }
 
-static int wav_write(wav_context_t *ctx, const uint8_t *buffer, size_t count) {
-    for (size_t i = 0; i < count; i++) {
-        ctx->buffer[ctx->buffer_pos++] = buffer[i];
+/*
+ * Map the clip files read-only, so that clips are played straight from
+ * the page cache with no copies
+ */
+static int map_clips(const config_t *config, synth_clip_t *clips) {
+    for (int i = 0; i < config->num_clips; i++) {
+        const char *filename = config->clip_files[i];
+        struct stat st;
+        
+        clips[i] = (synth_clip_t){ NULL, 0 };
         
-        if (ctx->buffer_pos >= ctx->buffer_size) {
-            const size_t written = fwrite(ctx->buffer, 1, ctx->buffer_pos, ctx->fp);
-            if (written != ctx->buffer_pos) {
-                fprintf(stderr, "Error: WAV write failed\n");
+        const int fd = open(filename, O_RDONLY);
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            fprintf(stderr, "Error: Cannot open clip '%s': %s\n",
+                    filename, strerror(errno));
+            if (fd >= 0) {
+                close(fd);
+            }
+            unmap_clips(clips, i);
+            return -1;
+        }
+        
+        if (st.st_size > 0) {
+            void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                fprintf(stderr, "Error: Cannot map clip '%s': %s\n",
+                        filename, strerror(errno));
+                close(fd);
+                unmap_clips(clips, i);
                 return -1;
             }
-            ctx->samples_written += ctx->buffer_pos;
-            ctx->buffer_pos = 0;
+            clips[i] = (synth_clip_t){ data, st.st_size };
         }
+        close(fd);
+        
+        printf("Loaded PCM clip %d '%s' (%zu samples)\n", i + 1, filename,
+               clips[i].size);
     }
+    
     return 0;
 }
 
-static int wav_close(wav_context_t *ctx) {
-    if (!ctx) {
-        return -1;
+static void unmap_clips(synth_clip_t *clips, int count) {
+    for (int i = 0; i < count; i++) {
+        if (clips[i].data) {
+            munmap((void *)clips[i].data, clips[i].size);
+        }
     }
-    
-    if (ctx->buffer_pos > 0) {
-        fwrite(ctx->buffer, 1, ctx->buffer_pos, ctx->fp);
-        ctx->samples_written += ctx->buffer_pos;
+}
+
+static void free_outputs(config_t *config) {
+    for (int i = 0; i < config->num_outputs; i++) {
+        fanout_free_spec(&config->outputs[i]);
     }
-    
-    ctx->header.data_size = ctx->samples_written;
-    ctx->header.riff_size = 36 + ctx->header.data_size;
-    
-    fseek(ctx->fp, 0, SEEK_SET);
-    fwrite(&ctx->header, sizeof(wav_header_t), 1, ctx->fp);
-    
-    printf("WAV file closed: %zu samples (%.2f seconds)\n",
-           ctx->samples_written,
-           (double)ctx->samples_written / ctx->header.sample_rate);
-    
-    free(ctx->buffer);
-    fclose(ctx->fp);
-    free(ctx);
-    
-    return 0;
+    config->num_outputs = 0;
 }
 
 /* ============================================================================
@@ -1091,10 +1153,13 @@ static void cleanup(interpreter_state_t *state, snd_pcm_t *pcm_handle) {
     }
     
     if (state) {
-        free(state->object_code);
-        if (state->wavetables) {
+        /* In kim4v mode the wavetables are pages of the code memory image */
+        if (state->wavetables && state->wavetables[0] == state->object_code) {
+            free(state->wavetables);
+        } else if (state->wavetables) {
             free_wavetables(state->wavetables);
         }
+        free(state->object_code);
         free(state);
     }
 }
@@ -0,0 +1,1867 @@
+/*
+ * NOTRAN synthesis library - Renders NOTRAN bytecode and kim4v song
+ *                            tables to 8 bit samples
+ *
+ * Based on the original 6502 assembly implementation by Hal Chamberlin
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include "synth.h"
+#include "objfile.h"
+
+/* ============================================================================
+ * CONSTANTS
+ * ============================================================================ */
+
+#define NUM_NOTES               62
+
+#define PITCH_MASK              0xF0
+#define DURATION_MASK           0x0F
+#define PITCH_SHIFT             4
+
+/* Control commands (duration field = 0) */
+#define CMD_END                 0x00
+#define CMD_TEMPO               0x10
+#define CMD_CALL                0x20
+#define CMD_RETURN              0x30
+#define CMD_JUMP                0x40
+#define CMD_SETVOICES           0x50
+#define CMD_LONGNOTE_ABS        0x60
+#define CMD_LONGNOTE_REL        0x70
+#define CMD_DEACTIVATE          0x80
+#define CMD_ACTIVATE            0x90
+#define CMD_PCM                 0xA0    /* Extension, not in notint.asm */
+
+#define PITCH_REST              (-8)
+#define VOICE_INACTIVE          0xFF
+
+/* Predicted 6502 cycles of notint.asm, used when profiling. The control
+   command costs include the fetch and vectored dispatch at PCC1. The 8
+   voice interpreter is modelled with the same costs, only its sound loop
+   is twice as long (see SOUND_CYCLES) */
+#define CYCLES_END              38
+#define CYCLES_TEMPO            53
+#define CYCLES_CALL             90
+#define CYCLES_RETURN           67
+#define CYCLES_JUMP             73
+#define CYCLES_SETVOICES        56      /* Plus SETNV, see SETNV_CYCLES */
+#define CYCLES_DEACTIVATE       80
+#define CYCLES_ACTIVATE         66
+#define CYCLES_NOTE_ENTRY       15      /* Note found at PCC1, JMP NOTE */
+#define CYCLES_VOICE_INACTIVE   11      /* NOTE1 scan of each voice */
+#define CYCLES_VOICE_RUNNING    22
+#define CYCLES_VOICE_EXPIRED    21
+#define CYCLES_VOICE_STARTED    7       /* Just activated, duration 0 */
+#define CYCLES_VOICE_NEXT       15      /* NOTE9 step to the next voice */
+#define CYCLES_VOICE_LAST       5
+#define CYCLES_SHORT_NOTE       77      /* NOTE2 to NOTE3 */
+#define CYCLES_REST             60
+#define CYCLES_LONG_NOTE_ABS    113     /* LNOTE, PCC60 and LNOTE3 */
+#define CYCLES_LONG_NOTE_REL    120     /* LNOTE, PCC70 and LNOTE3 */
+#define CYCLES_PLAY             29      /* PLAY, SOUND entry and JPCC */
+#define CYCLES_PLAY_VOICE       6       /* PLAY1 scan of each voice */
+#define CYCLES_PLAY_SHORTER     8
+
+/* A PCM clip is mixed in with the share of the sum of one voice */
+#define CLIP_SHIFT              2
+#define CLIP_SHIFT_8V           3
+
+#define SAMPLE_MIN              0
+#define SAMPLE_MAX              255
+
+/* kim4v.asm song renderer. Songs are read from a memory image built from
+   the PAP files, using the zero page layout of kim4v.asm */
+#define KIM4V_VPT               0x00    /* V1PT-V4PT, 3 bytes each */
+#define KIM4V_SONGA             0x14
+#define KIM4V_TEMPO             0x16
+#define KIM4V_FRQTAB            0x1E
+#define KIM4V_EVENT_SIZE        5
+
+/* Live instrument. MIDI note 24 is C1, the first note of the tables */
+#define MIDI_NOTE_C1            24
+#define MIDI_NOTE_OFF           0x80
+#define MIDI_NOTE_ON            0x90
+#define MIDI_CONTROL            0xB0
+#define MIDI_PROGRAM            0xC0
+#define MIDI_PRESSURE           0xD0
+#define MIDI_SYSTEM             0xF0
+#define MIDI_REALTIME           0xF8
+#define MIDI_ALL_SOUND_OFF      120
+#define MIDI_ALL_NOTES_OFF      123
+
+#define INDEX_MAGIC             "NIDX"
+#define INDEX_VERSION           1
+#define INDEX_HEADER_SIZE       32
+#define INDEX_RECORD_SIZE       (28 + 8 * MAX_VOICES)   /* Without the stack */
+#define INDEX_NO_CLIP           0xFF
+
+#define KIM4V_END               0
+#define KIM4V_SEGMENT           1
+#define KIM4V_CALL              2
+#define KIM4V_RETURN            3
+
+/* ============================================================================
+ * TYPE DEFINITIONS
+ * ============================================================================ */
+
+typedef struct {
+    char riff_id[4];
+    uint32_t riff_size;
+    char wave_id[4];
+    char fmt_id[4];
+    uint32_t fmt_size;
+    uint16_t audio_format;
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    char data_id[4];
+    uint32_t data_size;
+} wav_header_t;
+
+struct wav_context {
+    FILE *fp;
+    wav_header_t header;
+    size_t samples_written;     /* In bytes */
+    uint8_t *buffer;
+    size_t buffer_size;
+    size_t buffer_pos;
+};
+
+struct synth_index {
+    uint32_t interval;          /* Samples between entries */
+    uint32_t code_hash;
+    uint8_t *records;           /* Serialized states */
+    size_t records_size;
+    size_t records_capacity;
+    uint32_t *offsets;          /* Record of each entry */
+    size_t count;
+    size_t capacity;
+    uint8_t pending[INDEX_RECORD_SIZE + 2 * STACK_SIZE];
+    size_t pending_size;        /* 0 if none */
+    size_t pending_offset;      /* Of the pending state, once stored */
+    bool pending_stored;
+};
+
+/* ============================================================================
+ * GLOBAL DATA
+ * ============================================================================ */
+
+static const uint8_t DURATION_TABLE[16] = {
+    0, 192, 144, 96, 72, 64, 48, 36, 32, 24, 18, 16, 12, 9, 8, 6
+};
+
+/* SETNV cycles by number of voices */
+static const uint8_t SETNV_CYCLES[MAX_VOICES + 1] = {
+    0, 47, 41, 43, 38, 38, 38, 38, 38
+};
+
+static const uint16_t FREQUENCY_TABLE[NUM_NOTES] = {
+    0x0000, 0x00F4, 0x0103, 0x0112, 0x0123, 0x0134, 0x0146, 0x015A,
+    0x016E, 0x0184, 0x019B, 0x01B3, 0x01CD, 0x01E9, 0x0206, 0x0225,
+    0x0245, 0x0268, 0x028C, 0x02B3, 0x02DC, 0x0308, 0x0336, 0x0367,
+    0x039A, 0x03D1, 0x040B, 0x0449, 0x048A, 0x04CF, 0x0519, 0x0566,
+    0x05B8, 0x060F, 0x066C, 0x06CD, 0x0735, 0x07A3, 0x0817, 0x0892,
+    0x0915, 0x099F, 0x0A31, 0x0ACC, 0x0B71, 0x0C1F, 0x0CD7, 0x0D9B,
+    0x0E6A, 0x0F45, 0x102E, 0x1124, 0x1229, 0x133E, 0x1462, 0x1599,
+    0x16E2, 0x183E, 0x19AF, 0x1B36, 0x1CD4, 0x1E8B
+};
+
+/* Same notes for the 8 voice interpreter (notint8.asm), which runs at
+   half the sample rate (4386 Hz) */
+static const uint16_t FREQUENCY_TABLE_8V[NUM_NOTES] = {
+    0x0000, 0x01E9, 0x0206, 0x0225, 0x0245, 0x0268, 0x028C, 0x02B3,
+    0x02DC, 0x0308, 0x0336, 0x0367, 0x039A, 0x03D1, 0x040B, 0x0449,
+    0x048A, 0x04CF, 0x0519, 0x0566, 0x05B8, 0x060F, 0x066C, 0x06CD,
+    0x0735, 0x07A3, 0x0817, 0x0892, 0x0914, 0x099F, 0x0A31, 0x0ACC,
+    0x0B71, 0x0C1F, 0x0CD7, 0x0D9B, 0x0E6A, 0x0F45, 0x102E, 0x1124,
+    0x1229, 0x133D, 0x1462, 0x1599, 0x16E1, 0x183E, 0x19AF, 0x1B36,
+    0x1CD4, 0x1E8B, 0x205B, 0x2248, 0x2452, 0x267B, 0x28C4, 0x2B31,
+    0x2DC3, 0x307B, 0x335D, 0x366B, 0x39A7, 0x3D15
+};
+
+/* ============================================================================
+ * Utility Functions
+ * ============================================================================ */
+
+static inline uint16_t get_frequency_increment(const uint16_t *table,
+                                               uint8_t note_offset) {
+    const int array_index = note_offset / 2;
+    
+    if (array_index >= NUM_NOTES || array_index < 0) {
+        return 0;
+    }
+    
+    return table[array_index];
+}
+
+static inline int8_t sign_extend_4bit(uint8_t nibble) {
+    int8_t value = (int8_t)nibble;
+    return (value >= 8) ? (value | 0xF0) : value;
+}
+
+static inline uint8_t clamp_sample(uint16_t value) {
+    return (value > SAMPLE_MAX) ? SAMPLE_MAX : (uint8_t)value;
+}
+
+static inline bool is_control_command(uint8_t command) {
+    return (command & DURATION_MASK) == 0;
+}
+
+static inline bool is_long_note_command(uint8_t command) {
+    const uint8_t cmd_type = command & PITCH_MASK;
+    return (cmd_type == CMD_LONGNOTE_ABS || cmd_type == CMD_LONGNOTE_REL);
+}
+
+static inline bool is_voice_active(const voice_t *voice) {
+    return voice->duration != VOICE_INACTIVE;
+}
+
+static inline bool is_voice_expired(const voice_t *voice) {
+    return voice->duration == 0;
+}
+
+/* ============================================================================
+ * Voice Management
+ * ============================================================================ */
+
+static void init_voice(voice_t *voice, uint8_t wavetable_base) {
+    memset(voice, 0, sizeof(*voice));
+    voice->wavetable_page = wavetable_base;
+    voice->duration = VOICE_INACTIVE;
+}
+
+static void set_voice_silent(voice_t *voice) {
+    voice->freq_increment = 0;
+}
+
+static void activate_voice(voice_t *voice) {
+    voice->duration = 0;
+    set_voice_silent(voice);
+}
+
+static void deactivate_voice(voice_t *voice) {
+    voice->duration = VOICE_INACTIVE;
+    set_voice_silent(voice);
+}
+
+static void reset_phase_accumulator(voice_t *voice) {
+    voice->phase_frac = 0;
+    voice->phase_int = 0;
+}
+
+static void update_voice_frequency(voice_t *voice, const uint16_t *table,
+                                   uint8_t note_offset) {
+    voice->note_offset = note_offset;
+    voice->freq_increment = get_frequency_increment(table, note_offset);
+}
+
+static void assign_short_note(voice_t *voice, const uint16_t *table,
+                              uint8_t pitch_field, uint8_t duration_code) {
+    const uint8_t prev_note_offset = voice->note_offset;
+    voice->duration = DURATION_TABLE[duration_code];
+    
+    const int8_t pitch_nibble = sign_extend_4bit(pitch_field >> PITCH_SHIFT);
+    
+    if (pitch_nibble == PITCH_REST) {
+        set_voice_silent(voice);
+        return;
+    }
+    
+    const int8_t byte_offset = pitch_nibble * 2;
+    voice->note_offset += byte_offset;
+    update_voice_frequency(voice, table, voice->note_offset);
+    
+    if (byte_offset == 0 && prev_note_offset == voice->note_offset) {
+        reset_phase_accumulator(voice);
+    }
+}
+
+static void assign_long_note_absolute(voice_t *voice, const uint16_t *table,
+                                      uint8_t pitch_byte, uint8_t waveform,
+                                      uint8_t duration_code) {
+    voice->note_offset = pitch_byte;
+    voice->wavetable_page = waveform;
+    voice->duration = DURATION_TABLE[duration_code];
+    update_voice_frequency(voice, table, pitch_byte);
+}
+
+static void assign_long_note_relative(voice_t *voice, const uint16_t *table,
+                                      int8_t pitch_displacement, uint8_t waveform,
+                                      uint8_t duration_code) {
+    voice->note_offset += pitch_displacement;
+    voice->wavetable_page = waveform;
+    voice->duration = DURATION_TABLE[duration_code];
+    update_voice_frequency(voice, table, voice->note_offset);
+}
+
+/* ============================================================================
+ * Interpreter State
+ * ============================================================================ */
+
+int synth_init(interpreter_state_t *state,
+               uint8_t *object_code,
+               size_t code_size,
+               uint8_t **wavetables,
+               int num_wavetables,
+               uint32_t max_jumps,
+               int max_voices) {
+    if (!state || !object_code || !wavetables) {
+        fprintf(stderr, "Error: NULL parameter in synth_init\n");
+        return -1;
+    }
+    
+    if (code_size == 0 || num_wavetables == 0) {
+        fprintf(stderr, "Error: Invalid code_size or num_wavetables\n");
+        return -1;
+    }
+    
+    memset(state, 0, sizeof(*state));
+    
+    state->object_code = object_code;
+    state->code_size = code_size;
+    state->wavetables = wavetables;
+    state->num_wavetables = num_wavetables;
+    state->num_active_voices = max_voices;
+    state->running = true;
+    state->max_jumps = max_jumps;
+    state->max_voices = max_voices;
+    state->frequency_table = (max_voices == 8) ? FREQUENCY_TABLE_8V
+                                               : FREQUENCY_TABLE;
+    
+    for (int i = 0; i < MAX_VOICES; i++) {
+        init_voice(&state->voices[i], 0);
+    }
+    
+    return 0;
+}
+
+static void set_num_voices(interpreter_state_t *state, int num_voices) {
+    if (num_voices < 1) {
+        num_voices = 1;
+    } else if (num_voices > state->max_voices) {
+        num_voices = state->max_voices;
+    }
+    state->num_active_voices = num_voices;
+}
+
+/* ============================================================================
+ * Bytecode Reading
+ * ============================================================================ */
+
+static inline uint8_t read_code_byte(interpreter_state_t *state) {
+    if (state->code_ptr >= state->code_size) {
+        return 0;
+    }
+    return state->object_code[state->code_ptr++];
+}
+
+static inline uint16_t read_code_address(interpreter_state_t *state) {
+    const uint8_t low = read_code_byte(state);
+    const uint8_t high = read_code_byte(state);
+    return (uint16_t)low | ((uint16_t)high << 8);
+}
+
+/* ============================================================================
+ * Profiling
+ * ============================================================================ */
+
+synth_profile_t *synth_profile_attach(interpreter_state_t *state) {
+    synth_profile_t *profile = calloc(state->code_size, sizeof(*profile));
+    if (!profile) {
+        fprintf(stderr, "Error: Failed to allocate profile\n");
+        return NULL;
+    }
+    
+    for (size_t i = 0; i < state->code_size; i++) {
+        profile[i].voice = -1;
+    }
+    
+    state->profile = profile;
+    return profile;
+}
+
+static void profile_command(interpreter_state_t *state, size_t addr,
+                            uint32_t cycles) {
+    synth_profile_t *entry = &state->profile[addr];
+    
+    if (entry->executions++ == 0) {
+        entry->first_time = state->sample_time;
+    }
+    entry->cycles += cycles;
+    state->last_command = addr;
+}
+
+static void profile_note(interpreter_state_t *state, size_t addr, int voice_idx,
+                         uint32_t cycles) {
+    synth_profile_t *entry = &state->profile[addr];
+    
+    if (entry->executions == 0) {
+        entry->voice = voice_idx;
+        entry->first_length = state->tempo * state->voices[voice_idx].duration;
+    }
+    profile_command(state, addr, cycles);
+}
+
+static uint32_t control_cycles(const interpreter_state_t *state, uint8_t command) {
+    switch (command & PITCH_MASK) {
+        case CMD_TEMPO:      return CYCLES_TEMPO;
+        case CMD_CALL:       return CYCLES_CALL;
+        case CMD_RETURN:     return CYCLES_RETURN;
+        case CMD_JUMP:       return CYCLES_JUMP;
+        case CMD_SETVOICES:
+            return CYCLES_SETVOICES + SETNV_CYCLES[state->num_active_voices];
+        case CMD_DEACTIVATE: return CYCLES_DEACTIVATE;
+        case CMD_ACTIVATE:   return CYCLES_ACTIVATE;
+        default:             return CYCLES_END;
+    }
+}
+
+static uint32_t note_cycles(uint8_t command) {
+    if (is_long_note_command(command)) {
+        return ((command & PITCH_MASK) == CMD_LONGNOTE_ABS) ? CYCLES_LONG_NOTE_ABS
+                                                            : CYCLES_LONG_NOTE_REL;
+    }
+    return (sign_extend_4bit(command >> PITCH_SHIFT) == PITCH_REST) ? CYCLES_REST
+                                                                    : CYCLES_SHORT_NOTE;
+}
+
+/* PLAY scan for the shortest duration, which costs two more cycles for
+   every voice that is not longer than the shortest so far */
+static uint32_t play_cycles(const interpreter_state_t *state) {
+    uint32_t cycles = CYCLES_PLAY;
+    uint8_t shortest = VOICE_INACTIVE;
+    
+    for (int i = 0; i < state->max_voices; i++) {
+        if (state->voices[i].duration <= shortest) {
+            shortest = state->voices[i].duration;
+            cycles += CYCLES_PLAY_SHORTER;
+        } else {
+            cycles += CYCLES_PLAY_VOICE;
+        }
+    }
+    
+    return cycles;
+}
+
+/* ============================================================================
+ * Seek Index
+ * ============================================================================ */
+
+static inline void put_le16(uint8_t *p, uint16_t value) {
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+static inline void put_le32(uint8_t *p, uint32_t value) {
+    put_le16(p, value & 0xFFFF);
+    put_le16(p + 2, value >> 16);
+}
+
+static inline uint16_t get_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)get_le16(p) | ((uint32_t)get_le16(p + 2) << 16);
+}
+
+/* FNV-1a, to tell if an index belongs to the code being played */
+static uint32_t hash_code(const uint8_t *code, size_t size) {
+    uint32_t hash = 2166136261u;
+    
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ code[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Serializes everything the interpreter loop carries from one period to
+ * the next. Returns the record size.
+ */
+static size_t save_state(const interpreter_state_t *state, uint8_t *record) {
+    uint8_t clip = INDEX_NO_CLIP;
+    
+    for (int i = 0; state->clip && i < state->num_clips; i++) {
+        const synth_clip_t *c = &state->clips[i];
+        if (state->clip >= c->data && state->clip < c->data + c->size) {
+            clip = i;
+            break;
+        }
+    }
+    
+    put_le32(record, state->sample_time & 0xFFFFFFFF);
+    put_le32(record + 4, state->sample_time >> 32);
+    put_le32(record + 8, state->code_ptr);
+    put_le32(record + 12, state->max_jumps);
+    record[16] = state->tempo;
+    record[17] = state->duration;
+    record[18] = state->duration_counter;
+    record[19] = state->num_active_voices;
+    record[20] = clip;
+    record[21] = 0;
+    put_le16(record + 22, state->stack_ptr);
+    put_le32(record + 24, (clip == INDEX_NO_CLIP) ? 0 : state->clip_left);
+    
+    uint8_t *p = record + 28;
+    for (int i = 0; i < MAX_VOICES; i++, p += 8) {
+        const voice_t *voice = &state->voices[i];
+        p[0] = voice->phase_frac;
+        p[1] = voice->phase_int;
+        p[2] = voice->wavetable_page;
+        p[3] = voice->note_offset;
+        put_le16(p + 4, voice->freq_increment);
+        p[6] = voice->duration;
+        p[7] = 0;
+    }
+    
+    for (int i = 0; i < state->stack_ptr; i++, p += 2) {
+        put_le16(p, state->call_stack[i]);
+    }
+    
+    return p - record;
+}
+
+/* The stack is read by the caller, after the fixed part */
+static int restore_state(interpreter_state_t *state, const uint8_t *record) {
+    const uint32_t code_ptr = get_le32(record + 8);
+    const uint8_t clip = record[20];
+    const uint16_t stack_ptr = get_le16(record + 22);
+    const uint32_t clip_left = get_le32(record + 24);
+    
+    if (code_ptr > state->code_size || stack_ptr > STACK_SIZE ||
+        record[19] > state->max_voices) {
+        fprintf(stderr, "Error: Corrupt seek index record\n");
+        return -1;
+    }
+    if (clip != INDEX_NO_CLIP &&
+        (clip >= state->num_clips || clip_left == 0 ||
+         clip_left > state->clips[clip].size)) {
+        fprintf(stderr, "Error: The seek index needs PCM clip %d\n", clip + 1);
+        return -1;
+    }
+    
+    state->sample_time = get_le32(record) | ((uint64_t)get_le32(record + 4) << 32);
+    state->code_ptr = code_ptr;
+    state->max_jumps = get_le32(record + 12);
+    state->tempo = record[16];
+    state->duration = record[17];
+    state->duration_counter = record[18];
+    state->num_active_voices = record[19];
+    state->stack_ptr = stack_ptr;
+    
+    if (clip == INDEX_NO_CLIP) {
+        state->clip = NULL;
+        state->clip_left = 0;
+    } else {
+        state->clip = state->clips[clip].data + state->clips[clip].size - clip_left;
+        state->clip_left = clip_left;
+    }
+    
+    const uint8_t *p = record + 28;
+    for (int i = 0; i < MAX_VOICES; i++, p += 8) {
+        voice_t *voice = &state->voices[i];
+        voice->phase_frac = p[0];
+        voice->phase_int = p[1];
+        voice->wavetable_page = p[2];
+        voice->note_offset = p[3];
+        voice->freq_increment = get_le16(p + 4);
+        voice->duration = p[6];
+    }
+    
+    return 0;
+}
+
+synth_index_t *synth_index_attach(interpreter_state_t *state, uint32_t interval) {
+    synth_index_t *index = calloc(1, sizeof(*index));
+    if (!index) {
+        fprintf(stderr, "Error: Failed to allocate seek index\n");
+        return NULL;
+    }
+    
+    index->interval = interval ? interval : 1;
+    index->code_hash = hash_code(state->object_code, state->code_size);
+    state->index = index;
+    return index;
+}
+
+void synth_index_free(synth_index_t *index) {
+    if (index) {
+        free(index->records);
+        free(index->offsets);
+        free(index);
+    }
+}
+
+static int index_add_entry(synth_index_t *index) {
+    if (!index->pending_stored) {
+        if (index->records_size + index->pending_size > index->records_capacity) {
+            const size_t capacity = index->records_capacity * 2 + sizeof(index->pending);
+            uint8_t *records = realloc(index->records, capacity);
+            if (!records) {
+                return -1;
+            }
+            index->records = records;
+            index->records_capacity = capacity;
+        }
+        memcpy(index->records + index->records_size, index->pending,
+               index->pending_size);
+        index->pending_offset = index->records_size;
+        index->records_size += index->pending_size;
+        index->pending_stored = true;
+    }
+    
+    if (index->count == index->capacity) {
+        const size_t capacity = index->capacity * 2 + 64;
+        uint32_t *offsets = realloc(index->offsets, capacity * sizeof(uint32_t));
+        if (!offsets) {
+            return -1;
+        }
+        index->offsets = offsets;
+        index->capacity = capacity;
+    }
+    index->offsets[index->count++] = index->pending_offset;
+    return 0;
+}
+
+/*
+ * Entry k is the last state saved at or before sample k * interval, so
+ * that it is found directly from a position and the time to render from it
+ * is bounded. Entries are added with the last state saved until the one
+ * for the current time. A state that ends up in several entries, over a
+ * long note, is stored once.
+ */
+static int index_fill(synth_index_t *index, uint64_t sample_time) {
+    while (index->pending_size &&
+           (uint64_t)index->count * index->interval < sample_time) {
+        if (index_add_entry(index) != 0) {
+            fprintf(stderr, "Error: Failed to grow seek index\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Called between periods */
+static int index_checkpoint(interpreter_state_t *state) {
+    synth_index_t *index = state->index;
+    
+    if (index_fill(index, state->sample_time) != 0) {
+        return -1;
+    }
+    
+    index->pending_size = save_state(state, index->pending);
+    index->pending_stored = false;
+    return 0;
+}
+
+int synth_index_finish(synth_index_t *index, const interpreter_state_t *state) {
+    /* Entries after the last state saved, up to the end of the output */
+    return index_fill(index, state->sample_time);
+}
+
+size_t synth_index_count(const synth_index_t *index) {
+    return index->count;
+}
+
+size_t synth_index_record(const synth_index_t *index, size_t entry,
+                          const uint8_t **record) {
+    const uint8_t *p = index->records + index->offsets[entry];
+    *record = p;
+    return INDEX_RECORD_SIZE + 2 * get_le16(p + 22);
+}
+
+int synth_index_write(synth_index_t *index, const interpreter_state_t *state,
+                      const char *filename, int sample_rate) {
+    if (synth_index_finish(index, state) != 0) {
+        return -1;
+    }
+    
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot create seek index '%s'\n", filename);
+        return -1;
+    }
+    
+    uint8_t header[INDEX_HEADER_SIZE] = {0};
+    memcpy(header, INDEX_MAGIC, 4);
+    put_le16(header + 4, INDEX_VERSION);
+    header[6] = state->max_voices;
+    put_le32(header + 8, sample_rate);
+    put_le32(header + 12, index->interval);
+    put_le32(header + 16, state->code_size);
+    put_le32(header + 20, index->code_hash);
+    put_le32(header + 24, index->count);
+    
+    const uint32_t base = INDEX_HEADER_SIZE + 4 * index->count;
+    bool ok = fwrite(header, 1, sizeof(header), fp) == sizeof(header);
+    
+    for (size_t i = 0; ok && i < index->count; i++) {
+        uint8_t offset[4];
+        put_le32(offset, base + index->offsets[i]);
+        ok = fwrite(offset, 1, sizeof(offset), fp) == sizeof(offset);
+    }
+    if (ok && index->records_size) {
+        ok = fwrite(index->records, 1, index->records_size, fp) == index->records_size;
+    }
+    
+    if (fclose(fp) != 0 || !ok) {
+        fprintf(stderr, "Error: Writing seek index '%s' failed\n", filename);
+        return -1;
+    }
+    
+    printf("Seek index written: %zu entries every %.2f seconds\n", index->count,
+           (double)index->interval / sample_rate);
+    return 0;
+}
+
+int synth_state_restore(interpreter_state_t *state, const uint8_t *record,
+                        size_t size) {
+    if (size < INDEX_RECORD_SIZE ||
+        size != INDEX_RECORD_SIZE + 2 * (size_t)get_le16(record + 22)) {
+        fprintf(stderr, "Error: Corrupt interpreter state record\n");
+        return -1;
+    }
+    if (restore_state(state, record) != 0) {
+        return -1;
+    }
+    
+    const uint8_t *p = record + INDEX_RECORD_SIZE;
+    for (int i = 0; i < state->stack_ptr; i++, p += 2) {
+        state->call_stack[i] = get_le16(p);
+    }
+    return 0;
+}
+
+int synth_index_seek(interpreter_state_t *state, const char *filename,
+                     uint64_t sample, uint64_t *position) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot open seek index '%s': %s\n",
+                filename, strerror(errno));
+        return -1;
+    }
+    
+    int result = -1;
+    uint8_t header[INDEX_HEADER_SIZE];
+    uint8_t record[INDEX_RECORD_SIZE];
+    uint8_t offset[4];
+    
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header) ||
+        memcmp(header, INDEX_MAGIC, 4) != 0 ||
+        get_le16(header + 4) != INDEX_VERSION) {
+        fprintf(stderr, "Error: '%s' is not a seek index\n", filename);
+    } else if (header[6] != state->max_voices ||
+               get_le32(header + 16) != state->code_size ||
+               get_le32(header + 20) != hash_code(state->object_code, state->code_size)) {
+        fprintf(stderr, "Error: Seek index '%s' was made for other code\n", filename);
+    } else if (get_le32(header + 24) == 0) {
+        fprintf(stderr, "Error: Seek index '%s' is empty\n", filename);
+    } else {
+        const uint32_t interval = get_le32(header + 12);
+        const uint32_t count = get_le32(header + 24);
+        const uint64_t entry = interval ? sample / interval : 0;
+        const uint32_t k = (entry < count) ? (uint32_t)entry : count - 1;
+        
+        if (fseek(fp, INDEX_HEADER_SIZE + 4L * k, SEEK_SET) == 0 &&
+            fread(offset, 1, sizeof(offset), fp) == sizeof(offset) &&
+            fseek(fp, get_le32(offset), SEEK_SET) == 0 &&
+            fread(record, 1, sizeof(record), fp) == sizeof(record)) {
+            result = restore_state(state, record);
+        } else {
+            fprintf(stderr, "Error: Truncated seek index '%s'\n", filename);
+        }
+        
+        for (int i = 0; result == 0 && i < state->stack_ptr; i++) {
+            uint8_t entry_bytes[2];
+            if (fread(entry_bytes, 1, sizeof(entry_bytes), fp) != sizeof(entry_bytes)) {
+                fprintf(stderr, "Error: Truncated seek index '%s'\n", filename);
+                result = -1;
+            } else {
+                state->call_stack[i] = get_le16(entry_bytes);
+            }
+        }
+    }
+    
+    fclose(fp);
+    if (result == 0) {
+        *position = state->sample_time;
+    }
+    return result;
+}
+
+/* ============================================================================
+ * Command Processing
+ * ============================================================================ */
+
+static int handle_tempo_command(interpreter_state_t *state) {
+    const uint8_t new_tempo = read_code_byte(state);
+    if (new_tempo == 0) {
+        fprintf(stderr, "Error: Tempo cannot be zero at position %zu\n",
+                state->code_ptr - 2);
+        return -1;
+    }
+    state->tempo = new_tempo;
+    return 0;
+}
+
+static int handle_call_command(interpreter_state_t *state) {
+    if (state->stack_ptr >= STACK_SIZE) {
+        fprintf(stderr, "Error: Call stack overflow at position %zu\n",
+                state->code_ptr - 1);
+        return -1;
+    }
+    
+    state->call_stack[state->stack_ptr++] = state->code_ptr + 2;
+    
+    const uint16_t addr = read_code_address(state);
+    if (addr >= state->code_size) {
+        fprintf(stderr, "Error: Call to invalid address 0x%04X at position %zu\n",
+                addr, state->code_ptr - 3);
+        return -1;
+    }
+    
+    state->code_ptr = addr;
+    return 0;
+}
+
+static int handle_return_command(interpreter_state_t *state) {
+    if (state->stack_ptr == 0) {
+        fprintf(stderr, "Error: Return with empty call stack at position %zu\n",
+                state->code_ptr - 1);
+        return -1;
+    }
+    
+    state->code_ptr = state->call_stack[--state->stack_ptr];
+    return 0;
+}
+
+static int handle_jump_command(interpreter_state_t *state) {
+    if (state->max_jumps == 0) {
+        fprintf(stderr, "Info: Maximum jump limit reached at position %zu\n",
+                state->code_ptr - 1);
+        return 1;
+    }
+    
+    --state->max_jumps;
+    
+    const uint16_t addr = read_code_address(state);
+    if (addr >= state->code_size) {
+        fprintf(stderr, "Error: Jump to invalid address 0x%04X at position %zu\n",
+                addr, state->code_ptr - 3);
+        return -1;
+    }
+    
+    state->code_ptr = addr;
+    return 0;
+}
+
+static int handle_setvoices_command(interpreter_state_t *state) {
+    const uint8_t num_voices = read_code_byte(state);
+    if (num_voices < 1 || num_voices > state->max_voices) {
+        fprintf(stderr, "Warning: Invalid voice count %d at position %zu\n",
+                num_voices, state->code_ptr - 2);
+    }
+    set_num_voices(state, num_voices);
+    return 0;
+}
+
+static int handle_deactivate_command(interpreter_state_t *state) {
+    const uint8_t voice_num = read_code_byte(state) & (state->max_voices - 1);
+    deactivate_voice(&state->voices[voice_num]);
+    return 0;
+}
+
+static int handle_activate_command(interpreter_state_t *state) {
+    const uint8_t voice_num = read_code_byte(state) & (state->max_voices - 1);
+    activate_voice(&state->voices[voice_num]);
+    return 0;
+}
+
+static int handle_pcm_command(interpreter_state_t *state) {
+    const uint8_t clip = read_code_byte(state);
+    
+    if (clip >= state->num_clips || state->clips[clip].size == 0) {
+        if (!state->clip_warned) {
+            fprintf(stderr, "Warning: PCM clip %d not loaded at position %zu\n",
+                    clip + 1, state->code_ptr - 2);
+            state->clip_warned = true;
+        }
+        return 0;
+    }
+    
+    state->clip = state->clips[clip].data;
+    state->clip_left = state->clips[clip].size;
+    return 0;
+}
+
+void synth_set_clips(interpreter_state_t *state, const synth_clip_t *clips,
+                     int count) {
+    state->clips = clips;
+    state->num_clips = count;
+}
+
+static int process_control_command(interpreter_state_t *state, uint8_t command) {
+    const uint8_t cmd_type = command & PITCH_MASK;
+    
+    if (is_long_note_command(command)) {
+        fprintf(stderr, "Error: Long note command 0x%02X in control processing "
+                "at position %zu\n", command, state->code_ptr - 1);
+        return -1;
+    }
+    
+    switch (cmd_type) {
+        case CMD_END:        return 1;
+        case CMD_TEMPO:      return handle_tempo_command(state);
+        case CMD_CALL:       return handle_call_command(state);
+        case CMD_RETURN:     return handle_return_command(state);
+        case CMD_JUMP:       return handle_jump_command(state);
+        case CMD_SETVOICES:  return handle_setvoices_command(state);
+        case CMD_DEACTIVATE: return handle_deactivate_command(state);
+        case CMD_ACTIVATE:   return handle_activate_command(state);
+        case CMD_PCM:        return handle_pcm_command(state);
+        default:
+            fprintf(stderr, "Error: Undefined control command 0x%02X at position %zu\n",
+                    command, state->code_ptr - 1);
+            return -1;
+    }
+}
+
+static void process_long_note(interpreter_state_t *state, voice_t *voice, 
+                              uint8_t command) {
+    const uint8_t cmd_type = command & PITCH_MASK;
+    const uint8_t pitch_byte = read_code_byte(state);
+    const uint8_t wd_byte = read_code_byte(state);
+    
+    uint8_t waveform = (wd_byte >> 4) & 0x0F;
+    uint8_t duration_code = wd_byte & 0x0F;
+    
+    if (duration_code == 0) {
+        fprintf(stderr, "Warning: Long note with duration code 0 at position %zu\n",
+                state->code_ptr - 3);
+        duration_code = 1;
+    }
+    
+    if (waveform >= state->num_wavetables) {
+        fprintf(stderr, "Warning: Invalid wavetable %d at position %zu\n",
+                waveform, state->code_ptr - 3);
+        waveform = state->num_wavetables - 1;
+    }
+    
+    if (cmd_type == CMD_LONGNOTE_ABS) {
+        assign_long_note_absolute(voice, state->frequency_table, pitch_byte,
+                                  waveform, duration_code);
+    } else {
+        assign_long_note_relative(voice, state->frequency_table,
+                                  (int8_t)pitch_byte, waveform, duration_code);
+    }
+}
+
+static uint8_t find_shortest_duration(const interpreter_state_t *state) {
+    uint8_t shortest = VOICE_INACTIVE;
+    
+    for (int i = 0; i < state->max_voices; i++) {
+        const voice_t *voice = &state->voices[i];
+        
+        if (is_voice_active(voice) && !is_voice_expired(voice)) {
+            if (voice->duration < shortest) {
+                shortest = voice->duration;
+            }
+        }
+    }
+    
+    return shortest;
+}
+
+/* ============================================================================
+ * Synthesis Engine
+ * ============================================================================ */
+
+static inline void advance_phase(voice_t *voice) {
+    uint16_t phase = ((uint16_t)voice->phase_int << 8) | voice->phase_frac;
+    phase += voice->freq_increment;
+    voice->phase_frac = phase & 0xFF;
+    voice->phase_int = (phase >> 8) & 0xFF;
+}
+
+/*
+ * Sum of the voices and the clip of one sample, before clipping, so that
+ * several streams can be mixed as if they were voices of one interpreter
+ */
+static inline uint16_t voice_sum(interpreter_state_t *state) {
+    uint16_t sum = 0;
+    
+    for (int i = 0; i < state->num_active_voices; i++) {
+        voice_t *voice = &state->voices[i];
+        
+        if (voice->freq_increment == 0 || 
+            voice->wavetable_page >= state->num_wavetables) {
+            continue;
+        }
+        
+        const uint8_t *wavetable = state->wavetables[voice->wavetable_page];
+        sum += wavetable[voice->phase_int];
+        advance_phase(voice);
+    }
+    
+    if (state->clip) {
+        sum += *state->clip++ >> ((state->max_voices == 8) ? CLIP_SHIFT_8V
+                                                            : CLIP_SHIFT);
+        if (--state->clip_left == 0) {
+            state->clip = NULL;
+        }
+    }
+    
+    return sum;
+}
+
+static inline uint8_t generate_sample(interpreter_state_t *state) {
+    return clamp_sample(voice_sum(state));
+}
+
+/*
+ * Same as advance_phase, but with the carry in and out of the 6502 ADC
+ * chain. Returns the carry out of the integer part.
+ */
+static inline uint8_t advance_phase_carry(voice_t *voice, uint8_t carry) {
+    const uint32_t phase = (((uint32_t)voice->phase_int << 8) | voice->phase_frac)
+                           + voice->freq_increment + carry;
+    voice->phase_frac = phase & 0xFF;
+    voice->phase_int = (phase >> 8) & 0xFF;
+    return (phase >> 16) & 1;
+}
+
+/*
+ * Sample generation of kim4v.asm, exact to the DAC output. Silent voices
+ * still add their current table entry, the sum wraps instead of clipping
+ * and the carry ripples from the sum into the first voice pointer and from
+ * each voice pointer into the next one, as there is no CLC between them.
+ */
+static inline uint8_t generate_sample_kim4v(interpreter_state_t *state) {
+    uint8_t carry = 0;
+    uint16_t sum = 0;
+    
+    for (int i = 0; i < KIM4V_VOICES; i++) {
+        const voice_t *voice = &state->voices[i];
+        sum = (sum & 0xFF) + state->wavetables[voice->wavetable_page][voice->phase_int]
+              + carry;
+        carry = sum >> 8;
+    }
+    
+    for (int i = 0; i < KIM4V_VOICES; i++) {
+        carry = advance_phase_carry(&state->voices[i], carry);
+    }
+    
+    return sum & 0xFF;
+}
+
+/*
+ * Leave the voices and the clip as count samples of generate_sample()
+ * would, without making them. Each voice phase only ever moves by its
+ * increment, so the result is exact.
+ */
+static void skip_samples(interpreter_state_t *state, uint32_t count) {
+    for (int i = 0; i < state->num_active_voices; i++) {
+        voice_t *voice = &state->voices[i];
+        
+        if (voice->freq_increment == 0 ||
+            voice->wavetable_page >= state->num_wavetables) {
+            continue;
+        }
+        
+        const uint16_t phase = (((uint16_t)voice->phase_int << 8) | voice->phase_frac)
+                               + (uint16_t)(voice->freq_increment * count);
+        voice->phase_frac = phase & 0xFF;
+        voice->phase_int = phase >> 8;
+    }
+    
+    if (state->clip) {
+        const size_t n = (count < state->clip_left) ? count : state->clip_left;
+        state->clip += n;
+        state->clip_left -= n;
+        if (state->clip_left == 0) {
+            state->clip = NULL;
+        }
+    }
+}
+
+static int play_notes(interpreter_state_t *state, synth_sink_t sink, void *ctx,
+                      uint8_t *buffer, size_t buffer_size) {
+    const int total_samples = state->tempo * state->duration;
+    
+    if (state->silent && !state->kim4v) {
+        skip_samples(state, total_samples);
+        state->sample_time += total_samples;
+        return 0;
+    }
+    int samples_generated = 0;
+    size_t buffer_pos = 0;
+    
+    while (samples_generated < total_samples && state->running) {
+        buffer[buffer_pos++] = state->kim4v ? generate_sample_kim4v(state)
+                                            : generate_sample(state);
+        samples_generated++;
+        
+        if (buffer_pos >= buffer_size) {
+            if (sink(ctx, buffer, buffer_pos) != 0) {
+                return -1;
+            }
+            buffer_pos = 0;
+        }
+    }
+    
+    state->sample_time += samples_generated;
+    
+    if (buffer_pos > 0) {
+        if (sink(ctx, buffer, buffer_pos) != 0) {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+/* ============================================================================
+ * Interpreter Main Loop
+ * ============================================================================ */
+
+static int process_pure_control_commands(interpreter_state_t *state) {
+    while (state->code_ptr < state->code_size) {
+        const uint8_t command = state->object_code[state->code_ptr];
+        
+        if (!is_control_command(command) || is_long_note_command(command)) {
+            break;
+        }
+        
+        const size_t addr = state->code_ptr++;
+        const int result = process_control_command(state, command);
+        if (state->profile) {
+            profile_command(state, addr, control_cycles(state, command));
+        }
+        if (result != 0) {
+            return result;
+        }
+    }
+    
+    return 0;
+}
+
+/*
+ * Scan cycles of a voice for the profile, from its state before the scan
+ */
+static uint32_t voice_scan_cycles(const interpreter_state_t *state,
+                                  const voice_t *voice, int voice_idx) {
+    uint32_t cycles = (voice_idx == state->max_voices - 1) ? CYCLES_VOICE_LAST
+                                                           : CYCLES_VOICE_NEXT;
+    
+    if (!is_voice_active(voice)) {
+        return cycles + CYCLES_VOICE_INACTIVE;
+    }
+    if (voice->duration == 0 || state->duration == 0) {
+        return cycles + CYCLES_VOICE_STARTED;
+    }
+    if (voice->duration > state->duration) {
+        return cycles + CYCLES_VOICE_RUNNING;
+    }
+    return cycles + CYCLES_VOICE_EXPIRED;
+}
+
+static int process_notes_for_voices(interpreter_state_t *state) {
+    int notes_assigned = 0;
+    uint32_t scan_cycles = CYCLES_NOTE_ENTRY;
+    
+    for (int voice_idx = 0; voice_idx < state->max_voices; voice_idx++) {
+        voice_t *voice = &state->voices[voice_idx];
+        
+        if (state->profile) {
+            scan_cycles += voice_scan_cycles(state, voice, voice_idx);
+        }
+        
+        if (!is_voice_active(voice)) {
+            continue;
+        }
+        
+        if (voice->duration > 0 && state->duration > 0) {
+            if (voice->duration > state->duration) {
+                voice->duration -= state->duration;
+                continue;
+            }
+            voice->duration = 0;
+        }
+        
+        if (!is_voice_expired(voice)) {
+            continue;
+        }
+        
+        if (state->code_ptr >= state->code_size) {
+            break;
+        }
+        
+        const size_t addr = state->code_ptr;
+        const uint8_t command = read_code_byte(state);
+        const uint8_t duration_code = command & DURATION_MASK;
+        
+        if (duration_code == 0) {
+            if (is_long_note_command(command)) {
+                process_long_note(state, voice, command);
+                notes_assigned++;
+            } else {
+                state->code_ptr--;
+                break;
+            }
+        } else {
+            const uint8_t pitch_field = command & PITCH_MASK;
+            assign_short_note(voice, state->frequency_table, pitch_field,
+                              duration_code);
+            notes_assigned++;
+        }
+        
+        if (state->profile) {
+            profile_note(state, addr, voice_idx, note_cycles(command));
+        }
+    }
+    
+    if (state->profile) {
+        state->profile[state->last_command].cycles += scan_cycles;
+    }
+    
+    return notes_assigned;
+}
+
+/* Results of next_period() */
+enum {
+    PERIOD_ERROR = -1,
+    PERIOD_DONE,            /* Out of code, or running cleared */
+    PERIOD_STOPPED,         /* END or the jump limit */
+    PERIOD_READY            /* state->duration is the next period to play */
+};
+
+/*
+ * Interpret commands up to the next play period
+ */
+static int next_period(interpreter_state_t *state) {
+    while (state->running && state->code_ptr < state->code_size) {
+        if (state->index && index_checkpoint(state) != 0) {
+            return PERIOD_ERROR;
+        }
+        
+        const int pcc_result = process_pure_control_commands(state);
+        if (pcc_result != 0) {
+            return (pcc_result > 0) ? PERIOD_STOPPED : PERIOD_ERROR;
+        }
+        
+        if (state->code_ptr >= state->code_size) {
+            break;
+        }
+        
+        process_notes_for_voices(state);
+        
+        state->duration = find_shortest_duration(state);
+        
+        if (state->duration == VOICE_INACTIVE || state->duration == 0) {
+            continue;
+        }
+        
+        return PERIOD_READY;
+    }
+    
+    return PERIOD_DONE;
+}
+
+static void check_tempo(interpreter_state_t *state) {
+    if (state->tempo == 0) {
+        fprintf(stderr, "Warning: Tempo not set, using default of 32\n");
+        state->tempo = 32;
+    }
+}
+
+int synth_run_notran(interpreter_state_t *state, synth_sink_t sink, void *ctx) {
+    uint8_t *audio_buffer = malloc(BUFFER_FRAMES);
+    if (!audio_buffer) {
+        fprintf(stderr, "Error: Failed to allocate audio buffer\n");
+        return -1;
+    }
+    
+    check_tempo(state);
+    
+    int period;
+    while ((period = next_period(state)) == PERIOD_READY) {
+        const uint64_t start_time = state->sample_time;
+        if (state->profile) {
+            state->profile[state->last_command].cycles += play_cycles(state);
+        }
+        
+        if (play_notes(state, sink, ctx, audio_buffer, BUFFER_FRAMES) != 0) {
+            free(audio_buffer);
+            return -1;
+        }
+        
+        if (state->profile) {
+            state->profile[state->last_command].samples +=
+                state->sample_time - start_time;
+        }
+    }
+    
+    free(audio_buffer);
+    if (period == PERIOD_ERROR) {
+        return -1;
+    }
+    if (period == PERIOD_DONE) {
+        puts("Interpretation complete");
+    }
+    return 0;
+}
+
+static bool streams_running(interpreter_state_t **states, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!states[i]->running) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * The streams are advanced in spans, from one period boundary of any of
+ * them to the next, and the voices of all of them are summed in one loop
+ * per sample. A stream that ends leaves the others playing.
+ */
+int synth_run_notran_mix(interpreter_state_t **states, int count,
+                         synth_sink_t sink, void *ctx) {
+    if (count < 1 || count > SYNTH_MAX_STREAMS) {
+        fprintf(stderr, "Error: Can't mix %d streams\n", count);
+        return -1;
+    }
+    
+    uint8_t *audio_buffer = malloc(BUFFER_FRAMES);
+    if (!audio_buffer) {
+        fprintf(stderr, "Error: Failed to allocate audio buffer\n");
+        return -1;
+    }
+    
+    uint32_t left[SYNTH_MAX_STREAMS] = { 0 };  /* Samples to the period end */
+    bool active[SYNTH_MAX_STREAMS];
+    
+    for (int i = 0; i < count; i++) {
+        check_tempo(states[i]);
+        active[i] = true;
+    }
+    
+    size_t buffer_pos = 0;
+    int result = 0;
+    
+    while (result == 0 && streams_running(states, count)) {
+        uint32_t span = UINT32_MAX;
+        
+        for (int i = 0; i < count && result == 0; i++) {
+            while (active[i] && left[i] == 0) {
+                const int period = next_period(states[i]);
+                if (period == PERIOD_ERROR) {
+                    result = -1;
+                    break;
+                }
+                if (period == PERIOD_READY) {
+                    left[i] = (uint32_t)states[i]->tempo * states[i]->duration;
+                } else {
+                    active[i] = false;
+                }
+            }
+            
+            if (active[i] && left[i] < span) {
+                span = left[i];
+            }
+        }
+        
+        if (result != 0 || span == UINT32_MAX) {
+            break;
+        }
+        
+        uint32_t played = 0;
+        while (played < span && streams_running(states, count)) {
+            const uint32_t room = BUFFER_FRAMES - buffer_pos;
+            const uint32_t block = (span - played < room) ? span - played : room;
+            
+            for (uint32_t n = 0; n < block; n++) {
+                uint16_t sum = 0;
+                for (int i = 0; i < count; i++) {
+                    if (active[i]) {
+                        sum += voice_sum(states[i]);
+                    }
+                }
+                audio_buffer[buffer_pos++] = clamp_sample(sum);
+            }
+            played += block;
+            
+            if (buffer_pos >= BUFFER_FRAMES) {
+                if (sink(ctx, audio_buffer, buffer_pos) != 0) {
+                    result = -1;
+                    break;
+                }
+                buffer_pos = 0;
+            }
+        }
+        
+        for (int i = 0; i < count; i++) {
+            if (active[i]) {
+                left[i] -= played;
+                states[i]->sample_time += played;
+            }
+        }
+    }
+    
+    if (result == 0 && buffer_pos > 0 && sink(ctx, audio_buffer, buffer_pos) != 0) {
+        result = -1;
+    }
+    
+    if (result == 0) {
+        puts("Interpretation complete");
+    }
+    free(audio_buffer);
+    return result;
+}
+
+/* ============================================================================
+ * kim4v Song Renderer
+ * ============================================================================ */
+
+static inline uint16_t read_memory_word(const uint8_t *memory, uint16_t addr) {
+    return (uint16_t)memory[addr] | ((uint16_t)memory[(uint16_t)(addr + 1)] << 8);
+}
+
+/*
+ * Loads the four voice increments for the event at code_ptr, as MUSIC3 in
+ * kim4v.asm does. FRQTAB is indexed in zero page, so the index wraps.
+ */
+static void kim4v_load_notes(interpreter_state_t *state) {
+    const uint8_t *memory = state->object_code;
+    
+    for (int i = 0; i < KIM4V_VOICES; i++) {
+        const uint8_t note_id = memory[(uint16_t)(state->code_ptr + 1 + i)];
+        const uint8_t entry = (uint8_t)(KIM4V_FRQTAB + note_id);
+        
+        state->voices[i].note_offset = note_id;
+        state->voices[i].freq_increment = ((uint16_t)memory[entry] << 8) |
+                                          memory[(uint8_t)(entry + 1)];
+    }
+}
+
+int synth_run_kim4v(interpreter_state_t *state, synth_sink_t sink, void *ctx) {
+    const uint8_t *memory = state->object_code;
+    uint8_t *audio_buffer = malloc(BUFFER_FRAMES);
+    if (!audio_buffer) {
+        fprintf(stderr, "Error: Failed to allocate audio buffer\n");
+        return -1;
+    }
+    
+    /* Initial voice pointers and waveform pages, as set in the image */
+    for (int i = 0; i < KIM4V_VOICES; i++) {
+        voice_t *voice = &state->voices[i];
+        voice->phase_frac = memory[KIM4V_VPT + 3 * i];
+        voice->phase_int = memory[KIM4V_VPT + 3 * i + 1];
+        voice->wavetable_page = memory[KIM4V_VPT + 3 * i + 2];
+        voice->freq_increment = 0;
+    }
+    
+    state->kim4v = true;
+    state->tempo = memory[KIM4V_TEMPO];
+    state->code_ptr = read_memory_word(memory, KIM4V_SONGA);
+    
+    int result = 0;
+    
+    while (state->running) {
+        const uint8_t duration = memory[state->code_ptr];
+        
+        if (duration == KIM4V_END) {
+            break;
+        }
+        
+        if (duration == KIM4V_SEGMENT || duration == KIM4V_CALL) {
+            if (duration == KIM4V_CALL) {
+                if (state->stack_ptr >= STACK_SIZE) {
+                    fprintf(stderr, "Error: Refrain stack overflow at 0x%04zX\n",
+                            state->code_ptr);
+                    result = -1;
+                    break;
+                }
+                state->call_stack[state->stack_ptr++] = state->code_ptr;
+            } else if (state->max_jumps-- == 0) {
+                fprintf(stderr, "Info: Maximum jump limit reached at 0x%04zX\n",
+                        state->code_ptr);
+                break;
+            }
+            state->code_ptr = read_memory_word(memory, (uint16_t)(state->code_ptr + 1));
+            continue;
+        }
+        
+        if (duration == KIM4V_RETURN) {
+            if (state->stack_ptr == 0) {
+                fprintf(stderr, "Error: Refrain return with empty stack at 0x%04zX\n",
+                        state->code_ptr);
+                result = -1;
+                break;
+            }
+            /* The saved pointer is the refrain call itself */
+            state->code_ptr = (uint16_t)(state->call_stack[--state->stack_ptr] + 3);
+            continue;
+        }
+        
+        kim4v_load_notes(state);
+        state->code_ptr = (uint16_t)(state->code_ptr + KIM4V_EVENT_SIZE);
+        state->duration = duration;
+        
+        if (play_notes(state, sink, ctx, audio_buffer, BUFFER_FRAMES) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    
+    if (result == 0) {
+        puts("Playback complete");
+    }
+    
+    free(audio_buffer);
+    return result;
+}
+
+/* ============================================================================
+ * Live Instrument
+ * ============================================================================ */
+
+int synth_live_init(synth_live_t *live, interpreter_state_t *state,
+                    uint8_t **wavetables, int num_wavetables, int max_voices) {
+    /* The interpreter is never run, it only needs some code */
+    static uint8_t end_code = CMD_END;
+    
+    if (!live || synth_init(state, &end_code, 1, wavetables, num_wavetables,
+                            0, max_voices) != 0) {
+        return -1;
+    }
+    
+    memset(live, 0, sizeof(*live));
+    live->state = state;
+    memset(live->note, LIVE_NO_NOTE, sizeof(live->note));
+    return 0;
+}
+
+static void live_release(synth_live_t *live, int v) {
+    set_voice_silent(&live->state->voices[v]);
+    live->note[v] = LIVE_NO_NOTE;
+    live->changed[v] = live->counter++;
+}
+
+/*
+ * Voice for a new note: the one already playing it, else the voice that
+ * has been free the longest, else the one playing the oldest note
+ */
+static int live_allocate(synth_live_t *live, uint8_t channel, uint8_t note) {
+    int free_voice = -1;
+    int oldest = 0;
+    
+    for (int v = 0; v < live->state->max_voices; v++) {
+        if (live->note[v] == note && live->channel[v] == channel) {
+            return v;
+        }
+        if (live->note[v] == LIVE_NO_NOTE) {
+            if (free_voice < 0 || live->changed[v] < live->changed[free_voice]) {
+                free_voice = v;
+            }
+        } else if (live->changed[v] < live->changed[oldest]) {
+            oldest = v;
+        }
+    }
+    
+    if (free_voice >= 0) {
+        return free_voice;
+    }
+    
+    live->stolen++;
+    return oldest;
+}
+
+static void live_note_on(synth_live_t *live, uint8_t channel, uint8_t note) {
+    interpreter_state_t *state = live->state;
+    
+    /* Notes out of the range of the tables are moved by octaves into it */
+    int index = note - MIDI_NOTE_C1 + 1;
+    while (index < 1) {
+        index += 12;
+    }
+    while (index >= NUM_NOTES) {
+        index -= 12;
+    }
+    
+    const int v = live_allocate(live, channel, note);
+    voice_t *voice = &state->voices[v];
+    
+    voice->wavetable_page = live->program[channel] % state->num_wavetables;
+    update_voice_frequency(voice, state->frequency_table, (uint8_t)(index * 2));
+    live->note[v] = note;
+    live->channel[v] = channel;
+    live->changed[v] = live->counter++;
+}
+
+static void live_note_off(synth_live_t *live, uint8_t channel, uint8_t note) {
+    for (int v = 0; v < live->state->max_voices; v++) {
+        if (live->note[v] == note && live->channel[v] == channel) {
+            live_release(live, v);
+        }
+    }
+}
+
+static void live_channel_off(synth_live_t *live, uint8_t channel) {
+    for (int v = 0; v < live->state->max_voices; v++) {
+        if (live->note[v] != LIVE_NO_NOTE && live->channel[v] == channel) {
+            live_release(live, v);
+        }
+    }
+}
+
+static int live_data_length(uint8_t status) {
+    const uint8_t type = status & 0xF0;
+    return (type == MIDI_PROGRAM || type == MIDI_PRESSURE) ? 1 : 2;
+}
+
+bool synth_live_midi(synth_live_t *live, uint8_t byte) {
+    if (byte >= MIDI_REALTIME) {
+        /* Clock and friends may come in the middle of any message */
+        return false;
+    }
+    
+    if (byte & 0x80) {
+        /* System messages cancel the running status, and their data,
+           such as system exclusive dumps, is skipped */
+        live->status = (byte < MIDI_SYSTEM) ? byte : 0;
+        live->data_count = 0;
+        return false;
+    }
+    
+    if (live->status == 0) {
+        return false;
+    }
+    
+    live->data[live->data_count++] = byte;
+    if (live->data_count < live_data_length(live->status)) {
+        return false;
+    }
+    live->data_count = 0;
+    
+    const uint8_t channel = live->status & 0x0F;
+    
+    switch (live->status & 0xF0) {
+        case MIDI_NOTE_ON:
+            if (live->data[1] != 0) {
+                live_note_on(live, channel, live->data[0]);
+                return true;
+            }
+            live_note_off(live, channel, live->data[0]);
+            break;
+        case MIDI_NOTE_OFF:
+            live_note_off(live, channel, live->data[0]);
+            break;
+        case MIDI_CONTROL:
+            if (live->data[0] == MIDI_ALL_SOUND_OFF ||
+                live->data[0] == MIDI_ALL_NOTES_OFF) {
+                live_channel_off(live, channel);
+            }
+            break;
+        case MIDI_PROGRAM:
+            live->program[channel] = live->data[0];
+            break;
+    }
+    
+    return false;
+}
+
+void synth_live_render(synth_live_t *live, uint8_t *buffer, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        buffer[i] = generate_sample(live->state);
+    }
+}
+
+/* ============================================================================
+ * Image Loading
+ * ============================================================================ */
+
+static int store_record(void *context, uint16_t address, const uint8_t *data, size_t size) {
+    uint8_t *memory = context;
+    
+    for (size_t i = 0; i < size; i++) {
+        memory[(address + i) & (MEMORY_SIZE - 1)] = data[i];
+    }
+    return 0;
+}
+
+/*
+ * Loads a PAP file into the memory image, with the PAP reader of
+ * objfile.c.
+ */
+static int load_pap_file(const char *filename, uint8_t *memory) {
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot open file '%s': %s\n",
+                filename, strerror(errno));
+        return -1;
+    }
+    
+    const long loaded = objfile_read_pap(fp, filename, store_record, memory);
+    fclose(fp);
+    if (loaded < 0) {
+        return -1;
+    }
+    
+    printf("Loaded PAP image '%s' (%ld bytes)\n", filename, loaded);
+    return 0;
+}
+
+uint8_t *synth_load_pap_images(char **filenames, int count) {
+    uint8_t *memory = calloc(MEMORY_SIZE, 1);
+    if (!memory) {
+        fprintf(stderr, "Error: Cannot allocate memory image\n");
+        return NULL;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (load_pap_file(filenames[i], memory) != 0) {
+            free(memory);
+            return NULL;
+        }
+    }
+    
+    return memory;
+}
+
+/*
+ * Makes an array of pointers to consecutive tables. With a memory image,
+ * every page becomes a wavetable, so that kim4v voices can use whatever
+ * page is set at V1PT+2 and so on.
+ */
+uint8_t **synth_table_pointers(uint8_t *data, int count) {
+    uint8_t **tables = malloc(count * sizeof(uint8_t *));
+    if (!tables) {
+        fprintf(stderr, "Error: Cannot allocate wavetable array\n");
+        return NULL;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        tables[i] = data + (i * WAVETABLE_SIZE);
+    }
+    
+    return tables;
+}
+
+/* ============================================================================
+ * WAV File Output
+ * ============================================================================ */
+
+wav_context_t *wav_open(const char *filename, int sample_rate) {
+    return wav_open_format(filename, sample_rate, BITS_PER_SAMPLE);
+}
+
+wav_context_t *wav_open_format(const char *filename, int sample_rate, int bits) {
+    wav_context_t *ctx = calloc(1, sizeof(wav_context_t));
+    if (!ctx) {
+        return NULL;
+    }
+    
+    ctx->fp = fopen(filename, "wb");
+    if (!ctx->fp) {
+        fprintf(stderr, "Error: Cannot create WAV file '%s'\n", filename);
+        free(ctx);
+        return NULL;
+    }
+    
+    ctx->buffer_size = BUFFER_FRAMES;
+    ctx->buffer = malloc(ctx->buffer_size);
+    if (!ctx->buffer) {
+        fclose(ctx->fp);
+        free(ctx);
+        return NULL;
+    }
+    
+    memcpy(ctx->header.riff_id, "RIFF", 4);
+    memcpy(ctx->header.wave_id, "WAVE", 4);
+    memcpy(ctx->header.fmt_id, "fmt ", 4);
+    ctx->header.fmt_size = 16;
+    ctx->header.audio_format = 1;
+    ctx->header.num_channels = CHANNELS;
+    ctx->header.sample_rate = sample_rate;
+    ctx->header.bits_per_sample = bits;
+    ctx->header.byte_rate = sample_rate * CHANNELS * bits / 8;
+    ctx->header.block_align = CHANNELS * bits / 8;
+    memcpy(ctx->header.data_id, "data", 4);
+    
+    fwrite(&ctx->header, sizeof(wav_header_t), 1, ctx->fp);
+    printf("WAV file opened: '%s' @ %d Hz\n", filename, sample_rate);
+    
+    return ctx;
+}
+
+int wav_write(wav_context_t *ctx, const uint8_t *buffer, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        ctx->buffer[ctx->buffer_pos++] = buffer[i];
+        
+        if (ctx->buffer_pos >= ctx->buffer_size) {
+            const size_t written = fwrite(ctx->buffer, 1, ctx->buffer_pos, ctx->fp);
+            if (written != ctx->buffer_pos) {
+                fprintf(stderr, "Error: WAV write failed\n");
+                return -1;
+            }
+            ctx->samples_written += ctx->buffer_pos;
+            ctx->buffer_pos = 0;
+        }
+    }
+    return 0;
+}
+
+int wav_close(wav_context_t *ctx) {
+    if (!ctx) {
+        return -1;
+    }
+    
+    if (ctx->buffer_pos > 0) {
+        fwrite(ctx->buffer, 1, ctx->buffer_pos, ctx->fp);
+        ctx->samples_written += ctx->buffer_pos;
+    }
+    
+    ctx->header.data_size = ctx->samples_written;
+    ctx->header.riff_size = 36 + ctx->header.data_size;
+    
+    fseek(ctx->fp, 0, SEEK_SET);
+    fwrite(&ctx->header, sizeof(wav_header_t), 1, ctx->fp);
+    
+    const size_t samples = ctx->samples_written / ctx->header.block_align;
+    printf("WAV file closed: %zu samples (%.2f seconds)\n",
+           samples, (double)samples / ctx->header.sample_rate);
+    
+    free(ctx->buffer);
+    fclose(ctx->fp);
+    free(ctx);
+    
+    return 0;
+}
+
+int wav_sink(void *ctx, const uint8_t *buffer, size_t count) {
+    return wav_write(ctx, buffer, count);
+}
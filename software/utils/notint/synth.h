@@ -0,0 +1,306 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+/*
+ * NOTRAN synthesis library - Renders NOTRAN bytecode and kim4v song
+ *                            tables to 8 bit samples
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SAMPLE_RATE_DEFAULT     8772
+#define SAMPLE_RATE_8V_DEFAULT  4386
+#define SOUND_CYCLES            114     /* notint.asm sound loop, per sample */
+#define SOUND_CYCLES_8V         228     /* notint8.asm */
+#define CHANNELS                1
+#define BITS_PER_SAMPLE         8
+#define BUFFER_FRAMES           1024
+
+#define MAX_VOICES              8
+#define DEFAULT_VOICES          4
+#define WAVETABLE_SIZE          256
+#define STACK_SIZE              256
+
+#define MEMORY_SIZE             0x10000
+#define KIM4V_VOICES            4
+
+#define SYNTH_MAX_STREAMS       8
+
+#define MIDI_CHANNELS           16
+#define LIVE_NO_NOTE            0xFF
+
+typedef struct {
+    uint8_t phase_frac;
+    uint8_t phase_int;
+    uint8_t wavetable_page;
+    uint8_t note_offset;
+    uint16_t freq_increment;
+    uint8_t duration;
+    uint8_t padding;
+} voice_t;
+
+/*
+ * A PCM clip for the PCM command: 8 bit unsigned samples at the sample
+ * rate of the interpreter, as pcmconv writes them for the PCM player
+ */
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+} synth_clip_t;
+
+/*
+ * Statistics of the command at one code address, gathered when the state
+ * has a profile (see synth_profile_attach()). Play periods and the
+ * interpreter work around them are charged to the last command read
+ * before they start.
+ */
+typedef struct {
+    uint32_t executions;    /* Times the command was interpreted */
+    uint64_t first_time;    /* Sample time of its first execution */
+    uint32_t first_length;  /* Note length in samples at its first execution */
+    int8_t voice;           /* Voice of a note at its first execution */
+    uint64_t cycles;        /* Predicted 6502 interpreter cycles */
+    uint64_t samples;       /* Samples played after it */
+} synth_profile_t;
+
+typedef struct synth_index synth_index_t;
+
+typedef struct {
+    voice_t voices[MAX_VOICES];
+    uint8_t *object_code;
+    size_t code_size;
+    size_t code_ptr;
+    uint8_t **wavetables;
+    int num_wavetables;
+    uint8_t tempo;
+    uint8_t duration;
+    uint8_t duration_counter;
+    uint16_t call_stack[STACK_SIZE];
+    int stack_ptr;
+    int num_active_voices;
+    bool running;           /* Clear to stop rendering */
+    uint32_t max_jumps;
+    int max_voices;
+    const uint16_t *frequency_table;
+    bool kim4v;
+    const synth_clip_t *clips;  /* Clip bank of the PCM command, or NULL */
+    int num_clips;
+    const uint8_t *clip;    /* Clip being played, or NULL */
+    size_t clip_left;
+    bool clip_warned;
+    synth_profile_t *profile;   /* One entry per code byte, or NULL */
+    size_t last_command;    /* Address of the last command read, profiling */
+    uint64_t sample_time;   /* Samples played */
+    synth_index_t *index;   /* Seek index being built, or NULL */
+    bool silent;            /* Advance NOTRAN voices without making samples */
+} interpreter_state_t;
+
+/*
+ * Live instrument. MIDI bytes are parsed as they come and their notes are
+ * played on the interpreter voices, which are given to new notes in turn
+ * and taken from the oldest note when all are busy.
+ */
+typedef struct {
+    interpreter_state_t *state;
+    uint8_t status;                     /* Running status, 0 if none */
+    uint8_t data[2];
+    int data_count;
+    uint8_t program[MIDI_CHANNELS];     /* Wavetable of each channel */
+    uint8_t note[MAX_VOICES];           /* MIDI note of each voice */
+    uint8_t channel[MAX_VOICES];
+    uint32_t changed[MAX_VOICES];       /* Order of the last note-on or off */
+    uint32_t counter;
+    uint32_t stolen;                    /* Notes cut to make room */
+} synth_live_t;
+
+/**
+ * Receives each block of rendered samples.
+ *
+ * @return 0 on success, -1 to stop rendering with an error
+ */
+typedef int (*synth_sink_t)(void *ctx, const uint8_t *buffer, size_t count);
+
+typedef struct wav_context wav_context_t;
+
+/**
+ * Prepare the interpreter to run object_code. The code and the tables are
+ * not copied and must stay valid while rendering.
+ *
+ * @param max_jumps Jumps (or kim4v segment links) allowed before stopping
+ * @param max_voices 4 or 8, for the 4 or 8 voice interpreter
+ * @return 0 on success, -1 on error
+ */
+int synth_init(interpreter_state_t *state, uint8_t *object_code, size_t code_size,
+               uint8_t **wavetables, int num_wavetables, uint32_t max_jumps,
+               int max_voices);
+
+/**
+ * Give the PCM command its clip bank. The clips are not copied and must
+ * stay valid while rendering.
+ */
+void synth_set_clips(interpreter_state_t *state, const synth_clip_t *clips,
+                     int count);
+
+/**
+ * Allocate a profile for the code of an initialized state and attach it,
+ * so that the next synth_run_notran() fills it in. Release it with free().
+ *
+ * @return The profile, one entry per code byte, or NULL on error
+ */
+synth_profile_t *synth_profile_attach(interpreter_state_t *state);
+
+/**
+ * Attach a seek index to an initialized state, so that the next
+ * synth_run_notran() saves the interpreter state as it goes. Entry k of the
+ * index is the last state between periods at or before sample k * interval.
+ *
+ * @return The index, to be released with synth_index_free(), or NULL
+ */
+synth_index_t *synth_index_attach(interpreter_state_t *state, uint32_t interval);
+
+/**
+ * Complete the index built by the last run of state and write it to a
+ * file.
+ *
+ * @return 0 on success, -1 on error
+ */
+int synth_index_write(synth_index_t *index, const interpreter_state_t *state,
+                      const char *filename, int sample_rate);
+
+/**
+ * Complete the index built by the last run of state, up to its end, with
+ * no file. synth_index_write() does it too.
+ *
+ * @return 0 on success, -1 on error
+ */
+int synth_index_finish(synth_index_t *index, const interpreter_state_t *state);
+
+size_t synth_index_count(const synth_index_t *index);
+
+/**
+ * Get the saved state of an entry of a completed index, as taken by
+ * synth_state_restore(). The record belongs to the index.
+ *
+ * @return The size of the record
+ */
+size_t synth_index_record(const synth_index_t *index, size_t entry,
+                          const uint8_t **record);
+
+void synth_index_free(synth_index_t *index);
+
+/**
+ * Restore a state saved in an index record, as synth_index_seek() does
+ * from a file. The state must be initialized with the code and clips the
+ * record was made for.
+ *
+ * @return 0 on success, -1 on error
+ */
+int synth_state_restore(interpreter_state_t *state, const uint8_t *record,
+                        size_t size);
+
+/**
+ * Restore the state saved in an index file at or before sample, from the
+ * entry for it, with no search. The state must be initialized with the
+ * code and clips the index was made for; rendering it reaches sample after
+ * sample - position more samples.
+ *
+ * @param position Sample time of the restored state
+ * @return 0 on success, -1 on error
+ */
+int synth_index_seek(interpreter_state_t *state, const char *filename,
+                     uint64_t sample, uint64_t *position);
+
+/**
+ * Render NOTRAN bytecode until END, the jump limit or state->running is
+ * cleared, passing the samples to sink. A silent state only runs the
+ * interpreter, for its index or its length, and sink is not called.
+ *
+ * @return 0 on success, -1 on error
+ */
+int synth_run_notran(interpreter_state_t *state, synth_sink_t sink, void *ctx);
+
+/**
+ * Render several NOTRAN programs at once, each with its own initialized
+ * state and voices, mixing them as one interpreter with all their voices
+ * would. Rendering ends when the last program ends, or when running is
+ * cleared in any of the states.
+ *
+ * @param count Number of states, up to SYNTH_MAX_STREAMS
+ * @return 0 on success, -1 on error
+ */
+int synth_run_notran_mix(interpreter_state_t **states, int count,
+                         synth_sink_t sink, void *ctx);
+
+/**
+ * Render the song of a kim4v.asm memory image, sample exact with the real
+ * player. The state must be initialized with the 64K image as code and
+ * its pages as wavetables (see synth_table_pointers()).
+ *
+ * @return 0 on success, -1 on error
+ */
+int synth_run_kim4v(interpreter_state_t *state, synth_sink_t sink, void *ctx);
+
+/**
+ * Prepare the state to be played live, with all the voices silent.
+ *
+ * @param max_voices 4 or 8, for the 4 or 8 voice interpreter
+ * @return 0 on success, -1 on error
+ */
+int synth_live_init(synth_live_t *live, interpreter_state_t *state,
+                    uint8_t **wavetables, int num_wavetables, int max_voices);
+
+/**
+ * Parse one byte of a MIDI stream. Note on and off, program change (the
+ * wavetable of the channel) and the all notes and all sound off
+ * controllers are played; anything else is ignored.
+ *
+ * @return true if the byte completed a note-on
+ */
+bool synth_live_midi(synth_live_t *live, uint8_t byte);
+
+/**
+ * Render count samples of the notes being played. Does not allocate.
+ */
+void synth_live_render(synth_live_t *live, uint8_t *buffer, size_t count);
+
+/**
+ * Make an array of pointers to the count consecutive tables in data, as
+ * needed by synth_init().
+ *
+ * @return The array, to be released with free(), or NULL on error
+ */
+uint8_t **synth_table_pointers(uint8_t *data, int count);
+
+/**
+ * Load PAP files, in order, into a 64K memory image.
+ *
+ * @return The image, to be released with free(), or NULL on error
+ */
+uint8_t *synth_load_pap_images(char **filenames, int count);
+
+/* WAV file output, usable as a sink through wav_sink(). wav_open() makes
+   8 bit files; wav_write() takes the sample bytes as they go in the file */
+wav_context_t *wav_open(const char *filename, int sample_rate);
+wav_context_t *wav_open_format(const char *filename, int sample_rate, int bits);
+int wav_write(wav_context_t *ctx, const uint8_t *buffer, size_t count);
+int wav_close(wav_context_t *ctx);
+int wav_sink(void *ctx, const uint8_t *buffer, size_t count);
+
+#endif /* SYNTH_H */
@@ -0,0 +1,341 @@
+/*
+ * NOTRAN linker - Loads relocatable NOTRAN modules made by notcmp at their
+ *                 addresses and resolves the songs against a shared
+ *                 library of refrains
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include "relobj.h"
+#include "objfile.h"
+
+#define MAX_MODULES 32
+#define MEMORY_SIZE 0x10000
+
+/*
+ * The interpreter adds the JMP and JSR addresses to SONGA, the start of the
+ * song being played, so every address word holds the target minus the
+ * origin of the song. A library refrain is reached from any song with the
+ * right word in the song, but the words in the library itself are relative
+ * to the song that called it: a library with its own jumps can only be
+ * shared by songs loaded at the same address, one at a time.
+ */
+typedef struct {
+    const char *filename;
+    uint16_t address;
+    relobj_t obj;
+} module_t;
+
+typedef struct {
+    module_t modules[MAX_MODULES];  /* The library first, if any */
+    int count;
+    bool library;
+} link_t;
+
+/* ============================================================================
+ * Linking
+ * ============================================================================ */
+
+static int load_module(link_t *l, const char *spec) {
+    if (l->count >= MAX_MODULES) {
+        fprintf(stderr, "Error: Too many modules (maximum %d)\n", MAX_MODULES);
+        return -1;
+    }
+
+    const char *at = strrchr(spec, '@');
+    if (!at || at == spec || !at[1]) {
+        fprintf(stderr, "Error: Missing load address in '%s' (expected: FILE@ADDRESS)\n", spec);
+        return -1;
+    }
+
+    char *end;
+    const unsigned long address = strtoul(at + 1, &end, 0);
+    if (*end || address >= MEMORY_SIZE) {
+        fprintf(stderr, "Error: Invalid load address in '%s'\n", spec);
+        return -1;
+    }
+
+    module_t *m = &l->modules[l->count];
+    const size_t length = at - spec;
+    char *filename = malloc(length + 1);
+    if (!filename) {
+        fprintf(stderr, "Error: Cannot allocate module name\n");
+        return -1;
+    }
+    memcpy(filename, spec, length);
+    filename[length] = '\0';
+
+    if (relobj_read(filename, &m->obj) != 0) {
+        free(filename);
+        return -1;
+    }
+    m->filename = filename;
+    m->address = (uint16_t)address;
+    l->count++;
+
+    if (address + m->obj.code_size > MEMORY_SIZE) {
+        fprintf(stderr, "Error: Module '%s' does not fit at 0x%04lX\n", filename, address);
+        return -1;
+    }
+    return 0;
+}
+
+static void free_link(link_t *l) {
+    for (int i = 0; i < l->count; i++) {
+        relobj_free(&l->modules[i].obj);
+        free((char *)l->modules[i].filename);
+    }
+}
+
+static bool find_export(const module_t *m, uint8_t id, uint16_t *offset) {
+    for (int i = 0; i < m->obj.num_exports; i++) {
+        if (m->obj.exports[i].id == id) {
+            *offset = m->obj.exports[i].offset;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int check_modules(const link_t *l) {
+    const int first_song = l->library ? 1 : 0;
+
+    if (first_song >= l->count) {
+        fprintf(stderr, "Error: No songs to link\n");
+        return -1;
+    }
+
+    for (int i = 0; i < l->count; i++) {
+        const module_t *m = &l->modules[i];
+        if (m->obj.num_voices != l->modules[0].obj.num_voices) {
+            fprintf(stderr, "Error: '%s' is for %d voices and '%s' for %d\n",
+                    m->filename, m->obj.num_voices,
+                    l->modules[0].filename, l->modules[0].obj.num_voices);
+            return -1;
+        }
+
+        for (int j = 0; j < i; j++) {
+            const module_t *o = &l->modules[j];
+            if (m->address < o->address + o->obj.code_size &&
+                o->address < m->address + m->obj.code_size) {
+                fprintf(stderr, "Error: '%s' at 0x%04X overlaps '%s' at 0x%04X\n",
+                        m->filename, m->address, o->filename, o->address);
+                return -1;
+            }
+        }
+    }
+
+    if (!l->library) {
+        return 0;
+    }
+
+    const module_t *lib = &l->modules[0];
+    bool jumps = false;
+    for (int i = 0; i < lib->obj.num_relocs; i++) {
+        if (lib->obj.relocs[i].symbol != 0) {
+            fprintf(stderr, "Error: Library '%s' refers to identifier %d, not defined in it\n",
+                    lib->filename, lib->obj.relocs[i].symbol);
+            return -1;
+        }
+        jumps = true;
+    }
+
+    for (int i = first_song + 1; jumps && i < l->count; i++) {
+        if (l->modules[i].address != l->modules[first_song].address) {
+            fprintf(stderr, "Error: Library '%s' has jumps of its own, so its songs must be "
+                    "loaded at one address and linked separately\n", lib->filename);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Patch the address words of m for the song loaded at origin */
+static int relocate(const link_t *l, module_t *m, uint16_t origin) {
+    for (int i = 0; i < m->obj.num_relocs; i++) {
+        const notcmp_reloc_t *r = &m->obj.relocs[i];
+        uint8_t *word = &m->obj.code[r->offset];
+        uint16_t target;
+
+        if (r->symbol == 0) {
+            target = m->address + (word[0] | (word[1] << 8));
+        } else {
+            uint16_t offset;
+            if (!l->library || !find_export(&l->modules[0], r->symbol, &offset)) {
+                fprintf(stderr, "Error: Undefined identifier %d in '%s'\n", r->symbol, m->filename);
+                return -1;
+            }
+            target = l->modules[0].address + offset;
+        }
+
+        const uint16_t relative = target - origin;
+        word[0] = relative & 0xFF;
+        word[1] = relative >> 8;
+    }
+    return 0;
+}
+
+static int link_modules(link_t *l) {
+    const int first_song = l->library ? 1 : 0;
+
+    for (int i = first_song; i < l->count; i++) {
+        if (relocate(l, &l->modules[i], l->modules[i].address) != 0) {
+            return -1;
+        }
+    }
+    if (l->library) {
+        return relocate(l, &l->modules[0], l->modules[first_song].address);
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Output
+ * ============================================================================ */
+
+/* The binary format holds no addresses, so the memory from the lowest
+   module to the end of the highest one is written, gaps zeroed */
+static int write_flat(FILE *file, const link_t *l) {
+    uint32_t low = MEMORY_SIZE, high = 0;
+    for (int i = 0; i < l->count; i++) {
+        const module_t *m = &l->modules[i];
+        if (m->address < low) {
+            low = m->address;
+        }
+        if (m->address + m->obj.code_size > high) {
+            high = m->address + m->obj.code_size;
+        }
+    }
+
+    uint8_t *image = calloc(high > low ? high - low : 1, 1);
+    if (!image) {
+        return -1;
+    }
+    for (int i = 0; i < l->count; i++) {
+        const module_t *m = &l->modules[i];
+        memcpy(image + (m->address - low), m->obj.code, m->obj.code_size);
+    }
+
+    const int result = objfile_write(OUT_BIN, file, image, high - low, (uint16_t)low);
+    free(image);
+    return result;
+}
+
+static int write_output(const char *filename, output_format_t format, const link_t *l) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        perror("Cannot open output file");
+        return -1;
+    }
+
+    int result;
+    if (format == OUT_BIN) {
+        result = write_flat(file, l);
+    } else {
+        objfile_segment_t segments[MAX_MODULES];
+        for (int i = 0; i < l->count; i++) {
+            segments[i].data = l->modules[i].obj.code;
+            segments[i].size = l->modules[i].obj.code_size;
+            segments[i].address = l->modules[i].address;
+        }
+        result = objfile_write_segments(format, file, segments, l->count);
+    }
+
+    if (fclose(file) != 0) {
+        result = -1;
+    }
+    if (result != 0) {
+        fprintf(stderr, "Error: Cannot write '%s'\n", filename);
+    }
+    return result;
+}
+
+/* ============================================================================
+ * Main Entry Point
+ * ============================================================================ */
+
+static void print_usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [-f {bin|pap|ihex}] [-l library.rel@address] -o output song.rel@address...\n", program_name);
+}
+
+int main(int argc, char *argv[]) {
+    const char *output_file = NULL;
+    const char *library = NULL;
+    output_format_t out_fmt = OUT_BIN;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:l:f:")) != -1) {
+        switch (opt) {
+            case 'o': output_file = optarg; break;
+            case 'l': library = optarg; break;
+            case 'f':
+                if (strcasecmp(optarg, "bin") == 0) out_fmt = OUT_BIN;
+                else if (strcasecmp(optarg, "pap") == 0) out_fmt = OUT_PAP;
+                else if (strcasecmp(optarg, "ihex") == 0) out_fmt = OUT_IHEX;
+                else {
+                    fprintf(stderr, "Unknown output format '%s' (expected: bin, pap, ihex)\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (!output_file || optind >= argc) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    link_t l = { .count = 0, .library = (library != NULL) };
+    int status = EXIT_FAILURE;
+
+    if (library && load_module(&l, library) != 0) {
+        goto done;
+    }
+    for (int i = optind; i < argc; i++) {
+        if (load_module(&l, argv[i]) != 0) {
+            goto done;
+        }
+    }
+
+    if (check_modules(&l) != 0 || link_modules(&l) != 0 ||
+        write_output(output_file, out_fmt, &l) != 0) {
+        goto done;
+    }
+
+    printf("Link successful:\n");
+    for (int i = 0; i < l.count; i++) {
+        const module_t *m = &l.modules[i];
+        printf("  %-8s 0x%04X-0x%04X  %s\n", (l.library && i == 0) ? "Library" : "Song",
+               m->address, (unsigned)(m->address + m->obj.code_size - (m->obj.code_size ? 1 : 0)),
+               m->filename);
+    }
+    status = EXIT_SUCCESS;
+
+done:
+    free_link(&l);
+    return status;
+}
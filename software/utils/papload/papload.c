@@ -0,0 +1,598 @@
+/*
+ * papload.c - Paced PAP uploader
+ *
+ * Sends PAP records to a KIM-1 over its TTY port (or anything standing in
+ * for it, such as a PTY), with a delay after every character and after
+ * every line so that the monitor, which reads the serial line in software,
+ * does not drop characters while it is busy storing the previous ones.
+ *
+ * The inputs are PAP files or raw binaries, which are loaded into memory
+ * segments and written again as a single PAP stream with one trailer. The
+ * KIM-1 monitor echoes every character it reads: with echo verification
+ * each character must come back before the next one is sent. A record
+ * that fails cannot be sent again, as the monitor gives up the load at the
+ * first bad checksum, so the upload stops there. Adaptive pacing makes the
+ * delays shorter after a run of good records and, when one fails, works
+ * out longer ones for the next try.
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "objfile.h"
+
+/* ============================================================================
+ * Constants and Configuration
+ * ============================================================================ */
+
+#define DEFAULT_BAUD 2400
+#define DEFAULT_CHAR_DELAY 1.0      /* ms */
+#define DEFAULT_LINE_DELAY 100.0    /* ms */
+#define DEFAULT_TIMEOUT 500.0       /* ms to wait for an echo */
+#define DEFAULT_ADDRESS 0x2000
+
+#define LINE_END "\r\n"
+
+/* Adaptive pacing: speed up slowly after a run of good records, down to
+   the delays given or to these if none are, back off after a failed one */
+#define ADAPT_BACKOFF 1.5
+#define ADAPT_SPEEDUP 0.9
+#define ADAPT_STREAK 8
+#define ADAPT_MIN_CHAR 0.5          /* ms, also first step up from no delay */
+#define ADAPT_MIN_LINE 10.0
+
+typedef struct {
+    const char *device;
+    int baud;
+    double char_delay;
+    double line_delay;
+    double min_char_delay;          /* Adaptive pacing does not go below */
+    double min_line_delay;
+    double timeout;
+    bool echo;
+    bool adaptive;
+    uint16_t address;               /* Of binary inputs */
+} config_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    uint16_t address;
+} segment_t;
+
+typedef struct {
+    segment_t *segments;
+    int count;
+    int capacity;
+} image_t;
+
+typedef struct {
+    int records;
+    size_t data_bytes;
+    size_t characters;
+    double seconds;
+} stats_t;
+
+/* ============================================================================
+ * Input
+ * ============================================================================ */
+
+/* Append data at address, extending the last segment if it ends there */
+static int image_add(image_t *image, uint16_t address, const uint8_t *data, size_t size) {
+    segment_t *last = image->count ? &image->segments[image->count - 1] : NULL;
+
+    if (!last || (uint16_t)(last->address + last->size) != address ||
+        last->address + last->size + size > 0x10000) {
+        if (image->count == image->capacity) {
+            const int capacity = image->capacity ? image->capacity * 2 : 8;
+            segment_t *bigger = realloc(image->segments, capacity * sizeof(segment_t));
+            if (!bigger) {
+                return -1;
+            }
+            image->segments = bigger;
+            image->capacity = capacity;
+        }
+        last = &image->segments[image->count++];
+        *last = (segment_t){ .address = address };
+    }
+
+    if (last->size + size > last->capacity) {
+        const size_t capacity = (last->size + size) * 2;
+        uint8_t *bigger = realloc(last->data, capacity);
+        if (!bigger) {
+            return -1;
+        }
+        last->data = bigger;
+        last->capacity = capacity;
+    }
+    memcpy(last->data + last->size, data, size);
+    last->size += size;
+    return 0;
+}
+
+static void image_free(image_t *image) {
+    for (int i = 0; i < image->count; i++) {
+        free(image->segments[i].data);
+    }
+    free(image->segments);
+}
+
+/* Add the data of a PAP record to the image */
+static int add_record(void *context, uint16_t address, const uint8_t *data, size_t size) {
+    if (image_add(context, address, data, size) != 0) {
+        fprintf(stderr, "Error: Cannot allocate memory image\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int read_binary(image_t *image, FILE *file, const char *filename, uint16_t address) {
+    uint8_t buffer[4096];
+    size_t count;
+    uint32_t next = address;
+
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        if (next + count > 0x10000) {
+            fprintf(stderr, "Error: '%s' does not fit in memory at 0x%04X\n", filename, address);
+            return -1;
+        }
+        if (image_add(image, (uint16_t)next, buffer, count) != 0) {
+            fprintf(stderr, "Error: Cannot allocate memory image\n");
+            return -1;
+        }
+        next += count;
+    }
+    return 0;
+}
+
+static bool is_pap_file(const char *filename) {
+    const char *dot = strrchr(filename, '.');
+    return dot && strcasecmp(dot, ".pap") == 0;
+}
+
+/*
+ * Load the inputs and write them as a PAP stream, one record per line.
+ * Binaries follow one another from address on.
+ */
+static char *make_stream(char **filenames, int count, uint16_t address, size_t *data_bytes) {
+    image_t image = { 0 };
+    char *text = NULL;
+    size_t length = 0;
+
+    for (int i = 0; i < count; i++) {
+        FILE *file = fopen(filenames[i], "rb");
+        if (!file) {
+            fprintf(stderr, "Error: Cannot open '%s'\n", filenames[i]);
+            image_free(&image);
+            return NULL;
+        }
+
+        int result;
+        if (is_pap_file(filenames[i])) {
+            result = (objfile_read_pap(file, filenames[i], add_record, &image) < 0) ? -1 : 0;
+        } else {
+            const long start = ftell(file);
+            result = read_binary(&image, file, filenames[i], address);
+            address += (uint16_t)(ftell(file) - start);
+        }
+        fclose(file);
+
+        if (result != 0) {
+            image_free(&image);
+            return NULL;
+        }
+    }
+
+    objfile_segment_t *segments = malloc((image.count ? image.count : 1) * sizeof(objfile_segment_t));
+    FILE *stream = open_memstream(&text, &length);
+    int result = (segments && stream) ? 0 : -1;
+
+    *data_bytes = 0;
+    for (int i = 0; result == 0 && i < image.count; i++) {
+        segments[i].data = image.segments[i].data;
+        segments[i].size = image.segments[i].size;
+        segments[i].address = image.segments[i].address;
+        *data_bytes += image.segments[i].size;
+    }
+    if (result == 0) {
+        result = objfile_write_segments(OUT_PAP, stream, segments, image.count);
+    }
+    if (stream && fclose(stream) != 0) {
+        result = -1;
+    }
+
+    free(segments);
+    image_free(&image);
+    if (result != 0) {
+        fprintf(stderr, "Error: Cannot build the PAP stream\n");
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+/* ============================================================================
+ * Serial Port
+ * ============================================================================ */
+
+static speed_t baud_to_speed(int baud) {
+    switch (baud) {
+        case 110: return B110;
+        case 300: return B300;
+        case 600: return B600;
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        default: return B0;
+    }
+}
+
+static int open_port(const config_t *config) {
+    const int fd = open(config->device, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open '%s': %s\n", config->device, strerror(errno));
+        return -1;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        fprintf(stderr, "Error: '%s' is not a terminal\n", config->device);
+        close(fd);
+        return -1;
+    }
+
+    /* 8N1 raw. A PTY takes the speed and ignores it */
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, baud_to_speed(config->baud));
+    cfsetospeed(&tio, baud_to_speed(config->baud));
+
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        fprintf(stderr, "Error: Cannot set up '%s': %s\n", config->device, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_ms(double ms) {
+    if (ms <= 0) {
+        return;
+    }
+    struct timespec ts = {
+        .tv_sec = (time_t)(ms / 1000),
+        .tv_nsec = (long)((ms - (time_t)(ms / 1000) * 1000.0) * 1e6)
+    };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+/* Send one character and wait until it has left the port */
+static int send_char(int fd, char c) {
+    ssize_t n;
+    while ((n = write(fd, &c, 1)) < 0 && errno == EINTR) {
+    }
+    if (n != 1) {
+        fprintf(stderr, "Error: Cannot write to the port: %s\n", strerror(errno));
+        return -1;
+    }
+    tcdrain(fd);
+    return 0;
+}
+
+/*
+ * Wait for the echo of c.
+ *
+ * @return 0 if it came back, 1 if something else or nothing did, -1 on error
+ */
+static int wait_echo(int fd, char c, double timeout) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    const int result = poll(&pfd, 1, (int)timeout);
+    if (result < 0) {
+        return (errno == EINTR) ? 1 : -1;
+    }
+    if (result == 0) {
+        return 1;
+    }
+
+    char echo;
+    if (read(fd, &echo, 1) != 1) {
+        return 1;
+    }
+    return (echo == c) ? 0 : 1;
+}
+
+static void discard_input(int fd) {
+    char buffer[256];
+    while (read(fd, buffer, sizeof(buffer)) > 0) {
+    }
+}
+
+/* ============================================================================
+ * Upload
+ * ============================================================================ */
+
+/*
+ * Send a record and its line end with the current pacing.
+ *
+ * @return 0 on success, 1 if an echo failed, -1 on error
+ */
+static int send_record(int fd, const char *record, size_t length, const config_t *config,
+                       stats_t *stats) {
+    for (size_t i = 0; i < length; i++) {
+        if (send_char(fd, record[i]) != 0) {
+            return -1;
+        }
+        stats->characters++;
+
+        if (config->echo) {
+            const int result = wait_echo(fd, record[i], config->timeout);
+            if (result != 0) {
+                return result;
+            }
+        }
+        sleep_ms(config->char_delay);
+    }
+
+    for (const char *p = LINE_END; *p; p++) {
+        if (send_char(fd, *p) != 0) {
+            return -1;
+        }
+        stats->characters++;
+
+        if (config->echo) {
+            const int result = wait_echo(fd, *p, config->timeout);
+            if (result != 0) {
+                return result;
+            }
+        }
+    }
+    sleep_ms(config->line_delay);
+
+    /* Anything the monitor prints after the line end */
+    if (config->echo) {
+        discard_input(fd);
+    }
+    return 0;
+}
+
+/* Makes the delays shorter, but not below the limits */
+static void speed_up(config_t *config) {
+    config->char_delay *= ADAPT_SPEEDUP;
+    if (config->char_delay < config->min_char_delay) {
+        config->char_delay = config->min_char_delay;
+    }
+    config->line_delay *= ADAPT_SPEEDUP;
+    if (config->line_delay < config->min_line_delay) {
+        config->line_delay = config->min_line_delay;
+    }
+}
+
+static int upload(int fd, const char *stream, config_t *config, stats_t *stats) {
+    int streak = 0;
+    const double start = now_seconds();
+
+    /* Delays of the last run of good records, the ones given at first */
+    double good_char = config->char_delay;
+    double good_line = config->line_delay;
+
+    for (const char *line = stream; *line; ) {
+        const size_t length = strcspn(line, "\n");
+        const bool trailer = (length >= 3 && strncmp(line, ";00", 3) == 0);
+
+        const int result = send_record(fd, line, length, config, stats);
+        if (result < 0) {
+            return -1;
+        }
+        if (result > 0) {
+            /* LOAD drops out with ERR at the checksum of a broken record and
+               takes no more, so there is no point in sending it again */
+            fprintf(stderr, "\nError: No echo for record %d, restart L on the KIM-1 and "
+                    "send again\n", stats->records + 1);
+            if (config->adaptive) {
+                /* Go back to the last good delays if they were longer, as
+                   they held for a whole run, or else back off from them */
+                if (config->char_delay >= good_char && config->line_delay >= good_line) {
+                    good_char = good_char > 0 ? good_char * ADAPT_BACKOFF : ADAPT_MIN_CHAR;
+                    good_line = good_line > ADAPT_MIN_LINE
+                                ? good_line * ADAPT_BACKOFF : ADAPT_MIN_LINE;
+                }
+                fprintf(stderr, "Longer delays to try: -c %.2f -l %.1f\n",
+                        good_char, good_line);
+            }
+            return -1;
+        }
+
+        if (!trailer) {
+            stats->records++;
+        }
+        if (config->adaptive && ++streak >= ADAPT_STREAK) {
+            good_char = config->char_delay;
+            good_line = config->line_delay;
+            speed_up(config);
+            streak = 0;
+        }
+
+        fprintf(stderr, "\rRecord %d", stats->records);
+        line += length;
+        if (*line == '\n') {
+            line++;
+        }
+    }
+
+    stats->seconds = now_seconds() - start;
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+/* ============================================================================
+ * Command Line Interface
+ * ============================================================================ */
+
+static void print_usage(const char *progname) {
+    printf("Usage: %s -d <device> [-b <baud>] [-c <ms>] [-l <ms>] [-e] [-A]\n"
+           "       [-t <ms>] [-a <address>] <file>...\n",
+           progname);
+    printf("\nOptions:\n");
+    printf("  -d <device>    Serial device or PTY connected to the KIM-1 TTY port\n");
+    printf("  -b <baud>      Baud rate (default: %d)\n", DEFAULT_BAUD);
+    printf("  -c <ms>        Delay after each character (default: %.1f)\n",
+           DEFAULT_CHAR_DELAY);
+    printf("  -l <ms>        Delay after each record (default: %.1f)\n",
+           DEFAULT_LINE_DELAY);
+    printf("  -e             Verify the echo of every character and stop at the first\n");
+    printf("                 record that fails\n");
+    printf("  -A             Shorten the delays after every %d good records, not below\n",
+           ADAPT_STREAK);
+    printf("                 those given (needs -e)\n");
+    printf("  -t <ms>        Time to wait for an echo (default: %.0f)\n", DEFAULT_TIMEOUT);
+    printf("  -a <address>   Load address of the first binary input (default: 0x%04X)\n",
+           DEFAULT_ADDRESS);
+    printf("  -h             Show this help\n");
+    printf("\nFiles ending in .pap are read as PAP, anything else as raw binary. Start\n");
+    printf("the monitor load command (L) on the KIM-1 before sending.\n");
+}
+
+static bool parse_command_line(int argc, char *argv[], config_t *config) {
+    *config = (config_t){
+        .baud = DEFAULT_BAUD,
+        .char_delay = DEFAULT_CHAR_DELAY,
+        .line_delay = DEFAULT_LINE_DELAY,
+        .min_char_delay = ADAPT_MIN_CHAR,
+        .min_line_delay = ADAPT_MIN_LINE,
+        .timeout = DEFAULT_TIMEOUT,
+        .address = DEFAULT_ADDRESS
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:b:c:l:eAt:a:h")) != -1) {
+        switch (opt) {
+            case 'd': config->device = optarg; break;
+            case 'b': config->baud = atoi(optarg); break;
+            case 'c': config->char_delay = config->min_char_delay = atof(optarg); break;
+            case 'l': config->line_delay = config->min_line_delay = atof(optarg); break;
+            case 'e': config->echo = true; break;
+            case 'A': config->adaptive = true; break;
+            case 't': config->timeout = atof(optarg); break;
+            case 'a': config->address = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(argv[0]);
+                return false;
+        }
+    }
+
+    if (!config->device) {
+        fprintf(stderr, "Error: Missing device\n\n");
+        print_usage(argv[0]);
+        return false;
+    }
+    if (baud_to_speed(config->baud) == B0) {
+        fprintf(stderr, "Error: Unsupported baud rate %d\n\n", config->baud);
+        return false;
+    }
+    if (config->char_delay < 0 || config->line_delay < 0 || config->timeout <= 0) {
+        fprintf(stderr, "Error: Delays cannot be negative\n\n");
+        return false;
+    }
+    if (config->adaptive && !config->echo) {
+        fprintf(stderr, "Error: Adaptive pacing needs echo verification (-e)\n\n");
+        return false;
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Error: Missing input file\n\n");
+        print_usage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+/* ============================================================================
+ * Main Program
+ * ============================================================================ */
+
+int main(int argc, char *argv[]) {
+    config_t config;
+    if (!parse_command_line(argc, argv, &config)) {
+        return EXIT_FAILURE;
+    }
+
+    stats_t stats = { 0 };
+    char *stream = make_stream(&argv[optind], argc - optind, config.address, &stats.data_bytes);
+    if (!stream) {
+        return EXIT_FAILURE;
+    }
+
+    const int fd = open_port(&config);
+    if (fd < 0) {
+        free(stream);
+        return EXIT_FAILURE;
+    }
+
+    const int result = upload(fd, stream, &config, &stats);
+    close(fd);
+    free(stream);
+    if (result != 0) {
+        return EXIT_FAILURE;
+    }
+
+    printf("Upload successful:\n");
+    printf("  Records: %d\n", stats.records);
+    printf("  Data bytes: %zu\n", stats.data_bytes);
+    printf("  Characters sent: %zu\n", stats.characters);
+    printf("  Time: %.2f s\n", stats.seconds);
+    if (stats.seconds > 0) {
+        printf("  Throughput: %.1f data bytes/s (%.1f characters/s)\n",
+               stats.data_bytes / stats.seconds, stats.characters / stats.seconds);
+    }
+    if (config.adaptive) {
+        printf("  Final delays: %.2f ms per character, %.1f ms per record\n",
+               config.char_delay, config.line_delay);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,685 @@
+/*
+ * pappack.c - Self-extracting PAP packer
+ *
+ * Joins PAP files into a single memory image and packs it with a byte
+ * aligned LZ code that the KIM-1 decodes quickly, so that the much slower
+ * serial load has fewer characters to send. The output is a PAP file with
+ * the packed image and the decompressor of unlz.asm in a free area of
+ * memory. Running the decompressor unpacks the image to its own addresses
+ * and starts the program at its entry point.
+ *
+ * The packing is optimal for the code: every run of consecutive bytes of
+ * the image is parsed backwards, choosing at every byte the cheapest of a
+ * literal run or any of the copies found by hash chains.
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <errno.h>
+#include "objfile.h"
+
+/* ============================================================================
+ * Constants and Configuration
+ * ============================================================================ */
+
+#define MEMORY_SIZE 0x10000
+
+#define DEFAULT_STUB "unlz.bin"
+#define DEFAULT_ENTRY 0x0200
+#define DEFAULT_BAUD 2400
+#define DEFAULT_CHAR_DELAY 1.0      /* ms, as papload */
+#define DEFAULT_LINE_DELAY 100.0    /* ms */
+
+/* Where the decompressor goes if no address is given: the expansion RAM */
+#define STUB_AREA_START 0x2000
+#define STUB_AREA_END 0xA000
+
+/* Page 0 bytes used by the decompressor. Must match unlz.asm */
+#define UNLZ_ZP 0xE0
+#define UNLZ_ZP_SIZE 6
+#define UNLZ_MAX_SIZE 256
+
+/* Tokens of the packed stream, see unlz.asm */
+#define TOKEN_END 0x00
+#define TOKEN_RUN 0x80
+#define TOKEN_SHORT 0x80
+#define TOKEN_LONG 0xC0
+
+#define LITERAL_MAX 127
+#define SHORT_MIN 2                 /* Length 1 would be TOKEN_RUN */
+#define SHORT_MAX 64
+#define SHORT_DISTANCE 256
+#define LONG_MIN 3
+#define LONG_MAX 66
+#define MATCH_MAX LONG_MAX
+
+#define CHAIN_DEPTH 2048            /* Candidates tried at every byte */
+
+/* Decompressor cycles, for the time estimate. Taken from unlz.asm,
+   assuming no page crossings */
+#define CYCLES_START 4
+#define CYCLES_TOKEN 17             /* Control byte up to the dispatch */
+#define CYCLES_LITERALS 32          /* Plus the pointer updates */
+#define CYCLES_SHORT 63
+#define CYCLES_LONG 76
+#define CYCLES_BYTE 18              /* Per byte written */
+#define CYCLES_RUN 44
+#define CYCLES_END 118
+#define CPU_CLOCK 1000000.0
+
+/* ============================================================================
+ * Input
+ * ============================================================================ */
+
+typedef struct {
+    uint8_t data[MEMORY_SIZE];
+    bool present[MEMORY_SIZE];
+    size_t size;
+} image_t;
+
+/* Put the data of a record into the image, later files overwriting
+   earlier ones */
+static int add_record(void *context, uint16_t address, const uint8_t *data, size_t size) {
+    image_t *image = context;
+
+    for (size_t i = 0; i < size; i++) {
+        const uint16_t at = (uint16_t)(address + i);
+        if (!image->present[at]) {
+            image->present[at] = true;
+            image->size++;
+        }
+        image->data[at] = data[i];
+    }
+    return 0;
+}
+
+static int read_pap(image_t *image, const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open '%s': %s\n", filename, strerror(errno));
+        return -1;
+    }
+
+    const long result = objfile_read_pap(file, filename, add_record, image);
+    fclose(file);
+    return (result < 0) ? -1 : 0;
+}
+
+static int read_stub(const char *filename, uint8_t *stub, size_t *size) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open '%s': %s\n", filename, strerror(errno));
+        return -1;
+    }
+    *size = fread(stub, 1, UNLZ_MAX_SIZE, file);
+    const bool more = fgetc(file) != EOF;
+    fclose(file);
+
+    if (*size == 0 || more) {
+        fprintf(stderr, "Error: '%s' is not a decompressor of 1 to %d bytes\n", filename,
+                UNLZ_MAX_SIZE);
+        return -1;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Packing
+ * ============================================================================ */
+
+/* The bytes that the decompressor writes, in address order, which are the
+   ones of the image but its work area. Those go in the end token. */
+static bool is_packed(const image_t *image, uint32_t address) {
+    return address < MEMORY_SIZE && image->present[address] &&
+           (address < UNLZ_ZP || address >= UNLZ_ZP + UNLZ_ZP_SIZE);
+}
+
+typedef struct {
+    uint8_t length;
+    uint16_t distance;
+} match_t;
+
+typedef struct {
+    match_t near;                   /* Longest one within SHORT_DISTANCE */
+    match_t far;                    /* Longest one at any distance */
+} matches_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    int runs;
+    unsigned long cycles;
+} stream_t;
+
+static int stream_put(stream_t *stream, uint8_t value) {
+    if (stream->size == stream->capacity) {
+        const size_t capacity = stream->capacity ? stream->capacity * 2 : 4096;
+        uint8_t *bigger = realloc(stream->data, capacity);
+        if (!bigger) {
+            return -1;
+        }
+        stream->data = bigger;
+        stream->capacity = capacity;
+    }
+    stream->data[stream->size++] = value;
+    return 0;
+}
+
+/*
+ * Length of the copy from source to dest, which must stay within the run
+ * ending at end. Source bytes below dest must be written already, so they
+ * must be packed ones, as all of them below dest are. The ones from dest
+ * on are written by the copy itself.
+ */
+static int match_length(const image_t *image, uint32_t source, uint32_t dest, uint32_t end) {
+    int length = 0;
+    while (length < MATCH_MAX && dest + length < end &&
+           (source + length >= dest || is_packed(image, source + length)) &&
+           image->data[source + length] == image->data[dest + length]) {
+        length++;
+    }
+    return length;
+}
+
+/*
+ * Find the longest near and far copies for every packed byte. Candidates
+ * are earlier bytes starting with the same two values, most recent first,
+ * chained through previous.
+ */
+static int find_matches(const image_t *image, matches_t *matches) {
+    int32_t *head = malloc(MEMORY_SIZE * sizeof(int32_t));
+    int32_t *previous = malloc(MEMORY_SIZE * sizeof(int32_t));
+    if (!head || !previous) {
+        free(head);
+        free(previous);
+        return -1;
+    }
+    for (uint32_t i = 0; i < MEMORY_SIZE; i++) {
+        head[i] = -1;
+    }
+
+    uint32_t end = 0;
+    for (uint32_t at = 0; at < MEMORY_SIZE; at++) {
+        if (!is_packed(image, at)) {
+            continue;
+        }
+        if (at >= end) {
+            for (end = at; is_packed(image, end); end++) {
+            }
+        }
+        if (at + 1 >= end) {
+            continue;                           /* No key, the run ends */
+        }
+
+        matches_t *found = &matches[at];
+        const uint16_t key = image->data[at] | (image->data[at + 1] << 8);
+        int depth = 0;
+        for (int32_t source = head[key]; source >= 0 && depth < CHAIN_DEPTH;
+             source = previous[source], depth++) {
+            const int length = match_length(image, source, at, end);
+            const uint32_t distance = at - source;
+            if (distance <= SHORT_DISTANCE && length > found->near.length) {
+                found->near = (match_t){ length, distance };
+            }
+            if (length > found->far.length) {
+                found->far = (match_t){ length, distance };
+            }
+            if (found->far.length == MATCH_MAX) {
+                break;
+            }
+        }
+
+        previous[at] = head[key];
+        head[key] = at;
+    }
+
+    free(head);
+    free(previous);
+    return 0;
+}
+
+typedef struct {
+    uint32_t cost;                  /* Packed bytes from here to the run end */
+    uint8_t length;                 /* Of the first token */
+    uint16_t distance;              /* 0 for literals */
+} step_t;
+
+/* Choose the cheapest tokens for the run from start to end, last to first */
+static void parse_run(const matches_t *matches, step_t *steps, uint32_t start, uint32_t end) {
+    steps[end - start].cost = 0;
+
+    for (uint32_t at = end; at-- > start; ) {
+        step_t *best = &steps[at - start];
+        best->cost = UINT32_MAX;
+
+        for (uint32_t length = 1; length <= LITERAL_MAX && at + length <= end; length++) {
+            const uint32_t cost = 1 + length + steps[at + length - start].cost;
+            if (cost < best->cost) {
+                *best = (step_t){ cost, length, 0 };
+            }
+        }
+
+        const match_t *near = &matches[at].near;
+        for (uint32_t length = SHORT_MIN; length <= near->length && length <= SHORT_MAX;
+             length++) {
+            const uint32_t cost = 2 + steps[at + length - start].cost;
+            if (cost < best->cost) {
+                *best = (step_t){ cost, length, near->distance };
+            }
+        }
+
+        const match_t *far = &matches[at].far;
+        for (uint32_t length = LONG_MIN; length <= far->length; length++) {
+            const uint32_t cost = 3 + steps[at + length - start].cost;
+            if (cost < best->cost) {
+                *best = (step_t){ cost, length, far->distance };
+            }
+        }
+    }
+}
+
+static int emit_run(const image_t *image, const step_t *steps, uint32_t start, uint32_t end,
+                    stream_t *stream) {
+    int result = stream_put(stream, TOKEN_RUN);
+    result |= stream_put(stream, start & 0xFF);
+    result |= stream_put(stream, start >> 8);
+    stream->runs++;
+    stream->cycles += CYCLES_TOKEN + CYCLES_RUN;
+
+    for (uint32_t at = start; at < end && result == 0; ) {
+        const step_t *step = &steps[at - start];
+        const uint16_t negated = (uint16_t)-step->distance;
+
+        if (step->distance == 0) {
+            result |= stream_put(stream, step->length);
+            for (int i = 0; i < step->length; i++) {
+                result |= stream_put(stream, image->data[at + i]);
+            }
+            stream->cycles += CYCLES_TOKEN + CYCLES_LITERALS;
+        } else if (step->distance <= SHORT_DISTANCE && step->length <= SHORT_MAX) {
+            result |= stream_put(stream, TOKEN_SHORT | (step->length - 1));
+            result |= stream_put(stream, negated & 0xFF);
+            stream->cycles += CYCLES_TOKEN + CYCLES_SHORT;
+        } else {
+            result |= stream_put(stream, TOKEN_LONG | (step->length - LONG_MIN));
+            result |= stream_put(stream, negated & 0xFF);
+            result |= stream_put(stream, negated >> 8);
+            stream->cycles += CYCLES_TOKEN + CYCLES_LONG;
+        }
+        stream->cycles += (unsigned long)CYCLES_BYTE * step->length;
+        at += step->length;
+    }
+    return result;
+}
+
+/*
+ * Pack the image into stream: its runs in address order, then the end
+ * token with the work area bytes of the image and the entry point.
+ */
+static int pack_image(const image_t *image, uint16_t entry, stream_t *stream) {
+    matches_t *matches = calloc(MEMORY_SIZE, sizeof(matches_t));
+    step_t *steps = malloc((MEMORY_SIZE + 1) * sizeof(step_t));
+    int result = (matches && steps) ? find_matches(image, matches) : -1;
+
+    stream->cycles = CYCLES_START;
+    for (uint32_t start = 0; start < MEMORY_SIZE && result == 0; start++) {
+        if (!is_packed(image, start)) {
+            continue;
+        }
+        uint32_t end = start;
+        while (is_packed(image, end)) {
+            end++;
+        }
+        parse_run(matches, steps, start, end);
+        result = emit_run(image, steps, start, end, stream);
+        start = end;
+    }
+
+    if (result == 0) {
+        result = stream_put(stream, TOKEN_END);
+        for (int i = 0; i < UNLZ_ZP_SIZE; i++) {
+            result |= stream_put(stream, image->data[UNLZ_ZP + i]);
+        }
+        result |= stream_put(stream, (uint8_t)(entry - 1));
+        result |= stream_put(stream, (uint16_t)(entry - 1) >> 8);
+        stream->cycles += CYCLES_TOKEN + CYCLES_END;
+    }
+
+    free(matches);
+    free(steps);
+    if (result != 0) {
+        fprintf(stderr, "Error: Cannot allocate the packed image\n");
+    }
+    return result;
+}
+
+/* ============================================================================
+ * Placement
+ * ============================================================================ */
+
+static bool area_is_free(const image_t *image, uint32_t start, size_t size) {
+    if (start + size > MEMORY_SIZE) {
+        return false;
+    }
+    if (start < UNLZ_ZP + UNLZ_ZP_SIZE && start + size > UNLZ_ZP) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        if (image->present[start + i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Lowest address of the expansion RAM with room for size bytes */
+static int find_free_area(const image_t *image, size_t size) {
+    for (uint32_t start = STUB_AREA_START; start + size <= STUB_AREA_END; start++) {
+        if (area_is_free(image, start, size)) {
+            return start;
+        }
+    }
+    return -1;
+}
+
+/* ============================================================================
+ * Output
+ * ============================================================================ */
+
+typedef struct {
+    size_t characters;
+    int lines;
+} pap_size_t;
+
+/* Write the segments as PAP to file, if any, and measure them */
+static int write_pap(FILE *file, const objfile_segment_t *segments, int count,
+                     pap_size_t *size) {
+    char *text = NULL;
+    size_t length = 0;
+    FILE *stream = open_memstream(&text, &length);
+    int result = stream ? objfile_write_segments(OUT_PAP, stream, segments, count) : -1;
+
+    if (stream && fclose(stream) != 0) {
+        result = -1;
+    }
+    if (result == 0) {
+        *size = (pap_size_t){ 0 };
+        for (size_t i = 0; i < length; i++) {
+            if (text[i] == '\n') {
+                size->lines++;
+            } else {
+                size->characters++;
+            }
+        }
+        if (file && fwrite(text, 1, length, file) != length) {
+            result = -1;
+        }
+    }
+    free(text);
+    return result;
+}
+
+/* The image as it would be loaded unpacked: a segment per run of bytes */
+static int image_segments(const image_t *image, objfile_segment_t *segments) {
+    int count = 0;
+    for (uint32_t start = 0; start < MEMORY_SIZE; start++) {
+        if (!image->present[start]) {
+            continue;
+        }
+        uint32_t end = start;
+        while (end < MEMORY_SIZE && image->present[end]) {
+            end++;
+        }
+        segments[count++] = (objfile_segment_t){
+            .data = image->data + start, .size = end - start, .address = start
+        };
+        start = end;
+    }
+    return count;
+}
+
+typedef struct {
+    int baud;
+    double char_delay;
+    double line_delay;
+} pacing_t;
+
+/* Seconds that papload takes to send it: every record ends in CR LF, and
+   is followed by the line delay */
+static double load_time(const pap_size_t *size, const pacing_t *pacing) {
+    const double char_time = 10.0 / pacing->baud;
+    return (size->characters + 2.0 * size->lines) * char_time +
+           size->characters * pacing->char_delay / 1000.0 +
+           size->lines * pacing->line_delay / 1000.0;
+}
+
+/* ============================================================================
+ * Command Line Interface
+ * ============================================================================ */
+
+typedef struct {
+    const char *output_filename;
+    const char *stub_filename;
+    int address;                    /* Of the decompressor, -1 to find one */
+    uint16_t entry;
+    pacing_t pacing;
+} config_t;
+
+static void print_usage(const char *progname) {
+    printf("Usage: %s -o <output.pap> [-a <address>] [-e <entry>] [-s <unlz.bin>]\n"
+           "       [-b <baud>] [-c <ms>] [-l <ms>] <file.pap>...\n", progname);
+    printf("\nOptions:\n");
+    printf("  -o <file>      Output PAP file\n");
+    printf("  -a <address>   Load address of the decompressor and the packed image\n");
+    printf("                 (default: the first free one from 0x%04X)\n", STUB_AREA_START);
+    printf("  -e <entry>     Entry point of the program (default: 0x%04X)\n", DEFAULT_ENTRY);
+    printf("  -s <file>      Decompressor binary (default: %s)\n", DEFAULT_STUB);
+    printf("  -b <baud>      Baud rate of the load time estimate (default: %d)\n",
+           DEFAULT_BAUD);
+    printf("  -c <ms>        Delay after each character, as for papload (default: %.1f)\n",
+           DEFAULT_CHAR_DELAY);
+    printf("  -l <ms>        Delay after each record, as for papload (default: %.1f)\n",
+           DEFAULT_LINE_DELAY);
+    printf("  -h             Show this help\n");
+    printf("\nLoad the output and run it at the address of the decompressor. It uses\n");
+    printf("page 0 from 0x%02X to 0x%02X and two bytes of the stack before starting the\n",
+           UNLZ_ZP, UNLZ_ZP + UNLZ_ZP_SIZE - 1);
+    printf("program.\n");
+}
+
+static bool parse_command_line(int argc, char *argv[], config_t *config) {
+    *config = (config_t){
+        .stub_filename = DEFAULT_STUB,
+        .address = -1,
+        .entry = DEFAULT_ENTRY,
+        .pacing = { DEFAULT_BAUD, DEFAULT_CHAR_DELAY, DEFAULT_LINE_DELAY }
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:a:e:s:b:c:l:h")) != -1) {
+        switch (opt) {
+            case 'o': config->output_filename = optarg; break;
+            case 'a': config->address = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 'e': config->entry = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 's': config->stub_filename = optarg; break;
+            case 'b': config->pacing.baud = atoi(optarg); break;
+            case 'c': config->pacing.char_delay = atof(optarg); break;
+            case 'l': config->pacing.line_delay = atof(optarg); break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(argv[0]);
+                return false;
+        }
+    }
+
+    if (!config->output_filename) {
+        fprintf(stderr, "Error: Missing output file\n\n");
+        print_usage(argv[0]);
+        return false;
+    }
+    if (config->pacing.baud <= 0 || config->pacing.char_delay < 0 ||
+        config->pacing.line_delay < 0) {
+        fprintf(stderr, "Error: Baud rate must be positive and delays not negative\n\n");
+        return false;
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Error: Missing input file\n\n");
+        print_usage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+/* ============================================================================
+ * Main Program
+ * ============================================================================ */
+
+static int write_output(const config_t *config, const image_t *image, const uint8_t *stub,
+                        size_t stub_size, const stream_t *stream) {
+    int address = config->address;
+    const size_t size = stub_size + stream->size;
+
+    if (address < 0) {
+        address = find_free_area(image, size);
+        if (address < 0) {
+            fprintf(stderr, "Error: No room for %zu bytes between 0x%04X and 0x%04X\n",
+                    size, STUB_AREA_START, STUB_AREA_END);
+            return -1;
+        }
+    } else if (!area_is_free(image, address, size)) {
+        fprintf(stderr, "Error: %zu bytes at 0x%04X overlap the image or page 0 "
+                "from 0x%02X\n", size, address, UNLZ_ZP);
+        return -1;
+    }
+
+    uint8_t *packed = malloc(size);
+    objfile_segment_t *segments = malloc((MEMORY_SIZE / 2 + 1) * sizeof(objfile_segment_t));
+    if (!packed || !segments) {
+        fprintf(stderr, "Error: Cannot allocate the output\n");
+        free(packed);
+        free(segments);
+        return -1;
+    }
+    memcpy(packed, stub, stub_size);
+    memcpy(packed + stub_size, stream->data, stream->size);
+
+    /* The stream pointer of the decompressor, then the code and the stream */
+    const uint16_t source = address + stub_size;
+    const uint8_t pointer[2] = { source & 0xFF, source >> 8 };
+    const objfile_segment_t output[] = {
+        { .data = pointer, .size = sizeof(pointer), .address = UNLZ_ZP },
+        { .data = packed, .size = size, .address = address }
+    };
+
+    pap_size_t unpacked_pap, packed_pap;
+    const int count = image_segments(image, segments);
+    int result = write_pap(NULL, segments, count, &unpacked_pap);
+
+    FILE *file = fopen(config->output_filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot create output file '%s'\n", config->output_filename);
+        result = -1;
+    }
+    if (result == 0) {
+        result = write_pap(file, output, 2, &packed_pap);
+    }
+    if (file && fclose(file) != 0) {
+        result = -1;
+    }
+    if (result != 0) {
+        if (file) {
+            fprintf(stderr, "Error: Cannot write output file '%s'\n", config->output_filename);
+            remove(config->output_filename);
+        }
+        free(packed);
+        free(segments);
+        return -1;
+    }
+
+    const double unpacked_time = load_time(&unpacked_pap, &config->pacing);
+    const double packed_time = load_time(&packed_pap, &config->pacing);
+    const double decode_time = stream->cycles / CPU_CLOCK;
+
+    printf("Packed image:\n");
+    printf("  Image bytes: %zu in %d runs\n", image->size, stream->runs);
+    printf("  Packed bytes: %zu (ratio %.2f:1), %zu with the decompressor\n",
+           stream->size, (double)image->size / stream->size, size);
+    printf("  Run at: $%04X, starts $%04X\n", address, config->entry);
+    printf("  PAP characters: %zu unpacked, %zu packed\n",
+           unpacked_pap.characters, packed_pap.characters);
+    printf("  Load time: %.1f s unpacked, %.1f s packed at %d baud\n",
+           unpacked_time, packed_time, config->pacing.baud);
+    printf("  Decompression: %.2f s\n", decode_time);
+    printf("  Saved: %.1f s\n", unpacked_time - packed_time - decode_time);
+    if (unpacked_time <= packed_time + decode_time) {
+        fprintf(stderr, "Warning: The image loads faster unpacked\n");
+    }
+
+    free(packed);
+    free(segments);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    config_t config;
+    if (!parse_command_line(argc, argv, &config)) {
+        return EXIT_FAILURE;
+    }
+
+    uint8_t stub[UNLZ_MAX_SIZE];
+    size_t stub_size;
+    if (read_stub(config.stub_filename, stub, &stub_size) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    image_t *image = calloc(1, sizeof(image_t));
+    if (!image) {
+        fprintf(stderr, "Error: Cannot allocate memory image\n");
+        return EXIT_FAILURE;
+    }
+    for (int i = optind; i < argc; i++) {
+        if (read_pap(image, argv[i]) != 0) {
+            free(image);
+            return EXIT_FAILURE;
+        }
+    }
+    if (image->size == 0) {
+        fprintf(stderr, "Error: The inputs have no data\n");
+        free(image);
+        return EXIT_FAILURE;
+    }
+
+    stream_t stream = { 0 };
+    int result = pack_image(image, config.entry, &stream);
+    if (result == 0) {
+        result = write_output(&config, image, stub, stub_size, &stream);
+    }
+
+    free(stream.data);
+    free(image);
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
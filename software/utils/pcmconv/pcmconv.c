@@ -0,0 +1,770 @@
+/*
+ * pcmconv.c - PCM Sample Converter
+ *
+ * Converts a WAV file into 8-bit unsigned sample data for the pcmplay
+ * KIM-1 player, or 4-bit DPCM data for dpcmplay, resampled to the exact
+ * rate the player achieves for a given number of CPU cycles per sample
+ * and padded to whole pages.
+ *
+ * Any RIFF WAV file is accepted: 8, 16, 24 or 32 bit integer or 32/64 bit
+ * float samples, any number of channels (mixed down to mono) and any
+ * sample rate. Resampling uses a polyphase windowed sinc filter, and the
+ * result can be normalized and dithered down to 8 bits with optional
+ * noise shaping. The output is a CA65 include file, raw binary or a
+ * PAP/Intel HEX file ready to load.
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <math.h>
+#include <strings.h>
+#include "objfile.h"
+
+/* ============================================================================
+ * Constants and Configuration
+ * ============================================================================ */
+
+#define DEFAULT_CLOCK 1000000
+#define DEFAULT_CYCLES 125
+#define DEFAULT_MAX_SIZE 0x8000
+#define DEFAULT_SEGMENT "PCMDATA"
+#define DEFAULT_ADDRESS 0x2000  /* EXTRAM, where the players expect the data */
+#define DEFAULT_SEED 0x1002
+
+#define PI 3.14159265358979323846
+
+#define PAGE_SIZE 256
+#define BYTES_PER_ROW 16
+
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_IEEE_FLOAT 3
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+/* Resampling filter */
+#define FILTER_PHASES 256       /* Fractional positions between samples */
+#define FILTER_ZEROS 16         /* Sinc zero crossings on each side */
+#define FILTER_ROLLOFF 0.92     /* Cutoff relative to the output Nyquist */
+#define KAISER_BETA 8.0
+
+#define DPCM_INITIAL 0x80       /* Decoder starts from mid scale */
+#define DPCM_ZERO 8             /* Code for a zero delta */
+#define DPCM_CODES 16
+
+/*
+ * Fibonacci delta table, the same as DELTAS in dpcmplay.asm. Small steps
+ * are fine grained for quiet passages, large ones follow fast slopes.
+ */
+static const int DPCM_DELTAS[DPCM_CODES] = {
+    -34, -21, -13, -8, -5, -3, -2, -1, 0, 1, 2, 3, 5, 8, 13, 21
+};
+
+/* ============================================================================
+ * Type Definitions
+ * ============================================================================ */
+
+typedef struct {
+    float *samples;             /* Mono samples, -1.0 to 1.0 */
+    size_t count;
+    uint32_t sample_rate;
+} audio_t;
+
+typedef enum {
+    QUANT_ROUND = 0,            /* Plain rounding */
+    QUANT_TPDF,                 /* Triangular dither */
+    QUANT_SHAPED                /* Triangular dither with noise shaping */
+} quantizer_t;
+
+typedef enum {
+    FORMAT_INC = 0,             /* CA65 include file */
+    FORMAT_OBJ                  /* Any objfile format */
+} file_format_t;
+
+typedef struct {
+    int taps;                   /* Taps per phase, a multiple of 4 */
+    int half;                   /* Half width of the filter in samples */
+    float *coeffs;              /* (FILTER_PHASES + 1) * taps coefficients */
+} filter_t;
+
+typedef struct {
+    char *input_filename;
+    char *output_filename;
+    long clock;
+    long cycles;
+    long max_size;
+    bool dpcm;
+    bool normalize;
+    quantizer_t quantizer;
+    file_format_t file_format;
+    output_format_t obj_format;
+    uint16_t address;
+} command_line_args_t;
+
+/* ============================================================================
+ * WAV File Input
+ * ============================================================================ */
+
+static inline uint16_t get_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t get_le24(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+
+/*
+ * Decodes one sample to the -1.0 to 1.0 range. 8 bit WAV samples are
+ * unsigned, all wider integer formats are signed.
+ */
+static float decode_sample(const uint8_t *p, uint16_t bits, bool is_float) {
+    if (is_float) {
+        if (bits == 32) {
+            const uint32_t u = get_le32(p);
+            float f;
+            memcpy(&f, &u, sizeof(f));
+            return f;
+        }
+        const uint64_t u = get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+        double d;
+        memcpy(&d, &u, sizeof(d));
+        return (float)d;
+    }
+
+    switch (bits) {
+        case 8:
+            return (p[0] - 128) / 128.0f;
+        case 16:
+            return (int16_t)get_le16(p) / 32768.0f;
+        case 24:
+            return (int32_t)(get_le24(p) << 8) / 2147483648.0f;
+        default:
+            return (int32_t)get_le32(p) / 2147483648.0f;
+    }
+}
+
+/*
+ * Walks the RIFF chunks instead of assuming a canonical 44 byte header,
+ * so files with LIST or other extra chunks are read correctly. All the
+ * channels are averaged into a single mono channel.
+ */
+static bool read_wav_file(const char *filename, audio_t *audio) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot open input file '%s'\n", filename);
+        return false;
+    }
+
+    uint8_t header[12];
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header) ||
+        memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "Error: '%s' is not a WAV file\n", filename);
+        fclose(fp);
+        return false;
+    }
+
+    bool have_fmt = false, is_float = false;
+    uint16_t channels = 0, bits = 0, block_align = 0;
+    uint8_t chunk[8];
+
+    while (fread(chunk, 1, sizeof(chunk), fp) == sizeof(chunk)) {
+        const uint32_t size = get_le32(chunk + 4);
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            /* Large enough for WAVE_FORMAT_EXTENSIBLE */
+            uint8_t fmt[40] = {0};
+            const size_t fmt_size = size < sizeof(fmt) ? size : sizeof(fmt);
+            if (size < 16 || fread(fmt, 1, fmt_size, fp) != fmt_size) {
+                break;
+            }
+
+            uint16_t format = get_le16(fmt);
+            if (format == WAVE_FORMAT_EXTENSIBLE && fmt_size >= 26) {
+                /* The first two bytes of the sub format GUID are the format */
+                format = get_le16(fmt + 24);
+            }
+            channels = get_le16(fmt + 2);
+            audio->sample_rate = get_le32(fmt + 4);
+            block_align = get_le16(fmt + 12);
+            bits = get_le16(fmt + 14);
+            is_float = (format == WAVE_FORMAT_IEEE_FLOAT);
+
+            if (format != WAVE_FORMAT_PCM && !is_float) {
+                fprintf(stderr, "Error: '%s' is not in PCM or float format\n", filename);
+                fclose(fp);
+                return false;
+            }
+            if (is_float ? (bits != 32 && bits != 64)
+                         : (bits != 8 && bits != 16 && bits != 24 && bits != 32)) {
+                fprintf(stderr, "Error: Unsupported sample size (%u bit %s)\n",
+                        bits, is_float ? "float" : "integer");
+                fclose(fp);
+                return false;
+            }
+            if (channels == 0 || block_align < channels * (bits / 8) ||
+                audio->sample_rate == 0) {
+                fprintf(stderr, "Error: '%s' has an invalid fmt chunk\n", filename);
+                fclose(fp);
+                return false;
+            }
+            have_fmt = true;
+            fseek(fp, (long)(size - fmt_size + (size & 1)), SEEK_CUR);
+
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!have_fmt) {
+                break;
+            }
+
+            uint8_t *raw = malloc(size ? size : 1);
+            if (!raw) {
+                fprintf(stderr, "Error: Out of memory\n");
+                fclose(fp);
+                return false;
+            }
+            const size_t got = fread(raw, 1, size, fp);
+            fclose(fp);
+
+            audio->count = got / block_align;
+            audio->samples = malloc((audio->count ? audio->count : 1) * sizeof(float));
+            if (!audio->samples) {
+                fprintf(stderr, "Error: Out of memory\n");
+                free(raw);
+                return false;
+            }
+            for (size_t i = 0; i < audio->count; i++) {
+                const uint8_t *frame = raw + i * block_align;
+                float sum = 0.0f;
+                for (uint16_t ch = 0; ch < channels; ch++) {
+                    sum += decode_sample(frame + ch * (bits / 8), bits, is_float);
+                }
+                audio->samples[i] = sum / channels;
+            }
+            free(raw);
+            return true;
+
+        } else {
+            fseek(fp, (long)(size + (size & 1)), SEEK_CUR);
+        }
+    }
+
+    fprintf(stderr, "Error: '%s' has no valid fmt and data chunks\n", filename);
+    fclose(fp);
+    return false;
+}
+
+/* ============================================================================
+ * Sample Processing
+ * ============================================================================ */
+
+/*
+ * Zeroth order modified Bessel function of the first kind, for the Kaiser
+ * window. The series converges quickly for the beta values used here.
+ */
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+
+    for (int k = 1; k < 50 && term > 1e-12 * sum; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+/*
+ * Builds a Kaiser windowed sinc filter bank with one set of taps for each
+ * of FILTER_PHASES + 1 fractional positions, so that the resampler can
+ * interpolate between two neighbouring phases. When downsampling, the
+ * cutoff moves down to the output Nyquist frequency and the filter gets
+ * proportionally longer.
+ */
+static bool build_filter(filter_t *filter, double in_rate, double out_rate) {
+    const double cutoff = (out_rate < in_rate) ? FILTER_ROLLOFF * out_rate / in_rate : 1.0;
+    const int half = (int)ceil(FILTER_ZEROS / cutoff);
+    const double norm = bessel_i0(KAISER_BETA);
+
+    /* Round up to the dot product accumulator count, extra taps are zero */
+    filter->taps = (2 * half + 3) & ~3;
+    filter->half = half;
+    filter->coeffs = malloc((size_t)(FILTER_PHASES + 1) * filter->taps * sizeof(float));
+    if (!filter->coeffs) {
+        return false;
+    }
+
+    for (int phase = 0; phase <= FILTER_PHASES; phase++) {
+        float *c = filter->coeffs + (size_t)phase * filter->taps;
+        const double frac = (double)phase / FILTER_PHASES;
+        double sum = 0.0;
+
+        /* Tap k multiplies input sample i - half + 1 + k */
+        for (int k = 0; k < filter->taps; k++) {
+            const double x = k - half + 1 - frac;
+            const double r = x / half;
+            const double sinc = (x == 0.0) ? 1.0 : sin(PI * cutoff * x) / (PI * cutoff * x);
+            const double window = (fabs(r) >= 1.0) ? 0.0
+                                : bessel_i0(KAISER_BETA * sqrt(1.0 - r * r)) / norm;
+            c[k] = (float)(sinc * window);
+            sum += c[k];
+        }
+
+        /* Unity gain at DC for every phase */
+        for (int k = 0; k < filter->taps; k++) {
+            c[k] = (float)(c[k] / sum);
+        }
+    }
+    return true;
+}
+
+/*
+ * Dot product with four independent accumulators. Splitting the sum lets
+ * the compiler keep the loop in vector registers without reassociating
+ * floating point operations behind our back.
+ */
+static float dot_product(const float *restrict x, const float *restrict c, int taps) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+
+    for (int k = 0; k < taps; k += 4) {
+        s0 += x[k] * c[k];
+        s1 += x[k + 1] * c[k + 1];
+        s2 += x[k + 2] * c[k + 2];
+        s3 += x[k + 3] * c[k + 3];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+/*
+ * Polyphase resampler. Output sample n is taken at input position
+ * n * in_rate / out_rate, interpolating linearly between the two closest
+ * filter phases. The input is copied into a zero padded buffer so that
+ * the inner loop never has to check the clip boundaries.
+ */
+static size_t resample(const audio_t *audio, double out_rate, float *out,
+                       size_t max_count) {
+    if (audio->count == 0) {
+        return 0;
+    }
+
+    filter_t filter;
+    if (!build_filter(&filter, audio->sample_rate, out_rate)) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 0;
+    }
+
+    const int taps = filter.taps;
+    const int half = filter.half;
+    float *padded = calloc(audio->count + 2 * (size_t)taps, sizeof(float));
+    if (!padded) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(filter.coeffs);
+        return 0;
+    }
+    memcpy(padded + taps, audio->samples, audio->count * sizeof(float));
+
+    const double step = audio->sample_rate / out_rate;
+    const double last = (double)(audio->count - 1);
+    size_t n;
+
+    for (n = 0; n < max_count; n++) {
+        const double pos = n * step;
+        if (pos > last) {
+            break;
+        }
+
+        const size_t i = (size_t)pos;
+        const double p = (pos - i) * FILTER_PHASES;
+        const int phase = (int)p;
+        const float t = (float)(p - phase);
+
+        const float *c = filter.coeffs + (size_t)phase * taps;
+        const float *x = padded + taps + i - half + 1;
+        const float a = dot_product(x, c, taps);
+        const float b = dot_product(x, c + taps, taps);
+        out[n] = a + (b - a) * t;
+    }
+
+    free(padded);
+    free(filter.coeffs);
+    return n;
+}
+
+/*
+ * Scales the clip so that its highest peak just reaches full scale.
+ */
+static void normalize(float *samples, size_t count) {
+    float peak = 0.0f;
+
+    for (size_t n = 0; n < count; n++) {
+        peak = fmaxf(peak, fabsf(samples[n]));
+    }
+
+    if (peak > 0.0f) {
+        const float gain = (127.0f / 128.0f) / peak;
+        for (size_t n = 0; n < count; n++) {
+            samples[n] *= gain;
+        }
+    }
+}
+
+/*
+ * Small xorshift generator for the dither. A fixed seed keeps the output
+ * reproducible from one build to the next.
+ */
+static uint32_t next_random(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static inline float random_unit(uint32_t *state) {
+    return (next_random(state) >> 8) / 16777216.0f;
+}
+
+static inline uint8_t clamp_byte(float value) {
+    if (value < 0.0f) return 0;
+    if (value > 255.0f) return 255;
+    return (uint8_t)value;
+}
+
+/*
+ * Reduces the samples to 8-bit unsigned. TPDF dither adds the difference
+ * of two uniform random values, one LSB peak, which turns quantization
+ * distortion into steady noise. Noise shaping also feeds the error back
+ * through a second order filter, (1 - z^-1)^2, moving the noise towards
+ * the top of the band where it is less audible.
+ */
+static void quantize(const float *samples, size_t count, quantizer_t quantizer,
+                     uint8_t *out) {
+    uint32_t seed = DEFAULT_SEED;
+    float e1 = 0.0f, e2 = 0.0f;
+
+    for (size_t n = 0; n < count; n++) {
+        float value = samples[n] * 128.0f + 128.0f;
+
+        if (quantizer == QUANT_SHAPED) {
+            value -= 2.0f * e1 - e2;
+        }
+
+        float dither = 0.0f;
+        if (quantizer != QUANT_ROUND) {
+            dither = random_unit(&seed) - random_unit(&seed);
+        }
+
+        out[n] = clamp_byte(floorf(value + dither + 0.5f));
+
+        if (quantizer == QUANT_SHAPED) {
+            /* Keep the loop stable when the output clips */
+            e2 = e1;
+            e1 = fminf(fmaxf(out[n] - value, -2.0f), 2.0f);
+        }
+    }
+}
+
+/*
+ * Greedy 4-bit DPCM encoder. For each sample it picks the delta that gets
+ * the decoder closest to it, never letting the decoded value leave 0-255
+ * because the player adds without checking for overflow. Two samples go
+ * in each byte, the first in the high nibble.
+ */
+static size_t dpcm_encode(const uint8_t *samples, size_t count, uint8_t *out) {
+    int predicted = DPCM_INITIAL;
+    size_t size = 0;
+
+    for (size_t n = 0; n < count; n++) {
+        int best_code = DPCM_ZERO;
+        int best_error = abs(predicted - samples[n]);
+
+        for (int code = 0; code < DPCM_CODES; code++) {
+            const int value = predicted + DPCM_DELTAS[code];
+            const int error = abs(value - samples[n]);
+
+            if (value >= 0 && value <= 255 && error < best_error) {
+                best_code = code;
+                best_error = error;
+            }
+        }
+        predicted += DPCM_DELTAS[best_code];
+
+        if (n & 1) {
+            out[size++] |= (uint8_t)best_code;
+        } else {
+            out[size] = (uint8_t)(best_code << 4);
+        }
+    }
+
+    if (count & 1) {
+        out[size++] |= DPCM_ZERO;
+    }
+    return size;
+}
+
+/*
+ * Pads with fill bytes up to a whole number of pages, which is what the
+ * players expect.
+ */
+static size_t pad_to_page(uint8_t *data, size_t count, uint8_t fill) {
+    while (count % PAGE_SIZE) {
+        data[count++] = fill;
+    }
+    return count;
+}
+
+/* ============================================================================
+ * Output Generation
+ * ============================================================================ */
+
+static void write_inc_file(FILE *out, const command_line_args_t *args,
+                           double rate, const uint8_t *data, size_t size) {
+    fprintf(out, "; %s data generated by pcmconv - DO NOT EDIT\n",
+            args->dpcm ? "4-bit DPCM" : "PCM");
+    fprintf(out, "; Generated from: %s\n", args->input_filename);
+    fprintf(out, "; Sample rate: %.2f Hz (%ld cycles per sample at %ld Hz)\n\n",
+            rate, args->cycles, args->clock);
+    fprintf(out, ".segment \"%s\"\n\n", DEFAULT_SEGMENT);
+    fprintf(out, "PCM_TABLE:\n");
+
+    for (size_t i = 0; i < size; i += BYTES_PER_ROW) {
+        fprintf(out, "    .byte ");
+        for (size_t j = i; j < i + BYTES_PER_ROW && j < size; j++) {
+            fprintf(out, "$%02X%s", data[j],
+                    (j + 1 < i + BYTES_PER_ROW && j + 1 < size) ? "," : "");
+        }
+        fprintf(out, "\n");
+    }
+
+    fprintf(out, "TABLE_SIZE = * - PCM_TABLE\n");
+}
+
+/* ============================================================================
+ * Command Line Interface
+ * ============================================================================ */
+
+static void print_usage(const char *progname) {
+    printf("Usage: %s [-d] [-n] [-q <mode>] [-c <cycles>] [-k <clock>] [-m <size>]\n"
+           "       [-f <format>] [-a <address>] [-o <output>] <input.wav>\n",
+           progname);
+    printf("\nOptions:\n");
+    printf("  -d             Encode as 4-bit DPCM for dpcmplay, two samples per byte\n");
+    printf("  -n             Normalize the clip to full scale\n");
+    printf("  -q <mode>      Quantization to 8 bits: round, tpdf (dithered) or\n");
+    printf("                 shaped (dithered with noise shaping) (default: round)\n");
+    printf("  -c <cycles>    CPU cycles per sample of the player (default: %d)\n",
+           DEFAULT_CYCLES);
+    printf("  -k <clock>     CPU clock in Hz (default: %d)\n", DEFAULT_CLOCK);
+    printf("  -m <size>      Maximum data size in bytes (default: 0x%X)\n",
+           DEFAULT_MAX_SIZE);
+    printf("  -f <format>    Output format: inc, bin, pap or ihex (default: inc)\n");
+    printf("  -a <address>   Load address for pap and ihex (default: 0x%04X)\n",
+           DEFAULT_ADDRESS);
+    printf("  -o <file>      Output file (if not specified, uses stdout)\n");
+    printf("  -h             Show this help\n");
+    printf("\nThe input can be any PCM or float WAV file, mono or multichannel. It is\n");
+    printf("resampled to exactly clock / cycles Hz and padded to a whole number of pages.\n");
+}
+
+static bool parse_command_line(int argc, char *argv[], command_line_args_t *args) {
+    *args = (command_line_args_t){
+        .clock = DEFAULT_CLOCK,
+        .cycles = DEFAULT_CYCLES,
+        .max_size = DEFAULT_MAX_SIZE,
+        .quantizer = QUANT_ROUND,
+        .file_format = FORMAT_INC,
+        .address = DEFAULT_ADDRESS
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "dnq:c:k:m:f:a:o:h")) != -1) {
+        switch (opt) {
+            case 'd':
+                args->dpcm = true;
+                break;
+            case 'n':
+                args->normalize = true;
+                break;
+            case 'q':
+                if (strcasecmp(optarg, "round") == 0) {
+                    args->quantizer = QUANT_ROUND;
+                } else if (strcasecmp(optarg, "tpdf") == 0) {
+                    args->quantizer = QUANT_TPDF;
+                } else if (strcasecmp(optarg, "shaped") == 0) {
+                    args->quantizer = QUANT_SHAPED;
+                } else {
+                    fprintf(stderr, "Error: Unknown quantization '%s' "
+                                    "(expected: round, tpdf, shaped)\n\n", optarg);
+                    return false;
+                }
+                break;
+            case 'c':
+                args->cycles = strtol(optarg, NULL, 0);
+                break;
+            case 'k':
+                args->clock = strtol(optarg, NULL, 0);
+                break;
+            case 'm':
+                args->max_size = strtol(optarg, NULL, 0);
+                break;
+            case 'f':
+                if (strcasecmp(optarg, "inc") == 0) {
+                    args->file_format = FORMAT_INC;
+                } else {
+                    args->file_format = FORMAT_OBJ;
+                    if (strcasecmp(optarg, "bin") == 0) args->obj_format = OUT_BIN;
+                    else if (strcasecmp(optarg, "pap") == 0) args->obj_format = OUT_PAP;
+                    else if (strcasecmp(optarg, "ihex") == 0) args->obj_format = OUT_IHEX;
+                    else {
+                        fprintf(stderr, "Error: Unknown output format '%s' "
+                                        "(expected: inc, bin, pap, ihex)\n\n", optarg);
+                        return false;
+                    }
+                }
+                break;
+            case 'a':
+                args->address = (uint16_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'o':
+                args->output_filename = optarg;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(argv[0]);
+                return false;
+        }
+    }
+
+    if (args->cycles <= 0 || args->clock <= 0) {
+        fprintf(stderr, "Error: Cycles and clock must be positive\n\n");
+        return false;
+    }
+
+    if (args->max_size < PAGE_SIZE) {
+        fprintf(stderr, "Error: Maximum size must be at least one page\n\n");
+        return false;
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "Error: Missing input WAV file\n\n");
+        print_usage(argv[0]);
+        return false;
+    }
+
+    args->input_filename = argv[optind];
+    return true;
+}
+
+static FILE *open_output_file(const char *filename, bool binary) {
+    if (!filename) {
+        return stdout;
+    }
+
+    FILE *out = fopen(filename, binary ? "wb" : "w");
+    if (!out) {
+        fprintf(stderr, "Error: Cannot create output file '%s'\n", filename);
+    }
+    return out;
+}
+
+/* ============================================================================
+ * Main Program
+ * ============================================================================ */
+
+int main(int argc, char *argv[]) {
+    command_line_args_t args;
+    if (!parse_command_line(argc, argv, &args)) {
+        return EXIT_FAILURE;
+    }
+
+    audio_t audio = {0};
+    if (!read_wav_file(args.input_filename, &audio)) {
+        return EXIT_FAILURE;
+    }
+
+    /* Whole pages only, so the padding always fits */
+    const size_t max_size = (size_t)args.max_size & ~(size_t)(PAGE_SIZE - 1);
+    const size_t max_samples = args.dpcm ? 2 * max_size : max_size;
+    float *resampled = malloc(max_samples * sizeof(float));
+    uint8_t *samples = malloc(max_samples);
+    uint8_t *data = args.dpcm ? malloc(max_size) : samples;
+    if (!resampled || !samples || !data) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(resampled);
+        free(samples);
+        free(audio.samples);
+        return EXIT_FAILURE;
+    }
+
+    const double rate = (double)args.clock / args.cycles;
+    const size_t count = resample(&audio, rate, resampled, max_samples);
+
+    if (count == max_samples) {
+        fprintf(stderr, "Warning: Clip truncated to %zu bytes (%.2f seconds)\n",
+                max_size, max_samples / rate);
+    }
+
+    if (args.normalize) {
+        normalize(resampled, count);
+    }
+    quantize(resampled, count, args.quantizer, samples);
+
+    size_t size;
+    if (args.dpcm) {
+        size = pad_to_page(data, dpcm_encode(samples, count, data),
+                           DPCM_ZERO << 4 | DPCM_ZERO);
+    } else {
+        /* Repeating the last value avoids a click at the end */
+        size = pad_to_page(data, count, count ? data[count - 1] : 0x80);
+    }
+
+    int result = EXIT_SUCCESS;
+    FILE *out = open_output_file(args.output_filename, args.file_format != FORMAT_INC);
+    if (!out) {
+        result = EXIT_FAILURE;
+    } else {
+        if (args.file_format == FORMAT_INC) {
+            write_inc_file(out, &args, rate, data, size);
+        } else if (objfile_write(args.obj_format, out, data, size, args.address) < 0) {
+            fprintf(stderr, "Error: Cannot write output file\n");
+            result = EXIT_FAILURE;
+        }
+
+        if (args.output_filename) {
+            fclose(out);
+            if (result == EXIT_SUCCESS) {
+                printf("Converted: %zu samples at %u Hz to %zu bytes at %.2f Hz\n",
+                       audio.count, audio.sample_rate, size, rate);
+            }
+        }
+    }
+
+    if (data != samples) {
+        free(data);
+    }
+    free(samples);
+    free(resampled);
+    free(audio.samples);
+    return result;
+}
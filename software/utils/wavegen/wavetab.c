@@ -0,0 +1,606 @@
+/*
+ * wavetab.c - Waveform table generation library
+ * 
+ * Parses harmonic specifications in YAML format and evaluates them into
+ * waveform tables, using the Fourier series evaluation algorithm.
+ * 
+ * Based on the original program by Hal Chamberlin for KIM-1/6502
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+#include <yaml.h>
+#include "wavetab.h"
+
+/* ============================================================================
+ * Constants and Configuration
+ * ============================================================================ */
+
+#define MIN_HARMONICS 1
+#define PI 3.14159265358979323846
+
+#define DEFAULT_PEAK 0x3F
+#define DEFAULT_SEGMENT "WAVE"
+#define INITIAL_LIST_CAPACITY 10
+
+/* ============================================================================
+ * Harmonic Data Extraction
+ * ============================================================================ */
+
+static inline uint8_t extract_amplitude(uint16_t harmonic_data) {
+    return (harmonic_data >> 8) & 0xFF;
+}
+
+static inline uint8_t extract_phase(uint16_t harmonic_data) {
+    return harmonic_data & 0xFF;
+}
+
+/* ============================================================================
+ * Unit Conversions
+ * ============================================================================ */
+
+static inline double byte_to_normalized_amplitude(uint8_t amplitude) {
+    return amplitude / 255.0;
+}
+
+static inline double byte_to_radians(uint8_t angle_byte) {
+    return (angle_byte / 256.0) * 2.0 * PI;
+}
+
+static inline uint8_t double_to_byte_saturated(double value) {
+    if (value < 0.0) return 0;
+    if (value > 255.0) return 255;
+    return (uint8_t)(value + 0.5);  /* Round to nearest */
+}
+
+/* ============================================================================
+ * Fourier Series Evaluation
+ * ============================================================================ */
+
+/*
+ * Evaluates a single harmonic contribution at a given point.
+ * 
+ * This replicates the original 6502 assembly algorithm:
+ * - angle = phase + index_accumulator (8-bit arithmetic)
+ * - contribution = amplitude * cos(angle)
+ */
+static double evaluate_harmonic(uint16_t harmonic_data, uint8_t angle_offset) {
+    const uint8_t amplitude = extract_amplitude(harmonic_data);
+    const uint8_t phase = extract_phase(harmonic_data);
+    
+    const double normalized_amplitude = byte_to_normalized_amplitude(amplitude);
+    const uint8_t angle_byte = (uint8_t)(phase + angle_offset);
+    const double angle_radians = byte_to_radians(angle_byte);
+    
+    return normalized_amplitude * cos(angle_radians);
+}
+
+/*
+ * Evaluates a waveform point using Fourier series.
+ * 
+ * point_index: point number (0-255)
+ * spec: waveform specification
+ * Returns: accumulated harmonic value
+ * 
+ * Algorithm matches original assembly:
+ * - index_accumulator starts at 0
+ * - For each harmonic: calculate and accumulate contribution
+ * - Then: index_accumulator += point_index (for next iteration)
+ */
+static double evaluate_fourier_series(int point_index, const waveform_spec_t *spec) {
+    double accumulator = 0.0;
+    uint8_t index_accumulator = 0;
+    
+    for (int i = 0; i <= spec->num_harmonics; i++) {
+        accumulator += evaluate_harmonic(spec->harmonics[i], index_accumulator);
+        index_accumulator = (uint8_t)(index_accumulator + point_index);
+    }
+    
+    return accumulator;
+}
+
+/* ============================================================================
+ * Waveform Generation
+ * ============================================================================ */
+
+typedef struct {
+    double min;
+    double max;
+} value_range_t;
+
+static value_range_t find_waveform_range(const double *waveform, int size) {
+    value_range_t range = { .min = waveform[0], .max = waveform[0] };
+    
+    for (int i = 1; i < size; i++) {
+        if (waveform[i] < range.min) range.min = waveform[i];
+        if (waveform[i] > range.max) range.max = waveform[i];
+    }
+    
+    return range;
+}
+
+static void compute_raw_waveform(const waveform_spec_t *spec, double *waveform) {
+    for (int i = 0; i < WAVE_SIZE; i++) {
+        waveform[i] = evaluate_fourier_series(i, spec);
+    }
+}
+
+static void normalize_and_quantize(const waveform_spec_t *spec, 
+                                   const double *waveform, 
+                                   uint8_t *output) {
+    const value_range_t range = find_waveform_range(waveform, WAVE_SIZE);
+    
+    double scale = 1.0;
+    double offset = 0.0;
+    
+    if (spec->norm) {
+        const double span = range.max - range.min;
+        if (span > 0.0) {
+            scale = spec->peak / span;
+            offset = -range.min;
+        }
+    }
+    
+    for (int i = 0; i < WAVE_SIZE; i++) {
+        const double normalized = spec->norm 
+            ? (waveform[i] + offset) * scale 
+            : waveform[i];
+        
+        output[i] = double_to_byte_saturated(normalized);
+    }
+}
+
+static void generate_waveform(const waveform_spec_t *spec, uint8_t *wavetable) {
+    double waveform[WAVE_SIZE];
+    
+    compute_raw_waveform(spec, waveform);
+    normalize_and_quantize(spec, waveform, wavetable);
+}
+
+/* ============================================================================
+ * Waveform List Management
+ * ============================================================================ */
+
+void wavetab_init_list(waveform_list_t *list) {
+    list->capacity = INITIAL_LIST_CAPACITY;
+    list->count = 0;
+    list->specs = malloc(list->capacity * sizeof(waveform_spec_t));
+    
+    if (!list->specs) {
+        fprintf(stderr, "Fatal: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void add_waveform_spec(waveform_list_t *list, const waveform_spec_t *spec) {
+    if (list->count >= list->capacity) {
+        list->capacity *= 2;
+        waveform_spec_t *new_specs = realloc(list->specs, 
+                                          list->capacity * sizeof(waveform_spec_t));
+        if (!new_specs) {
+            fprintf(stderr, "Fatal: Memory reallocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        list->specs = new_specs;
+    }
+    
+    list->specs[list->count++] = *spec;
+}
+
+void wavetab_free_list(waveform_list_t *list) {
+    free(list->specs);
+    list->specs = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+/* ============================================================================
+ * YAML Parsing
+ * ============================================================================ */
+
+typedef struct {
+    waveform_spec_t current_spec;
+    char current_key[256];
+    bool in_document;
+    bool in_list;
+    int list_index;
+} parser_state_t;
+
+static void init_parser_state(parser_state_t *state) {
+    memset(state, 0, sizeof(parser_state_t));
+}
+
+static void start_new_document(parser_state_t *state) {
+    memset(&state->current_spec, 0, sizeof(waveform_spec_t));
+    state->current_spec.peak = DEFAULT_PEAK;
+    state->current_spec.norm = true;
+    strncpy(state->current_spec.segment, DEFAULT_SEGMENT, 
+            sizeof(state->current_spec.segment) - 1);
+    state->current_key[0] = '\0';
+    state->in_document = true;
+}
+
+static void handle_list_value(parser_state_t *state, const char *value) {
+    if (state->list_index <= MAX_HARMONICS) {
+        state->current_spec.harmonics[state->list_index++] = 
+            (uint16_t)strtol(value, NULL, 0);
+    }
+}
+
+static void handle_scalar_value(parser_state_t *state, const char *value) {
+    if (strcmp(state->current_key, "name") == 0) {
+        strncpy(state->current_spec.name, value, 
+                sizeof(state->current_spec.name) - 1);
+    } else if (strcmp(state->current_key, "desc") == 0) {
+        strncpy(state->current_spec.desc, value, 
+                sizeof(state->current_spec.desc) - 1);
+    } else if (strcmp(state->current_key, "segment") == 0) {
+        strncpy(state->current_spec.segment, value, 
+                sizeof(state->current_spec.segment) - 1);
+    } else if (strcmp(state->current_key, "peak") == 0) {
+        state->current_spec.peak = (uint8_t)strtol(value, NULL, 0);
+    } else if (strcmp(state->current_key, "norm") == 0) {
+        state->current_spec.norm = (strcasecmp(value, "true") == 0 || 
+                                   strcmp(value, "1") == 0);
+    }
+}
+
+static void handle_scalar_event(parser_state_t *state, const char *value) {
+    if (state->in_list) {
+        handle_list_value(state, value);
+    } else if (state->current_key[0] == '\0') {
+        /* This is a key */
+        strncpy(state->current_key, value, sizeof(state->current_key) - 1);
+    } else {
+        /* This is a value */
+        handle_scalar_value(state, value);
+        state->current_key[0] = '\0';
+    }
+}
+
+static void handle_sequence_end(parser_state_t *state) {
+    state->in_list = false;
+    state->current_spec.num_harmonics = state->list_index - 1;  /* Subtract DC */
+    state->current_key[0] = '\0';
+}
+
+/*
+ * Passes each specification to the callback as soon as its document ends.
+ * Only the specification being parsed is kept, so memory use does not
+ * grow with the number of documents.
+ */
+static bool process_yaml_events(yaml_parser_t *parser, wavetab_spec_cb_t callback,
+                                void *ctx) {
+    parser_state_t state;
+    init_parser_state(&state);
+    
+    yaml_event_t event;
+    bool done = false;
+    
+    while (!done) {
+        if (!yaml_parser_parse(parser, &event)) {
+            fprintf(stderr, "Error: YAML parsing failed\n");
+            return false;
+        }
+        
+        switch (event.type) {
+            case YAML_STREAM_END_EVENT:
+                done = true;
+                break;
+                
+            case YAML_DOCUMENT_START_EVENT:
+                start_new_document(&state);
+                break;
+                
+            case YAML_DOCUMENT_END_EVENT:
+                if (state.in_document && state.current_spec.name[0] &&
+                    !callback(ctx, &state.current_spec)) {
+                    yaml_event_delete(&event);
+                    return false;
+                }
+                state.in_document = false;
+                break;
+                
+            case YAML_MAPPING_START_EVENT:
+                state.current_key[0] = '\0';
+                break;
+                
+            case YAML_SEQUENCE_START_EVENT:
+                state.in_list = true;
+                state.list_index = 0;
+                break;
+                
+            case YAML_SEQUENCE_END_EVENT:
+                handle_sequence_end(&state);
+                break;
+                
+            case YAML_SCALAR_EVENT:
+                handle_scalar_event(&state, (char *)event.data.scalar.value);
+                break;
+                
+            default:
+                break;
+        }
+        
+        yaml_event_delete(&event);
+    }
+    
+    return true;
+}
+
+static bool add_to_list(void *ctx, const waveform_spec_t *spec) {
+    add_waveform_spec(ctx, spec);
+    return true;
+}
+
+bool wavetab_parse_yaml(const char *filename, waveform_list_t *list) {
+    return wavetab_parse_yaml_stream(filename, add_to_list, list);
+}
+
+bool wavetab_parse_yaml_stream(const char *filename, wavetab_spec_cb_t callback,
+                               void *ctx) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
+        return false;
+    }
+    
+    yaml_parser_t parser;
+    if (!yaml_parser_initialize(&parser)) {
+        fprintf(stderr, "Error: YAML parser initialization failed\n");
+        fclose(file);
+        return false;
+    }
+    
+    yaml_parser_set_input_file(&parser, file);
+    const bool success = process_yaml_events(&parser, callback, ctx);
+    
+    yaml_parser_delete(&parser);
+    fclose(file);
+    
+    return success;
+}
+
+/* ============================================================================
+ * Table Generation
+ * ============================================================================ */
+
+static bool is_valid_harmonic_count(int num_harmonics) {
+    return num_harmonics >= MIN_HARMONICS && num_harmonics <= MAX_HARMONICS;
+}
+
+bool wavetab_generate(const waveform_spec_t *spec, uint8_t *wavetable) {
+    if (!is_valid_harmonic_count(spec->num_harmonics)) {
+        fprintf(stderr, "Warning: '%s' has %d harmonics (valid: %d-%d), skipping\n",
+                spec->name, spec->num_harmonics, MIN_HARMONICS, MAX_HARMONICS);
+        return false;
+    }
+    
+    generate_waveform(spec, wavetable);
+    return true;
+}
+
+uint8_t *wavetab_generate_all(const waveform_list_t *list, int *num_tables) {
+    uint8_t *tables = malloc((list->count ? list->count : 1) * WAVE_SIZE);
+    if (!tables) {
+        fprintf(stderr, "Error: Cannot allocate waveform tables\n");
+        return NULL;
+    }
+    
+    int count = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (wavetab_generate(&list->specs[i], tables + count * WAVE_SIZE)) {
+            ++count;
+        }
+    }
+    
+    *num_tables = count;
+    return tables;
+}
+
+/* ============================================================================
+ * Symmetric Table Packing
+ * ============================================================================ */
+
+/* Sum of each sample and the one half a cycle later, if it is constant */
+static bool find_half_wave_sum(const uint8_t *wavetable, uint8_t *sum) {
+    *sum = wavetable[0] + wavetable[WAVE_SIZE / 2];
+    for (int i = 1; i < WAVE_SIZE / 2; i++) {
+        if ((uint8_t)(wavetable[i] + wavetable[i + WAVE_SIZE / 2]) != *sum) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* True if wavetable[center - i] == wavetable[center + i] up to span */
+static bool is_mirrored(const uint8_t *wavetable, int center, int span) {
+    for (int i = 1; i < span; i++) {
+        if (wavetable[center - i] != wavetable[(center + i) % WAVE_SIZE]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is_repeated(const uint8_t *wavetable) {
+    return memcmp(wavetable, wavetable + WAVE_SIZE / 2, WAVE_SIZE / 2) == 0;
+}
+
+size_t wavetab_pack(const uint8_t *wavetable, uint8_t *packed) {
+    uint8_t sum;
+    const bool half_wave = find_half_wave_sum(wavetable, &sum);
+    size_t size;
+    
+    /* Smallest form first */
+    if (half_wave && is_mirrored(wavetable, WAVE_SIZE / 4, WAVE_SIZE / 4)) {
+        packed[0] = WAVETAB_PACK_QUARTER;
+        packed[1] = sum;
+        size = WAVE_SIZE / 4 + 1;
+    } else if (is_repeated(wavetable)) {
+        packed[0] = WAVETAB_PACK_REPEAT;
+        size = WAVE_SIZE / 2;
+    } else if (half_wave) {
+        packed[0] = WAVETAB_PACK_ANTI;
+        packed[1] = sum;
+        size = WAVE_SIZE / 2;
+    } else if (is_mirrored(wavetable, WAVE_SIZE / 2, WAVE_SIZE / 2)) {
+        packed[0] = WAVETAB_PACK_MIRROR;
+        size = WAVE_SIZE / 2 + 1;
+    } else {
+        packed[0] = WAVETAB_PACK_FULL;
+        size = WAVE_SIZE;
+    }
+    
+    const size_t header = (packed[0] == WAVETAB_PACK_QUARTER ||
+                           packed[0] == WAVETAB_PACK_ANTI) ? 2 : 1;
+    memcpy(packed + header, wavetable, size);
+    return header + size;
+}
+
+/* ============================================================================
+ * Harmonic Specification Packing
+ * ============================================================================ */
+
+/*
+ * Model of the table generator of kimfsb.asm, exact to the bit. Each
+ * harmonic is amplitude times a 15 bit cosine, shifted right so that the
+ * sum of all of them fits in 16 bits, and the cycle is normalized with a
+ * rounded division for every sample.
+ */
+
+static const uint16_t KIMFSB_COSTAB[WAVE_SIZE / 4 + 1] = {
+    0x7FFF, 0x7FF5, 0x7FD8, 0x7FA6, 0x7F61, 0x7F09, 0x7E9C, 0x7E1D,
+    0x7D89, 0x7CE3, 0x7C29, 0x7B5C, 0x7A7C, 0x7989, 0x7884, 0x776B,
+    0x7641, 0x7504, 0x73B5, 0x7254, 0x70E2, 0x6F5E, 0x6DC9, 0x6C23,
+    0x6A6D, 0x68A6, 0x66CF, 0x64E8, 0x62F1, 0x60EB, 0x5ED7, 0x5CB3,
+    0x5A82, 0x5842, 0x55F5, 0x539B, 0x5133, 0x4EBF, 0x4C3F, 0x49B4,
+    0x471C, 0x447A, 0x41CE, 0x3F17, 0x3C56, 0x398C, 0x36BA, 0x33DF,
+    0x30FB, 0x2E11, 0x2B1F, 0x2826, 0x2528, 0x2223, 0x1F1A, 0x1C0B,
+    0x18F9, 0x15E2, 0x12C8, 0x0FAB, 0x0C8C, 0x096A, 0x0648, 0x0324,
+    0x0000
+};
+
+/* Smallest shift that keeps the sum of the amplitudes within 15 bits */
+static uint8_t kimfsb_shift(const waveform_spec_t *spec) {
+    int sum = 0;
+    for (int h = 0; h <= spec->num_harmonics; h++) {
+        sum += extract_amplitude(spec->harmonics[h]);
+    }
+    
+    uint8_t shift = 0;
+    while ((1 << shift) < sum) {
+        shift++;
+    }
+    return shift;
+}
+
+/* False if the cycle is flat and cannot be normalized */
+static bool kimfsb_generate(const waveform_spec_t *spec, uint8_t shift,
+                            uint8_t *wavetable) {
+    int16_t accumulator[WAVE_SIZE] = { 0 };
+    
+    for (int h = 0; h <= spec->num_harmonics; h++) {
+        const uint8_t amplitude = extract_amplitude(spec->harmonics[h]);
+        if (amplitude == 0) {
+            continue;
+        }
+        
+        /* HRMTAB, for the first quadrant */
+        int16_t quadrant[WAVE_SIZE / 4 + 1];
+        for (int i = 0; i <= WAVE_SIZE / 4; i++) {
+            quadrant[i] = (int16_t)(((uint32_t)amplitude * KIMFSB_COSTAB[i]) >> shift);
+        }
+        
+        /* FSEVAL, with the quadrant of each angle */
+        uint8_t angle = extract_phase(spec->harmonics[h]);
+        for (int i = 0; i < WAVE_SIZE; i++) {
+            const int offset = angle & 0x3F;
+            const int16_t value = quadrant[(angle & 0x40) ? 0x40 - offset : offset];
+            
+            if (((angle << 1) ^ angle) & 0x80) {
+                accumulator[i] -= value;
+            } else {
+                accumulator[i] += value;
+            }
+            angle += h;
+        }
+    }
+    
+    /* SCALE */
+    int16_t max = INT16_MIN, min = INT16_MAX;
+    for (int i = 0; i < WAVE_SIZE; i++) {
+        if (accumulator[i] > max) max = accumulator[i];
+        if (accumulator[i] < min) min = accumulator[i];
+    }
+    const uint32_t span = (uint16_t)(max - min);
+    if (span == 0) {
+        return false;
+    }
+    
+    /* WAVE, rounding half up */
+    for (int i = 0; i < WAVE_SIZE; i++) {
+        const uint32_t offset = (uint16_t)(accumulator[i] - min);
+        wavetable[i] = (offset * spec->peak + span / 2) / span;
+    }
+    return true;
+}
+
+size_t wavetab_pack_spec(const waveform_spec_t *spec, const uint8_t *wavetable,
+                         uint8_t *packed) {
+    const uint8_t shift = kimfsb_shift(spec);
+    uint8_t model[WAVE_SIZE];
+    
+    if (spec->norm && kimfsb_generate(spec, shift, model)) {
+        /* The samples where integer and floating point evaluation differ */
+        int fixes = 0;
+        for (int i = 0; i < WAVE_SIZE; i++) {
+            fixes += model[i] != wavetable[i];
+        }
+        
+        size_t size = 0;
+        packed[size++] = spec->num_harmonics;
+        packed[size++] = spec->peak;
+        packed[size++] = shift;
+        for (int h = 0; h <= spec->num_harmonics; h++) {
+            packed[size++] = extract_amplitude(spec->harmonics[h]);
+            packed[size++] = extract_phase(spec->harmonics[h]);
+        }
+        
+        if (size + 1 + 2 * fixes < WAVE_SIZE + 1) {
+            packed[size++] = fixes;
+            for (int i = 0; i < WAVE_SIZE; i++) {
+                if (model[i] != wavetable[i]) {
+                    packed[size++] = i;
+                    packed[size++] = wavetable[i];
+                }
+            }
+            return size;
+        }
+    }
+    
+    /* Not normalized, or too many fixes to be worth it */
+    packed[0] = WAVETAB_SPEC_TABLE;
+    memcpy(packed + 1, wavetable, WAVE_SIZE);
+    return WAVE_SIZE + 1;
+}
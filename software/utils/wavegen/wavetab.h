@@ -0,0 +1,144 @@
+#ifndef WAVETAB_H
+#define WAVETAB_H
+/*
+ * wavetab.h - Waveform table generation library
+ *
+ * Copyright (C) 2025 Eduardo Casino
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, Version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define WAVE_SIZE 256
+#define MAX_HARMONICS 16
+
+typedef struct {
+    char name[256];
+    char desc[512];
+    char segment[64];
+    uint8_t peak;
+    bool norm;
+    uint16_t harmonics[MAX_HARMONICS + 1];  /* DC + up to 16 harmonics */
+    int num_harmonics;                      /* Number of harmonics (excluding DC) */
+} waveform_spec_t;
+
+typedef struct {
+    waveform_spec_t *specs;
+    int count;
+    int capacity;
+} waveform_list_t;
+
+void wavetab_init_list(waveform_list_t *list);
+void wavetab_free_list(waveform_list_t *list);
+
+/**
+ * Parse the waveform specifications of a YAML file, one per document,
+ * and append them to list.
+ *
+ * @return true on success, false on error
+ */
+bool wavetab_parse_yaml(const char *filename, waveform_list_t *list);
+
+/**
+ * Receives each specification of a YAML file as it is parsed. The
+ * specification is only valid during the call.
+ *
+ * @return true to go on, false to stop parsing with an error
+ */
+typedef bool (*wavetab_spec_cb_t)(void *ctx, const waveform_spec_t *spec);
+
+/**
+ * Parse a YAML file one document at a time, passing each specification to
+ * callback when its document ends. Memory use does not depend on the
+ * number of documents.
+ *
+ * @return true on success, false on error
+ */
+bool wavetab_parse_yaml_stream(const char *filename, wavetab_spec_cb_t callback,
+                               void *ctx);
+
+/**
+ * Evaluate a specification into a WAVE_SIZE byte table.
+ *
+ * @return true on success, false if the specification is not valid
+ */
+bool wavetab_generate(const waveform_spec_t *spec, uint8_t *wavetable);
+
+/**
+ * Evaluate all the valid specifications of the list into consecutive
+ * tables, in the same order and layout as the assembled wavegen output.
+ *
+ * @param list Waveform specifications
+ * @param num_tables Number of tables generated
+ * @return Tables, to be released with free(), or NULL on error
+ */
+uint8_t *wavetab_generate_all(const waveform_list_t *list, int *num_tables);
+
+/*
+ * Packed forms of a table, by the symmetry found in it. The packed table
+ * is the form byte, the sum byte K of the half-wave forms and the samples
+ * kept. wavexp.asm expands a list of them ended by WAVETAB_PACK_END.
+ */
+typedef enum {
+    WAVETAB_PACK_FULL = 0,      /* All the 256 samples */
+    WAVETAB_PACK_REPEAT,        /* 0 to 127, repeated in the second half */
+    WAVETAB_PACK_MIRROR,        /* 0 to 128, the rest mirrored around 128 */
+    WAVETAB_PACK_ANTI,          /* 0 to 127, the second half is K minus them */
+    WAVETAB_PACK_QUARTER        /* 0 to 64, mirrored around 64, then as ANTI */
+} wavetab_pack_t;
+
+#define WAVETAB_PACK_END        0xFF
+#define WAVETAB_PACKED_MAX      (WAVE_SIZE + 2)
+
+/**
+ * Pack a table in the smallest form its symmetry allows. Tables with
+ * only odd harmonics have half-wave symmetry, and phases of 0 or 0x80
+ * make them mirror symmetric. Sums wrap at 8 bits, so the tables expand
+ * exactly.
+ *
+ * @param packed At least WAVETAB_PACKED_MAX bytes
+ * @return Size of the packed table
+ */
+size_t wavetab_pack(const uint8_t *wavetable, uint8_t *packed);
+
+/*
+ * Packed harmonic specification, for the table generator of kimfsb.asm:
+ * NHARM, PKAMP, the shift of the harmonic tables and the FSRAM amplitude
+ * and phase pairs of kimfs, then the count of fixed samples and their
+ * index and value pairs. A record with
+ * WAVETAB_SPEC_TABLE in place of NHARM is the whole table instead, and
+ * WAVETAB_SPEC_END ends the list.
+ */
+#define WAVETAB_SPEC_TABLE      0x80
+#define WAVETAB_SPEC_END        0xFF
+#define WAVETAB_SPEC_MAX        (WAVE_SIZE + 1)
+
+/**
+ * Pack the specification of a table for the table generator. The fixes
+ * are the samples where its integer evaluation differs from wavetable,
+ * so that the generated table is the same, byte by byte. Specifications
+ * that are not normalized, or that need too many fixes, are packed as
+ * the whole table.
+ *
+ * @param wavetable The table generated from spec
+ * @param packed At least WAVETAB_SPEC_MAX bytes
+ * @return Size of the packed record
+ */
+size_t wavetab_pack_spec(const waveform_spec_t *spec, const uint8_t *wavetable,
+                         uint8_t *packed);
+
+#endif /* WAVETAB_H */
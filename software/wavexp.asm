@@ -0,0 +1,236 @@
+; K-1002 Waveform Table Expander
+; Expands the packed waveform tables of wavegen -c into their pages and
+; starts the NOTRAN interpreter
+;
+; (C) 2025 Eduardo Casino
+;
+; Tables with only odd harmonics have half-wave symmetry: the second half
+; of the cycle is the first one upside down. Harmonics all in cosine phase
+; make a table mirror symmetric, and odd ones all in sine phase give both
+; symmetries at once. wavegen -c finds them in the tables it generates and
+; keeps only the samples that cannot be derived from others:
+;
+;   Form   Kept                        Rest of the table
+;   0      All the 256 samples         -
+;   1      0-127                       Repeated in 128-255
+;   2      0-128                       Mirrored around 128
+;   3      K, 0-127                    K minus the first half, in 128-255
+;   4      K, 0-64                     Mirrored around 64, then as form 3
+;
+; Each packed table is its form byte and the bytes kept, and the list ends
+; with $FF. As the packed tables are taken from the exact samples, with
+; sums that wrap at 8 bits, the expanded ones are the same, byte by byte.
+;
+; Load the packed bank together with the interpreter and the score and run
+; it at $2000 instead of the interpreter. The tables are expanded into
+; consecutive pages starting at WAVPG ($2003) and then the interpreter is
+; started at $0200. WAVPG is set from WAVTBA when assembling; change it
+; for another table area as SONGA and WAVTBA are changed in the
+; interpreter.
+;
+; The four bytes of page 0 used as pointers are saved and restored, so the
+; interpreter finds its page 0 as it was loaded.
+;
+
+            .ifndef WAVTBA
+WAVTBA      = $3000
+            .endif
+
+            .assert <WAVTBA = 0, error, "WAVTBA must be page aligned"
+
+MUSIC       = $0200                 ; Entry point of the interpreter
+
+PACK_REPEAT  = 1                    ; Forms of the packed tables
+PACK_MIRROR  = 2
+PACK_ANTI    = 3
+PACK_QUARTER = 4
+
+            .import __WAVE_RUN__    ; The packed tables
+
+            .zeropage
+
+SRC:        .res    2               ; Next packed byte
+DST:        .res    2               ; Page being expanded, low byte 0
+
+            .code
+
+            jmp     expand
+
+WAVPG:      .byte   >WAVTBA         ; Page of the first table
+
+SAVE:       .res    4               ; Page 0 bytes of the interpreter
+SUM:        .res    1               ; K of the half-wave forms
+CENTER:     .res    1               ; Of the mirror, see reflect
+HALF:       .res    1
+TEMP:       .res    1
+
+expand:     cld
+
+            ; Keep the page 0 bytes of the interpreter
+            ;
+            ldx     #3
+save_loop:  lda     SRC,X
+            sta     SAVE,X
+            dex
+            bpl     save_loop
+
+            lda     #<__WAVE_RUN__
+            sta     SRC
+            lda     #>__WAVE_RUN__
+            sta     SRC+1
+            lda     #0
+            sta     DST
+            lda     WAVPG
+            sta     DST+1
+
+            ; One table per iteration
+            ;
+next_table: ldy     #0
+            lda     (SRC),Y         ; Form byte
+            bmi     done            ; $FF ends the list
+            tax
+            lda     #1              ; Skip it
+            jsr     advance
+
+            cpx     #PACK_ANTI      ; Half-wave forms start with K
+            bcc     no_sum
+            ldy     #0
+            lda     (SRC),Y
+            sta     SUM
+            lda     #1
+            jsr     advance
+
+no_sum:     cpx     #PACK_REPEAT
+            beq     repeat
+            cpx     #PACK_MIRROR
+            beq     mirror
+            cpx     #PACK_ANTI
+            beq     anti
+            cpx     #PACK_QUARTER
+            beq     quarter
+
+            ; Form 0, all the samples
+            ;
+            ldx     #0
+            jsr     copy
+            inc     SRC+1
+            jmp     table_done
+
+repeat:     ldx     #128
+            jsr     copy_half
+            ldy     #0
+rep_loop:   lda     (DST),Y
+            jsr     store_high
+            iny
+            bpl     rep_loop
+            jmp     table_done
+
+mirror:     ldx     #129
+            jsr     copy
+            lda     #129
+            jsr     advance
+            lda     #0              ; Around 128: 256 - Y, for Y = 1..127
+            ldx     #128
+            jsr     reflect
+            jmp     table_done
+
+anti:       ldx     #128
+            jsr     copy_half
+            jsr     negate_half
+            jmp     table_done
+
+quarter:    ldx     #65
+            jsr     copy
+            lda     #65
+            jsr     advance
+            lda     #128            ; Around 64: 128 - Y, for Y = 1..63
+            ldx     #64
+            jsr     reflect
+            jsr     negate_half
+
+table_done: inc     DST+1
+            jmp     next_table
+
+            ; Give the interpreter its page 0 back and start it
+            ;
+done:       ldx     #3
+rest_loop:  lda     SAVE,X
+            sta     SRC,X
+            dex
+            bpl     rest_loop
+            jmp     MUSIC
+
+;---------------------------------------------------------------------------------
+; Add A to the packed byte pointer
+;
+advance:    clc
+            adc     SRC
+            sta     SRC
+            bcc     adv_done
+            inc     SRC+1
+adv_done:   rts
+
+;---------------------------------------------------------------------------------
+; Copy X packed bytes (0 for 256) to the start of the page. copy_half also
+; moves the pointer past them.
+;
+copy:       ldy     #0
+copy_loop:  lda     (SRC),Y
+            sta     (DST),Y
+            iny
+            dex
+            bne     copy_loop
+            rts
+
+copy_half:  jsr     copy
+            lda     #128
+            jmp     advance
+
+;---------------------------------------------------------------------------------
+; Store A at Y + 128 of the page, for Y below 128. Y is kept.
+;
+store_high: sty     TEMP
+            pha
+            tya
+            ora     #$80
+            tay
+            pla
+            sta     (DST),Y
+            ldy     TEMP
+            rts
+
+;---------------------------------------------------------------------------------
+; Fill the second half of the page with K minus the first one
+;
+negate_half:
+            ldy     #0
+neg_loop:   lda     SUM
+            sec
+            sbc     (DST),Y
+            jsr     store_high
+            iny
+            bpl     neg_loop
+            rts
+
+;---------------------------------------------------------------------------------
+; Mirror the page around CENTER / 2: the sample at CENTER - Y is set to the
+; one at Y, for Y from 1 to HALF - 1. CENTER is in A (0 for 256) and HALF
+; in X.
+;
+reflect:    sta     CENTER
+            stx     HALF
+            ldy     #1
+refl_loop:  sty     TEMP
+            lda     (DST),Y
+            pha
+            lda     CENTER
+            sec
+            sbc     TEMP
+            tay
+            pla
+            sta     (DST),Y
+            ldy     TEMP
+            iny
+            cpy     HALF
+            bne     refl_loop
+            rts